@@ -0,0 +1,493 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+#include "dali/config.h"
+#include "dali/layers/Layers.h"
+#include "dali/layers/LSTM.h"
+#include "dali/math/memory_bank/MemoryBank.h"
+#include "dali/tensor/Mat.h"
+#include "dali/tensor/MatOps.h"
+#include "dali/tensor/Quantization.h"
+#include "dali/tensor/Solver.h"
+#include "dali/tensor/Tape.h"
+#include "dali/utils/core_utils.h"
+#include "dali/utils/vocab.h"
+
+/*
+Dali benchmark suite
+--------------------
+
+A StackedLSTM language model trained on data/paul_graham/train.txt,
+reported in words/sec and peak memory (it runs first, so that the peak
+resident memory of the process is its own), followed by microbenchmarks
+of the operations a training step is made of (matrix products,
+elementwise ops one at a time and fused by a graph::FusionScope,
+softmax, rows_pluck, the tape and a step replayed from a graph::Plan,
+solver steps and the memory bank). Inference goes through a Layer
+and the trained model with float then int8 weights, the latter also
+reporting how far their predictions drift (see
+dali/tensor/Quantization.h).
+
+    bench_dali [--json results.json] [--filter gemm] [--quick]
+
+Results are printed as a table, and written as JSON with `--json` so
+that runs of different releases can be compared:
+
+    {"benchmarks": [{"name": "gemm_256", "unit": "GFLOP/s",
+                     "value": 41.2, "ns_per_iteration": 814.2,
+                     "iterations": 2048}, ...]}
+*/
+
+typedef float R;
+using std::string;
+using std::vector;
+using utils::MS;
+typedef std::chrono::high_resolution_clock clock_t_;
+
+struct Result {
+    string name;
+    string unit;
+    double value;
+    double ns_per_iteration;
+    long iterations;
+};
+
+struct Options {
+    string json;
+    string filter;
+    // minimum time measured per benchmark
+    double min_seconds = 0.5;
+    int lm_sentences   = 300;
+};
+
+vector<Result> results;
+Options options;
+
+bool selected(const string& name) {
+    return options.filter.empty() || name.find(options.filter) != string::npos;
+}
+
+void record(const Result& result) {
+    results.emplace_back(result);
+    std::cout << std::left  << std::setw(32) << result.name
+              << std::right << std::setw(14) << std::fixed << std::setprecision(2) << result.value
+              << " " << std::left << std::setw(12) << result.unit
+              << std::right << std::setw(14) << std::setprecision(1) << result.ns_per_iteration
+              << " ns/iter" << std::endl;
+}
+
+// Runs `iteration` (after a warm up) in doubling batches until a
+// batch takes at least `options.min_seconds`, and records `work_per_iteration`
+// units of `unit` per second (or ns per iteration when no work is given).
+void benchmark(const string& name,
+               const string& unit,
+               double work_per_iteration,
+               std::function<void()> iteration) {
+    if (!selected(name)) return;
+    iteration();
+    long iterations = 1;
+    double elapsed_ns = 0;
+    while (true) {
+        auto start = clock_t_::now();
+        for (long i = 0; i < iterations; i++) {
+            iteration();
+        }
+        elapsed_ns = std::chrono::duration<double, std::nano>(clock_t_::now() - start).count();
+        if (elapsed_ns >= options.min_seconds * 1e9 || iterations >= (1L << 30)) break;
+        iterations *= 2;
+    }
+    Result result;
+    result.name             = name;
+    result.unit             = unit;
+    result.ns_per_iteration = elapsed_ns / iterations;
+    result.iterations       = iterations;
+    result.value            = work_per_iteration > 0 ?
+            work_per_iteration / result.ns_per_iteration * 1e9 :
+            result.ns_per_iteration;
+    record(result);
+}
+
+double peak_memory_mb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    // kilobytes on Linux, bytes on OS X
+    #ifdef __APPLE__
+        return usage.ru_maxrss / (1024.0 * 1024.0);
+    #else
+        return usage.ru_maxrss / 1024.0;
+    #endif
+}
+
+void bench_gemm() {
+    for (int n : {64, 256, 1024}) {
+        Mat<R> a(n, n, weights<R>::uniform(1.0));
+        Mat<R> b(n, n, weights<R>::uniform(1.0));
+        graph::NoBackprop nb;
+        benchmark(MS() << "gemm_" << n, "GFLOP/s", 2.0 * n * n * n / 1e9, [&]() {
+            a.dot(b);
+        });
+    }
+    // the shape of an LSTM gate projection for a minibatch of 64
+    Mat<R> inputs(64, 512, weights<R>::uniform(1.0));
+    Mat<R> weight(512, 2048, weights<R>::uniform(1.0));
+    Mat<R> bias(1, 2048, weights<R>::uniform(1.0));
+    benchmark("gemm_bias_64x512x2048_fwd_bwd", "GFLOP/s", 3 * 2.0 * 64 * 512 * 2048 / 1e9, [&]() {
+        auto out = MatOps<R>::mul_with_bias(weight, inputs, bias);
+        out.grad();
+        graph::backward();
+    });
+
+    // inference through a layer too large for the caches
+    Layer<R> layer(1024, 4096);
+    for (bool quantized : {false, true}) {
+        if (quantized) layer.quantize();
+        graph::NoBackprop nb;
+        for (int batch : {1, 16, 64}) {
+            Mat<R> x(batch, 1024, weights<R>::uniform(1.0));
+            benchmark(MS() << "layer_1024x4096_batch_" << batch << (quantized ? "_int8" : ""),
+                      "GFLOP/s", 2.0 * batch * 1024 * 4096 / 1e9, [&]() {
+                layer.activate(x);
+            });
+        }
+    }
+}
+
+void bench_elementwise() {
+    const int n = 1 << 20;
+    Mat<R> a(1024, 1024, weights<R>::uniform(1.0));
+    Mat<R> b(1024, 1024, weights<R>::uniform(1.0));
+    {
+        graph::NoBackprop nb;
+        benchmark("elementwise_add_1M",     "Melem/s", n / 1e6, [&]() { a + b; });
+        benchmark("elementwise_eltmul_1M",  "Melem/s", n / 1e6, [&]() { a * b; });
+        benchmark("elementwise_tanh_1M",    "Melem/s", n / 1e6, [&]() { a.tanh(); });
+        benchmark("elementwise_sigmoid_1M", "Melem/s", n / 1e6, [&]() { a.sigmoid(); });
+    }
+
+    // the cell update of an LSTM (8 ops), op by op or fused
+    Mat<R> c(1024, 1024, weights<R>::uniform(1.0));
+    Mat<R> d(1024, 1024, weights<R>::uniform(1.0));
+    Mat<R> e(1024, 1024, weights<R>::uniform(1.0));
+    auto cell_update = [&]() {
+        auto cell = a.sigmoid() * c + b.sigmoid() * d.tanh();
+        return e.sigmoid() * cell.tanh();
+    };
+    for (bool fused : {false, true}) {
+        string suffix = fused ? "_fused" : "";
+        {
+            graph::NoBackprop nb;
+            benchmark("elementwise_lstm_cell_1M" + suffix, "Melem/s", n / 1e6, [&]() {
+                graph::FusionScope fusion(fused);
+                cell_update().w();
+            });
+        }
+        benchmark("elementwise_lstm_cell_1M_fwd_bwd" + suffix, "Melem/s", n / 1e6, [&]() {
+            {
+                graph::FusionScope fusion(fused);
+                cell_update().grad();
+            }
+            graph::backward();
+        });
+    }
+}
+
+void bench_softmax() {
+    Mat<R> logits(64, 10000, weights<R>::uniform(1.0));
+    vector<uint> targets(64);
+    for (int i = 0; i < targets.size(); i++) targets[i] = (i * 7919) % 10000;
+    {
+        graph::NoBackprop nb;
+        benchmark("softmax_64x10000", "Melem/s", 64 * 10000 / 1e6, [&]() {
+            MatOps<R>::softmax_rowwise(logits);
+        });
+    }
+    benchmark("softmax_xent_64x10000_fwd_bwd", "Melem/s", 64 * 10000 / 1e6, [&]() {
+        auto error = MatOps<R>::softmax_cross_entropy_rowwise(logits, &targets).sum();
+        error.grad();
+        graph::backward();
+    });
+}
+
+void bench_rows_pluck() {
+    Mat<R> embedding(20000, 128, weights<R>::uniform(1.0));
+    vector<uint> indices(512);
+    for (int i = 0; i < indices.size(); i++) indices[i] = (i * 104729) % 20000;
+    benchmark("rows_pluck_512x128_fwd_bwd", "Mrows/s", 512 / 1e6, [&]() {
+        auto rows = MatOps<R>::rows_pluck(embedding, &indices);
+        rows.grad();
+        graph::backward();
+    });
+}
+
+void bench_tape() {
+    const int num_ops = 10000;
+    Mat<R> a(4, 4);
+    Mat<R> b(4, 4);
+    Mat<R> out(4, 4);
+    volatile R sink = 0;
+    benchmark("tape_record_replay", "Mops/s", num_ops / 1e6, [&]() {
+        for (int i = 0; i < num_ops; i++) {
+            graph::emplace_back([a, b, out, &sink]() mutable {
+                sink += a.dims(0) + b.dims(0) + out.dims(0);
+            });
+        }
+        graph::backward();
+    });
+
+    // a small MLP step, rebuilt every time or replayed from a plan
+    Layer<R> hidden(32, 64);
+    Layer<R> output(64, 10);
+    Mat<R> inputs(16, 32, weights<R>::uniform(1.0));
+    vector<uint> targets(16);
+    for (int i = 0; i < targets.size(); i++) targets[i] = i % 10;
+    auto mlp_step = [&]() {
+        auto error = MatOps<R>::softmax_cross_entropy_rowwise(
+                output.activate(hidden.activate(inputs).tanh()), &targets).sum();
+        error.grad();
+    };
+    benchmark("mlp_step_16x32x64x10", "ns", 0, [&]() {
+        mlp_step();
+        graph::backward();
+    });
+    graph::Plan plan;
+    plan.capture(mlp_step);
+    benchmark("mlp_step_16x32x64x10_plan", "ns", 0, [&]() {
+        plan.replay();
+    });
+}
+
+void bench_solvers() {
+    vector<Mat<R>> params;
+    for (int i = 0; i < 4; i++) {
+        params.emplace_back(512, 512, weights<R>::uniform(1.0));
+        params.back().dw().mutable_cpu_data();
+    }
+    const double num_params = 4.0 * 512 * 512;
+    Solver::SGD<R> sgd(params);
+    Solver::AdaGrad<R> adagrad(params);
+    Solver::Adam<R> adam(params);
+    benchmark("solver_sgd_1M",     "Mparams/s", num_params / 1e6, [&]() { sgd.step(params); });
+    benchmark("solver_adagrad_1M", "Mparams/s", num_params / 1e6, [&]() { adagrad.step(params); });
+    benchmark("solver_adam_1M",    "Mparams/s", num_params / 1e6, [&]() { adam.step(params); });
+}
+
+void bench_memory_bank() {
+    const int amount = 128 * 128;
+    benchmark("memory_bank_allocate_64KB", "ns", 0, [&]() {
+        R* ptr = memory_bank<R>::allocate_cpu(amount, 128);
+        memory_bank<R>::deposit_cpu(amount, 128, ptr);
+    });
+    benchmark("mat_temporary_128x128", "ns", 0, [&]() {
+        Mat<R> temporary(128, 128, weights<R>::empty());
+        temporary.w().mutable_cpu_data();
+    });
+}
+
+struct LanguageModel {
+    Mat<R> embedding;
+    StackedLSTM<R> lstm;
+    Layer<R> decoder;
+
+    LanguageModel(int vocab_size, int input_size, const vector<int>& hidden_sizes) :
+            embedding(vocab_size, input_size, weights<R>::uniform(0.1)),
+            lstm(input_size, hidden_sizes, false, false),
+            decoder(hidden_sizes.back(), vocab_size) {
+    }
+
+    vector<Mat<R>> parameters() const {
+        auto params = lstm.parameters();
+        auto decoder_params = decoder.parameters();
+        params.insert(params.end(), decoder_params.begin(), decoder_params.end());
+        params.emplace_back(embedding);
+        return params;
+    }
+
+    Mat<R> error(const vector<uint>& sentence) const {
+        auto state = lstm.initial_states();
+        Mat<R> total(1, 1);
+        for (int t = 0; t + 1 < sentence.size(); t++) {
+            state = lstm.activate(state, embedding[sentence[t]]);
+            total = total + MatOps<R>::softmax_cross_entropy_rowwise(
+                    decoder.activate(state.back().hidden), sentence[t + 1]);
+        }
+        return total;
+    }
+
+    // probabilities of the next word after every word but the last.
+    Mat<R> predict(const vector<uint>& sentence) const {
+        auto state = lstm.initial_states();
+        vector<Mat<R>> probabilities;
+        for (int t = 0; t + 1 < sentence.size(); t++) {
+            state = lstm.activate(state, embedding[sentence[t]]);
+            probabilities.emplace_back(MatOps<R>::softmax_rowwise(decoder.activate(state.back().hidden)));
+        }
+        return MatOps<R>::vstack(probabilities);
+    }
+
+    // (embedding[word] is a view of the float row, it stays as is)
+    void quantize() {
+        lstm.quantize();
+        decoder.quantize();
+    }
+};
+
+void bench_language_model() {
+    const string name = "stacked_lstm_lm_paul_graham";
+    if (!selected(name)) return;
+    auto corpus = utils::load_tokenized_unlabeled_corpus(
+            utils::dir_join({ STR(DALI_DATA_DIR), "paul_graham/train.txt" }));
+    if (corpus.empty()) {
+        std::cerr << "skipping " << name << ": data/paul_graham/train.txt not found" << std::endl;
+        return;
+    }
+    auto words = utils::get_vocabulary(corpus, 2);
+    words.emplace_back(utils::end_symbol);
+    utils::Vocab vocab(words);
+    vocab.freeze();
+    vector<vector<uint>> sentences;
+    for (int i = 0; i < std::min((int)corpus.size(), options.lm_sentences); i++) {
+        sentences.emplace_back(vocab.encode(corpus[i], true));
+    }
+
+    LanguageModel model(vocab.size(), 100, {200, 200});
+    auto params = model.parameters();
+    Solver::AdaGrad<R> solver(params);
+    auto train = [&](const vector<uint>& sentence) {
+        auto error = model.error(sentence);
+        error.grad();
+        graph::backward();
+        solver.step(params);
+    };
+    // warm up the memory bank and the tape
+    train(sentences.front());
+
+    long num_words = 0;
+    auto start = clock_t_::now();
+    for (auto& sentence : sentences) {
+        train(sentence);
+        num_words += sentence.size() - 1;
+    }
+    double elapsed_ns = std::chrono::duration<double, std::nano>(clock_t_::now() - start).count();
+
+    Result words_per_second;
+    words_per_second.name             = name;
+    words_per_second.unit             = "words/s";
+    words_per_second.value            = num_words / elapsed_ns * 1e9;
+    words_per_second.ns_per_iteration = elapsed_ns / sentences.size();
+    words_per_second.iterations       = sentences.size();
+    record(words_per_second);
+
+    Result peak_memory = words_per_second;
+    peak_memory.name  = name + "_peak_memory";
+    peak_memory.unit  = "MB";
+    peak_memory.value = peak_memory_mb();
+    record(peak_memory);
+
+    // inference with the trained weights, in float then in int8
+    auto predict_all = [&]() {
+        vector<Mat<R>> predictions;
+        for (auto& sentence : sentences) {
+            if (sentence.size() > 1) predictions.emplace_back(model.predict(sentence));
+        }
+        return predictions;
+    };
+    for (bool quantized : {false, true}) {
+        if (quantized) model.quantize();
+        graph::NoBackprop nb;
+        auto start = clock_t_::now();
+        predict_all();
+        double elapsed_ns = std::chrono::duration<double, std::nano>(clock_t_::now() - start).count();
+        Result inference = words_per_second;
+        inference.name             = name + (quantized ? "_inference_int8" : "_inference");
+        inference.value            = num_words / elapsed_ns * 1e9;
+        inference.ns_per_iteration = elapsed_ns / sentences.size();
+        record(inference);
+    }
+    auto report = quantization::report<R>(model.parameters(), predict_all);
+    std::cout << report << std::endl;
+    Result drift = words_per_second;
+    drift.name  = name + "_int8_relative_error";
+    drift.unit  = "%";
+    drift.value = 100.0 * report.relative_error;
+    record(drift);
+    drift.name  = name + "_int8_argmax_agreement";
+    drift.value = 100.0 * report.argmax_agreement;
+    record(drift);
+}
+
+string json_escape(const string& text) {
+    string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+void save_json(const string& fname) {
+    std::ofstream out(fname);
+    utils::assert2(out.good(), MS() << "Cannot write benchmark results to " << fname << ".");
+    out << "{\n"
+        << "  \"suite\": \"bench_dali\",\n"
+        << "  \"float_type\": \"float\",\n"
+        #ifdef DALI_USE_CUDA
+        << "  \"device\": \"gpu\",\n"
+        #else
+        << "  \"device\": \"cpu\",\n"
+        #endif
+        << "  \"benchmarks\": [";
+    out << std::setprecision(6);
+    for (int i = 0; i < results.size(); i++) {
+        auto& result = results[i];
+        out << (i > 0 ? ",\n" : "\n")
+            << "    {\"name\": \"" << json_escape(result.name) << "\""
+            << ", \"unit\": \"" << json_escape(result.unit) << "\""
+            << ", \"value\": " << result.value
+            << ", \"ns_per_iteration\": " << result.ns_per_iteration
+            << ", \"iterations\": " << result.iterations << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            options.json = argv[++i];
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            options.min_seconds  = 0.05;
+            options.lm_sentences = 30;
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--json results.json] [--filter substring] [--quick]" << std::endl;
+            return 1;
+        }
+    }
+    dali_init();
+
+    // first: its peak memory is the peak of the whole process so far.
+    bench_language_model();
+    bench_gemm();
+    bench_elementwise();
+    bench_softmax();
+    bench_rows_pluck();
+    bench_tape();
+    bench_solvers();
+    bench_memory_bank();
+
+    if (!options.json.empty()) {
+        save_json(options.json);
+        std::cout << "results saved to " << options.json << std::endl;
+    }
+    return 0;
+}
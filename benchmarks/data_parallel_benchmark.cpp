@@ -0,0 +1,119 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "dali/execution/DataParallelTrainer.h"
+#include "dali/layers/Layers.h"
+#include "dali/layers/LSTM.h"
+#include "dali/tensor/Mat.h"
+#include "dali/tensor/MatOps.h"
+#include "dali/tensor/Solver.h"
+
+/*
+Data parallel benchmark
+-----------------------
+
+Trains a small LSTM language model on random sentences with
+DataParallelTrainer and reports words per second with 1 to 32
+threads (all running the same number of minibatches).
+*/
+
+typedef float R;
+typedef std::vector<uint> sentence_t;
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+typedef std::chrono::high_resolution_clock clock_t_;
+
+const int VOCAB_SIZE      = 2000;
+const int INPUT_SIZE      = 64;
+const int HIDDEN_SIZE     = 128;
+const int SENTENCE_LENGTH = 20;
+const int MINIBATCH_SIZE  = 64;
+const int NUM_MINIBATCHES = 10;
+
+struct LanguageModel {
+    Mat<R> embedding;
+    LSTM<R> lstm;
+    Layer<R> decoder;
+
+    LanguageModel() :
+            embedding(VOCAB_SIZE, INPUT_SIZE, weights<R>::uniform(0.1)),
+            lstm(INPUT_SIZE, HIDDEN_SIZE),
+            decoder(HIDDEN_SIZE, VOCAB_SIZE) {
+    }
+
+    LanguageModel(const LanguageModel& other, bool copy_w, bool copy_dw) :
+            embedding(other.embedding, copy_w, copy_dw),
+            lstm(other.lstm, copy_w, copy_dw),
+            decoder(other.decoder, copy_w, copy_dw) {
+    }
+
+    LanguageModel shallow_copy() const {
+        return LanguageModel(*this, false, true);
+    }
+
+    std::vector<Mat<R>> parameters() const {
+        auto params = lstm.parameters();
+        auto decoder_params = decoder.parameters();
+        params.insert(params.end(), decoder_params.begin(), decoder_params.end());
+        params.emplace_back(embedding);
+        return params;
+    }
+
+    Mat<R> error(const sentence_t& sentence) const {
+        auto state = lstm.initial_states();
+        Mat<R> total(1, 1);
+        for (int t = 0; t + 1 < sentence.size(); t++) {
+            state = lstm.activate(embedding[sentence[t]], state);
+            total = total + MatOps<R>::softmax_cross_entropy_rowwise(
+                    decoder.activate(state.hidden), sentence[t + 1]);
+        }
+        return total;
+    }
+};
+
+int main() {
+    dali_init();
+    std::mt19937 generator(1234);
+    std::uniform_int_distribution<uint> word(0, VOCAB_SIZE - 1);
+    std::vector<std::vector<sentence_t>> minibatches(NUM_MINIBATCHES);
+    for (auto& minibatch : minibatches) {
+        for (int i = 0; i < MINIBATCH_SIZE; i++) {
+            sentence_t sentence(SENTENCE_LENGTH);
+            for (auto& w : sentence) w = word(generator);
+            minibatch.emplace_back(sentence);
+        }
+    }
+    const double words = (double)NUM_MINIBATCHES * MINIBATCH_SIZE * SENTENCE_LENGTH;
+
+    std::cout << "threads    words/sec   speedup" << std::endl;
+    double single_thread = 0.0;
+    for (int num_threads : {1, 2, 4, 8, 16, 32}) {
+        LanguageModel model;
+        auto params = model.parameters();
+        DataParallelTrainer<R, LanguageModel, sentence_t> trainer(
+                model,
+                std::make_shared<Solver::AdaGrad<R>>(params),
+                [](LanguageModel& model, const sentence_t& sentence) {
+                    return model.error(sentence);
+                },
+                num_threads);
+        // warm up the memory banks and tapes of every thread
+        trainer.step(minibatches[0]);
+
+        auto start = clock_t_::now();
+        for (auto& minibatch : minibatches) {
+            trainer.step(minibatch);
+        }
+        auto elapsed = duration_cast<milliseconds>(clock_t_::now() - start).count();
+        double words_per_second = words / std::max(elapsed, (decltype(elapsed))1) * 1000.0;
+        if (num_threads == 1) single_thread = words_per_second;
+        std::cout << std::setw(7)  << num_threads
+                  << std::setw(13) << (int)words_per_second
+                  << std::setw(9)  << std::setprecision(3) << words_per_second / single_thread
+                  << "x" << std::endl;
+    }
+    return 0;
+}
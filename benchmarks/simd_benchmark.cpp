@@ -0,0 +1,77 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "dali/math/TensorFunctions.h"
+#include "dali/math/simd/SimdFunctions.h"
+
+/*
+Simd benchmark
+--------------
+
+Measures the throughput of the elementwise transcendental functions
+over a float array, once element by element through the scalar
+`TensorOps::op` functors (what mshadow expressions evaluate on the
+CPU) and once through dali/math/simd with every instruction set the
+cpu supports.
+*/
+
+typedef float R;
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+typedef std::chrono::high_resolution_clock clock_t_;
+
+const int SIZE           = 1 << 16;
+const int NUM_ITERATIONS = 500;
+
+template<typename Function>
+double nanoseconds_per_element(Function f) {
+    // warm up caches and the dispatcher
+    f();
+    auto start = clock_t_::now();
+    for (int i = 0; i < NUM_ITERATIONS; i++) {
+        f();
+    }
+    auto elapsed = duration_cast<nanoseconds>(clock_t_::now() - start).count();
+    return (double)elapsed / ((double)NUM_ITERATIONS * SIZE);
+}
+
+template<typename op_t>
+void benchmark(const std::string& name, const std::vector<R>& in, std::vector<R>& out) {
+    std::cout << std::setw(10) << name;
+    double scalar = nanoseconds_per_element([&]() {
+        for (int i = 0; i < SIZE; i++) out[i] = op_t::Map(in[i]);
+    });
+    std::cout << "  scalar " << std::setw(6) << scalar << " ns";
+    for (auto isa : {"sse2", "avx2", "avx512"}) {
+        if (!simd::set_instruction_set(isa)) continue;
+        double vectorized = nanoseconds_per_element([&]() {
+            op_t::Map(in.data(), out.data(), SIZE);
+        });
+        std::cout << "  " << isa << " " << std::setw(6) << vectorized << " ns"
+                  << " (x" << scalar / vectorized << ")";
+    }
+    std::cout << std::endl;
+}
+
+int main() {
+    std::vector<R> in(SIZE), out(SIZE);
+    for (int i = 0; i < SIZE; i++) {
+        // activations live in a few units around zero
+        in[i] = -8.0 + 16.0 * i / SIZE;
+    }
+    std::vector<R> positive(SIZE);
+    for (int i = 0; i < SIZE; i++) {
+        positive[i] = 1e-3 + 100.0 * i / SIZE;
+    }
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "time per element, " << SIZE << " floats:" << std::endl;
+    benchmark<TensorOps::op::exp<R>>("exp", in, out);
+    benchmark<TensorOps::op::log<R>>("log", positive, out);
+    benchmark<TensorOps::op::sigmoid<R>>("sigmoid", in, out);
+    benchmark<TensorOps::op::tanh<R>>("tanh", in, out);
+    benchmark<TensorOps::op::softplus<R>>("softplus", in, out);
+    return 0;
+}
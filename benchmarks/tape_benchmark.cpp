@@ -0,0 +1,81 @@
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include "dali/tensor/Mat.h"
+#include "dali/tensor/Tape.h"
+
+/*
+Tape benchmark
+--------------
+
+Measures the cost of recording and replaying a backward closure
+shaped like the ones ops put on the tape (three Mats captured by
+value), once with the previous std::function based tape and once
+with graph::tape.
+*/
+
+typedef float R;
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+typedef std::chrono::high_resolution_clock clock_t_;
+
+const int NUM_OPS        = 10000;
+const int NUM_ITERATIONS = 200;
+
+template<typename Record, typename Replay>
+double nanoseconds_per_op(Record record, Replay replay) {
+    // warm up so that steady state capacity is reached
+    record();
+    replay();
+    auto start = clock_t_::now();
+    for (int i = 0; i < NUM_ITERATIONS; i++) {
+        record();
+        replay();
+    }
+    auto elapsed = duration_cast<nanoseconds>(clock_t_::now() - start).count();
+    return (double)elapsed / ((double)NUM_ITERATIONS * NUM_OPS);
+}
+
+int main() {
+    dali_init();
+    Mat<R> a(4, 4);
+    Mat<R> b(4, 4);
+    Mat<R> out(4, 4);
+    volatile R sink = 0;
+
+    std::vector<std::function<void()>> function_tape;
+    double before = nanoseconds_per_op(
+        [&]() {
+            for (int i = 0; i < NUM_OPS; i++) {
+                std::function<void()> f = [a, b, out, &sink]() mutable {
+                    sink += a.dims(0) + b.dims(0) + out.dims(0);
+                };
+                function_tape.emplace_back(f);
+            }
+        },
+        [&]() {
+            for (auto it = function_tape.rbegin(); it != function_tape.rend(); ++it)
+                (*it)();
+            function_tape.clear();
+        }
+    );
+
+    double after = nanoseconds_per_op(
+        [&]() {
+            for (int i = 0; i < NUM_OPS; i++) {
+                graph::emplace_back([a, b, out, &sink]() mutable {
+                    sink += a.dims(0) + b.dims(0) + out.dims(0);
+                });
+            }
+        },
+        []() {
+            graph::backward();
+        }
+    );
+
+    std::cout << "record + replay, std::function tape : " << before << " ns/op" << std::endl;
+    std::cout << "record + replay, graph::tape        : " << after  << " ns/op" << std::endl;
+    return 0;
+}
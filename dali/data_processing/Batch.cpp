@@ -1,10 +1,26 @@
 #include "Batch.h"
 
+template<typename R>
+Batch<R>::Batch(int max_length, int num_examples) :
+        data(max_length, num_examples),
+        target(max_length, num_examples),
+        mask(max_length, num_examples),
+        code_lengths(num_examples, 0),
+        total_codes(0) {
+}
+
 template<typename R>
 void Batch<R>::insert_example(const std::vector<std::string>& example,
                               const utils::Vocab& vocab,
                               size_t example_idx,
                               int offset) {
+    insert_example(vocab.encode(example), example_idx, offset);
+}
+
+template<typename R>
+void Batch<R>::insert_example(const std::vector<uint>& example,
+                              size_t example_idx,
+                              int offset) {
     auto example_length = example.size();
     ASSERT2(example_idx < data.dims(1),
             utils::MS() << "Inserting at position " << example_idx
@@ -17,8 +33,10 @@ void Batch<R>::insert_example(const std::vector<std::string>& example,
             << " + " << offset << " > max example length ("
             << data.dims(0) << ")");
 
+    // examples are columns: step j of the example is row offset + j.
+    auto values = data.w().mutable_cpu_data();
     for (size_t j = 0; j < example_length; j++) {
-        data.w(offset + j, example_idx) = vocab[example[j]];
+        values[offset + j][example_idx] = example[j];
     }
 }
 
@@ -21,11 +21,17 @@ struct Batch {
     int total_codes;
 
     Batch() = default;
+    // zero padded batch of `num_examples` examples of up to
+    // `max_length` steps (targets have the same shape as the
+    // inputs), with an empty mask.
+    Batch(int max_length, int num_examples);
 
     size_t size() const;
     size_t max_length() const;
 
     void insert_example(const std::vector<std::string>& example, const utils::Vocab& vocab, size_t example_idx, int offset = 0);
+    // same, for an example whose words are already indices.
+    void insert_example(const std::vector<uint>& example, size_t example_idx, int offset = 0);
 
     int example_length(const int& idx) const;
 
@@ -0,0 +1,52 @@
+#include "dali/data_processing/BatchPipeline.h"
+
+#include <algorithm>
+#include <tuple>
+
+#include "dali/utils/random.h"
+
+using std::vector;
+
+namespace batching {
+    vector<vector<int>> length_bucketed_batches(const vector<int>& lengths,
+                                                int minibatch_size,
+                                                int bucket_width,
+                                                std::mt19937* generator) {
+        ASSERT2(minibatch_size > 0, "Minibatch size must be positive.");
+        ASSERT2(bucket_width > 0, "Bucket width must be positive.");
+        auto& random = generator == NULL ? utils::random::generator() : *generator;
+
+        // (bucket, random tie breaker, example)
+        vector<std::tuple<int, unsigned int, int>> order;
+        order.reserve(lengths.size());
+        for (int i = 0; i < lengths.size(); i++) {
+            order.emplace_back(lengths[i] / bucket_width, random(), i);
+        }
+        std::sort(order.begin(), order.end());
+
+        vector<vector<int>> batches;
+        for (int i = 0; i < order.size(); i += minibatch_size) {
+            batches.emplace_back();
+            auto& batch = batches.back();
+            int end = std::min(i + minibatch_size, (int)order.size());
+            for (int j = i; j < end; j++) {
+                batch.emplace_back(std::get<2>(order[j]));
+            }
+        }
+        std::shuffle(batches.begin(), batches.end(), random);
+        return batches;
+    }
+
+    double padding_fraction(const vector<int>& lengths, const vector<vector<int>>& batches) {
+        long steps = 0, padded_steps = 0;
+        for (auto& batch : batches) {
+            int max_length = 0;
+            for (auto example : batch) {
+                steps += lengths[example];
+                max_length = std::max(max_length, lengths[example]);
+            }
+            padded_steps += (long)max_length * batch.size();
+        }
+        return padded_steps == 0 ? 0.0 : 1.0 - (double)steps / padded_steps;
+    }
+}
@@ -0,0 +1,172 @@
+#ifndef DALI_DATA_PROCESSING_BATCH_PIPELINE_H
+#define DALI_DATA_PROCESSING_BATCH_PIPELINE_H
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "dali/utils/assert2.h"
+#include "dali/utils/core_utils.h"
+
+/*
+Batch Pipeline
+--------------
+
+Padding a minibatch to its longest example wastes the computation
+spent on the padding, so examples are first grouped by length:
+
+    auto batches = batching::length_bucketed_batches(lengths, 64);
+
+and the batches (lists of example indices) are then built on
+background threads, a few minibatches ahead of the training loop:
+
+    batching::Prefetcher<Batch<R>> prefetcher(batches,
+        [&](const std::vector<int>& examples) {
+            Batch<R> batch(max_length_of(examples), examples.size());
+            ...
+            return batch;
+        });
+    Batch<R> batch;
+    while (prefetcher.next(&batch)) {
+        ... train on batch ...
+    }
+*/
+
+namespace batching {
+    // Cuts the examples into minibatches of up to `minibatch_size`
+    // examples of similar length: examples are sorted by length rounded
+    // down to a multiple of `bucket_width` (ties in random order) before
+    // being cut, and the minibatches are shuffled. Wider buckets give
+    // more varied minibatches for more padding. `generator` defaults to
+    // utils::random::generator().
+    std::vector<std::vector<int>> length_bucketed_batches(const std::vector<int>& lengths,
+                                                          int minibatch_size,
+                                                          int bucket_width = 1,
+                                                          std::mt19937* generator = NULL);
+
+    // Fraction of the steps of the minibatches that are padding, when
+    // every example is padded to the longest one in its minibatch.
+    double padding_fraction(const std::vector<int>& lengths,
+                            const std::vector<std::vector<int>>& batches);
+
+    // Builds the minibatches on `num_threads` background threads, and
+    // hands them out in order. At most `capacity` minibatches are built
+    // ahead of the last one taken, so memory stays bounded when training
+    // is slower than building.
+    template<typename batch_t>
+    class Prefetcher {
+        public:
+            typedef std::function<batch_t(const std::vector<int>&)> builder_t;
+        private:
+            std::vector<std::vector<int>> batches;
+            builder_t build;
+            int capacity;
+
+            std::mutex mutex;
+            // signalled when a minibatch is ready or taken.
+            std::condition_variable changed;
+            // minibatch `i` is built into slot i % capacity.
+            std::vector<std::unique_ptr<batch_t>> slots;
+            std::vector<std::exception_ptr> errors;
+            int next_to_build;
+            int next_to_take;
+            bool stopping;
+            std::vector<std::thread> workers;
+
+            void work() {
+                while (true) {
+                    int batch_idx;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        changed.wait(lock, [this]() {
+                            return stopping ||
+                                   next_to_build == batches.size() ||
+                                   next_to_build < next_to_take + capacity;
+                        });
+                        if (stopping || next_to_build == batches.size()) return;
+                        batch_idx = next_to_build++;
+                    }
+                    std::unique_ptr<batch_t> batch;
+                    std::exception_ptr error;
+                    try {
+                        batch.reset(new batch_t(build(batches[batch_idx])));
+                    } catch (...) {
+                        error = std::current_exception();
+                    }
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        slots[batch_idx % capacity]  = std::move(batch);
+                        errors[batch_idx % capacity] = error;
+                    }
+                    changed.notify_all();
+                }
+            }
+        public:
+            Prefetcher(std::vector<std::vector<int>> _batches,
+                       builder_t _build,
+                       int num_threads = 1,
+                       int _capacity = 4) :
+                    batches(std::move(_batches)),
+                    build(_build),
+                    capacity(_capacity),
+                    slots(_capacity),
+                    errors(_capacity),
+                    next_to_build(0),
+                    next_to_take(0),
+                    stopping(false) {
+                ASSERT2(num_threads > 0, "Prefetcher needs at least one thread.");
+                ASSERT2(capacity > 0, "Prefetcher capacity must be positive.");
+                for (int i = 0; i < num_threads; i++) {
+                    workers.emplace_back(&Prefetcher<batch_t>::work, this);
+                }
+            }
+
+            Prefetcher(const Prefetcher&) = delete;
+            Prefetcher& operator=(const Prefetcher&) = delete;
+
+            // Waits for the next minibatch and moves it into `batch`.
+            // Returns false once every minibatch was taken. Exceptions
+            // thrown while building a minibatch are rethrown here.
+            bool next(batch_t* batch) {
+                std::unique_ptr<batch_t> ready;
+                std::exception_ptr error;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    if (next_to_take == batches.size()) return false;
+                    int slot = next_to_take % capacity;
+                    changed.wait(lock, [this, slot]() {
+                        return slots[slot] != nullptr || errors[slot] != nullptr;
+                    });
+                    ready = std::move(slots[slot]);
+                    error = errors[slot];
+                    errors[slot] = nullptr;
+                    next_to_take++;
+                }
+                changed.notify_all();
+                if (error) std::rethrow_exception(error);
+                *batch = std::move(*ready);
+                return true;
+            }
+
+            int size() const {
+                return batches.size();
+            }
+
+            // stops building (minibatches being built are finished).
+            ~Prefetcher() {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stopping = true;
+                }
+                changed.notify_all();
+                for (auto& worker : workers) worker.join();
+            }
+    };
+}
+
+#endif
@@ -1,118 +1,416 @@
 #include "dali/data_processing/Glove.h"
-#include "dali/tensor/__MatMacros__.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#include "dali/tensor/__MatMacros__.h"
+#include "dali/utils/ThreadPool.h"
 
 using std::string;
 using utils::Vocab;
 using std::make_tuple;
 using std::vector;
-using utils::from_string;
+using utils::MS;
 
-namespace glove {
-    template<typename T>
-    void collect_numericals_from_line(const std::string& line, int* offset_ptr, vector<T>* res) {
-        int& offset = *offset_ptr;
-        while (offset < line.size()) {
-            res->push_back(atof(line.c_str() + offset));
-            offset++;
-            while (offset < line.size() && *(line.begin() + offset) != ' ') {
-                offset++;
+namespace {
+    // text parsed by one task (chunks end on line boundaries).
+    const size_t CHUNK_SIZE = 1 << 22;
+
+    const char     CACHE_MAGIC[8] = {'D', 'A', 'L', 'I', 'G', 'L', 'O', 'V'};
+    const uint32_t CACHE_VERSION  = 2;
+    const char*    CACHE_SUFFIX   = ".dali_cache";
+
+    struct glove_cache_header {
+        char     magic[8];
+        uint32_t version;
+        uint32_t dtype_size;
+        // the text file the cache was made from
+        uint64_t source_size;
+        int64_t  source_mtime;
+        int64_t  source_mtime_nsec;
+        // threshold the file was loaded with (-1 for every word)
+        int64_t  threshold;
+        uint32_t rows;
+        uint32_t cols;
+        // words, one per line, after the (rows + 1) x cols matrix
+        uint64_t words_offset;
+    };
+    static_assert(sizeof(glove_cache_header) == 64, "glove cache header must take 64 bytes.");
+
+    struct mapped_file {
+        char* data;
+        size_t size;
+        mapped_file(char* data, size_t size) : data(data), size(size) {}
+        ~mapped_file() {
+            if (size > 0) munmap(data, size);
+        }
+    };
+
+    // maps the whole file (privately: writes to the pages stay in
+    // this process), or returns nullptr.
+    std::shared_ptr<mapped_file> map_file(const string& fname, struct stat* file_stat) {
+        int fd = open(fname.c_str(), O_RDONLY);
+        if (fd < 0) return nullptr;
+        if (fstat(fd, file_stat) != 0) {
+            close(fd);
+            return nullptr;
+        }
+        if (file_stat->st_size == 0) {
+            close(fd);
+            return std::make_shared<mapped_file>(nullptr, 0);
+        }
+        void* data = mmap(NULL, file_stat->st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) return nullptr;
+        return std::make_shared<mapped_file>((char*)data, file_stat->st_size);
+    }
+
+    template<typename Function>
+    void parallel_chunks(int num_chunks, Function f) {
+        if (num_chunks == 1) {
+            f(0);
+        } else {
+            // the calling thread works too.
+            ThreadPool pool(std::max(1, std::min(num_chunks, (int)std::thread::hardware_concurrency()) - 1));
+            pool.parallel_for(0, num_chunks, f, 1);
+        }
+    }
+
+    struct text_chunk {
+        const char* begin;
+        const char* end;
+    };
+
+    vector<text_chunk> line_aligned_chunks(const char* data, size_t size) {
+        vector<text_chunk> chunks;
+        const char* end = data + size;
+        const char* begin = data;
+        while (begin < end) {
+            const char* chunk_end = begin + std::min(CHUNK_SIZE, (size_t)(end - begin));
+            if (chunk_end < end) {
+                auto newline = (const char*)memchr(chunk_end, '\n', end - chunk_end);
+                chunk_end = newline == NULL ? end : newline + 1;
             }
+            chunks.push_back({begin, chunk_end});
+            begin = chunk_end;
         }
+        return chunks;
     }
 
-    void collect_name_from_line(const std::string& line, int* offset_ptr, std::string* word) {
-        int& offset = *offset_ptr;
-        for (const char& c : line) {
-            offset++;
-            if (c == ' ')
-                break;
+    // calls f(line_begin, line_end) for each non empty line of the
+    // chunk (without its end of line), until f returns false.
+    template<typename Function>
+    void for_each_line(const text_chunk& chunk, Function f) {
+        const char* p = chunk.begin;
+        while (p < chunk.end) {
+            auto newline = (const char*)memchr(p, '\n', chunk.end - p);
+            const char* line_end = newline == NULL ? chunk.end : newline;
+            const char* next = newline == NULL ? chunk.end : newline + 1;
+            if (line_end > p && line_end[-1] == '\r') line_end--;
+            if (line_end > p && !f(p, line_end)) return;
+            p = next;
         }
-        (*word) = std::string(line.begin(), line.begin() + (offset > 0 ? offset - 1 : 0));
     }
 
-    template<typename T>
-    void convert_line_to_embedding(const std::string& line, std::string* word, vector<T>* embedding) {    // int offset = 0;
-        int offset = 0;
-        collect_name_from_line(line, &offset, word);
-        embedding->clear();
-        collect_numericals_from_line(line, &offset, embedding);
+    int count_lines(const text_chunk& chunk) {
+        int lines = 0;
+        for_each_line(chunk, [&lines](const char*, const char*) {
+            lines++;
+            return true;
+        });
+        return lines;
     }
 
+    const char* word_end(const char* line, const char* line_end) {
+        auto space = (const char*)memchr(line, ' ', line_end - line);
+        return space == NULL ? line_end : space;
+    }
+
+    const double POWERS_OF_TEN[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    bool is_separator(char c) {
+        return c == ' ' || c == '\t';
+    }
+
+    // Parses the number starting at p. Decimal numbers with at most 19
+    // digits and a small exponent (every number in GloVe files) are
+    // computed exactly in double precision with one rounding, so the
+    // value is the same as atof's; anything else goes to strtod.
+    // Returns the position after the number.
     template<typename T>
-    void convert_line_to_embedding_if(const std::string& line, std::function<bool(const std::string&)> checker, std::string* word, vector<T>* embedding) {
-        int offset = 0;
-        collect_name_from_line(line, &offset, word);
-        embedding->clear();
-        if (checker(*word)) {
-            collect_numericals_from_line(line, &offset, embedding);
+    const char* parse_number(const char* p, const char* end, T* out) {
+        const char* start = p;
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative = *p == '-';
+            p++;
+        }
+        uint64_t mantissa = 0;
+        int digits   = 0;
+        int exponent = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+            mantissa = mantissa * 10 + (*p - '0');
+        }
+        if (p < end && *p == '.') {
+            for (p++; p < end && *p >= '0' && *p <= '9'; p++, digits++, exponent--) {
+                mantissa = mantissa * 10 + (*p - '0');
+            }
+        }
+        bool simple = digits > 0 && digits <= 19;
+        if (simple && p < end && (*p == 'e' || *p == 'E')) {
+            p++;
+            bool negative_exponent = false;
+            if (p < end && (*p == '-' || *p == '+')) {
+                negative_exponent = *p == '-';
+                p++;
+            }
+            int value = 0, exponent_digits = 0;
+            for (; p < end && *p >= '0' && *p <= '9' && exponent_digits < 4; p++, exponent_digits++) {
+                value = value * 10 + (*p - '0');
+            }
+            simple = exponent_digits > 0;
+            exponent += negative_exponent ? -value : value;
         }
+        simple = simple && (p == end || is_separator(*p)) &&
+                 mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22;
+        if (simple) {
+            double value = exponent < 0 ?
+                    (double)mantissa / POWERS_OF_TEN[-exponent] :
+                    (double)mantissa * POWERS_OF_TEN[exponent];
+            *out = (T)(negative ? -value : value);
+            return p;
+        }
+        p = start;
+        while (p < end && !is_separator(*p)) p++;
+        char token[64];
+        size_t length = std::min((size_t)(p - start), sizeof(token) - 1);
+        memcpy(token, start, length);
+        token[length] = '\0';
+        *out = (T)strtod(token, NULL);
+        return p;
     }
 
+    // Parses the values after the word into `out` (which has room for
+    // `expected` of them) and returns how many the line holds.
+    template<typename T>
+    int parse_values(const char* p, const char* line_end, T* out, int expected) {
+        int found = 0;
+        T value;
+        while (true) {
+            while (p < line_end && is_separator(*p)) p++;
+            if (p >= line_end) break;
+            p = parse_number(p, line_end, &value);
+            if (found < expected) out[found] = value;
+            found++;
+        }
+        return found;
+    }
 
+    // nanoseconds of the modification time: a file rewritten within
+    // the same second must not match its old cache.
+    int64_t mtime_nsec(const struct stat& file_stat) {
+#ifdef __APPLE__
+        return file_stat.st_mtimespec.tv_nsec;
+#else
+        return file_stat.st_mtim.tv_nsec;
+#endif
+    }
 
+    string cache_name(const string& fname) {
+        return fname + CACHE_SUFFIX;
+    }
 
+    // Maps the binary cache of `fname` if it is up to date, holds T
+    // values and has at least the first `threshold` words.
     template<typename T>
-    void load(string fname, Mat<T>* underlying_mat, Vocab* vocab, int threshold) {
-        ASSERT2(utils::file_exists(fname), "Cannot open file with glove vectors.");
+    std::shared_ptr<mapped_file> map_cache(const string& fname, const struct stat& source_stat, int threshold) {
+        struct stat cache_stat;
+        auto cache = map_file(cache_name(fname), &cache_stat);
+        if (cache == nullptr || cache->size < sizeof(glove_cache_header)) return nullptr;
+        auto& header = *(const glove_cache_header*)cache->data;
+        bool valid =
+            memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+            header.version == CACHE_VERSION &&
+            header.dtype_size == sizeof(T) &&
+            header.source_size == (uint64_t)source_stat.st_size &&
+            header.source_mtime == (int64_t)source_stat.st_mtime &&
+            header.source_mtime_nsec == mtime_nsec(source_stat) &&
+            header.words_offset >= sizeof(header) + (uint64_t)(header.rows + 1) * header.cols * sizeof(T) &&
+            header.words_offset <= cache->size &&
+            (header.threshold == -1 || (threshold != -1 && threshold <= header.threshold));
+        return valid ? cache : nullptr;
+    }
 
-        std::fstream fp(fname);
-        std::string line;
+    vector<string> cached_words(const mapped_file& cache, int rows) {
+        auto& header = *(const glove_cache_header*)cache.data;
+        vector<string> words;
+        words.reserve(rows);
+        text_chunk chunk = {cache.data + header.words_offset, cache.data + cache.size};
+        const char* p = chunk.begin;
+        while (words.size() < rows && p < chunk.end) {
+            auto newline = (const char*)memchr(p, '\n', chunk.end - p);
+            const char* line_end = newline == NULL ? chunk.end : newline;
+            words.emplace_back(p, line_end);
+            p = line_end + 1;
+        }
+        return words;
+    }
 
-        int observed_size = underlying_mat->dims(1);
-        int capacity      = underlying_mat->dims(0);
+    // written to a temporary file then renamed, so that a concurrent or
+    // interrupted load never sees half a cache. Failures (e.g. a read
+    // only directory) only mean there is no cache.
+    template<typename T>
+    void write_cache(const string& fname, const struct stat& source_stat, int threshold,
+                     const Mat<T>& mat, const vector<string>& words) {
+        glove_cache_header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        header.version      = CACHE_VERSION;
+        header.dtype_size   = sizeof(T);
+        header.source_size  = source_stat.st_size;
+        header.source_mtime = source_stat.st_mtime;
+        header.source_mtime_nsec = mtime_nsec(source_stat);
+        header.threshold    = threshold;
+        header.rows         = words.size();
+        header.cols         = mat.dims(1);
+        header.words_offset = sizeof(header) + (uint64_t)mat.number_of_elements() * sizeof(T);
 
-        if (capacity == 0) {
-            underlying_mat->resize(1, std::max(observed_size, 1));
-            capacity = 1;
+        auto temporary = cache_name(fname) + ".tmp" + std::to_string(getpid());
+        FILE* fp = fopen(temporary.c_str(), "wb");
+        if (fp == NULL) return;
+        bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+                  fwrite(MAT(mat).cpu_data().dptr_, sizeof(T), mat.number_of_elements(), fp) == mat.number_of_elements();
+        for (auto& word : words) {
+            ok = ok && fwrite(word.data(), 1, word.size(), fp) == word.size() && fputc('\n', fp) != EOF;
         }
-        auto& mat         = underlying_mat->w();
-        int vocab_size = 0;
-        vector<string> vocabulary;
-        std::string word;
-        vector<T> embedding;
-        // // use mat for assigning elements
-        while (std::getline(fp, line)) {
-            convert_line_to_embedding<T>(line, &word, &embedding);
-
-            vocabulary.emplace_back(word);
-            vocab_size += 1;
-            if (vocab_size > capacity) {
-                // increase matrix by 10%
-                mat.resize(mshadow::Shape2(std::max((int)(capacity * 1.1), capacity + 1), observed_size));
-                capacity = std::max((int)(capacity * 1.1), capacity + 1);
-            }
+        ok = fclose(fp) == 0 && ok;
+        if (!ok || rename(temporary.c_str(), cache_name(fname).c_str()) != 0) {
+            remove(temporary.c_str());
+        }
+    }
 
-            if (observed_size == 0 && embedding.size() > mat.shape[1]) {
-                mat.resize(mshadow::Shape2(capacity, embedding.size()));
-            }
-            for (int col_idx = 0 ; col_idx < embedding.size(); ++col_idx) {
-                mat(vocab_size-1, col_idx) = embedding[col_idx];
+    // the chunks holding the first `threshold` lines (all of them for -1),
+    // and the number of lines in each.
+    vector<text_chunk> first_lines(const mapped_file& text, int threshold, vector<int>* lines) {
+        auto chunks = line_aligned_chunks(text.data, text.size);
+        lines->assign(chunks.size(), 0);
+        parallel_chunks(chunks.size(), [&](int c) {
+            (*lines)[c] = count_lines(chunks[c]);
+        });
+        if (threshold < 0) return chunks;
+        int total = 0;
+        for (int c = 0; c < chunks.size(); c++) {
+            if (total + (*lines)[c] < threshold) {
+                total += (*lines)[c];
+                continue;
             }
+            // cut the chunk after the last line needed
+            int remaining = threshold - total;
+            const char* end = chunks[c].end;
+            for_each_line(chunks[c], [&](const char*, const char* line_end) {
+                end = std::min(chunks[c].end, line_end + 1);
+                return --remaining > 0;
+            });
+            chunks[c].end = end;
+            (*lines)[c] = threshold - total;
+            chunks.resize(c + 1);
+            lines->resize(c + 1);
+            break;
+        }
+        return chunks;
+    }
+}
 
-            if (observed_size == 0) {
-                // actualize size of matrix
-                observed_size = embedding.size();
-                mat.resize(mshadow::Shape2(capacity, observed_size));
-            }
-            ASSERT2(embedding.size() == observed_size,
-                utils::MS() << "Vectors in Glove file are of different sizes. Expected "
-                            << observed_size << " but found " << embedding.size()
-            );
-            // got all the vocab needed.
-            if (vocab_size == threshold) {
-                break;
+namespace glove {
+    bool use_binary_cache = true;
+
+    template<typename T>
+    void load(string fname, Mat<T>* underlying_mat, Vocab* vocab, int threshold) {
+        ASSERT2(utils::file_exists(fname), "Cannot open file with glove vectors.");
+        struct stat source_stat;
+        auto text = map_file(fname, &source_stat);
+        ASSERT2(text != nullptr, MS() << "Cannot read glove vectors from " << fname << ".");
+        if (threshold <= 0) threshold = -1;
+
+        if (use_binary_cache) {
+            auto cache = map_cache<T>(fname, source_stat, threshold);
+            if (cache != nullptr) {
+                auto& header = *(const glove_cache_header*)cache->data;
+                int rows = threshold != -1 ? std::min(threshold, (int)header.rows) : header.rows;
+                T* values = (T*)(cache->data + sizeof(header));
+                // the row after the words is the (zero) unknown word
+                // (written in the private mapping only).
+                std::fill(values + rows * header.cols, values + (rows + 1) * header.cols, (T)0.0);
+                *vocab = Vocab(cached_words(*cache, rows));
+                *underlying_mat = Mat<T>(rows + 1, header.cols, false);
+                MAT(*underlying_mat).memory().adopt_cpu(values, cache);
+                return;
             }
         }
-        (*vocab) = Vocab(vocabulary);
-        if (observed_size > 0) {
-            // // now final update is made to matrix
-            underlying_mat->resize(vocab_size + 1, observed_size);
-            mat[vocab_size].clear();
-        } else {
+
+        vector<int> lines;
+        auto chunks = first_lines(*text, threshold, &lines);
+        vector<int> first_row(chunks.size() + 1, 0);
+        for (int c = 0; c < chunks.size(); c++) {
+            first_row[c + 1] = first_row[c] + lines[c];
+        }
+        const int vocab_size = first_row.back();
+        if (vocab_size == 0) {
+            (*vocab) = Vocab(vector<string>());
             underlying_mat->forget_w();
             underlying_mat->forget_dw();
+            return;
+        }
+        int embedding_size = 0;
+        for_each_line(chunks[0], [&embedding_size](const char* line, const char* line_end) {
+            embedding_size = parse_values<T>(word_end(line, line_end), line_end, (T*)NULL, 0);
+            return false;
+        });
+        ASSERT2(embedding_size > 0, MS() << "No vectors in glove file " << fname << ".");
+
+        *underlying_mat = Mat<T>(vocab_size + 1, embedding_size, false);
+        T* values = MAT(*underlying_mat).overwrite_cpu_data().dptr_;
+        vector<vector<string>> chunk_words(chunks.size());
+        parallel_chunks(chunks.size(), [&](int c) {
+            T* row = values + (size_t)first_row[c] * embedding_size;
+            chunk_words[c].reserve(lines[c]);
+            for_each_line(chunks[c], [&](const char* line, const char* line_end) {
+                auto end_of_word = word_end(line, line_end);
+                chunk_words[c].emplace_back(line, end_of_word);
+                int found = parse_values(end_of_word, line_end, row, embedding_size);
+                ASSERT2(found == embedding_size,
+                    MS() << "Vectors in Glove file are of different sizes. Expected "
+                         << embedding_size << " but found " << found
+                );
+                row += embedding_size;
+                return true;
+            });
+        });
+        std::fill(values + (size_t)vocab_size * embedding_size,
+                  values + (size_t)(vocab_size + 1) * embedding_size, (T)0.0);
+
+        vector<string> vocabulary;
+        vocabulary.reserve(vocab_size);
+        for (auto& words : chunk_words) {
+            for (auto& word : words) vocabulary.emplace_back(std::move(word));
         }
+        if (use_binary_cache) {
+            // a threshold past the end of the file read every word
+            write_cache(fname, source_stat, vocab_size < threshold ? -1 : threshold,
+                        *underlying_mat, vocabulary);
+        }
+        (*vocab) = Vocab(vocabulary);
     }
 
     template<typename T>
@@ -128,36 +426,97 @@ namespace glove {
                               const utils::Vocab& vocab,
                               int threshold) {
         ASSERT2(utils::file_exists(fname), "Cannot open file with glove vectors.");
+        struct stat source_stat;
+        auto text = map_file(fname, &source_stat);
+        ASSERT2(text != nullptr, MS() << "Cannot read glove vectors from " << fname << ".");
+        // (at least one line is always read)
+        if (threshold != -1) threshold = std::max(threshold, 1);
+
+        auto ensure_target_size = [&](int embedding_size) {
+            if (target->dims(0) != vocab.word2index.size() ||
+                    target->dims(1) != embedding_size) {
+                *target = Mat<T>(vocab.size(), embedding_size,
+                                 weights<T>::uniform(1.0/embedding_size));
+            }
+        };
+
+        if (use_binary_cache) {
+            auto cache = map_cache<T>(fname, source_stat, threshold);
+            if (cache != nullptr) {
+                auto& header = *(const glove_cache_header*)cache->data;
+                int rows = threshold != -1 ? std::min(threshold, (int)header.rows) : header.rows;
+                const T* values = (const T*)(cache->data + sizeof(header));
+                auto words = cached_words(*cache, rows);
+                int words_matched_so_far = 0;
+                for (int i = 0; i < words.size(); i++) {
+                    auto found = vocab.word2index.find(words[i]);
+                    if (found == vocab.word2index.end()) continue;
+                    if (words_matched_so_far++ == 0) ensure_target_size(header.cols);
+                    std::copy(values + (size_t)i * header.cols, values + (size_t)(i + 1) * header.cols,
+                              MAT(*target).mutable_cpu_data().dptr_ + (size_t)found->second * header.cols);
+                }
+                return words_matched_so_far;
+            }
+        }
+
+        vector<text_chunk> chunks;
+        if (threshold != -1) {
+            vector<int> lines;
+            chunks = first_lines(*text, threshold, &lines);
+        } else {
+            chunks = line_aligned_chunks(text->data, text->size);
+        }
+        // embeddings of the words in the vocabulary, in file order
+        struct matches_t {
+            vector<int> indices;
+            vector<T> values;
+            int embedding_size = 0;
+        };
+        vector<matches_t> matches(chunks.size());
+        parallel_chunks(chunks.size(), [&](int c) {
+            auto& found = matches[c];
+            string word;
+            for_each_line(chunks[c], [&](const char* line, const char* line_end) {
+                auto end_of_word = word_end(line, line_end);
+                word.assign(line, end_of_word);
+                auto index = vocab.word2index.find(word);
+                // skipped lines are never parsed further
+                if (index == vocab.word2index.end()) return true;
+                if (found.embedding_size == 0) {
+                    found.embedding_size = parse_values<T>(end_of_word, line_end, (T*)NULL, 0);
+                }
+                found.indices.emplace_back(index->second);
+                found.values.resize(found.values.size() + found.embedding_size);
+                int size = parse_values(end_of_word, line_end,
+                                        found.values.data() + found.values.size() - found.embedding_size,
+                                        found.embedding_size);
+                ASSERT2(size == found.embedding_size,
+                    MS() << "Vectors in Glove file are of different sizes. Expected "
+                         << found.embedding_size << " but found " << size
+                );
+                return true;
+            });
+        });
 
         int embedding_size = 0;
-        int words_read_so_far = 0;
         int words_matched_so_far = 0;
-        vector<T> embedding;
-        std::string word;
-        std::string line;
-
-        std::fstream fp(fname);
-        while (std::getline(fp, line)) {
-            convert_line_to_embedding_if<T>(line, [&vocab](const string& word) {
-                return vocab.word2index.find(word) != vocab.word2index.end();
-            }, &word, &embedding);
-            if (embedding.size() > 0) {
-                int word_index = vocab.word2index.at(word);
-                // ensure matrix is the right size
-                if (embedding_size == 0) {
-                    embedding_size = embedding.size();
-                    if (target->dims(0) != vocab.word2index.size() ||
-                            target->dims(1) !=  embedding_size) {
-                        *target = Mat<T>(vocab.size(), embedding_size,
-                                        weights<T>::uniform(1.0/embedding_size));
-                    }
-                }
-                // store the embedding
-                for (int eidx = 0; eidx < embedding_size; ++ eidx)
-                    target->w(word_index, eidx) = embedding[eidx];
-                ++words_matched_so_far;
+        for (auto& found : matches) {
+            if (found.indices.empty()) continue;
+            if (embedding_size == 0) {
+                embedding_size = found.embedding_size;
+                ensure_target_size(embedding_size);
+            }
+            ASSERT2(found.embedding_size == embedding_size,
+                MS() << "Vectors in Glove file are of different sizes. Expected "
+                     << embedding_size << " but found " << found.embedding_size
+            );
+            T* values = MAT(*target).mutable_cpu_data().dptr_;
+            for (int i = 0; i < found.indices.size(); i++) {
+                std::copy(found.values.begin() + (size_t)i * embedding_size,
+                          found.values.begin() + (size_t)(i + 1) * embedding_size,
+                          values + (size_t)found.indices[i] * embedding_size);
             }
-            if (threshold != -1 && ++words_read_so_far >= threshold) break;
+            words_matched_so_far += found.indices.size();
         }
         return words_matched_so_far;
     }
@@ -8,11 +8,18 @@
 #include "dali/utils/assert2.h"
 
 namespace glove {
+    // Loading a text file keeps a binary copy of the embeddings next
+    // to it (`fname + ".dali_cache"`), which later loads map instead
+    // of parsing the text again (as long as the text file keeps the
+    // same size and modification time). Defaults to true.
+    extern bool use_binary_cache;
+
     /**
     Loads a text file with Glove word vectors. Returns a tuple
     with a Matrix containing the embeddings (one row per word)
     and a Vocab object containing a mapping from index to word
-    and from word to index. Matrix is dynamically resized.
+    and from word to index. The file is memory mapped and parsed
+    in parallel, and reads at most threshold words (if not -1).
     **/
 
     template<typename T>
@@ -1,9 +1,11 @@
-
+#include <cstdio>
 #include <vector>
 #include <gtest/gtest.h>
 
 #include "dali/data_processing/Glove.h"
 #include "dali/data_processing/Arithmetic.h"
+#include "dali/data_processing/Batch.h"
+#include "dali/data_processing/BatchPipeline.h"
 #include "dali/data_processing/NER.h"
 #include "dali/data_processing/Paraphrase.h"
 #include "dali/data_processing/babi.h"
@@ -29,6 +31,87 @@ TEST(Glove, load) {
     ASSERT_EQ(relevant_mat.dims(0), std::get<0>(embedding).dims(0));
 
     ASSERT_TRUE(MatOps<double>::equals(relevant_mat,  std::get<0>(embedding)));
+
+    std::remove(STR(DALI_DATA_DIR) "/tests/glove_dummy_test_data.txt.dali_cache");
+}
+
+TEST(Glove, binary_cache) {
+    string fname = STR(DALI_DATA_DIR) "/tests/glove_dummy_test_data.txt";
+    std::remove((fname + ".dali_cache").c_str());
+
+    glove::use_binary_cache = false;
+    auto parsed = glove::load<double>(fname);
+    glove::use_binary_cache = true;
+    // the first load writes the cache, the second one reads it
+    auto written = glove::load<double>(fname);
+    auto cached  = glove::load<double>(fname);
+
+    ASSERT_EQ(std::get<1>(cached).index2word, std::get<1>(parsed).index2word);
+    ASSERT_TRUE(MatOps<double>::equals(std::get<0>(written), std::get<0>(parsed)));
+    ASSERT_TRUE(MatOps<double>::equals(std::get<0>(cached),  std::get<0>(parsed)));
+
+    // fewer words come from the same cache, with a zero row at the end
+    auto first_words = glove::load<double>(fname, 5);
+    ASSERT_EQ(std::get<1>(first_words).size(), 6);
+    ASSERT_EQ(std::get<0>(first_words).dims(0), 6);
+    for (int i = 0; i < 5; i++) {
+        ASSERT_EQ(std::get<1>(first_words).index2word[i], std::get<1>(parsed).index2word[i]);
+        ASSERT_TRUE(MatOps<double>::equals(std::get<0>(first_words)[i], std::get<0>(parsed)[i]));
+    }
+    ASSERT_EQ(std::get<0>(first_words)[5].w().sum(), 0.0);
+
+    Mat<double> relevant_mat;
+    ASSERT_EQ(glove::load_relevant_vectors(fname, &relevant_mat, std::get<1>(parsed), -1), 20);
+    relevant_mat[relevant_mat.dims(0) - 1].clear();
+    ASSERT_TRUE(MatOps<double>::equals(relevant_mat, std::get<0>(parsed)));
+
+    std::remove((fname + ".dali_cache").c_str());
+}
+
+TEST(Batch, length_bucketed_prefetch) {
+    std::mt19937 generator(1234);
+    std::geometric_distribution<int> extra_length(0.1);
+    vector<int> lengths(1000);
+    for (auto& length : lengths) length = 1 + extra_length(generator);
+
+    auto batches = batching::length_bucketed_batches(lengths, 32, 1, &generator);
+    vector<bool> seen(lengths.size(), false);
+    for (auto& batch : batches) {
+        ASSERT_LE(batch.size(), 32);
+        for (auto example : batch) {
+            ASSERT_FALSE(seen[example]);
+            seen[example] = true;
+        }
+    }
+    ASSERT_EQ(std::count(seen.begin(), seen.end(), true), lengths.size());
+    ASSERT_LT(batching::padding_fraction(lengths, batches), 0.05);
+
+    // batches hold each example's length at every one of its steps.
+    batching::Prefetcher<Batch<float>> prefetcher(batches,
+        [&lengths](const vector<int>& examples) {
+            int max_length = 0;
+            for (auto example : examples) max_length = std::max(max_length, lengths[example]);
+            Batch<float> batch(max_length, examples.size());
+            for (int i = 0; i < examples.size(); i++) {
+                batch.insert_example(vector<uint>(lengths[examples[i]], lengths[examples[i]]), i);
+                batch.code_lengths[i] = lengths[examples[i]];
+            }
+            return batch;
+        }, 3, 2);
+    Batch<float> batch;
+    int batch_idx = 0;
+    while (prefetcher.next(&batch)) {
+        auto& examples = batches[batch_idx++];
+        ASSERT_EQ(batch.size(), examples.size());
+        for (int i = 0; i < examples.size(); i++) {
+            ASSERT_EQ(batch.example_length(i), lengths[examples[i]]);
+            ASSERT_EQ(batch.data.w(0, i), lengths[examples[i]]);
+            if (lengths[examples[i]] < batch.max_length()) {
+                ASSERT_EQ(batch.data.w(lengths[examples[i]], i), 0);
+            }
+        }
+    }
+    ASSERT_EQ(batch_idx, batches.size());
 }
 
 // exposing internal functions from arithmetic for testing.
@@ -2,6 +2,7 @@
 #define BEAM_SEARCH_MAT_H
 
 #include <algorithm>
+#include <cmath>
 #include <functional>
 #include <vector>
 
@@ -26,43 +27,223 @@ namespace beam_search {
         }
     };
 
+    namespace internal {
+        template<typename REAL_t>
+        struct Hypothesis {
+            // sum of the candidate scores
+            REAL_t score;
+            // score after length normalization, used for ranking
+            REAL_t rank;
+            // last symbol in the backpointer arrays (-1 when empty)
+            int node;
+            int length;
+            bool finished;
+        };
+
+        template<typename REAL_t>
+        struct Candidate {
+            REAL_t rank;
+            REAL_t score;
+            // position in the beam of the hypothesis being extended
+            int hypothesis;
+            // symbol appended, -1 to carry a finished hypothesis over
+            int symbol;
+        };
+    }
+
+    // Batched beam search: all the live hypotheses are scored with one
+    // call to `candidate_scores`, which receives their states and returns
+    // a matrix with a row of scores (typically log probabilities) over
+    // the vocabulary for each one of them. The `beam_width` best
+    // extensions are then picked with a bounded heap over every row, and
+    // `make_choices(states, parents, symbols)` returns the states
+    // obtained by appending symbols[i] to the hypothesis in
+    // states[parents[i]].
+    //
+    // Hypotheses that emitted `end_symbol` stay in the beam and compete
+    // with the live ones on their (normalized) score. Hypotheses are
+    // ranked by score / length^length_normalization, so 0 ranks by raw
+    // score and 1 by average score per symbol.
+    //
+    // With `early_stopping` the search ends as soon as no live hypothesis
+    // can overtake the best finished one. This assumes scores are
+    // never positive (log probabilities); the best result is then the
+    // same as without early stopping, while the rest of the beam may be
+    // left partially decoded.
+    //
+    // Results are sorted from best to worst rank, solutions include
+    // the end symbol when they have it.
     template<typename REAL_t, typename state_t>
-    struct BeamSearchProposal {
-        typedef BeamSearchResult<REAL_t,state_t> result_t;
+    std::vector<BeamSearchResult<REAL_t,state_t>>
+    batched_beam_search(state_t initial_state,
+                        uint beam_width,
+                        std::function<Mat<REAL_t>(const std::vector<state_t>&)> candidate_scores,
+                        std::function<std::vector<state_t>(const std::vector<state_t>&,
+                                                           const std::vector<uint>&,
+                                                           const std::vector<uint>&)> make_choices,
+                        uint end_symbol,
+                        int max_solution_length,
+                        std::vector<uint> forbidden_symbols=std::vector<uint>(),
+                        REAL_t length_normalization=0.0,
+                        bool early_stopping=false) {
+        utils::assert2(beam_width > 0, "Beam width must be strictly positive.");
+        utils::assert2(length_normalization >= 0, "Length normalization must be non-negative.");
+        typedef internal::Hypothesis<REAL_t> hypothesis_t;
+        typedef internal::Candidate<REAL_t> candidate_t;
 
-        result_t prev_result;
-        REAL_t score;
-        uint candidate_idx;
-        bool finalized;
-
-        BeamSearchProposal() {}
-
-        BeamSearchProposal(result_t _prev_result,
-                         REAL_t _score,
-                         uint _candidate_idx,
-                         bool _finalized) :
-                prev_result(_prev_result),
-                score(_score),
-                candidate_idx(_candidate_idx),
-                finalized(_finalized) {
-        }
+        auto normalizer = [length_normalization](int length) -> REAL_t {
+            if (length_normalization == 0 || length == 0) return 1.0;
+            return std::pow((REAL_t)length, length_normalization);
+        };
+        // heap comparator: the worst candidate sits at the front. Ties go
+        // to hypotheses higher up in the beam, then to larger symbols.
+        auto better = [](const candidate_t& a, const candidate_t& b) {
+            if (a.rank != b.rank) return a.rank > b.rank;
+            if (a.hypothesis != b.hypothesis) return a.hypothesis < b.hypothesis;
+            return a.symbol > b.symbol;
+        };
 
-        static BeamSearchProposal finalized_solution(result_t _result) {
-            return BeamSearchProposal<REAL_t,state_t>(
-                    _result, _result.score, 0, true);
-        }
+        // backpointer arrays shared by every hypothesis ever proposed.
+        std::vector<int>  parents;
+        std::vector<uint> symbols;
+        parents.reserve(beam_width * std::max(max_solution_length, 1));
+        symbols.reserve(beam_width * std::max(max_solution_length, 1));
 
-        static BeamSearchProposal solution_candidate(result_t _prev_result,
-                                                     REAL_t _updated_score,
-                                                     uint _candidate_idx) {
-            return BeamSearchProposal<REAL_t,state_t>(
-                    _prev_result, _updated_score, _candidate_idx, false);
-        }
+        std::vector<hypothesis_t> beam = {hypothesis_t{0, 0, -1, 0, false}};
+        std::vector<state_t> states = {initial_state};
 
+        // buffers reused at every step
+        std::vector<hypothesis_t> next_beam;
+        std::vector<state_t> next_states;
+        std::vector<state_t> live_states;
+        std::vector<int> live_position;
+        std::vector<candidate_t> heap;
+        std::vector<uint> choice_parents;
+        std::vector<uint> choice_symbols;
+        std::vector<bool> forbidden;
+        heap.reserve(beam_width + 1);
 
-    };
+        const REAL_t final_normalizer = normalizer(max_solution_length);
+
+        for (int step = 0; step < max_solution_length; ++step) {
+            int num_live = 0;
+            REAL_t best_finished = -INFINITY;
+            REAL_t best_live     = -INFINITY;
+            for (auto& hypothesis : beam) {
+                if (hypothesis.finished) {
+                    best_finished = std::max(best_finished, hypothesis.rank);
+                } else {
+                    num_live++;
+                    // scores only go down from here.
+                    best_live = std::max(best_live, hypothesis.score / final_normalizer);
+                }
+            }
+            if (num_live == 0)
+                break;
+            if (early_stopping && best_finished >= best_live)
+                break;
+
+            live_states.clear();
+            live_position.assign(beam.size(), -1);
+            for (int i = 0; i < beam.size(); ++i) {
+                if (!beam[i].finished) {
+                    live_position[i] = live_states.size();
+                    live_states.emplace_back(std::move(states[i]));
+                }
+            }
+
+            auto scores = candidate_scores(live_states);
+            utils::assert2(scores.dims(0) == live_states.size(),
+                    "candidate_scores must return one row per hypothesis.");
+            const int vocab_size = scores.dims(1);
+            if (forbidden.size() != vocab_size) {
+                forbidden.assign(vocab_size, false);
+                for (auto symbol : forbidden_symbols)
+                    if (symbol < vocab_size) forbidden[symbol] = true;
+            }
+
+            heap.clear();
+            auto offer = [&](const candidate_t& candidate) {
+                heap.push_back(candidate);
+                std::push_heap(heap.begin(), heap.end(), better);
+                if (heap.size() > beam_width) {
+                    std::pop_heap(heap.begin(), heap.end(), better);
+                    heap.pop_back();
+                }
+            };
+            for (int i = 0; i < beam.size(); ++i) {
+                if (beam[i].finished)
+                    offer(candidate_t{beam[i].rank, beam[i].score, i, -1});
+            }
+            // every live hypothesis has the same length.
+            const REAL_t step_normalizer = normalizer(step + 1);
+            const auto data = scores.w().cpu_data();
+            for (int i = 0; i < beam.size(); ++i) {
+                if (beam[i].finished) continue;
+                const REAL_t* row = data.dptr_ + live_position[i] * data.stride_;
+                const REAL_t base = beam[i].score;
+                for (int symbol = 0; symbol < vocab_size; ++symbol) {
+                    REAL_t score = base + row[symbol];
+                    candidate_t candidate{score / step_normalizer, score, i, symbol};
+                    if (heap.size() == beam_width && !better(candidate, heap.front()))
+                        continue;
+                    if (forbidden[symbol])
+                        continue;
+                    offer(candidate);
+                }
+            }
+            // best first
+            std::sort_heap(heap.begin(), heap.end(), better);
+
+            next_beam.clear();
+            choice_parents.clear();
+            choice_symbols.clear();
+            for (auto& candidate : heap) {
+                auto& hypothesis = beam[candidate.hypothesis];
+                if (candidate.symbol < 0) {
+                    next_beam.emplace_back(hypothesis);
+                    continue;
+                }
+                parents.emplace_back(hypothesis.node);
+                symbols.emplace_back(candidate.symbol);
+                next_beam.emplace_back(hypothesis_t{
+                    candidate.score,
+                    candidate.rank,
+                    (int)parents.size() - 1,
+                    hypothesis.length + 1,
+                    (uint)candidate.symbol == end_symbol
+                });
+                choice_parents.emplace_back(live_position[candidate.hypothesis]);
+                choice_symbols.emplace_back(candidate.symbol);
+            }
+            auto new_states = make_choices(live_states, choice_parents, choice_symbols);
+            utils::assert2(new_states.size() == choice_symbols.size(),
+                    "make_choices must return one state per choice.");
+            next_states.clear();
+            int extended = 0;
+            for (auto& candidate : heap) {
+                next_states.emplace_back(std::move(candidate.symbol < 0 ?
+                        states[candidate.hypothesis] :
+                        new_states[extended++]));
+            }
+            std::swap(beam, next_beam);
+            std::swap(states, next_states);
+        }
+
+        std::vector<BeamSearchResult<REAL_t,state_t>> results;
+        results.reserve(beam.size());
+        for (int i = 0; i < beam.size(); ++i) {
+            std::vector<uint> solution(beam[i].length);
+            for (int node = beam[i].node, pos = beam[i].length - 1; node >= 0; node = parents[node]) {
+                solution[pos--] = symbols[node];
+            }
+            results.emplace_back(std::move(states[i]), std::move(solution), beam[i].score);
+        }
+        return results;
+    }
 
     // attempts to find maximum sum of scores candidate.
+    // (one hypothesis at a time version of `batched_beam_search`)
     template<typename REAL_t, typename state_t>
     std::vector<BeamSearchResult<REAL_t,state_t>>
     beam_search(state_t initial_state,
@@ -72,54 +253,32 @@ namespace beam_search {
                 uint end_symbol,
                 int max_solution_length,
                 std::vector<uint> forbidden_symbols=std::vector<uint>()) {
-        utils::assert2(beam_width > 0, "Beam width must be strictly positive.");
-        typedef BeamSearchResult<REAL_t, state_t> result_t;
-        typedef BeamSearchProposal<REAL_t, state_t> proposal_t;
-
-        std::vector<result_t> results = {
-            result_t(initial_state, std::vector<uint>(), (REAL_t)0.0)
-        };
-
-        while (max_solution_length--) {
-            std::vector<proposal_t> proposals;
-            for (auto& result: results) {
-                if (result.solution.size() > 0 && result.solution.back() == end_symbol) {
-                    proposals.push_back(proposal_t::finalized_solution(result));
-                } else {
-                    auto scores = candidate_scores(result.state);
-                    auto sorted_candidates = scores.argsort();
-                    std::reverse(sorted_candidates.begin(), sorted_candidates.end());
-                    auto candidates_remaining = beam_width;
-                    for(auto& candidate_idx: sorted_candidates) {
-                        if (utils::in_vector(forbidden_symbols, (uint)candidate_idx))
-                            continue;
-                        if (candidates_remaining-- <= 0)
-                            break;
-                        auto candidate_score = scores.w(candidate_idx);
-                        proposals.push_back(proposal_t::solution_candidate(
-                                result, result.score + candidate_score, candidate_idx));
-                    }
+        return batched_beam_search<REAL_t, state_t>(
+            initial_state,
+            beam_width,
+            [&candidate_scores](const std::vector<state_t>& states) {
+                Mat<REAL_t> scores;
+                for (int i = 0; i < states.size(); ++i) {
+                    auto row = candidate_scores(states[i]);
+                    if (i == 0)
+                        scores = Mat<REAL_t>(states.size(), row.number_of_elements());
+                    for (int j = 0; j < row.number_of_elements(); ++j)
+                        scores.w(i, j) = row.w(j);
                 }
-            }
-            // proposals due
-            sort(proposals.begin(), proposals.end(), [](proposal_t a, proposal_t b) {
-                return a.score > b.score;
-            });
-            proposals.resize(std::min((size_t)beam_width, proposals.size()));
-
-            results = std::vector<result_t>();
-            for(auto& proposal : proposals) {
-                if (proposal.finalized) {
-                    results.push_back(proposal.prev_result);
-                } else {
-                    auto new_state = make_choice(proposal.prev_result.state, proposal.candidate_idx);
-                    auto new_solution = proposal.prev_result.solution;
-                    new_solution.emplace_back(proposal.candidate_idx);
-                    results.emplace_back(new_state, new_solution, proposal.score);
-                }
-            }
-        }
-        return results;
+                return scores;
+            },
+            [&make_choice](const std::vector<state_t>& states,
+                           const std::vector<uint>& parents,
+                           const std::vector<uint>& symbols) {
+                std::vector<state_t> new_states;
+                new_states.reserve(symbols.size());
+                for (int i = 0; i < symbols.size(); ++i)
+                    new_states.emplace_back(make_choice(states[parents[i]], symbols[i]));
+                return new_states;
+            },
+            end_symbol,
+            max_solution_length,
+            forbidden_symbols);
     }
 }
 
@@ -0,0 +1,215 @@
+#ifndef DALI_EXECUTION_DATA_PARALLEL_TRAINER_H
+#define DALI_EXECUTION_DATA_PARALLEL_TRAINER_H
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "dali/tensor/Mat.h"
+#include "dali/tensor/MatOps.h"
+#include "dali/tensor/Solver.h"
+#include "dali/tensor/Tape.h"
+#include "dali/utils/ThreadPool.h"
+#include "dali/utils/assert2.h"
+
+/*
+Data Parallel Trainer
+---------------------
+
+Synchronous data parallel training: every minibatch is cut into one
+contiguous shard per thread, and each shard goes through forward and
+backward on its own replica of the model (a `shallow_copy`, so the
+weights are shared and the gradients are not) with the tape of the
+thread it runs on. The replicas' gradients are then summed into the
+model's own gradients by a chunked parallel reduction, and a single
+solver step updates the shared weights. Unlike Hogwild there are no
+concurrent writes to the weights, so results do not depend on the
+interleaving of the threads (only on floating point summation order).
+
+The model must provide `parameters()` and `shallow_copy()` (like the
+layers in `dali/layers`), and the loss returns the (1x1) error of the
+model on one example:
+
+    DataParallelTrainer<R, StackedLSTM<R>, example_t> trainer(
+        model, solver,
+        [](StackedLSTM<R>& model, const example_t& example) {
+            return ...;
+        });
+    for (auto& minibatch : minibatches)
+        error += trainer.step(minibatch);
+
+The tape of the calling thread must be empty when calling `step`,
+since it may run shards too.
+*/
+
+namespace data_parallel {
+    // gradient values summed by one reduction task.
+    const int REDUCE_GRAIN = 1 << 15;
+
+    // Adds the gradients of every replica's parameters to the matching
+    // parameter of `master` and clears them. Dense CPU gradients are
+    // cut in chunks of REDUCE_GRAIN values summed in parallel on
+    // `pool` (the calling thread alone when NULL), each chunk reading
+    // every replica once. Sparse gradients only add their rows, and GPU
+    // gradients are summed on the device.
+    template<typename R>
+    void reduce_gradients(std::vector<Mat<R>>& master,
+                          std::vector<std::vector<Mat<R>>>& replicas,
+                          ThreadPool* pool) {
+        struct chunk_t {
+            int param;
+            int begin;
+            int end;
+        };
+        std::vector<R*> totals(master.size(), NULL);
+        std::vector<std::vector<R*>> parts(master.size());
+        std::vector<chunk_t> chunks;
+
+        for (int p = 0; p < master.size(); p++) {
+            auto& param = master[p];
+            for (auto& replica : replicas) {
+                ASSERT2(replica.size() == master.size(),
+                        "Error: replicas must have as many parameters as the model.");
+                auto& copy = replica[p];
+                if (!copy.has_grad()) continue;
+                // (`dw_rows` does not make a sparse gradient dense)
+                auto& part = copy.dw_rows(NULL, 0);
+                auto rows = copy.grad_rows();
+                if (part.compute_me_on_gpu() || param.w().compute_me_on_gpu()) {
+                    MatOps<R>::add_grad(&param, copy);
+                    copy.clear_grad();
+                } else if (rows != NULL) {
+                    if (!rows->empty()) {
+                        auto total  = param.dw_rows(rows->data(), rows->size()).mutable_cpu_data();
+                        auto values = part.cpu_data();
+                        for (auto row : *rows) {
+                            R* total_row = total.dptr_ + row * total.stride_;
+                            const R* values_row = values.dptr_ + row * values.stride_;
+                            for (int j = 0; j < total.size(1); j++) {
+                                total_row[j] += values_row[j];
+                            }
+                        }
+                    }
+                    copy.clear_grad();
+                } else {
+                    parts[p].emplace_back(part.mutable_cpu_data().dptr_);
+                }
+            }
+            if (parts[p].empty()) continue;
+            totals[p] = param.dw().mutable_cpu_data().dptr_;
+            int size = param.number_of_elements();
+            for (int begin = 0; begin < size; begin += REDUCE_GRAIN) {
+                chunks.push_back({p, begin, std::min(size, begin + REDUCE_GRAIN)});
+            }
+        }
+
+        auto reduce_chunk = [&](int c) {
+            const auto& chunk = chunks[c];
+            R* total = totals[chunk.param];
+            for (R* part : parts[chunk.param]) {
+                for (int i = chunk.begin; i < chunk.end; i++) {
+                    total[i] += part[i];
+                    part[i] = 0;
+                }
+            }
+        };
+        if (pool == NULL || chunks.size() <= 1) {
+            for (int c = 0; c < chunks.size(); c++) reduce_chunk(c);
+        } else {
+            pool->parallel_for(0, chunks.size(), reduce_chunk, 1);
+        }
+    }
+}
+
+template<typename R, typename model_t, typename example_t>
+class DataParallelTrainer {
+    public:
+        // error of the model on one example, as a 1x1 Mat.
+        typedef std::function<Mat<R>(model_t&, const example_t&)> loss_t;
+    private:
+        model_t& model;
+        // replicas of the model for every thread but the first one,
+        // which trains `model` directly.
+        std::vector<model_t> replicas;
+        std::vector<Mat<R>> parameters;
+        std::vector<std::vector<Mat<R>>> replica_parameters;
+        std::shared_ptr<Solver::AbstractSolver<R>> solver;
+        loss_t loss;
+        // the calling thread works too.
+        std::unique_ptr<ThreadPool> pool;
+
+        model_t& replica(int shard) {
+            return shard == 0 ? model : replicas[shard - 1];
+        }
+    public:
+        // `num_threads` <= 0 uses every core.
+        DataParallelTrainer(model_t& _model,
+                            std::shared_ptr<Solver::AbstractSolver<R>> _solver,
+                            loss_t _loss,
+                            int num_threads = 0) :
+                model(_model),
+                solver(_solver),
+                loss(_loss) {
+            if (num_threads <= 0) {
+                num_threads = std::max(1, (int)std::thread::hardware_concurrency());
+            }
+            // parameters are collected with backprop on, so that the model
+            // and this list share their gradients.
+            parameters = model.parameters();
+            for (int i = 1; i < num_threads; i++) {
+                replicas.emplace_back(model.shallow_copy());
+            }
+            for (auto& copy : replicas) {
+                replica_parameters.emplace_back(copy.parameters());
+                ASSERT2(replica_parameters.back().size() == parameters.size(),
+                        "Error: shallow copies of the model have different parameters.");
+                // the copy starts from the model's gradient.
+                for (auto& param : replica_parameters.back()) param.clear_grad();
+            }
+            if (num_threads > 1) {
+                pool.reset(new ThreadPool(num_threads - 1));
+            }
+        }
+
+        int num_threads() const {
+            return replicas.size() + 1;
+        }
+
+        const std::vector<Mat<R>>& model_parameters() const {
+            return parameters;
+        }
+
+        // Computes the gradients of the minibatch in parallel, sums them
+        // and takes one solver step. Returns the total error.
+        R step(const std::vector<example_t>& minibatch) {
+            if (minibatch.empty()) return 0.0;
+            int num_shards = std::min((int)minibatch.size(), num_threads());
+            std::vector<R> errors(num_shards, 0.0);
+            auto run_shard = [&](int shard) {
+                auto& shard_model = replica(shard);
+                int begin = (long)minibatch.size() * shard / num_shards;
+                int end   = (long)minibatch.size() * (shard + 1) / num_shards;
+                for (int i = begin; i < end; i++) {
+                    auto error = loss(shard_model, minibatch[i]);
+                    error.grad();
+                    errors[shard] += error.w(0);
+                    graph::backward();
+                }
+            };
+            if (pool == nullptr || num_shards <= 1) {
+                for (int shard = 0; shard < num_shards; shard++) run_shard(shard);
+            } else {
+                pool->parallel_for(0, num_shards, run_shard, 1);
+            }
+            data_parallel::reduce_gradients(parameters, replica_parameters, pool.get());
+            solver->step(parameters);
+
+            R total = 0.0;
+            for (auto error : errors) total += error;
+            return total;
+        }
+};
+
+#endif
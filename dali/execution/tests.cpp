@@ -4,7 +4,9 @@
 
 #include "dali/tensor/Mat.h"
 #include "dali/tensor/MatOps.h"
+#include "dali/layers/Layers.h"
 #include "dali/execution/BeamSearch.h"
+#include "dali/execution/DataParallelTrainer.h"
 #include "dali/execution/SequenceProbability.h"
 
 using std::make_tuple;
@@ -214,6 +216,80 @@ TEST(beam_search, beam_search_score_test) {
     ));
 }
 
+TEST(beam_search, batched_beam_search_automata) {
+    typedef float REAL_t;
+    int max_size = 20;
+    int beam_width = 7;
+    vector<int> batch_sizes;
+
+    auto prob_next_states = [&batch_sizes](const vector<state_t>& states) -> Mat<REAL_t> {
+        batch_sizes.emplace_back(states.size());
+        Mat<REAL_t> scores(states.size(), 3);
+        for (int i = 0; i < states.size(); i++) {
+            auto probs = states[i].predict().log();
+            for (int to = 0; to < 3; to++) {
+                scores.w(i, to) = probs.w(to);
+            }
+        }
+        return scores;
+    };
+    auto make_choices = [](const vector<state_t>& states,
+                           const vector<uint>& parents,
+                           const vector<uint>& candidates) -> vector<state_t> {
+        vector<state_t> new_states;
+        for (auto candidate : candidates) {
+            new_states.emplace_back((int)candidate);
+        }
+        return new_states;
+    };
+    auto search = [&](REAL_t length_normalization, bool early_stopping) {
+        batch_sizes.clear();
+        return beam_search::batched_beam_search<REAL_t, state_t>(
+                state_t(0),
+                beam_width,
+                prob_next_states,
+                make_choices,
+                2,
+                max_size,
+                vector<uint>(),
+                length_normalization,
+                early_stopping);
+    };
+
+    // same results as one hypothesis at a time, with one call per step
+    auto results = search(0.0, false);
+    auto expected = beam_search::beam_search<REAL_t, state_t>(
+            state_t(0),
+            beam_width,
+            [](state_t state) { return state.predict().log(); },
+            [](state_t state, uint candidate) { return state_t((int)candidate); },
+            2,
+            max_size);
+    ASSERT_EQ(results.size(), expected.size());
+    for (int i = 0; i < results.size(); i++) {
+        ASSERT_EQ(results[i].solution, expected[i].solution);
+        ASSERT_NEAR(results[i].score, expected[i].score, 1e-5);
+    }
+    ASSERT_EQ(batch_sizes.size(), max_size);
+    for (auto batch_size : batch_sizes) {
+        ASSERT_LE(batch_size, beam_width);
+    }
+
+    // log(0.2) for "2" is out of reach for anything live after 3 steps
+    results = search(0.0, true);
+    ASSERT_EQ(batch_sizes.size(), 3);
+    ASSERT_EQ(results[0].solution, vector<uint>{2});
+    ASSERT_NEAR(std::exp(results[0].score), 0.2, 1e-6);
+
+    // ranked by score per symbol, long sequences of 0.5 transitions win
+    results = search(1.0, false);
+    ASSERT_EQ(results[0].solution, vector<uint>(max_size, 0));
+    for (int i = 0; i + 1 < results.size(); i++) {
+        ASSERT_GE(results[i].score / results[i].solution.size(),
+                  results[i + 1].score / results[i + 1].solution.size());
+    }
+}
+
 
 TEST(sequence_probability, score) {
     Batch<R> batch;
@@ -266,3 +342,44 @@ TEST(sequence_probability, score) {
 
     ASSERT_EQ(scores.w(0), expected_prob);
 }
+
+TEST(DataParallelTrainer, matches_sequential_training) {
+    // the summed gradients of the shards must give the same step as
+    // going through the minibatch on one thread.
+    typedef std::pair<Mat<R>, uint> example_t;
+    Layer<R> model(6, 4);
+    Layer<R> reference(model, true, true);
+    auto loss = [](Layer<R>& layer, const example_t& example) {
+        return MatOps<R>::softmax_cross_entropy_rowwise(
+                layer.activate(example.first), example.second).sum();
+    };
+    vector<example_t> minibatch;
+    for (int i = 0; i < 11; i++) {
+        minibatch.emplace_back(Mat<R>(1, 6, weights<R>::uniform(2.0)), i % 4);
+    }
+
+    auto params = model.parameters();
+    auto reference_params = reference.parameters();
+    DataParallelTrainer<R, Layer<R>, example_t> trainer(
+            model, std::make_shared<Solver::SGD<R>>(params, 0.0), loss, 4);
+    Solver::SGD<R> reference_solver(reference_params, 0.0);
+    ASSERT_EQ(trainer.num_threads(), 4);
+
+    for (int iter = 0; iter < 3; iter++) {
+        R error = trainer.step(minibatch);
+        R reference_error = 0.0;
+        for (auto& example : minibatch) {
+            auto example_error = loss(reference, example);
+            example_error.grad();
+            reference_error += example_error.w(0);
+            graph::backward();
+        }
+        reference_solver.step(reference_params);
+
+        ASSERT_NEAR(error, reference_error, 1e-4);
+        for (int i = 0; i < params.size(); i++) {
+            ASSERT_TRUE(MatOps<R>::allclose(params[i], reference_params[i], 1e-5));
+            ASSERT_EQ(params[i].dw().sum(), 0.0);
+        }
+    }
+}
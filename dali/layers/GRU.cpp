@@ -55,10 +55,59 @@ Mat<R> GRU<R>::activate_sequence(const vector<Mat<R>>& input_sequence) const {
     return activate_sequence(input_sequence, initial_states());
 }
 
+template<typename R>
+Mat<R> GRU<R>::activate_projected(
+        Mat<R> reset_input,
+        Mat<R> update_input,
+        Mat<R> candidate_input,
+        Mat<R> previous_state) const {
+
+    auto reset_gate = (reset_input + previous_state.dot(reset_layer.matrices[1])).sigmoid();
+
+    // the new state dampened by resetting
+    auto reset_state = reset_gate * previous_state;
+
+    // the new hidden state:
+    auto candidate_new_state = (candidate_input + reset_state.dot(memory_to_memory_layer.matrices[1])).tanh();
+
+    // how much to update the new hidden state:
+    auto update_gate = (update_input + previous_state.dot(memory_interpolation_layer.matrices[1])).sigmoid();
+
+    // the new state interploated between candidate and old:
+    auto new_state = (
+        previous_state      * (1.0 - update_gate) +
+        candidate_new_state * update_gate
+    );
+    return new_state;
+}
+
 template<typename R>
 Mat<R> GRU<R>::activate_sequence(const vector<Mat<R>>& input_sequence, Mat<R> state) const {
+    bool batched = input_sequence.size() > 1;
+    int num_examples = batched ? input_sequence[0].dims(0) : 0;
     for (auto& input: input_sequence) {
-        state = activate(input, state);
+        batched = batched && input.dims(0) == num_examples;
+    }
+    if (!batched) {
+        for (auto& input: input_sequence) {
+            state = activate(input, state);
+        }
+        return state;
+    }
+
+    auto inputs = MatOps<R>::vstack(input_sequence);
+    auto reset_inputs     = MatOps<R>::mul_with_bias(reset_layer.matrices[0], inputs, reset_layer.b);
+    auto update_inputs    = MatOps<R>::mul_with_bias(memory_interpolation_layer.matrices[0], inputs, memory_interpolation_layer.b);
+    auto candidate_inputs = MatOps<R>::mul_with_bias(memory_to_memory_layer.matrices[0], inputs, memory_to_memory_layer.b);
+
+    for (int t = 0; t < input_sequence.size(); ++t) {
+        int start = t * num_examples, end = (t + 1) * num_examples;
+        state = activate_projected(
+            MatOps<R>::slice(reset_inputs,     start, end),
+            MatOps<R>::slice(update_inputs,    start, end),
+            MatOps<R>::slice(candidate_inputs, start, end),
+            state
+        );
     }
     return state;
 }
@@ -28,8 +28,18 @@ class GRU {
 
         Mat<R> activate_sequence(const std::vector<Mat<R>>& input_sequence) const;
 
+        // The input projections of the whole sequence are computed
+        // ahead of the loop, one large matrix product per gate.
         Mat<R> activate_sequence(const std::vector<Mat<R>>& input_sequence, Mat<R> initial_state) const;
 
+        // Step where the products of the input with reset, update and
+        // candidate weights (and the biases) are already computed.
+        Mat<R> activate_projected(
+            Mat<R> reset_input,
+            Mat<R> update_input,
+            Mat<R> candidate_input,
+            Mat<R> previous_state) const;
+
         std::vector<Mat<R>> parameters() const;
 
         Mat<R> initial_states() const;
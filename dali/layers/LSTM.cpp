@@ -5,6 +5,20 @@ using utils::assert2;
 using std::string;
 using std::make_shared;
 
+#ifdef DALI_USE_CUDA
+namespace {
+    // `MatOps<R>::lstm_cell` works on CPU memory, the GPU keeps going
+    // through one op per gate.
+    template<typename R>
+    bool on_cpu(const vector<Mat<R>>& mats) {
+        for (auto& mat : mats) {
+            if (mat.w().compute_me_on_gpu()) return false;
+        }
+        return true;
+    }
+}
+#endif
+
 ///////////////////////////// LSTM STATE /////////////////////////////////////////////
 
 template<typename R>
@@ -117,6 +131,16 @@ LSTM<R> LSTM<R>::shallow_copy() const {
     return LSTM<R>(*this, false, true);
 }
 
+template<typename R>
+void LSTM<R>::quantize() {
+    input_layer.quantize();
+    for (auto& forget_layer : forget_layers) {
+        forget_layer.quantize();
+    }
+    output_layer.quantize();
+    cell_layer.quantize();
+}
+
 template<typename R>
 void LSTM<R>::name_internal_layers() {
     int i = 0;
@@ -182,6 +206,37 @@ typename LSTM<R>::activation_t LSTM<R>::activate(
     }
     auto gate_input = utils::concatenate({inputs, activation_t::hiddens(states)});
 
+    bool fused = !memory_feeds_gates;
+    #ifdef DALI_USE_CUDA
+        fused = fused && on_cpu(gate_input) && on_cpu(activation_t::memories(states)) && on_cpu(parameters());
+    #endif
+    if (fused) {
+        // (Zaremba 2014 style)
+        // all the gates come out of a single product,
+        // followed by one pass for nonlinearities and cell update.
+        vector<vector<Mat<R>>> gate_weights;
+        vector<Mat<R>> gate_biases;
+        gate_weights.emplace_back(input_layer.matrices);
+        gate_biases.emplace_back(input_layer.b);
+        for (auto& forget_layer : forget_layers) {
+            gate_weights.emplace_back(forget_layer.matrices);
+            gate_biases.emplace_back(forget_layer.b);
+        }
+        gate_weights.emplace_back(output_layer.matrices);
+        gate_biases.emplace_back(output_layer.b);
+        gate_weights.emplace_back(cell_layer.matrices);
+        gate_biases.emplace_back(cell_layer.b);
+
+        auto cell = MatOps<R>::lstm_cell(
+            gate_input,
+            activation_t::memories(states),
+            gate_weights,
+            gate_biases,
+            packed_weights
+        );
+        return activation_t(std::get<0>(cell), std::get<1>(cell));
+    }
+
     if (memory_feeds_gates) {
         input_gate  = input_layer.activate(gate_input);
         // if the memory feeds the gates (Alex Graves 2013) then
@@ -198,8 +253,6 @@ typename LSTM<R>::activation_t LSTM<R>::activate(
         }
         input_gate  = input_gate.sigmoid();
     } else {
-        // (Zaremba 2014 style)
-
         // input gate:
         input_gate  = input_layer.activate(gate_input).sigmoid();
         // forget gate
@@ -272,14 +325,91 @@ template<typename R>
 typename LSTM<R>::activation_t LSTM<R>::activate_sequence(
         activation_t state,
         const vector<Mat<R>>& sequence) const {
+    if (sequence.empty())
+        return state;
+    vector<vector<Mat<R>>> step_inputs;
+    step_inputs.reserve(sequence.size());
     for (auto& input_vector : sequence)
-        state = activate(
-            input_vector,
-            vector<activation_t>({state})
-        );
-    return state;
+        step_inputs.emplace_back(vector<Mat<R>>({input_vector}));
+    return activate_sequence_states(state, step_inputs).back();
 };
 
+template<typename R>
+vector<typename LSTM<R>::activation_t> LSTM<R>::activate_sequence_states(
+        activation_t state,
+        const vector<vector<Mat<R>>>& sequence) const {
+    vector<activation_t> states;
+    states.reserve(sequence.size());
+
+    bool batched = !memory_feeds_gates && num_children == 1 && sequence.size() > 1;
+    #ifdef DALI_USE_CUDA
+        batched = batched && on_cpu(parameters()) && on_cpu(vector<Mat<R>>({state.memory, state.hidden}));
+    #endif
+    int num_examples = batched ? sequence[0][0].dims(0) : 0;
+    for (auto& inputs : sequence) {
+        assert2(inputs.size() == input_sizes.size(),
+            utils::MS() << "LSTM: Got " << inputs.size() << " inputs but expected " << input_sizes.size() << " instead."
+        );
+        for (auto& input : inputs) {
+            batched = batched && input.dims(0) == num_examples;
+        }
+    }
+    if (!batched) {
+        for (auto& inputs : sequence) {
+            state = activate(inputs, vector<activation_t>({state}));
+            states.emplace_back(state);
+        }
+        return states;
+    }
+
+    // gates are laid out as in MatOps<R>::lstm_cell:
+    const vector<const layer_type*> gate_layers = {
+        &input_layer, &forget_layers[0], &output_layer, &cell_layer
+    };
+    // input projections for every step and gate at once:
+    vector<Mat<R>> input_weights;
+    vector<Mat<R>> stacked_inputs;
+    vector<Mat<R>> gate_biases;
+    for (int iidx = 0; iidx < input_sizes.size(); ++iidx) {
+        vector<Mat<R>> gate_weights;
+        for (auto layer : gate_layers) {
+            gate_weights.emplace_back(layer->matrices[iidx]);
+        }
+        input_weights.emplace_back(MatOps<R>::hstack(gate_weights));
+        vector<Mat<R>> steps;
+        for (auto& inputs : sequence) {
+            steps.emplace_back(inputs[iidx]);
+        }
+        stacked_inputs.emplace_back(MatOps<R>::vstack(steps));
+    }
+    for (auto layer : gate_layers) {
+        gate_biases.emplace_back(layer->b);
+    }
+    auto projections = MatOps<R>::mul_add_mul_with_bias(
+        input_weights,
+        stacked_inputs,
+        MatOps<R>::hstack(gate_biases)
+    );
+
+    // what remains for each step is the product with the hidden state:
+    vector<vector<Mat<R>>> recurrent_weights;
+    for (auto layer : gate_layers) {
+        recurrent_weights.emplace_back(vector<Mat<R>>({layer->matrices.back()}));
+    }
+    for (int t = 0; t < sequence.size(); ++t) {
+        auto cell = MatOps<R>::lstm_cell(
+            {state.hidden},
+            {state.memory},
+            recurrent_weights,
+            MatOps<R>::slice(projections, t * num_examples, (t + 1) * num_examples),
+            packed_recurrent_weights
+        );
+        state = activation_t(std::get<0>(cell), std::get<1>(cell));
+        states.emplace_back(state);
+    }
+    return states;
+}
+
 template<typename R>
 std::vector<Mat<R>> LSTM<R>::parameters() const {
     std::vector<Mat<R>> parameters;
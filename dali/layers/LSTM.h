@@ -59,6 +59,14 @@ class LSTM : public AbstractLayer<R> {
         // gradient by setting this to true:
         bool backprop_through_gates = false;
 
+        // gate weights packed by `MatOps<R>::lstm_cell`, reused until
+        // the weights change: all of them for `activate`, only the
+        // recurrent ones for `activate_sequence_states`.
+        std::shared_ptr<matops::PackedGateWeights<R>> packed_weights =
+                std::make_shared<matops::PackedGateWeights<R>>();
+        std::shared_ptr<matops::PackedGateWeights<R>> packed_recurrent_weights =
+                std::make_shared<matops::PackedGateWeights<R>>();
+
         LSTM() = default;
 
         // This is a regular vanilla, but awesome LSTM constructor.
@@ -92,11 +100,28 @@ class LSTM : public AbstractLayer<R> {
 
         LSTM<R> shallow_copy() const;
 
+        // int8 copies of the gate weights for inference (see
+        // dali/tensor/Quantization.h), the diagonal memory
+        // connections stay in float.
+        void quantize();
+
         activation_t initial_states() const;
 
         virtual activation_t activate_sequence(
             activation_t initial_state,
             const std::vector<Mat<R>>& sequence) const;
+
+        // Runs over a whole sequence, where `sequence[t]` holds the
+        // inputs at step t (as in `activate(inputs, states)`), and
+        // returns the state after every step. Since every input is
+        // known up front, their projections onto the gates are computed
+        // for the whole sequence by one large matrix product, leaving
+        // only the recurrent product inside the loop. (Falls back to
+        // step by step activation when memory feeds the gates, with
+        // several children, or if the batch size changes over time).
+        std::vector<activation_t> activate_sequence_states(
+            activation_t initial_state,
+            const std::vector<std::vector<Mat<R>>>& sequence) const;
 };
 
 template<typename R>
@@ -114,6 +139,30 @@ class AbstractStackedLSTM : public AbstractLayer<R> {
             state_t initial_state,
             const std::vector<Mat<R>>& sequence,
             R drop_prob = 0.0) const;
+        /*
+        Gradient checkpointing version of activate_sequence.
+
+        The sequence is cut into segments of `segment_length` steps
+        (sqrt of the sequence length by default) and only the states
+        at segment boundaries stay alive until backpropagation, when
+        each segment is run forward again to recover its activations.
+        Activation memory drops from O(T) to O(sqrt(T)) for the price
+        of one extra forward pass.
+
+        The top layer's hidden state at every step is appended to
+        `hiddens`. Dropout is not supported (the replayed forward pass
+        must match the original one) and the model must outlive the
+        call to graph::backward.
+        */
+        virtual state_t activate_sequence_checkpointed(
+            state_t initial_state,
+            const std::vector<Mat<R>>& sequence,
+            std::vector<Mat<R>>& hiddens,
+            int segment_length = 0) const;
+        virtual state_t activate_sequence_checkpointed(
+            state_t initial_state,
+            const std::vector<Mat<R>>& sequence,
+            int segment_length = 0) const;
 };
 
 template<typename R>
@@ -135,6 +184,13 @@ class StackedLSTM : public AbstractStackedLSTM<R> {
             state_t previous_state,
             const std::vector<Mat<R>>& inputs,
             R drop_prob = 0.0) const;
+        // goes through the sequence one layer at a time, so that each
+        // layer can project its whole input sequence at once
+        // (see LSTM::activate_sequence_states).
+        virtual state_t activate_sequence(
+            state_t initial_state,
+            const std::vector<Mat<R>>& sequence,
+            R drop_prob = 0.0) const;
         virtual std::vector<Mat<R>> parameters() const;
         StackedLSTM();
         StackedLSTM(
@@ -149,6 +205,8 @@ class StackedLSTM : public AbstractStackedLSTM<R> {
             bool _memory_feeds_gates);
         StackedLSTM(const StackedLSTM<R>& model, bool copy_w, bool copy_dw);
         StackedLSTM<R> shallow_copy() const;
+        // see LSTM::quantize
+        void quantize();
 };
 
 /**
@@ -1,5 +1,7 @@
 #include "dali/layers/Layers.h"
 
+#include "dali/tensor/Quantization.h"
+
 using std::vector;
 
 template<typename R>
@@ -48,6 +50,11 @@ Layer<R> Layer<R>::shallow_copy() const {
     return Layer<R>(*this, false, true);
 }
 
+template<typename R>
+void Layer<R>::quantize() {
+    quantization::quantize(W, quantization::QUANTIZE_COLUMNS);
+}
+
 template<typename R>
 vector<Mat<R>> Layer<R>::parameters() const{
     return vector<Mat<R>>({W, this->b});
@@ -173,6 +180,11 @@ StackedInputLayer<R> StackedInputLayer<R>::shallow_copy() const {
     return StackedInputLayer<R>(*this, false, true);
 }
 
+template<typename R>
+void StackedInputLayer<R>::quantize() {
+    quantization::quantize(matrices, quantization::QUANTIZE_COLUMNS);
+}
+
 template<typename R>
 std::vector<Mat<R>> StackedInputLayer<R>::parameters() const{
     auto params = vector<Mat<R>>(matrices);
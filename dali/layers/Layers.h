@@ -44,6 +44,8 @@ class Layer : public AbstractMultiInputLayer<R> {
 
         Mat<R> activate(Mat<R>) const;
         Layer<R> shallow_copy() const;
+        // int8 copy of W for inference (see dali/tensor/Quantization.h).
+        void quantize();
 };
 
 template<typename R>
@@ -80,6 +82,9 @@ class StackedInputLayer : public AbstractMultiInputLayer<R> {
         Mat<R> activate(Mat<R>, const std::vector<Mat<R>>&) const;
 
         StackedInputLayer<R> shallow_copy() const;
+        // int8 copies of the matrices for inference (see
+        // dali/tensor/Quantization.h).
+        void quantize();
 };
 
 template<typename R>
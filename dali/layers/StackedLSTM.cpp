@@ -1,5 +1,7 @@
 #include "dali/layers/LSTM.h"
 
+#include <cmath>
+
 using std::vector;
 using utils::assert2;
 
@@ -25,6 +27,70 @@ typename AbstractStackedLSTM<R>::state_t AbstractStackedLSTM<R>::activate_sequen
     return initial_state;
 };
 
+template<typename R>
+typename AbstractStackedLSTM<R>::state_t AbstractStackedLSTM<R>::activate_sequence_checkpointed(
+    state_t initial_state,
+    const vector<Mat<R>>& sequence,
+    vector<Mat<R>>& hiddens,
+    int segment_length) const {
+    if (!graph::backprop_enabled()) {
+        for (auto& input_vector : sequence) {
+            initial_state = activate(initial_state, input_vector);
+            hiddens.emplace_back(initial_state.back().hidden);
+        }
+        return initial_state;
+    }
+    if (segment_length <= 0) {
+        segment_length = std::max(1, (int)std::ceil(std::sqrt((double)sequence.size())));
+    }
+
+    state_t state = initial_state;
+    for (int start = 0; start < sequence.size(); start += segment_length) {
+        int end = std::min(start + segment_length, (int)sequence.size());
+        state_t segment_start = state;
+        vector<Mat<R>> segment(sequence.begin() + start, sequence.begin() + end);
+        vector<Mat<R>> segment_hiddens;
+        {
+            // nothing recorded here: the segment is replayed
+            // during backpropagation instead.
+            graph::NoBackprop nb;
+            for (auto& input_vector : segment) {
+                state = activate(state, input_vector);
+                segment_hiddens.emplace_back(state.back().hidden);
+            }
+        }
+        hiddens.insert(hiddens.end(), segment_hiddens.begin(), segment_hiddens.end());
+        state_t segment_end = state;
+
+        graph::emplace_back([this, segment_start, segment, segment_hiddens, segment_end]() mutable {
+            graph::ScopedTape subtape;
+            state_t replay_state = segment_start;
+            for (int t = 0; t < segment.size(); t++) {
+                replay_state = activate(replay_state, segment[t]);
+                // the last step's top hidden is part of the end state.
+                if (t + 1 < segment.size()) {
+                    replay_state.back().hidden.copy_grad_from(segment_hiddens[t]);
+                }
+            }
+            for (int l = 0; l < replay_state.size(); l++) {
+                replay_state[l].memory.copy_grad_from(segment_end[l].memory);
+                replay_state[l].hidden.copy_grad_from(segment_end[l].hidden);
+            }
+            graph::backward();
+        });
+    }
+    return state;
+}
+
+template<typename R>
+typename AbstractStackedLSTM<R>::state_t AbstractStackedLSTM<R>::activate_sequence_checkpointed(
+    state_t initial_state,
+    const vector<Mat<R>>& sequence,
+    int segment_length) const {
+    vector<Mat<R>> hiddens;
+    return activate_sequence_checkpointed(initial_state, sequence, hiddens, segment_length);
+}
+
 /** Stacked LSTM **/
 
 template<typename R>
@@ -61,6 +127,13 @@ StackedLSTM<R> StackedLSTM<R>::shallow_copy() const {
     return StackedLSTM<R>(*this, false, true);
 }
 
+template<typename R>
+void StackedLSTM<R>::quantize() {
+    for (auto& cell : cells) {
+        cell.quantize();
+    }
+}
+
 template<typename R>
 std::vector<Mat<R>> StackedLSTM<R>::parameters() const {
     vector<Mat<R>> parameters;
@@ -96,6 +169,41 @@ typename StackedLSTM<R>::state_t StackedLSTM<R>::activate(
     }
 };
 
+template<typename R>
+typename StackedLSTM<R>::state_t StackedLSTM<R>::activate_sequence(
+            state_t initial_state,
+            const vector<Mat<R>>& sequence,
+            R drop_prob) const {
+    ASSERT2(cells.size() == initial_state.size(),
+        utils::MS() << "Activating LSTM stack of size " << cells.size()
+        << " with different number of states " << initial_state.size());
+    if (sequence.empty())
+        return initial_state;
+
+    state_t out_state;
+    out_state.reserve(cells.size());
+    // hidden states of the layer below at every step:
+    vector<Mat<R>> layer_input = sequence;
+    for (int layer_idx = 0; layer_idx < cells.size(); ++layer_idx) {
+        vector<vector<Mat<R>>> step_inputs;
+        step_inputs.reserve(sequence.size());
+        for (int t = 0; t < sequence.size(); ++t) {
+            step_inputs.emplace_back(vector<Mat<R>>({
+                MatOps<R>::dropout_normalized(layer_input[t], drop_prob)
+            }));
+            if (shortcut && layer_idx > 0) {
+                step_inputs.back().emplace_back(
+                    MatOps<R>::dropout_normalized(sequence[t], drop_prob)
+                );
+            }
+        }
+        auto states = cells[layer_idx].activate_sequence_states(initial_state[layer_idx], step_inputs);
+        layer_input = LSTMState<R>::hiddens(states);
+        out_state.emplace_back(states.back());
+    }
+    return out_state;
+};
+
 template<typename celltype>
 vector<celltype> StackedCells(
         const int& input_size,
@@ -10,6 +10,7 @@
 #include "dali/layers/GRU.h"
 #include "dali/tensor/Mat.h"
 #include "dali/tensor/MatOps.h"
+#include "dali/tensor/Quantization.h"
 #include "dali/tensor/Tape.h"
 #include "dali/tensor/Solver.h"
 
@@ -355,6 +356,70 @@ TEST_F(LayerTests, activate_sequence) {
     ASSERT_EQ(num_out_states, LSTMState<R>::hiddens(out_states).size());
 }
 
+TEST_F(LayerTests, activate_sequence_checkpointed) {
+    vector<int> hidden_sizes = {4, 3};
+    int input_size = 3;
+    int tsteps = 5;
+
+    EXPERIMENT_REPEAT {
+        auto model = StackedLSTM<R>(input_size, hidden_sizes, false, false);
+        vector<Mat<R>> sequence;
+        for (int i = 0; i < tsteps; i++) {
+            sequence.emplace_back(1, input_size, weights<R>::uniform(2.0));
+        }
+        auto params = model.parameters();
+        params.insert(params.end(), sequence.begin(), sequence.end());
+
+        auto functor = [&model, &sequence](vector<Mat<R>> Xs)-> Mat<R> {
+            vector<Mat<R>> hiddens;
+            auto state = model.activate_sequence_checkpointed(
+                model.initial_states(), sequence, hiddens, 2
+            );
+            auto error = state.back().memory.sum();
+            for (auto& hidden : hiddens) {
+                error = error + (hidden ^ 2).sum();
+            }
+            return error;
+        };
+        ASSERT_TRUE(gradient_same(functor, params, 1e-3));
+    }
+}
+
+TEST_F(LayerTests, activate_sequence_batched_projection) {
+    vector<int> hidden_sizes = {4, 3};
+    int input_size = 3;
+    int num_examples = 2;
+    int tsteps = 4;
+
+    EXPERIMENT_REPEAT {
+        auto model = StackedLSTM<R>(input_size, hidden_sizes, true, false);
+        vector<Mat<R>> sequence;
+        for (int i = 0; i < tsteps; i++) {
+            sequence.emplace_back(num_examples, input_size, weights<R>::uniform(2.0));
+        }
+        // same result as going step by step:
+        {
+            graph::NoBackprop nb;
+            auto batched = model.activate_sequence(model.initial_states(), sequence);
+            auto state = model.initial_states();
+            for (auto& input : sequence) {
+                state = model.activate(state, input);
+            }
+            for (int l = 0; l < hidden_sizes.size(); ++l) {
+                ASSERT_MATRIX_CLOSE(batched[l].memory, state[l].memory, 1e-5);
+                ASSERT_MATRIX_CLOSE(batched[l].hidden, state[l].hidden, 1e-5);
+            }
+        }
+        auto params = model.parameters();
+        params.insert(params.end(), sequence.begin(), sequence.end());
+        auto functor = [&model, &sequence](vector<Mat<R>> Xs)-> Mat<R> {
+            auto state = model.activate_sequence(model.initial_states(), sequence);
+            return state.back().hidden + state.front().memory;
+        };
+        ASSERT_TRUE(gradient_same(functor, params, 1e-3));
+    }
+}
+
 TEST_F(LayerTests, GRU) {
     int input_size = 3;
     int hidden_size = 5;
@@ -375,3 +440,163 @@ TEST_F(LayerTests, GRU) {
         ASSERT_TRUE(gradient_same(functor, params, 1e-3));
     }
 }
+
+TEST_F(LayerTests, GRU_activate_sequence_batched_projection) {
+    int input_size = 3;
+    int hidden_size = 5;
+    int num_examples = 2;
+    int tsteps = 4;
+
+    EXPERIMENT_REPEAT {
+        auto gru = GRU<R>(input_size, hidden_size);
+        auto inputs = vector<Mat<R>>();
+        for (int i = 0; i < tsteps; i++)
+            inputs.emplace_back(Mat<R>(num_examples, input_size, weights<R>::uniform(2.0)));
+        auto params = gru.parameters();
+        params.insert(params.end(), inputs.begin(), inputs.end());
+        auto functor = [&inputs, &gru](vector<Mat<R>> Xs)-> Mat<R> {
+            return (gru.activate_sequence(inputs) - 1.0) ^ 2;
+        };
+        ASSERT_TRUE(gradient_same(functor, params, 1e-3));
+    }
+}
+
+TEST_F(LayerTests, plan_replay) {
+    int num_examples = 3;
+    int input_size   = 4;
+    int hidden_size  = 5;
+    int num_classes  = 3;
+
+    auto embedding  = Layer<R>(input_size, hidden_size);
+    auto lstm       = LSTM<R>(hidden_size, hidden_size, false);
+    auto classifier = Layer<R>(hidden_size, num_classes);
+    auto params = lstm.parameters();
+    auto embedding_params  = embedding.parameters();
+    auto classifier_params = classifier.parameters();
+    params.insert(params.end(), embedding_params.begin(), embedding_params.end());
+    params.insert(params.end(), classifier_params.begin(), classifier_params.end());
+    auto state = lstm.initial_states();
+
+    Mat<R> input(num_examples, input_size);
+    Mat<int> targets(num_examples, 1);
+    auto feed = [&](int batch) {
+        for (int row = 0; row < num_examples; row++) {
+            for (int col = 0; col < input_size; col++) {
+                input.w(row, col) = (R)((batch * 7 + row * 3 + col) % 11) / 5.0 - 1.0;
+            }
+            targets.w(row) = (batch + row) % num_classes;
+        }
+    };
+    auto step = [&]() {
+        auto next = lstm.activate(embedding.activate(input).tanh(), state);
+        auto error = MatOps<R>::softmax_cross_entropy_rowwise(classifier.activate(next.hidden), targets).sum();
+        error.grad();
+        return error;
+    };
+
+    // reference: the same steps run eagerly
+    vector<R> errors;
+    vector<vector<Mat<R>>> grads;
+    for (int batch = 0; batch < 3; batch++) {
+        feed(batch);
+        auto error = step();
+        graph::backward();
+        errors.emplace_back(error.w(0));
+        grads.emplace_back();
+        for (auto& param : params) {
+            grads.back().emplace_back(param, true, true);
+            param.clear_grad();
+        }
+    }
+
+    graph::Plan plan;
+    Mat<R> error;
+    for (int batch = 0; batch < 3; batch++) {
+        feed(batch);
+        if (batch == 0) {
+            plan.capture([&]() {
+                error = step();
+            });
+            ASSERT_EQ(0, graph::size());
+        } else {
+            plan.replay();
+        }
+        EXPECT_NEAR(errors[batch], error.w(0), 1e-5);
+        for (int i = 0; i < params.size(); i++) {
+            ASSERT_TRUE(MatOps<R>::grad_allclose(grads[batch][i], params[i], 1e-5));
+            params[i].clear_grad();
+        }
+    }
+
+    // under NoBackprop a replay only runs the forward pass, which reads
+    // the int8 weights of a quantized LSTM.
+    lstm.quantize();
+    {
+        graph::NoBackprop nb;
+        feed(0);
+        plan.replay();
+        auto expected = MatOps<R>::softmax_cross_entropy_rowwise(
+                classifier.activate(lstm.activate(embedding.activate(input).tanh(), state).hidden), targets).sum();
+        EXPECT_NEAR(expected.w(0), error.w(0), 1e-5);
+    }
+    for (auto& param : params) {
+        ASSERT_EQ(0.0, param.dw().sum());
+    }
+
+    // ops without a forward kernel cannot be captured
+    graph::Plan unsupported;
+    EXPECT_THROW(unsupported.capture([&]() {
+        MatOps<R>::L2_norm(input).grad();
+    }), std::runtime_error);
+    ASSERT_FALSE(unsupported.captured());
+    ASSERT_EQ(0, graph::size());
+}
+
+TEST_F(LayerTests, quantized_inference) {
+    int vocab_size   = 50;
+    int input_size   = 64;
+    int num_classes  = 7;
+    int num_examples = 4;
+    int tsteps       = 3;
+    vector<int> hidden_sizes = {64, 128};
+
+    auto embedding  = Mat<R>(vocab_size, input_size, weights<R>::uniform(1.0));
+    auto model      = StackedLSTM<R>(input_size, hidden_sizes, false, false);
+    auto classifier = Layer<R>(hidden_sizes.back(), num_classes);
+    auto predict = [&]() {
+        auto state = model.initial_states();
+        for (int t = 0; t < tsteps; t++) {
+            vector<uint> words;
+            for (int i = 0; i < num_examples; i++) {
+                words.emplace_back((7 * t + 13 * i) % vocab_size);
+            }
+            state = model.activate(state, MatOps<R>::rows_pluck(embedding, Indexing::Index(&words)));
+        }
+        return vector<Mat<R>>({MatOps<R>::softmax_rowwise(classifier.activate(state.back().hidden))});
+    };
+    Mat<R> expected;
+    {
+        graph::NoBackprop nb;
+        expected = predict()[0];
+    }
+
+    model.quantize();
+    classifier.quantize();
+    quantization::quantize(embedding, quantization::QUANTIZE_ROWS);
+    // training still sees the float weights
+    ASSERT_MATRIX_EQ(predict()[0], expected);
+    graph::clear();
+
+    auto params = model.parameters();
+    auto classifier_params = classifier.parameters();
+    params.insert(params.end(), classifier_params.begin(), classifier_params.end());
+    params.emplace_back(embedding);
+    auto report = quantization::report<R>(params, predict);
+    EXPECT_GT(report.max_absolute_error, 0.0);
+    EXPECT_LT(report.max_absolute_error, 1e-2);
+    EXPECT_LT(report.relative_error, 2e-2);
+    EXPECT_GT(report.argmax_agreement, 0.5);
+    // 8 byte doubles down to a byte (plus a scale and a sum per row)
+    EXPECT_GT(report.float_bytes, 6 * report.quantized_bytes);
+    ASSERT_EQ(0, graph::size());
+}
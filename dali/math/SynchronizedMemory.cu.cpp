@@ -1,6 +1,10 @@
 #include "dali/math/SynchronizedMemory.h"
 
+#include <algorithm>
+
+#include "dali/math/memory_bank/MemoryArena.h"
 #include "dali/math/memory_bank/MemoryBank.h"
+#include "dali/utils/Profiler.h"
 
 #ifdef DALI_USE_CUDA
     Device default_preferred_device = DEVICE_GPU;
@@ -83,6 +87,9 @@ SynchronizedMemory<R>::SynchronizedMemory(int _total_memory,
         cpu_fresh(false),
         allocated_cpu(false),
         cpu_ptr(NULL),
+        use_arena(memory_arena::enabled()),
+        cpu_from_arena(false),
+        version(0),
         total_memory(_total_memory),
         inner_dimension(_inner_dimension),
         preferred_device(_preferred_device) {
@@ -122,7 +129,14 @@ SynchronizedMemory<R>::SynchronizedMemory(const SynchronizedMemory& other) :
 template<typename R>
 void SynchronizedMemory<R>::free_cpu() const {
     if (allocated_cpu) {
-        memory_bank<R>::deposit_cpu(total_memory, inner_dimension, cpu_ptr);
+        if (cpu_owner != nullptr) {
+            cpu_owner.reset();
+        } else if (cpu_from_arena) {
+            memory_arena::deposit(cpu_ptr);
+            cpu_from_arena = false;
+        } else {
+            memory_bank<R>::deposit_cpu(total_memory, inner_dimension, cpu_ptr);
+        }
         cpu_ptr = NULL;
     }
     allocated_cpu = false;
@@ -151,6 +165,7 @@ SynchronizedMemory<R>::~SynchronizedMemory() {
 template<typename R>
 void SynchronizedMemory<R>::clear() {
     clear_on_allocation = true;
+    ++version;
     #ifdef DALI_USE_CUDA
     if (preferred_device == DEVICE_GPU) {
         allocate_gpu();
@@ -174,6 +189,7 @@ template<typename R>
 void SynchronizedMemory<R>::lazy_clear() {
     clear_on_allocation = true;
     cpu_fresh = false;
+    ++version;
 
     #ifdef DALI_USE_CUDA
         gpu_fresh = false;
@@ -196,6 +212,9 @@ void SynchronizedMemory<R>::lazy_clear() {
         }
         gpu_ptr = memory_bank<R>::allocate_gpu( total_memory , inner_dimension );
         allocated_gpu = true;
+        if (profiler::enabled()) {
+            profiler::count_allocation(total_memory * sizeof(R));
+        }
         return true;
     }
 
@@ -223,11 +242,53 @@ bool SynchronizedMemory<R>::allocate_cpu() const {
     if (allocated_cpu) {
         return false;
     }
-    cpu_ptr = memory_bank<R>::allocate_cpu( total_memory , inner_dimension );
+    // the arena may have been closed since this memory was created
+    if (use_arena && memory_arena::enabled()) {
+        cpu_ptr = (R*)memory_arena::allocate(total_memory * sizeof(R));
+        cpu_from_arena = true;
+    } else {
+        cpu_ptr = memory_bank<R>::allocate_cpu( total_memory , inner_dimension );
+    }
     allocated_cpu = true;
+    if (profiler::enabled()) {
+        profiler::count_allocation(total_memory * sizeof(R));
+    }
     return true;
 }
 
+template<typename R>
+R* SynchronizedMemory<R>::reallocate_cpu(int new_total_memory) {
+    if (cpu_from_arena || cpu_owner != nullptr) {
+        // arena and adopted memory cannot be resized, so move it to the bank.
+        R* new_ptr = memory_bank<R>::allocate_cpu(new_total_memory, inner_dimension);
+        std::copy(cpu_ptr, cpu_ptr + std::min(total_memory, new_total_memory), new_ptr);
+        if (cpu_from_arena) {
+            memory_arena::deposit(cpu_ptr);
+        }
+        cpu_owner.reset();
+        cpu_from_arena = false;
+        cpu_ptr = new_ptr;
+    } else {
+        cpu_ptr = memory_bank<R>::reallocate_cpu(cpu_ptr, total_memory, new_total_memory, inner_dimension);
+    }
+    total_memory = new_total_memory;
+    ++version;
+    return cpu_ptr;
+}
+
+template<typename R>
+void SynchronizedMemory<R>::adopt_cpu(R* ptr, std::shared_ptr<void> owner) {
+    free_cpu();
+    cpu_ptr = ptr;
+    cpu_owner = owner;
+    allocated_cpu = true;
+    cpu_fresh = true;
+    ++version;
+    #ifdef DALI_USE_CUDA
+        gpu_fresh = false;
+    #endif
+}
+
 template<typename R>
 void SynchronizedMemory<R>::to_cpu() const {
     if (!this->cpu_fresh) {
@@ -255,6 +316,7 @@ R* SynchronizedMemory<R>::cpu_data() const {
 template <typename R>
 R* SynchronizedMemory<R>::mutable_cpu_data() {
     to_cpu();
+    ++version;
     #ifdef DALI_USE_CUDA
         gpu_fresh = false;
     #endif
@@ -262,6 +324,7 @@ R* SynchronizedMemory<R>::mutable_cpu_data() {
 }
 template <typename R>
 R* SynchronizedMemory<R>::overwrite_cpu_data() {
+    ++version;
     #ifdef DALI_USE_CUDA
         gpu_fresh = false;
     #endif
@@ -279,11 +342,13 @@ R* SynchronizedMemory<R>::gpu_data() const {
 template <typename R>
 R* SynchronizedMemory<R>::mutable_gpu_data() {
     to_gpu();
+    ++version;
     cpu_fresh = false;
     return gpu_ptr;
 }
 template <typename R>
 R* SynchronizedMemory<R>::overwrite_gpu_data() {
+    ++version;
     cpu_fresh = false;
     allocate_gpu();
     gpu_fresh = true;
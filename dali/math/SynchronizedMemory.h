@@ -5,6 +5,7 @@
 #include <functional>
 #include <initializer_list>
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <ostream>
 
@@ -67,6 +68,19 @@ class SynchronizedMemory {
         mutable bool allocated_cpu;
         mutable bool cpu_fresh;
         mutable R* cpu_ptr;
+        // whether cpu memory may come from the graph arena (decided
+        // when the memory is created inside a graph::ArenaScope)
+        bool use_arena;
+        // whether cpu_ptr currently points into the graph arena
+        mutable bool cpu_from_arena;
+        // keeps alive the memory cpu_ptr points to when it was handed
+        // over with `adopt_cpu` (e.g. a memory mapped checkpoint)
+        mutable std::shared_ptr<void> cpu_owner;
+        // incremented by every write access (mutable_* and
+        // overwrite_* data, clear, adopt_cpu, ...), so that copies
+        // derived from the values (packed or quantized weights) can
+        // tell when they went stale.
+        std::atomic<long long> version;
 
         void free_cpu() const;
         // Ensure a fresh copy of the memory is on the cpu
@@ -75,6 +89,12 @@ class SynchronizedMemory {
         bool prefers_gpu() const;
 
         bool allocate_cpu() const;
+        // grow or shrink the (already allocated) cpu memory, keeping
+        // its first min(total_memory, new_total_memory) values.
+        R* reallocate_cpu(int new_total_memory);
+        // use `total_memory` values at ptr as the fresh cpu copy instead of
+        // allocating; `owner` is released once the memory is freed.
+        void adopt_cpu(R* ptr, std::shared_ptr<void> owner);
 
         SynchronizedMemory& operator=(const SynchronizedMemory&) = delete;
 
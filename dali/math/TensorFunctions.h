@@ -5,6 +5,8 @@
 #include <mshadow/tensor.h>
 #include <math.h>
 
+#include "dali/math/simd/SimdFunctions.h"
+
 #ifdef DALI_USE_CUDA
     #define TANH_F tanhf
     #define LOG_F  logf
@@ -70,6 +72,10 @@ namespace TensorOps {
             MSHADOW_XINLINE static R Map(const R& a) {
                 return 1.0 / (1.0 + EXP_F(-a));
             }
+            // whole contiguous CPU array at once, see dali/math/simd.
+            static void Map(const R* a, R* out, int size) {
+                simd::sigmoid(a, out, size);
+            }
         };
 
         template<typename R>
@@ -77,6 +83,9 @@ namespace TensorOps {
             MSHADOW_XINLINE static R Map(const R& a) {
                 return LOG_F(a);
             }
+            static void Map(const R* a, R* out, int size) {
+                simd::log(a, out, size);
+            }
         };
 
         template<typename R>
@@ -100,6 +109,9 @@ namespace TensorOps {
             MSHADOW_XINLINE static R Map(const R& a) {
                 return EXP_F(a);
             }
+            static void Map(const R* a, R* out, int size) {
+                simd::exp(a, out, size);
+            }
         };
 
         template<typename R>
@@ -125,6 +137,9 @@ namespace TensorOps {
                 //     return 1.0f;
                 return TANH_F(a);
             }
+            static void Map(const R* a, R* out, int size) {
+                simd::tanh(a, out, size);
+            }
         };
 
         template<typename R>
@@ -188,6 +203,9 @@ namespace TensorOps {
             MSHADOW_XINLINE static R Map(const R& x, const R& aggressiveness) {
                 return 1.0 / (1.0 + EXP_F( - aggressiveness * x));
             }
+            static void Map(const R* x, R* out, int size, R aggressiveness) {
+                simd::steep_sigmoid(x, out, size, aggressiveness);
+            }
         };
 
         template<typename R>
@@ -264,6 +282,9 @@ namespace TensorOps {
                     return LOG_F((R)1.0 + EXP_F(x));
                 }
             }
+            static void Map(const R* a, R* out, int size) {
+                simd::softplus(a, out, size);
+            }
         };
 
         template<typename R>
@@ -455,11 +455,9 @@ void TensorInternal<R, dimension>::resize(mshadow::Shape<dimension> newshape, R
             // then we can simply chop off or add memory
             // at the tail end of this tensor's memory buffer.
             R* data_ptr = memory_->mutable_cpu_data();
-            R* new_ptr  = (R*)realloc(data_ptr, newshape.Size() * sizeof(R));
+            R* new_ptr  = memory_->reallocate_cpu(newshape.Size());
             ASSERT2(new_ptr != NULL, "Error: Could not allocated memory for TensorInternal.");
             if (new_ptr != NULL) {
-                memory_->cpu_ptr = new_ptr;
-                memory_->total_memory = newshape.Size();
                 #ifdef DALI_USE_CUDA
                 memory_->free_gpu();
                 #endif
@@ -479,11 +477,9 @@ void TensorInternal<R, dimension>::resize(mshadow::Shape<dimension> newshape, R
                 // we move the farthest rows & columns out to
                 // make room for closer columns
                 R* data_ptr = memory_->mutable_cpu_data();
-                R* new_ptr  = (R*)realloc(data_ptr, newshape.Size() * sizeof(R));
+                R* new_ptr  = memory_->reallocate_cpu(newshape.Size());
                 ASSERT2(new_ptr != NULL, "Error: Could not allocated memory for TensorInternal.");
                 if (new_ptr != NULL) {
-                    memory_->cpu_ptr = new_ptr;
-                    memory_->total_memory = newshape.Size();
                     #ifdef DALI_USE_CUDA
                     memory_->free_gpu();
                     #endif
@@ -524,11 +520,9 @@ void TensorInternal<R, dimension>::resize(mshadow::Shape<dimension> newshape, R
                         *(data_ptr + new_offset) = *(data_ptr + old_offset);
                     }
                 }
-                R* new_ptr = (R*)realloc(data_ptr, newshape.Size() * sizeof(R));
+                R* new_ptr = memory_->reallocate_cpu(newshape.Size());
                 ASSERT2(new_ptr != NULL, "Error: Could not allocated memory for TensorInternal.");
                 if (new_ptr != NULL) {
-                    memory_->cpu_ptr = new_ptr;
-                    memory_->total_memory = newshape.Size();
                     #ifdef DALI_USE_CUDA
                     memory_->free_gpu();
                     #endif
@@ -556,10 +550,8 @@ void TensorInternal<R, dimension>::resize(mshadow::Shape<dimension> newshape, R
             if (newshape == shape)\
                 return;\
             dtype* data_ptr = memory_->mutable_cpu_data();\
-            dtype* new_ptr  = (dtype*)realloc(data_ptr, newshape.Size() * sizeof(dtype));\
+            dtype* new_ptr  = memory_->reallocate_cpu(newshape.Size());\
             ASSERT2(new_ptr != NULL, "Error: Could not allocated memory for TensorInternal.");\
-            memory_->cpu_ptr = new_ptr;\
-            memory_->total_memory = newshape.Size();\
             memory_->free_gpu();\
             if (newshape[0] > shape[0]) {\
                 for (int i = shape.Size(); i < newshape.Size(); i++) {\
@@ -575,10 +567,8 @@ void TensorInternal<R, dimension>::resize(mshadow::Shape<dimension> newshape, R
             if (newshape == shape)\
                 return;\
             dtype* data_ptr = memory_->mutable_cpu_data();\
-            dtype* new_ptr  = (dtype*)realloc(data_ptr, newshape.Size() * sizeof(dtype));\
+            dtype* new_ptr  = memory_->reallocate_cpu(newshape.Size());\
             ASSERT2(new_ptr != NULL, "Error: Could not allocated memory for TensorInternal.");\
-            memory_->cpu_ptr = new_ptr;\
-            memory_->total_memory = newshape.Size();\
             if (newshape[0] > shape[0]) {\
                 for (int i = shape.Size(); i < newshape.Size(); i++) {\
                     *(new_ptr + i) = filler;\
@@ -0,0 +1,134 @@
+#include "dali/math/memory_bank/MemoryArena.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "dali/utils/assert2.h"
+
+namespace {
+    // every allocation starts on this boundary, and the slot right
+    // before it records the chunk it belongs to.
+    const size_t ARENA_ALIGNMENT = 64;
+    // set in a chunk's tenant count once its arena gave up on it.
+    const long long CHUNK_RETIRED = 1LL << 62;
+
+    struct arena_chunk {
+        char* data;
+        size_t size;
+        size_t used;
+        std::atomic<long long> tenants;
+    };
+
+    arena_chunk* new_chunk(size_t size) {
+        auto chunk = new arena_chunk();
+        void* data = NULL;
+        int failed = posix_memalign(&data, ARENA_ALIGNMENT, size);
+        ASSERT2(!failed && data != NULL, "Error: Could not allocate memory arena chunk.");
+        chunk->data    = (char*)data;
+        chunk->size    = size;
+        chunk->used    = 0;
+        chunk->tenants = 0;
+        memory_arena::num_chunk_allocations++;
+        memory_arena::total_chunk_memory += size;
+        return chunk;
+    }
+
+    void free_chunk(arena_chunk* chunk) {
+        memory_arena::total_chunk_memory -= chunk->size;
+        free(chunk->data);
+        delete chunk;
+    }
+
+    // Returns true if nobody lives in the chunk anymore, in which case
+    // it can be freed. Otherwise the chunk is handed over to its
+    // tenants and the last one to leave frees it (once the thread
+    // owning the arena went away).
+    bool try_reclaim(arena_chunk* chunk) {
+        if (chunk->tenants.fetch_or(CHUNK_RETIRED) == 0) {
+            // only the owning thread adds tenants, so nobody
+            // could have moved in since.
+            chunk->tenants = 0;
+            return true;
+        }
+        return false;
+    }
+
+    thread_local bool arena_enabled = false;
+
+    struct thread_arena {
+        std::vector<arena_chunk*> chunks;
+        // chunk currently being bumped into
+        size_t current = 0;
+        size_t used = 0;
+
+        ~thread_arena() {
+            for (auto chunk : chunks) {
+                if (try_reclaim(chunk)) {
+                    free_chunk(chunk);
+                }
+            }
+        }
+    };
+
+    thread_arena& local_arena() {
+        thread_local thread_arena arena;
+        return arena;
+    }
+}
+
+std::atomic<long long> memory_arena::num_chunk_allocations(0);
+std::atomic<long long> memory_arena::total_chunk_memory(0);
+size_t memory_arena::chunk_size = 1 << 22;
+
+bool memory_arena::enabled() {
+    return arena_enabled;
+}
+
+void memory_arena::_set_enabled(bool value) {
+    arena_enabled = value;
+}
+
+void* memory_arena::allocate(size_t bytes) {
+    auto& arena = local_arena();
+    size_t needed = ARENA_ALIGNMENT + (bytes + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+    while (arena.current < arena.chunks.size() &&
+           arena.chunks[arena.current]->used + needed > arena.chunks[arena.current]->size) {
+        arena.current++;
+    }
+    if (arena.current == arena.chunks.size()) {
+        arena.chunks.emplace_back(new_chunk(std::max(chunk_size, needed)));
+    }
+    auto chunk = arena.chunks[arena.current];
+    char* block = chunk->data + chunk->used + ARENA_ALIGNMENT;
+    *(reinterpret_cast<arena_chunk**>(block) - 1) = chunk;
+    chunk->used += needed;
+    chunk->tenants++;
+    arena.used += needed;
+    return block;
+}
+
+void memory_arena::deposit(void* ptr) {
+    auto chunk = *(reinterpret_cast<arena_chunk**>(ptr) - 1);
+    if (chunk->tenants.fetch_sub(1) == (CHUNK_RETIRED | 1)) {
+        free_chunk(chunk);
+    }
+}
+
+void memory_arena::reset() {
+    auto& arena = local_arena();
+    for (auto chunk : arena.chunks) {
+        // only this thread adds tenants, so an empty chunk stays
+        // empty. The others keep what they hold and get bumped into
+        // past it, until they empty out at a later reset.
+        if (chunk->tenants.load() == 0) {
+            chunk->used = 0;
+        }
+    }
+    arena.current = 0;
+    arena.used = 0;
+}
+
+size_t memory_arena::used() {
+    return local_arena().used;
+}
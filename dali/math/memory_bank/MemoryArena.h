@@ -0,0 +1,50 @@
+#ifndef DALI_MATH_MEMORY_BANK_MEMORY_ARENA_H
+#define DALI_MATH_MEMORY_BANK_MEMORY_ARENA_H
+#include <atomic>
+#include <cstddef>
+
+/*
+Memory Arena
+------------
+
+Per-thread bump allocator for the temporaries of one forward /
+backward pass (see `graph::ArenaScope`).
+
+Memory is carved out of large chunks. Every allocation remembers the
+chunk it came from and each chunk counts its live tenants, so that
+`reset` (called by `graph::backward` and `graph::clear`) can rewind
+the bump pointer of every chunk that has emptied out. Chunks that
+still host live tensors (for instance a loss or a recurrent state
+the caller held on to) keep their bump pointer: the next pass
+allocates past their tenants, and they are rewound at the first
+reset after the tenants left. A training loop therefore settles on a
+fixed set of chunks. When the thread goes away, chunks still in use
+go back to the system when their last tenant is deposited, so memory
+is never reclaimed from under a tensor.
+
+Only CPU memory is served from the arena.
+*/
+
+struct memory_arena {
+    // number of chunks obtained from the system allocator
+    static std::atomic<long long> num_chunk_allocations;
+    // bytes held in chunks across all threads
+    static std::atomic<long long> total_chunk_memory;
+    // default size of a chunk in bytes
+    static size_t chunk_size;
+
+    // whether allocations on this thread should come from the arena.
+    static bool enabled();
+    // avoid using explicitly - use graph::ArenaScope instead
+    static void _set_enabled(bool value);
+
+    static void* allocate(size_t bytes);
+    // release memory obtained from `allocate` (from any thread).
+    static void deposit(void* ptr);
+    // rewind the chunks of this thread's arena that emptied out.
+    static void reset();
+    // bytes handed out by this thread's arena since the last reset.
+    static size_t used();
+};
+
+#endif
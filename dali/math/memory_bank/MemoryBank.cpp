@@ -1,58 +1,294 @@
 #include "dali/math/memory_bank/MemoryBank.h"
 
+#include <algorithm>
+
 using std::vector;
-static std::mutex memory_mutex;
+
+namespace {
+    // size classes are (4 + s) << k for s in [0, 4) and k >= 2,
+    // so the smallest class holds 16 values and the largest
+    // 1 << 24 values.
+    const int CPU_NUM_SIZE_CLASSES = 81;
+    // buffers above this size skip the per-thread magazines and
+    // are exchanged with the depot directly.
+    const int CPU_MAX_MAGAZINE_AMOUNT = 1 << 20;
+    // roughly how many values a single magazine slot may hold.
+    const int CPU_MAGAZINE_BUDGET = 1 << 18;
+
+    int magazine_capacity(int capacity) {
+        if (capacity > CPU_MAX_MAGAZINE_AMOUNT) {
+            return 0;
+        }
+        return std::max(2, std::min(64, CPU_MAGAZINE_BUDGET / capacity));
+    }
+
+    template<typename R>
+    struct cpu_depot {
+        std::mutex mutexes[CPU_NUM_SIZE_CLASSES];
+        std::vector<R*> buffers[CPU_NUM_SIZE_CLASSES];
+    };
+
+    // The depot is intentionally never destroyed: Mats with static
+    // storage duration may deposit their memory after main returns.
+    template<typename R>
+    cpu_depot<R>& shared_depot() {
+        static cpu_depot<R>* depot = new cpu_depot<R>();
+        return *depot;
+    }
+
+    template<typename R>
+    void release_to_system(R* ptr, int capacity) {
+        memory_operations<R>::free_cpu_memory(ptr, capacity, 1);
+        memory_bank<R>::num_cpu_deallocations++;
+        memory_bank<R>::total_cpu_memory -= capacity;
+    }
+
+    // set once a thread's magazine has been torn down, after which
+    // deposits from that thread go to the depot directly.
+    template<typename R>
+    bool& magazine_retired() {
+        thread_local bool retired = false;
+        return retired;
+    }
+
+    template<typename R>
+    struct cpu_magazine {
+        std::vector<R*> buffers[CPU_NUM_SIZE_CLASSES];
+
+        // hand the top `num` buffers of a size class over to the depot.
+        void flush(int size_class, int num) {
+            auto& slot = buffers[size_class];
+            num = std::min(num, (int)slot.size());
+            if (num == 0) {
+                return;
+            }
+            auto& depot = shared_depot<R>();
+            std::lock_guard<std::mutex> guard(depot.mutexes[size_class]);
+            depot.buffers[size_class].insert(depot.buffers[size_class].end(),
+                                             slot.end() - num, slot.end());
+            slot.resize(slot.size() - num);
+        }
+
+        // take up to `num` buffers of a size class from the depot.
+        void refill(int size_class, int num) {
+            auto& depot = shared_depot<R>();
+            std::lock_guard<std::mutex> guard(depot.mutexes[size_class]);
+            auto& stock = depot.buffers[size_class];
+            num = std::min(num, (int)stock.size());
+            buffers[size_class].insert(buffers[size_class].end(),
+                                       stock.end() - num, stock.end());
+            stock.resize(stock.size() - num);
+        }
+
+        void flush_all() {
+            for (int size_class = 0; size_class < CPU_NUM_SIZE_CLASSES; size_class++) {
+                flush(size_class, buffers[size_class].size());
+            }
+        }
+
+        ~cpu_magazine() {
+            flush_all();
+            magazine_retired<R>() = true;
+        }
+    };
+
+    template<typename R>
+    cpu_magazine<R>* local_magazine() {
+        if (magazine_retired<R>()) {
+            return NULL;
+        }
+        thread_local cpu_magazine<R> magazine;
+        return &magazine;
+    }
+}
+
+template<typename R>
+const int memory_bank<R>::num_cpu_size_classes = CPU_NUM_SIZE_CLASSES;
+
+template<typename R>
+const int memory_bank<R>::max_cached_cpu_amount = 1 << 24;
 
 template<typename R>
-cuckoohash_map<unsigned long long,std::vector<R*>> memory_bank<R>::cpu_memory_bank(100000);
+int memory_bank<R>::cpu_size_class(int amount) {
+    if (amount <= 16) {
+        return 0;
+    }
+    unsigned int n = amount - 1;
+    int msb = 31 - __builtin_clz(n);
+    int shift = msb - 2;
+    // top three bits of n (in [4, 8)) pick the class within this
+    // power of two; rounding up into the next power of two lands
+    // on the next class index naturally.
+    int top = n >> shift;
+    return (shift - 2) * 4 + top - 3;
+}
 
+template<typename R>
+int memory_bank<R>::cpu_size_class_capacity(int size_class) {
+    return (4 + size_class % 4) << (size_class / 4 + 2);
+}
 
 template<typename R>
 void memory_bank<R>::deposit_cpu(int amount, int inner_dimension, R* ptr) {
-    // make sure there is only one person
-    // at a time in the vault to prevent
-    // robberies
-    /*cpu_memory_bank.upsert(amount, [ptr](std::vector<R*>& deposit_box) {
-        deposit_box.emplace_back(ptr);
-    }, {ptr});*/
-    memory_operations<R>::free_cpu_memory(ptr, amount, inner_dimension);
+    if (amount > max_cached_cpu_amount) {
+        release_to_system(ptr, amount);
+        return;
+    }
+    int size_class = cpu_size_class(amount);
+    int capacity   = cpu_size_class_capacity(size_class);
+    int magazine_size = magazine_capacity(capacity);
+    cached_cpu_memory += capacity;
+
+    bool depot_grew = true;
+    auto magazine = local_magazine<R>();
+    if (magazine != NULL && magazine_size > 0) {
+        auto& slot = magazine->buffers[size_class];
+        if ((int)slot.size() >= magazine_size) {
+            // keep half so that an alternating allocate/deposit
+            // pattern does not bounce against the depot.
+            magazine->flush(size_class, magazine_size / 2);
+        } else {
+            depot_grew = false;
+        }
+        slot.emplace_back(ptr);
+    } else {
+        auto& depot = shared_depot<R>();
+        std::lock_guard<std::mutex> guard(depot.mutexes[size_class]);
+        depot.buffers[size_class].emplace_back(ptr);
+    }
+    // only the depot can be trimmed, so only check when it grew.
+    if (depot_grew && cached_cpu_memory > cpu_cache_limit) {
+        trim_cpu(cpu_cache_limit);
+    }
 }
 
 template<typename R>
 R* memory_bank<R>::allocate_cpu(int amount, int inner_dimension) {
-    /*R* memory = NULL;
-    bool success = cpu_memory_bank.update_fn(amount, [&memory](std::vector<R*>& deposit_box) {
-        if (!deposit_box.empty()) {
-            memory = deposit_box.back();
-            deposit_box.pop_back();
+    if (amount > max_cached_cpu_amount) {
+        num_cpu_allocations++;
+        total_cpu_memory += amount;
+        return memory_operations<R>::allocate_cpu_memory(amount, inner_dimension);
+    }
+    int size_class = cpu_size_class(amount);
+    int capacity   = cpu_size_class_capacity(size_class);
+    int magazine_size = magazine_capacity(capacity);
+
+    auto magazine = local_magazine<R>();
+    if (magazine != NULL && magazine_size > 0) {
+        auto& slot = magazine->buffers[size_class];
+        if (slot.empty()) {
+            magazine->refill(size_class, std::max(1, magazine_size / 2));
+        }
+        if (!slot.empty()) {
+            R* memory = slot.back();
+            slot.pop_back();
+            num_cpu_recycled++;
+            cached_cpu_memory -= capacity;
+            return memory;
+        }
+    } else {
+        R* memory = NULL;
+        {
+            auto& depot = shared_depot<R>();
+            std::lock_guard<std::mutex> guard(depot.mutexes[size_class]);
+            auto& stock = depot.buffers[size_class];
+            if (!stock.empty()) {
+                memory = stock.back();
+                stock.pop_back();
+            }
         }
-    });
-    if (memory != NULL) {
-        return memory;
-    }*/
+        if (memory != NULL) {
+            num_cpu_recycled++;
+            cached_cpu_memory -= capacity;
+            return memory;
+        }
+    }
     num_cpu_allocations++;
-    total_cpu_memory += amount;
-    return memory_operations<R>::allocate_cpu_memory(amount, inner_dimension);
+    total_cpu_memory += capacity;
+    // the inner dimension is only a hint, and a rounded up capacity
+    // need not be divisible by it.
+    return memory_operations<R>::allocate_cpu_memory(capacity, 1);
 }
 
 template<typename R>
-void memory_bank<R>::clear_cpu() {
-    for (auto it = cpu_memory_bank.cbegin(); !it.is_end(); it++) {
-        auto& ptrs = it->second;
-        for (auto ptr : ptrs) {
-            memory_operations<R>::free_cpu_memory(ptr, it->first, 1);
+R* memory_bank<R>::reallocate_cpu(R* ptr, int old_amount, int new_amount, int inner_dimension) {
+    if (old_amount <= max_cached_cpu_amount &&
+            new_amount <= max_cached_cpu_amount &&
+            cpu_size_class(old_amount) == cpu_size_class(new_amount)) {
+        // the buffer was rounded up and already has room.
+        return ptr;
+    }
+    R* new_ptr = allocate_cpu(new_amount, inner_dimension);
+    std::copy(ptr, ptr + std::min(old_amount, new_amount), new_ptr);
+    deposit_cpu(old_amount, inner_dimension, ptr);
+    return new_ptr;
+}
+
+template<typename R>
+void memory_bank<R>::trim_cpu(long long target) {
+    auto& depot = shared_depot<R>();
+    for (int size_class = CPU_NUM_SIZE_CLASSES - 1; size_class >= 0; size_class--) {
+        if (cached_cpu_memory <= target) {
+            return;
+        }
+        int capacity = cpu_size_class_capacity(size_class);
+        std::lock_guard<std::mutex> guard(depot.mutexes[size_class]);
+        auto& stock = depot.buffers[size_class];
+        while (!stock.empty() && cached_cpu_memory > target) {
+            release_to_system(stock.back(), capacity);
+            cached_cpu_memory -= capacity;
+            stock.pop_back();
         }
-        total_cpu_memory -= (it->first) * ptrs.size();
     }
-    cpu_memory_bank.clear();
+}
+
+template<typename R>
+void memory_bank<R>::set_cpu_cache_limit(long long limit) {
+    cpu_cache_limit = limit;
+    trim_cpu(limit);
+}
+
+template<typename R>
+void memory_bank<R>::clear_cpu() {
+    auto magazine = local_magazine<R>();
+    if (magazine != NULL) {
+        magazine->flush_all();
+    }
+    trim_cpu(0);
+}
+
+template<typename R>
+long long memory_bank<R>::thread_cached_cpu_memory() {
+    auto magazine = local_magazine<R>();
+    if (magazine == NULL) {
+        return 0;
+    }
+    long long total = 0;
+    for (int size_class = 0; size_class < CPU_NUM_SIZE_CLASSES; size_class++) {
+        total += (long long)magazine->buffers[size_class].size() * cpu_size_class_capacity(size_class);
+    }
+    return total;
 }
 
 template<typename R>
 std::atomic<long long> memory_bank<R>::num_cpu_allocations(0);
 
+template<typename R>
+std::atomic<long long> memory_bank<R>::num_cpu_deallocations(0);
+
+template<typename R>
+std::atomic<long long> memory_bank<R>::num_cpu_recycled(0);
+
 template<typename R>
 std::atomic<long long> memory_bank<R>::total_cpu_memory(0);
 
+template<typename R>
+std::atomic<long long> memory_bank<R>::cached_cpu_memory(0);
+
+// 256M values (1GB of floats) of idle buffers before trimming.
+template<typename R>
+std::atomic<long long> memory_bank<R>::cpu_cache_limit(1LL << 28);
+
 #ifdef DALI_USE_CUDA
     template<typename R>
     void memory_bank<R>::clear_gpu() {
@@ -5,22 +5,68 @@
 #include <mutex>
 #include <iostream>
 #include <unordered_map>
-#include <cuckoohash_map.hh>
 
 #include "dali/config.h"
 #include "dali/math/memory_bank/MemoryBankInternal.h"
 
+#ifdef DALI_USE_CUDA
+    #include <cuckoohash_map.hh>
+#endif
+
+/*
+Memory Bank
+-----------
+
+Caching allocator for the memory behind SynchronizedMemory.
+
+On the CPU, requests are rounded up to a size class (four classes
+per power of two, so at most 25% of a buffer is wasted). Freed
+buffers are parked in a per-thread magazine for their size class,
+and magazines exchange buffers in bulk with a shared depot, so the
+common allocate/deposit cycle of temporaries touches neither a lock
+nor the system allocator. When the memory parked in the depot grows
+past `cpu_cache_limit` the depot is trimmed back under it.
 
+Buffers larger than `max_cached_cpu_amount` are not worth rounding
+and go straight to the system allocator.
+
+All amounts are expressed in number of R's.
+*/
 
 template<typename R>
 struct memory_bank {
-    static cuckoohash_map<unsigned long long,std::vector<R*>> cpu_memory_bank;
+    // number of buffers obtained from the system allocator
     static std::atomic<long long> num_cpu_allocations;
+    // number of buffers returned to the system allocator
+    static std::atomic<long long> num_cpu_deallocations;
+    // number of allocations served from the cache
+    static std::atomic<long long> num_cpu_recycled;
+    // memory obtained from the system (in use + cached)
     static std::atomic<long long> total_cpu_memory;
+    // memory parked in magazines and in the depot
+    static std::atomic<long long> cached_cpu_memory;
+    // high-water mark for cached memory before the depot is trimmed
+    static std::atomic<long long> cpu_cache_limit;
+
+    static const int num_cpu_size_classes;
+    static const int max_cached_cpu_amount;
 
     static void deposit_cpu(int amount, int inner_dimension, R* ptr);
     static R* allocate_cpu(int amount, int inner_dimension);
+    // grow or shrink a buffer, keeping the first min(old, new) values.
+    static R* reallocate_cpu(R* ptr, int old_amount, int new_amount, int inner_dimension);
+    // return every cached buffer in the depot and in this thread's
+    // magazine to the system (other threads keep their magazines).
     static void clear_cpu();
+    // memory parked in this thread's magazine.
+    static long long thread_cached_cpu_memory();
+    // release depot buffers, largest first, until at most `target`
+    // memory remains cached.
+    static void trim_cpu(long long target);
+    static void set_cpu_cache_limit(long long limit);
+
+    static int cpu_size_class(int amount);
+    static int cpu_size_class_capacity(int size_class);
 
     #ifdef DALI_USE_CUDA
         // find out how many bytes of memory are still available
@@ -0,0 +1,80 @@
+#include "dali/math/simd/Int8Gemm.h"
+
+#include <atomic>
+
+#include "dali/math/simd/Int8Kernels.h"
+
+namespace {
+    void scalar_int8_gemm(const int8_t* a, const float* a_scales, int m,
+                          const int8_t* b, const float* b_scales, const int32_t*, int n,
+                          int stride, float* out, int ldout) {
+        for (int i = 0; i < m; ++i) {
+            const int8_t* a_row = a + (int64_t)i * stride;
+            for (int j = 0; j < n; ++j) {
+                const int8_t* b_row = b + (int64_t)j * stride;
+                int32_t total = 0;
+                for (int k = 0; k < stride; ++k) {
+                    total += (int32_t)a_row[k] * (int32_t)b_row[k];
+                }
+                out[(int64_t)i * ldout + j] += a_scales[i] * b_scales[j] * (float)total;
+            }
+        }
+    }
+
+    const simd::int8_kernel_table scalar_int8_kernels = {"scalar", &scalar_int8_gemm};
+
+    bool cpu_supports(const std::string& name) {
+        #if defined(__x86_64__) || defined(__i386__)
+            if (name == "vnni") {
+                return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vnni");
+            }
+            if (name == "avx2") return __builtin_cpu_supports("avx2");
+        #endif
+        return name == "scalar";
+    }
+
+    const simd::int8_kernel_table* int8_kernels_for(const std::string& name) {
+        if (!cpu_supports(name)) return NULL;
+        if (name == "vnni") return simd::vnni_int8_kernels();
+        if (name == "avx2") return simd::avx2_int8_kernels();
+        return &scalar_int8_kernels;
+    }
+
+    const simd::int8_kernel_table* detect_int8_kernels() {
+        for (auto name : {"vnni", "avx2"}) {
+            auto table = int8_kernels_for(name);
+            if (table != NULL) return table;
+        }
+        return &scalar_int8_kernels;
+    }
+
+    std::atomic<const simd::int8_kernel_table*>& active_int8_kernels() {
+        static std::atomic<const simd::int8_kernel_table*> active(detect_int8_kernels());
+        return active;
+    }
+}
+
+namespace simd {
+    void int8_gemm(const int8_t* a, const float* a_scales, int m,
+                   const int8_t* b, const float* b_scales, const int32_t* b_sums, int n,
+                   int stride, float* out, int ldout) {
+        active_int8_kernels().load(std::memory_order_relaxed)->gemm(
+                a, a_scales, m, b, b_scales, b_sums, n, stride, out, ldout);
+    }
+
+    const std::string& int8_instruction_set() {
+        static const std::string names[] = {"vnni", "avx2", "scalar"};
+        std::string current = active_int8_kernels().load()->name;
+        for (auto& name : names) {
+            if (name == current) return name;
+        }
+        return names[2];
+    }
+
+    bool set_int8_instruction_set(const std::string& name) {
+        auto table = int8_kernels_for(name);
+        if (table == NULL) return false;
+        active_int8_kernels() = table;
+        return true;
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef DALI_MATH_SIMD_INT8_GEMM_H
+#define DALI_MATH_SIMD_INT8_GEMM_H
+
+#include <cstdint>
+#include <string>
+
+/*
+Int8 Gemm
+---------
+
+Products of int8 matrices carrying one float scale per row, for the
+quantized inference path (see dali/tensor/Quantization.h):
+
+    out[i * ldout + j] += a_scales[i] * b_scales[j] * sum_k a[i, k] * b[j, k]
+
+`a` has m rows and `b` has n rows, both row major with `stride` bytes
+per row: the rows of `b` run along k, so `b` is the transpose of W in
+`x.dot(W)`. Rows are padded with zeros up to `stride`, a multiple of
+`int8_row_alignment`. Values must lie in [-127, 127] (-128 would
+overflow the pairwise products of AVX2), and `b_sums[j]` holds the sum
+of row j of `b` (the VNNI kernel multiplies unsigned activations, and
+subtracts the offset afterwards).
+
+Products accumulate in int32 and are exact up to k = 2^31 / 127^2
+(133,000). Like SimdFunctions.h, the kernel (AVX-512 VNNI, AVX2 or
+plain C++) is picked at runtime from the features of the cpu.
+*/
+
+namespace simd {
+    const int int8_row_alignment = 64;
+
+    void int8_gemm(const int8_t* a, const float* a_scales, int m,
+                   const int8_t* b, const float* b_scales, const int32_t* b_sums, int n,
+                   int stride, float* out, int ldout);
+
+    // "vnni", "avx2" or "scalar"
+    const std::string& int8_instruction_set();
+    // Forces the int8 kernel to a given instruction set (for testing
+    // and benchmarking). Returns false, leaving the current choice
+    // untouched, if this cpu or build does not support it.
+    bool set_int8_instruction_set(const std::string& name);
+}
+
+#endif
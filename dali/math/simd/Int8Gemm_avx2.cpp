@@ -0,0 +1,48 @@
+// Compiled with -mavx2 (see dali/CMakeLists.txt), only ever called
+// after checking that the cpu supports it.
+#include "dali/math/simd/Int8Kernels.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+namespace {
+    struct avx2_int8_traits {
+        typedef __m256i acc;
+        // maddubs multiplies unsigned by signed bytes: the sign of
+        // each activation moves onto the weight it multiplies.
+        struct activations {
+            __m256i magnitude;
+            __m256i value;
+        };
+        static const int width = 32;
+        static const bool unsigned_activations = false;
+
+        static acc zero() { return _mm256_setzero_si256(); }
+        static activations load_activations(const int8_t* a) {
+            __m256i value = _mm256_loadu_si256((const __m256i*)a);
+            activations x = {_mm256_abs_epi8(value), value};
+            return x;
+        }
+        static acc dot(acc sum, const activations& x, const int8_t* b) {
+            __m256i weights = _mm256_sign_epi8(_mm256_loadu_si256((const __m256i*)b), x.value);
+            // pairs of products fit in int16 since |values| <= 127.
+            __m256i pairs = _mm256_maddubs_epi16(x.magnitude, weights);
+            return _mm256_add_epi32(sum, _mm256_madd_epi16(pairs, _mm256_set1_epi16(1)));
+        }
+        static int32_t reduce(acc sum) {
+            __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+            half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+            half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+            return _mm_cvtsi128_si32(half);
+        }
+    };
+}
+
+const simd::int8_kernel_table* simd::avx2_int8_kernels() {
+    return kernels::int8_functions<avx2_int8_traits>::table("avx2");
+}
+#else
+const simd::int8_kernel_table* simd::avx2_int8_kernels() {
+    return nullptr;
+}
+#endif
@@ -0,0 +1,38 @@
+// Compiled with -mavx512f -mavx512vnni (see dali/CMakeLists.txt), only
+// ever called after checking that the cpu supports both.
+#include "dali/math/simd/Int8Kernels.h"
+
+#if defined(__AVX512F__) && defined(__AVX512VNNI__)
+#include <immintrin.h>
+
+namespace {
+    struct vnni_int8_traits {
+        typedef __m512i acc;
+        typedef __m512i activations;
+        static const int width = 64;
+        // dpbusd multiplies unsigned by signed bytes: activations are
+        // shifted by 128 (flipping their sign bit) and the offset is
+        // taken out with the sums of the weights.
+        static const bool unsigned_activations = true;
+
+        static acc zero() { return _mm512_setzero_si512(); }
+        static activations load_activations(const int8_t* a) {
+            return _mm512_xor_si512(_mm512_loadu_si512(a), _mm512_set1_epi8((char)0x80));
+        }
+        static acc dot(acc sum, activations x, const int8_t* b) {
+            return _mm512_dpbusd_epi32(sum, x, _mm512_loadu_si512(b));
+        }
+        static int32_t reduce(acc sum) {
+            return _mm512_reduce_add_epi32(sum);
+        }
+    };
+}
+
+const simd::int8_kernel_table* simd::vnni_int8_kernels() {
+    return kernels::int8_functions<vnni_int8_traits>::table("vnni");
+}
+#else
+const simd::int8_kernel_table* simd::vnni_int8_kernels() {
+    return nullptr;
+}
+#endif
@@ -0,0 +1,97 @@
+#ifndef DALI_MATH_SIMD_INT8_KERNELS_H
+#define DALI_MATH_SIMD_INT8_KERNELS_H
+
+#include <cstdint>
+
+/*
+Int8 Kernels
+------------
+
+Internal to dali/math/simd: the loops of `int8_gemm` written once
+against a traits struct `V` and instantiated by the translation units
+compiled for each instruction set (Int8Gemm_avx2.cpp and
+Int8Gemm_vnni.cpp). `V` provides:
+
+    acc                           int32 accumulator register
+    activations                   a loaded row chunk of `a`, prepared
+                                  for `dot`
+    width                         bytes of a row consumed per step
+    unsigned_activations          whether `load_activations` adds 128
+                                  to every value (then each result is
+                                  off by 128 * b_sums[j])
+    zero()                        empty accumulator
+    load_activations(a)           `width` values of a row of `a`
+    dot(sum, x, b)                sum + the products of x and `width`
+                                  values of a row of `b`, in int32
+    reduce(sum)                   horizontal sum of an accumulator
+
+As in SimdKernels.h, traits live in an anonymous namespace and nothing
+here is a non-template function.
+*/
+
+namespace simd {
+    typedef void (*int8_gemm_kernel_t)(const int8_t*, const float*, int,
+                                       const int8_t*, const float*, const int32_t*, int,
+                                       int, float*, int);
+
+    struct int8_kernel_table {
+        const char* name;
+        int8_gemm_kernel_t gemm;
+    };
+
+    // NULL when the library was built without support for the
+    // instruction set (the cpu may still lack it, check before use).
+    const int8_kernel_table* avx2_int8_kernels();
+    const int8_kernel_table* vnni_int8_kernels();
+
+    namespace kernels {
+        // `Rows` rows of b (starting at row j) against every row of a:
+        // the rows of b stay in L1 while the rows of a stream by.
+        template<typename V, int Rows>
+        void int8_gemm_block(const int8_t* a, const float* a_scales, int m,
+                             const int8_t* b, const float* b_scales, const int32_t* b_sums, int j,
+                             int stride, float* out, int ldout) {
+            typedef typename V::acc acc;
+            const int8_t* b_rows = b + (int64_t)j * stride;
+            for (int i = 0; i < m; ++i) {
+                const int8_t* a_row = a + (int64_t)i * stride;
+                acc sums[Rows];
+                for (int r = 0; r < Rows; ++r) sums[r] = V::zero();
+                for (int k = 0; k < stride; k += V::width) {
+                    auto x = V::load_activations(a_row + k);
+                    for (int r = 0; r < Rows; ++r) {
+                        sums[r] = V::dot(sums[r], x, b_rows + (int64_t)r * stride + k);
+                    }
+                }
+                float* out_row = out + (int64_t)i * ldout + j;
+                for (int r = 0; r < Rows; ++r) {
+                    int32_t total = V::reduce(sums[r]);
+                    if (V::unsigned_activations) total -= 128 * b_sums[j + r];
+                    out_row[r] += a_scales[i] * b_scales[j + r] * (float)total;
+                }
+            }
+        }
+
+        template<typename V>
+        struct int8_functions {
+            static void gemm(const int8_t* a, const float* a_scales, int m,
+                             const int8_t* b, const float* b_scales, const int32_t* b_sums, int n,
+                             int stride, float* out, int ldout) {
+                int j = 0;
+                for (; j + 4 <= n; j += 4) {
+                    int8_gemm_block<V, 4>(a, a_scales, m, b, b_scales, b_sums, j, stride, out, ldout);
+                }
+                for (; j < n; ++j) {
+                    int8_gemm_block<V, 1>(a, a_scales, m, b, b_scales, b_sums, j, stride, out, ldout);
+                }
+            }
+
+            static const int8_kernel_table* table(const char* name) {
+                static const int8_kernel_table result = {name, &gemm};
+                return &result;
+            }
+        };
+    }
+}
+
+#endif
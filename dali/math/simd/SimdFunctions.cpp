@@ -0,0 +1,146 @@
+#include "dali/math/simd/SimdFunctions.h"
+
+#include <atomic>
+
+#include "dali/math/simd/SimdKernels.h"
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+namespace {
+    #if defined(__SSE2__)
+    struct sse2_traits {
+        typedef __m128  vec;
+        typedef __m128  mask;
+        typedef __m128i ivec;
+        static const int width = 4;
+
+        static vec load(const float* x)    { return _mm_loadu_ps(x); }
+        static void store(float* x, vec v) { _mm_storeu_ps(x, v); }
+        static vec set1(float x)           { return _mm_set1_ps(x); }
+        static vec add(vec a, vec b)       { return _mm_add_ps(a, b); }
+        static vec sub(vec a, vec b)       { return _mm_sub_ps(a, b); }
+        static vec mul(vec a, vec b)       { return _mm_mul_ps(a, b); }
+        static vec div(vec a, vec b)       { return _mm_div_ps(a, b); }
+        static vec fmadd(vec a, vec b, vec c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+        static vec min(vec a, vec b)       { return _mm_min_ps(a, b); }
+        static vec max(vec a, vec b)       { return _mm_max_ps(a, b); }
+        static vec abs(vec a)              { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+        static vec sign_of(vec a)          { return _mm_and_ps(_mm_set1_ps(-0.0f), a); }
+        static vec or_(vec a, vec b)       { return _mm_or_ps(a, b); }
+        static mask lt(vec a, vec b)       { return _mm_cmplt_ps(a, b); }
+        static mask nge(vec a, vec b)      { return _mm_cmpnge_ps(a, b); }
+        static mask eq(vec a, vec b)       { return _mm_cmpeq_ps(a, b); }
+        static vec select(mask m, vec a, vec b) {
+            return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+        }
+        static ivec round_to_int(vec a)    { return _mm_cvtps_epi32(a); }
+        static vec int_to_float(ivec a)    { return _mm_cvtepi32_ps(a); }
+        static ivec shift_right_int(ivec a, int bits) { return _mm_srai_epi32(a, bits); }
+        static ivec sub_int(ivec a, ivec b) { return _mm_sub_epi32(a, b); }
+        static vec pow2(ivec n) {
+            return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23));
+        }
+        static ivec exponent(vec a) {
+            return _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(a), 23), _mm_set1_epi32(126));
+        }
+        static vec mantissa(vec a) {
+            return _mm_or_ps(
+                _mm_and_ps(a, _mm_castsi128_ps(_mm_set1_epi32(0x007fffff))),
+                _mm_set1_ps(0.5f));
+        }
+    };
+    #endif
+
+    const simd::kernel_table scalar_kernels = {
+        "scalar",
+        &simd::exp<float>,
+        &simd::log<float>,
+        &simd::sigmoid<float>,
+        &simd::tanh<float>,
+        &simd::softplus<float>,
+        &simd::steep_sigmoid<float>
+    };
+
+    const simd::kernel_table* baseline_kernels() {
+        #if defined(__SSE2__)
+            return simd::kernels::functions<sse2_traits>::table("sse2");
+        #else
+            return &scalar_kernels;
+        #endif
+    }
+
+    bool cpu_supports(const std::string& name) {
+        #if defined(__x86_64__) || defined(__i386__)
+            if (name == "avx512") return __builtin_cpu_supports("avx512f");
+            if (name == "avx2")   return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+            if (name == "sse2")   return __builtin_cpu_supports("sse2");
+        #endif
+        return name == "scalar";
+    }
+
+    const simd::kernel_table* kernels_for(const std::string& name) {
+        if (!cpu_supports(name)) return NULL;
+        if (name == "avx512") return simd::avx512_kernels();
+        if (name == "avx2")   return simd::avx2_kernels();
+        if (name == "scalar") return &scalar_kernels;
+        auto baseline = baseline_kernels();
+        return name == baseline->name ? baseline : NULL;
+    }
+
+    const simd::kernel_table* detect_kernels() {
+        for (auto name : {"avx512", "avx2"}) {
+            auto table = kernels_for(name);
+            if (table != NULL) return table;
+        }
+        return baseline_kernels();
+    }
+
+    std::atomic<const simd::kernel_table*>& active_kernels() {
+        static std::atomic<const simd::kernel_table*> active(detect_kernels());
+        return active;
+    }
+}
+
+namespace simd {
+    void exp(const float* in, float* out, int size) {
+        active_kernels().load(std::memory_order_relaxed)->exp(in, out, size);
+    }
+
+    void log(const float* in, float* out, int size) {
+        active_kernels().load(std::memory_order_relaxed)->log(in, out, size);
+    }
+
+    void sigmoid(const float* in, float* out, int size) {
+        active_kernels().load(std::memory_order_relaxed)->sigmoid(in, out, size);
+    }
+
+    void tanh(const float* in, float* out, int size) {
+        active_kernels().load(std::memory_order_relaxed)->tanh(in, out, size);
+    }
+
+    void softplus(const float* in, float* out, int size) {
+        active_kernels().load(std::memory_order_relaxed)->softplus(in, out, size);
+    }
+
+    void steep_sigmoid(const float* in, float* out, int size, float aggressiveness) {
+        active_kernels().load(std::memory_order_relaxed)->steep_sigmoid(in, out, size, aggressiveness);
+    }
+
+    const std::string& instruction_set() {
+        static const std::string names[] = {"avx512", "avx2", "sse2", "scalar"};
+        std::string current = active_kernels().load()->name;
+        for (auto& name : names) {
+            if (name == current) return name;
+        }
+        return names[3];
+    }
+
+    bool set_instruction_set(const std::string& name) {
+        auto table = kernels_for(name);
+        if (table == NULL) return false;
+        active_kernels() = table;
+        return true;
+    }
+}
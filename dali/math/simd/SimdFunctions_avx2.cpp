@@ -0,0 +1,57 @@
+// Compiled with -mavx2 -mfma (see dali/CMakeLists.txt), only ever
+// called after checking that the cpu supports both.
+#include "dali/math/simd/SimdKernels.h"
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+
+namespace {
+    struct avx2_traits {
+        typedef __m256  vec;
+        typedef __m256  mask;
+        typedef __m256i ivec;
+        static const int width = 8;
+
+        static vec load(const float* x)    { return _mm256_loadu_ps(x); }
+        static void store(float* x, vec v) { _mm256_storeu_ps(x, v); }
+        static vec set1(float x)           { return _mm256_set1_ps(x); }
+        static vec add(vec a, vec b)       { return _mm256_add_ps(a, b); }
+        static vec sub(vec a, vec b)       { return _mm256_sub_ps(a, b); }
+        static vec mul(vec a, vec b)       { return _mm256_mul_ps(a, b); }
+        static vec div(vec a, vec b)       { return _mm256_div_ps(a, b); }
+        static vec fmadd(vec a, vec b, vec c) { return _mm256_fmadd_ps(a, b, c); }
+        static vec min(vec a, vec b)       { return _mm256_min_ps(a, b); }
+        static vec max(vec a, vec b)       { return _mm256_max_ps(a, b); }
+        static vec abs(vec a)              { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+        static vec sign_of(vec a)          { return _mm256_and_ps(_mm256_set1_ps(-0.0f), a); }
+        static vec or_(vec a, vec b)       { return _mm256_or_ps(a, b); }
+        static mask lt(vec a, vec b)       { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+        static mask nge(vec a, vec b)      { return _mm256_cmp_ps(a, b, _CMP_NGE_UQ); }
+        static mask eq(vec a, vec b)       { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+        static vec select(mask m, vec a, vec b) { return _mm256_blendv_ps(b, a, m); }
+        static ivec round_to_int(vec a)    { return _mm256_cvtps_epi32(a); }
+        static vec int_to_float(ivec a)    { return _mm256_cvtepi32_ps(a); }
+        static ivec shift_right_int(ivec a, int bits) { return _mm256_srai_epi32(a, bits); }
+        static ivec sub_int(ivec a, ivec b) { return _mm256_sub_epi32(a, b); }
+        static vec pow2(ivec n) {
+            return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(n, _mm256_set1_epi32(127)), 23));
+        }
+        static ivec exponent(vec a) {
+            return _mm256_sub_epi32(_mm256_srli_epi32(_mm256_castps_si256(a), 23), _mm256_set1_epi32(126));
+        }
+        static vec mantissa(vec a) {
+            return _mm256_or_ps(
+                _mm256_and_ps(a, _mm256_castsi256_ps(_mm256_set1_epi32(0x007fffff))),
+                _mm256_set1_ps(0.5f));
+        }
+    };
+}
+
+const simd::kernel_table* simd::avx2_kernels() {
+    return kernels::functions<avx2_traits>::table("avx2");
+}
+#else
+const simd::kernel_table* simd::avx2_kernels() {
+    return nullptr;
+}
+#endif
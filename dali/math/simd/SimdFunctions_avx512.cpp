@@ -0,0 +1,67 @@
+// Compiled with -mavx512f -mfma (see dali/CMakeLists.txt), only ever
+// called after checking that the cpu supports AVX-512F.
+#include "dali/math/simd/SimdKernels.h"
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+
+namespace {
+    struct avx512_traits {
+        typedef __m512    vec;
+        typedef __mmask16 mask;
+        typedef __m512i   ivec;
+        static const int width = 16;
+
+        static vec load(const float* x)    { return _mm512_loadu_ps(x); }
+        static void store(float* x, vec v) { _mm512_storeu_ps(x, v); }
+        static vec set1(float x)           { return _mm512_set1_ps(x); }
+        static vec add(vec a, vec b)       { return _mm512_add_ps(a, b); }
+        static vec sub(vec a, vec b)       { return _mm512_sub_ps(a, b); }
+        static vec mul(vec a, vec b)       { return _mm512_mul_ps(a, b); }
+        static vec div(vec a, vec b)       { return _mm512_div_ps(a, b); }
+        static vec fmadd(vec a, vec b, vec c) { return _mm512_fmadd_ps(a, b, c); }
+        static vec min(vec a, vec b)       { return _mm512_min_ps(a, b); }
+        static vec max(vec a, vec b)       { return _mm512_max_ps(a, b); }
+        // AVX-512F has no float bitwise ops, they go through the integer unit.
+        static vec abs(vec a) {
+            return _mm512_castsi512_ps(_mm512_and_si512(
+                _mm512_castps_si512(a), _mm512_set1_epi32(0x7fffffff)));
+        }
+        static vec sign_of(vec a) {
+            return _mm512_castsi512_ps(_mm512_and_si512(
+                _mm512_castps_si512(a), _mm512_set1_epi32((int)0x80000000)));
+        }
+        static vec or_(vec a, vec b) {
+            return _mm512_castsi512_ps(_mm512_or_si512(
+                _mm512_castps_si512(a), _mm512_castps_si512(b)));
+        }
+        static mask lt(vec a, vec b)       { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+        static mask nge(vec a, vec b)      { return _mm512_cmp_ps_mask(a, b, _CMP_NGE_UQ); }
+        static mask eq(vec a, vec b)       { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+        static vec select(mask m, vec a, vec b) { return _mm512_mask_blend_ps(m, b, a); }
+        static ivec round_to_int(vec a)    { return _mm512_cvtps_epi32(a); }
+        static vec int_to_float(ivec a)    { return _mm512_cvtepi32_ps(a); }
+        static ivec shift_right_int(ivec a, int bits) { return _mm512_srai_epi32(a, bits); }
+        static ivec sub_int(ivec a, ivec b) { return _mm512_sub_epi32(a, b); }
+        static vec pow2(ivec n) {
+            return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(n, _mm512_set1_epi32(127)), 23));
+        }
+        static ivec exponent(vec a) {
+            return _mm512_sub_epi32(_mm512_srli_epi32(_mm512_castps_si512(a), 23), _mm512_set1_epi32(126));
+        }
+        static vec mantissa(vec a) {
+            return _mm512_castsi512_ps(_mm512_or_si512(
+                _mm512_and_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x007fffff)),
+                _mm512_set1_epi32(0x3f000000)));
+        }
+    };
+}
+
+const simd::kernel_table* simd::avx512_kernels() {
+    return kernels::functions<avx512_traits>::table("avx512");
+}
+#else
+const simd::kernel_table* simd::avx512_kernels() {
+    return nullptr;
+}
+#endif
@@ -0,0 +1,226 @@
+#ifndef DALI_MATH_SIMD_SIMD_KERNELS_H
+#define DALI_MATH_SIMD_SIMD_KERNELS_H
+
+/*
+Simd Kernels
+------------
+
+Internal to dali/math/simd: vectorized float approximations written
+once against a "vector traits" struct and instantiated by every
+translation unit that is compiled for a given instruction set
+(SimdFunctions.cpp for SSE2, SimdFunctions_avx2.cpp and
+SimdFunctions_avx512.cpp with their own compiler flags).
+
+A traits struct `V` provides:
+
+    vec, mask                     register and comparison-result types
+    width                         floats per register
+    load / store                  unaligned memory access
+    set1, add, sub, mul, div, fmadd(a, b, c) = a * b + c,
+    min, max                      (with SSE semantics: NaN in the
+                                   second operand is returned)
+    abs, sign_of, or_             sign bit manipulation
+    lt, nge                       comparisons (nge is true for NaN)
+    eq                            equality comparison
+    select(m, a, b)               m ? a : b
+    round_to_int, int_to_float    conversions through `ivec`
+    shift_right_int, sub_int      arithmetic on `ivec`
+    pow2(n)                       2^n for integer n in [-126, 127]
+    exponent / mantissa           frexp-style split of a positive
+                                  normal float (mantissa in [0.5, 1))
+
+Traits must have internal linkage (anonymous namespace) so that code
+compiled for a wider instruction set can never be picked by the linker
+in place of the baseline one. For the same reason nothing in this file
+is a non-template function.
+
+The coefficients come from the Cephes single precision library.
+*/
+
+namespace simd {
+    typedef void (*unary_kernel_t)(const float*, float*, int);
+    typedef void (*scalar_arg_kernel_t)(const float*, float*, int, float);
+
+    struct kernel_table {
+        const char* name;
+        unary_kernel_t exp;
+        unary_kernel_t log;
+        unary_kernel_t sigmoid;
+        unary_kernel_t tanh;
+        unary_kernel_t softplus;
+        scalar_arg_kernel_t steep_sigmoid;
+    };
+
+    // NULL when the library was built without support for the
+    // instruction set (the cpu may still lack it, check before use).
+    const kernel_table* avx2_kernels();
+    const kernel_table* avx512_kernels();
+
+    namespace kernels {
+        template<typename V>
+        typename V::vec exp(typename V::vec x) {
+            typedef typename V::vec vec;
+            vec original = x;
+            // NaN survives the clamp since it sits in the second operand.
+            x = V::min(V::set1(88.7228394f), V::max(V::set1(-104.0f), x));
+
+            auto n = V::round_to_int(V::mul(x, V::set1(1.44269504088896341f)));
+            vec fn = V::int_to_float(n);
+            vec r = V::fmadd(fn, V::set1(-0.693359375f), x);
+            r = V::fmadd(fn, V::set1(2.12194440e-4f), r);
+
+            vec p = V::set1(1.9875691500E-4f);
+            p = V::fmadd(p, r, V::set1(1.3981999507E-3f));
+            p = V::fmadd(p, r, V::set1(8.3334519073E-3f));
+            p = V::fmadd(p, r, V::set1(4.1665795894E-2f));
+            p = V::fmadd(p, r, V::set1(1.6666665459E-1f));
+            p = V::fmadd(p, r, V::set1(5.0000001201E-1f));
+            vec y = V::add(V::fmadd(p, V::mul(r, r), r), V::set1(1.0f));
+
+            // 2^n is applied in two halves so that results close to
+            // overflow or in the denormal range are still reached.
+            auto half = V::shift_right_int(n, 1);
+            y = V::mul(y, V::pow2(half));
+            y = V::mul(y, V::pow2(V::sub_int(n, half)));
+            // past the clamp the result overflows.
+            y = V::select(V::lt(V::set1(88.7228394f), original), V::set1(__builtin_inff()), y);
+            return y;
+        }
+
+        template<typename V>
+        typename V::vec log(typename V::vec x) {
+            typedef typename V::vec vec;
+            vec original = x;
+            // bring denormals into the normal range first.
+            auto is_denormal = V::lt(x, V::set1(1.17549435e-38f));
+            x = V::select(is_denormal, V::mul(x, V::set1(33554432.0f)), x);
+            vec e = V::add(
+                V::int_to_float(V::exponent(x)),
+                V::select(is_denormal, V::set1(-25.0f), V::set1(0.0f)));
+            vec m = V::mantissa(x);
+
+            // m in [sqrt(1/2), sqrt(2)) around 1.
+            auto below = V::lt(m, V::set1(0.707106781186547524f));
+            e = V::sub(e, V::select(below, V::set1(1.0f), V::set1(0.0f)));
+            m = V::sub(V::add(m, V::select(below, m, V::set1(0.0f))), V::set1(1.0f));
+
+            vec z = V::mul(m, m);
+            vec p = V::set1(7.0376836292E-2f);
+            p = V::fmadd(p, m, V::set1(-1.1514610310E-1f));
+            p = V::fmadd(p, m, V::set1(1.1676998740E-1f));
+            p = V::fmadd(p, m, V::set1(-1.2420140846E-1f));
+            p = V::fmadd(p, m, V::set1(1.4249322787E-1f));
+            p = V::fmadd(p, m, V::set1(-1.6668057665E-1f));
+            p = V::fmadd(p, m, V::set1(2.0000714765E-1f));
+            p = V::fmadd(p, m, V::set1(-2.4999993993E-1f));
+            p = V::fmadd(p, m, V::set1(3.3333331174E-1f));
+            vec y = V::mul(V::mul(p, m), z);
+            y = V::fmadd(e, V::set1(-2.12194440e-4f), y);
+            y = V::fmadd(z, V::set1(-0.5f), y);
+            y = V::add(m, y);
+            y = V::fmadd(e, V::set1(0.693359375f), y);
+
+            y = V::select(V::eq(original, V::set1(__builtin_inff())), original, y);
+            y = V::select(V::eq(original, V::set1(0.0f)), V::set1(-__builtin_inff()), y);
+            // negative numbers and NaN
+            y = V::select(V::nge(original, V::set1(0.0f)), V::set1(__builtin_nanf("")), y);
+            return y;
+        }
+
+        template<typename V>
+        typename V::vec tanh(typename V::vec x) {
+            typedef typename V::vec vec;
+            vec ax = V::abs(x);
+
+            // small arguments: odd polynomial.
+            vec z = V::mul(x, x);
+            vec p = V::set1(-5.70498872745E-3f);
+            p = V::fmadd(p, z, V::set1(2.06390887954E-2f));
+            p = V::fmadd(p, z, V::set1(-5.37397155531E-2f));
+            p = V::fmadd(p, z, V::set1(1.33314422036E-1f));
+            p = V::fmadd(p, z, V::set1(-3.33332819422E-1f));
+            vec small = V::fmadd(V::mul(p, z), x, x);
+
+            // large arguments: 1 - 2 / (exp(2|x|) + 1), with the sign of x.
+            vec ex = exp<V>(V::add(ax, ax));
+            vec large = V::sub(V::set1(1.0f), V::div(V::set1(2.0f), V::add(ex, V::set1(1.0f))));
+            large = V::or_(large, V::sign_of(x));
+
+            return V::select(V::lt(ax, V::set1(0.625f)), small, large);
+        }
+
+        template<typename V>
+        typename V::vec sigmoid(typename V::vec x) {
+            typedef typename V::vec vec;
+            vec ex = exp<V>(V::sub(V::set1(0.0f), x));
+            return V::div(V::set1(1.0f), V::add(V::set1(1.0f), ex));
+        }
+
+        template<typename V>
+        typename V::vec softplus(typename V::vec x) {
+            typedef typename V::vec vec;
+            // log(1 + u) as log(w) * u / (w - 1) with w = 1 + u, which
+            // cancels the rounding of w and keeps small results exact.
+            vec u = exp<V>(x);
+            vec w = V::add(V::set1(1.0f), u);
+            vec d = V::sub(w, V::set1(1.0f));
+            vec soft = V::select(V::eq(d, V::set1(0.0f)), u, V::mul(log<V>(w), V::div(u, d)));
+            return V::select(V::lt(V::set1(20.0f), x), x, soft);
+        }
+
+        // Applies `kernel` register by register, the tail goes through a
+        // zero padded register sized buffer.
+        template<typename V, typename Kernel>
+        void map(const float* in, float* out, int size, Kernel kernel) {
+            int i = 0;
+            for (; i + V::width <= size; i += V::width) {
+                V::store(out + i, kernel(V::load(in + i)));
+            }
+            if (i < size) {
+                float buffer[V::width];
+                int remainder = size - i;
+                for (int j = 0; j < V::width; j++) {
+                    buffer[j] = j < remainder ? in[i + j] : 0.0f;
+                }
+                V::store(buffer, kernel(V::load(buffer)));
+                for (int j = 0; j < remainder; j++) {
+                    out[i + j] = buffer[j];
+                }
+            }
+        }
+
+        template<typename V>
+        struct functions {
+            typedef typename V::vec vec;
+
+            static void exp(const float* in, float* out, int size) {
+                map<V>(in, out, size, [](vec x) { return kernels::exp<V>(x); });
+            }
+            static void log(const float* in, float* out, int size) {
+                map<V>(in, out, size, [](vec x) { return kernels::log<V>(x); });
+            }
+            static void sigmoid(const float* in, float* out, int size) {
+                map<V>(in, out, size, [](vec x) { return kernels::sigmoid<V>(x); });
+            }
+            static void tanh(const float* in, float* out, int size) {
+                map<V>(in, out, size, [](vec x) { return kernels::tanh<V>(x); });
+            }
+            static void softplus(const float* in, float* out, int size) {
+                map<V>(in, out, size, [](vec x) { return kernels::softplus<V>(x); });
+            }
+            static void steep_sigmoid(const float* in, float* out, int size, float aggressiveness) {
+                vec a = V::set1(aggressiveness);
+                map<V>(in, out, size, [a](vec x) { return kernels::sigmoid<V>(V::mul(a, x)); });
+            }
+
+            static const kernel_table* table(const char* name) {
+                static const kernel_table result = {
+                    name, &exp, &log, &sigmoid, &tanh, &softplus, &steep_sigmoid
+                };
+                return &result;
+            }
+        };
+    }
+}
+
+#endif
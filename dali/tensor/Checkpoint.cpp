@@ -0,0 +1,289 @@
+#include "dali/tensor/Checkpoint.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dali/utils/assert2.h"
+#include "dali/utils/core_utils.h"
+
+using std::string;
+using std::vector;
+using utils::MS;
+
+namespace {
+    const char     CHECKPOINT_MAGIC[8]  = {'D', 'A', 'L', 'I', 'C', 'K', 'P', 'T'};
+    const uint32_t CHECKPOINT_VERSION   = 1;
+    const uint32_t CHECKPOINT_BYTE_ORDER = 0x01020304;
+    const uint64_t CHECKPOINT_ALIGNMENT = 64;
+
+    struct checkpoint_header {
+        char     magic[8];
+        uint32_t version;
+        uint32_t num_tensors;
+        uint32_t byte_order;
+        uint32_t alignment;
+        uint64_t file_size;
+        uint64_t index_checksum;
+        char     reserved[24];
+    };
+    static_assert(sizeof(checkpoint_header) == 64, "checkpoint header must take 64 bytes.");
+
+    struct checkpoint_entry {
+        uint32_t dtype;
+        uint32_t rows;
+        uint32_t cols;
+        uint32_t reserved;
+        uint64_t offset;
+        uint64_t checksum;
+    };
+    static_assert(sizeof(checkpoint_entry) == 32, "checkpoint index entries must take 32 bytes.");
+
+    enum checkpoint_dtype {
+        DTYPE_FLOAT  = 1,
+        DTYPE_DOUBLE = 2,
+        DTYPE_INT32  = 3
+    };
+
+    template<typename R> uint32_t dtype_of();
+    template<> uint32_t dtype_of<float>()  { return DTYPE_FLOAT; }
+    template<> uint32_t dtype_of<double>() { return DTYPE_DOUBLE; }
+
+    size_t dtype_size(uint32_t dtype) {
+        return dtype == DTYPE_DOUBLE ? sizeof(double) : 4;
+    }
+
+    // FNV-1a over 64 bit words (and the remaining bytes one by one).
+    uint64_t checksum(const char* data, size_t size) {
+        const uint64_t prime = 1099511628211ULL;
+        uint64_t hash = 14695981039346656037ULL;
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+            uint64_t word;
+            memcpy(&word, data + i, sizeof(uint64_t));
+            hash = (hash ^ word) * prime;
+        }
+        for (; i < size; i++) {
+            hash = (hash ^ (unsigned char)data[i]) * prime;
+        }
+        return hash;
+    }
+
+    uint64_t aligned(uint64_t offset) {
+        return (offset + CHECKPOINT_ALIGNMENT - 1) / CHECKPOINT_ALIGNMENT * CHECKPOINT_ALIGNMENT;
+    }
+
+    uint64_t entry_bytes(const checkpoint_entry& entry) {
+        return (uint64_t)entry.rows * entry.cols * dtype_size(entry.dtype);
+    }
+
+    void check_header(const checkpoint_header& header, uint64_t file_size, const string& filename) {
+        ASSERT2(memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) == 0,
+                MS() << "Error: " << filename << " is not a checkpoint.");
+        ASSERT2(header.version == CHECKPOINT_VERSION,
+                MS() << "Error: unsupported checkpoint version " << header.version
+                     << " in " << filename << ".");
+        ASSERT2(header.byte_order == CHECKPOINT_BYTE_ORDER,
+                MS() << "Error: checkpoint " << filename << " was written with another byte order.");
+        ASSERT2(header.file_size == file_size,
+                MS() << "Error: checkpoint " << filename << " is truncated (expected "
+                     << header.file_size << " bytes, found " << file_size << ").");
+    }
+
+    void check_index(const checkpoint_header& header,
+                     const checkpoint_entry* entries,
+                     const string& filename) {
+        ASSERT2(checksum((const char*)entries, header.num_tensors * sizeof(checkpoint_entry)) == header.index_checksum,
+                MS() << "Error: index of checkpoint " << filename << " is corrupted.");
+        for (int i = 0; i < header.num_tensors; i++) {
+            ASSERT2(entries[i].offset % CHECKPOINT_ALIGNMENT == 0 &&
+                    entries[i].offset + entry_bytes(entries[i]) <= header.file_size,
+                    MS() << "Error: tensor " << i << " lies outside of checkpoint " << filename << ".");
+        }
+    }
+
+    template<typename R>
+    void check_parameter(const Mat<R>& param, const checkpoint_entry& entry, int i) {
+        ASSERT2(param.dims(0) == entry.rows && param.dims(1) == entry.cols,
+                MS() << "Error: parameter " << i << " has dimensions " << param.dims(0) << "x" << param.dims(1)
+                     << " but the checkpoint holds a " << entry.rows << "x" << entry.cols << " tensor.");
+    }
+
+    template<typename R>
+    void check_parameters(const vector<Mat<R>>& parameters, const checkpoint_header& header, const string& filename) {
+        ASSERT2(parameters.size() == header.num_tensors,
+                MS() << "Error: checkpoint " << filename << " holds " << header.num_tensors
+                     << " tensors, but " << parameters.size() << " parameters were given.");
+    }
+
+    struct mapped_file {
+        void* data;
+        size_t size;
+        mapped_file(void* data, size_t size) : data(data), size(size) {}
+        ~mapped_file() {
+            munmap(data, size);
+        }
+    };
+}
+
+namespace utils {
+    template<typename R>
+    void save_checkpoint(const vector<Mat<R>>& parameters, const string& filename) {
+        checkpoint_header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        header.version     = CHECKPOINT_VERSION;
+        header.num_tensors = parameters.size();
+        header.byte_order  = CHECKPOINT_BYTE_ORDER;
+        header.alignment   = CHECKPOINT_ALIGNMENT;
+
+        vector<checkpoint_entry> entries(parameters.size());
+        uint64_t offset = aligned(sizeof(header) + entries.size() * sizeof(checkpoint_entry));
+        for (int i = 0; i < parameters.size(); i++) {
+            auto& entry = entries[i];
+            memset(&entry, 0, sizeof(entry));
+            entry.dtype  = dtype_of<R>();
+            entry.rows   = parameters[i].dims(0);
+            entry.cols   = parameters[i].dims(1);
+            entry.offset = offset;
+            entry.checksum = checksum(entry_bytes(entry) > 0 ?
+                    (const char*)parameters[i].w().cpu_data().dptr_ : NULL,
+                    entry_bytes(entry));
+            offset = aligned(offset + entry_bytes(entry));
+        }
+        header.file_size = entries.empty() ? offset :
+            entries.back().offset + entry_bytes(entries.back());
+        header.index_checksum = checksum((const char*)entries.data(), entries.size() * sizeof(checkpoint_entry));
+
+        FILE* fp = fopen(filename.c_str(), "wb");
+        ASSERT2(fp != NULL, MS() << "Error: could not open " << filename << " for writing.");
+        std::unique_ptr<FILE, int(*)(FILE*)> file(fp, fclose);
+        bool written = fwrite(&header, sizeof(header), 1, fp) == 1;
+        if (!entries.empty()) {
+            written = written && fwrite(entries.data(), sizeof(checkpoint_entry), entries.size(), fp) == entries.size();
+        }
+        uint64_t position = sizeof(header) + entries.size() * sizeof(checkpoint_entry);
+        const char padding[CHECKPOINT_ALIGNMENT] = {0};
+        for (int i = 0; i < parameters.size() && written; i++) {
+            if (entries[i].offset > position) {
+                written = fwrite(padding, 1, entries[i].offset - position, fp) == entries[i].offset - position;
+            }
+            auto bytes = entry_bytes(entries[i]);
+            if (bytes > 0) {
+                written = written && fwrite(parameters[i].w().cpu_data().dptr_, 1, bytes, fp) == bytes;
+            }
+            position = entries[i].offset + bytes;
+        }
+        ASSERT2(written && fflush(fp) == 0, MS() << "Error: could not write checkpoint " << filename << ".");
+    }
+
+    template<typename R>
+    void load_checkpoint(vector<Mat<R>> parameters, const string& filename, bool verify_checksums) {
+        FILE* fp = fopen(filename.c_str(), "rb");
+        ASSERT2(fp != NULL, MS() << "Error: could not open checkpoint " << filename << ".");
+        std::unique_ptr<FILE, int(*)(FILE*)> file(fp, fclose);
+
+        struct stat file_stat;
+        ASSERT2(fstat(fileno(fp), &file_stat) == 0, MS() << "Error: could not stat " << filename << ".");
+        checkpoint_header header;
+        ASSERT2(fread(&header, sizeof(header), 1, fp) == 1,
+                MS() << "Error: " << filename << " is not a checkpoint.");
+        check_header(header, file_stat.st_size, filename);
+        check_parameters(parameters, header, filename);
+
+        vector<checkpoint_entry> entries(header.num_tensors);
+        ASSERT2(entries.empty() || fread(entries.data(), sizeof(checkpoint_entry), entries.size(), fp) == entries.size(),
+                MS() << "Error: index of checkpoint " << filename << " is truncated.");
+        check_index(header, entries.data(), filename);
+
+        vector<char> buffer;
+        for (int i = 0; i < parameters.size(); i++) {
+            auto& entry = entries[i];
+            check_parameter(parameters[i], entry, i);
+            uint64_t bytes = entry_bytes(entry);
+            bool same_type = entry.dtype == dtype_of<R>();
+            ASSERT2(same_type || (entry.dtype != DTYPE_INT32 && dtype_of<R>() != DTYPE_INT32),
+                    MS() << "Error: tensor " << i << " of " << filename
+                         << " cannot be converted to the parameter's type.");
+            // read straight into the parameter when no conversion is needed.
+            char* destination;
+            if (same_type) {
+                destination = (char*)parameters[i].w().overwrite_cpu_data().dptr_;
+            } else {
+                buffer.resize(bytes);
+                destination = buffer.data();
+            }
+            ASSERT2(fseek(fp, entry.offset, SEEK_SET) == 0 &&
+                    (bytes == 0 || fread(destination, 1, bytes, fp) == bytes),
+                    MS() << "Error: could not read tensor " << i << " of " << filename << ".");
+            ASSERT2(!verify_checksums || checksum(destination, bytes) == entry.checksum,
+                    MS() << "Error: tensor " << i << " of checkpoint " << filename << " is corrupted.");
+            if (!same_type) {
+                R* data = parameters[i].w().overwrite_cpu_data().dptr_;
+                int size = entry.rows * entry.cols;
+                if (entry.dtype == DTYPE_DOUBLE) {
+                    std::copy((const double*)destination, (const double*)destination + size, data);
+                } else {
+                    std::copy((const float*)destination, (const float*)destination + size, data);
+                }
+            }
+        }
+    }
+
+    template<typename R>
+    void map_checkpoint(vector<Mat<R>> parameters, const string& filename, bool verify_checksums) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        ASSERT2(fd >= 0, MS() << "Error: could not open checkpoint " << filename << ".");
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0) {
+            close(fd);
+            ASSERT2(false, MS() << "Error: could not stat " << filename << ".");
+        }
+        size_t file_size = file_stat.st_size;
+        if (file_size < sizeof(checkpoint_header)) {
+            close(fd);
+            ASSERT2(false, MS() << "Error: " << filename << " is not a checkpoint.");
+        }
+        // private mapping: pages written to are copied, never written back.
+        void* data = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        ASSERT2(data != MAP_FAILED, MS() << "Error: could not map checkpoint " << filename << ".");
+        auto mapping = std::make_shared<mapped_file>(data, file_size);
+
+        const char* base = (const char*)data;
+        auto& header = *(const checkpoint_header*)base;
+        check_header(header, file_size, filename);
+        check_parameters(parameters, header, filename);
+        ASSERT2(sizeof(header) + header.num_tensors * sizeof(checkpoint_entry) <= file_size,
+                MS() << "Error: index of checkpoint " << filename << " is truncated.");
+        auto entries = (const checkpoint_entry*)(base + sizeof(header));
+        check_index(header, entries, filename);
+
+        for (int i = 0; i < parameters.size(); i++) {
+            auto& entry = entries[i];
+            check_parameter(parameters[i], entry, i);
+            ASSERT2(entry.dtype == dtype_of<R>(),
+                    MS() << "Error: tensor " << i << " of " << filename
+                         << " has another type than the parameter, use load_checkpoint to convert it.");
+            auto& memory = parameters[i].w().memory();
+            ASSERT2(parameters[i].w().offset == 0 && memory.total_memory == entry.rows * entry.cols,
+                    MS() << "Error: parameter " << i << " is a view and cannot be mapped.");
+            ASSERT2(!verify_checksums || checksum(base + entry.offset, entry_bytes(entry)) == entry.checksum,
+                    MS() << "Error: tensor " << i << " of checkpoint " << filename << " is corrupted.");
+            memory.adopt_cpu((R*)(base + entry.offset), mapping);
+        }
+    }
+
+    template void save_checkpoint(const vector<Mat<float>>&, const string&);
+    template void save_checkpoint(const vector<Mat<double>>&, const string&);
+    template void load_checkpoint(vector<Mat<float>>, const string&, bool);
+    template void load_checkpoint(vector<Mat<double>>, const string&, bool);
+    template void map_checkpoint(vector<Mat<float>>, const string&, bool);
+    template void map_checkpoint(vector<Mat<double>>, const string&, bool);
+}
@@ -0,0 +1,52 @@
+#ifndef DALI_TENSOR_CHECKPOINT_H
+#define DALI_TENSOR_CHECKPOINT_H
+
+#include <string>
+#include <vector>
+
+#include "dali/tensor/Mat.h"
+
+/*
+Checkpoint
+----------
+
+Single file binary format for the parameters of a model, designed
+to be memory mapped:
+
+    header   64 bytes: magic "DALICKPT", version, number of tensors,
+             byte order mark, data alignment, file size and a
+             checksum of the index
+    index    32 bytes per tensor: dtype, rows, cols, offset of the
+             data in the file and a checksum of the data
+    data     row major values, each tensor starting on a 64 byte
+             boundary
+
+`map_checkpoint` makes the parameters point straight at the pages of
+the file (private, copy-on-write mapping: a model can keep training
+and the file on disk never changes), so startup costs a few system
+calls however big the model is. Pages are read from disk (or shared
+from the page cache with other processes mapping the same file) as
+they are first touched.
+*/
+
+namespace utils {
+    // write the parameters to a single checkpoint file.
+    template<typename R>
+    void save_checkpoint(const std::vector<Mat<R>>& parameters, const std::string& filename);
+
+    // copy the checkpoint into the parameters, which must already
+    // have the saved dimensions. Values saved with another floating
+    // point type are converted.
+    template<typename R>
+    void load_checkpoint(std::vector<Mat<R>> parameters, const std::string& filename,
+                         bool verify_checksums=true);
+
+    // point the parameters at a private mapping of the checkpoint
+    // (dimensions and type must match). Data checksums are only
+    // verified on demand since doing so reads the entire file.
+    template<typename R>
+    void map_checkpoint(std::vector<Mat<R>> parameters, const std::string& filename,
+                        bool verify_checksums=false);
+}
+
+#endif
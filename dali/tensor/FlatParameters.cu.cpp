@@ -0,0 +1,165 @@
+#include "dali/tensor/FlatParameters.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+
+#include "dali/math/LazyTensor.h"
+#include "dali/utils/assert2.h"
+
+using std::vector;
+using utils::MS;
+
+namespace {
+    // every parameter starts on a cache line (and widest vector) boundary.
+    const int FLAT_ALIGNMENT = 64;
+
+    template<typename R>
+    std::shared_ptr<SynchronizedMemory<R>> aligned_memory(int size) {
+        void* ptr = NULL;
+        ASSERT2(posix_memalign(&ptr, FLAT_ALIGNMENT, size * sizeof(R)) == 0,
+                MS() << "Error: could not allocate " << size << " values for flat parameters.");
+        // padding between parameters must read as zeros.
+        memset(ptr, 0, size * sizeof(R));
+        auto memory = std::make_shared<SynchronizedMemory<R>>(size);
+        memory->adopt_cpu((R*)ptr, std::shared_ptr<void>(ptr, free));
+        return memory;
+    }
+
+    // copy the values of `tensor` to `memory` at `offset`, and make
+    // it (and so every Mat sharing it) a view of that slice.
+    template<typename R>
+    void relocate(TensorInternal<R,2>& tensor, std::shared_ptr<SynchronizedMemory<R>> memory, int offset) {
+        auto source = tensor.cpu_data();
+        memcpy(memory->mutable_cpu_data() + offset, source.dptr_, tensor.number_of_elements() * sizeof(R));
+        tensor.memory_ = memory;
+        tensor.offset  = offset;
+    }
+}
+
+template<typename R>
+FlatParameters<R>::FlatParameters(vector<Mat<R>> parameters) : parameters_(parameters) {
+    ASSERT2(!parameters_.empty(), "Error: no parameters to flatten.");
+    const int alignment = FLAT_ALIGNMENT / sizeof(R);
+
+    std::unordered_map<const storage_t*, int> placed;
+    vector<bool> owner(parameters_.size(), false);
+    int total = 0;
+    for (int i = 0; i < parameters_.size(); i++) {
+        auto& param = parameters_[i];
+        auto found = placed.find(&param.w());
+        if (found != placed.end()) {
+            offsets_.emplace_back(found->second);
+            continue;
+        }
+        ASSERT2(param.w().offset == 0 && param.w().memory().total_memory == param.number_of_elements(),
+                MS() << "Error: parameter " << i << " is a view (or already flattened) and cannot be flattened.");
+        placed[&param.w()] = total;
+        offsets_.emplace_back(total);
+        owner[i] = true;
+        total += (param.number_of_elements() + alignment - 1) / alignment * alignment;
+    }
+
+    auto weights_memory   = aligned_memory<R>(total);
+    auto gradients_memory = aligned_memory<R>(total);
+    for (int i = 0; i < parameters_.size(); i++) {
+        if (!owner[i]) continue;
+        relocate(parameters_[i].w(), weights_memory, offsets_[i]);
+        // `dw_rows` leaves sparse gradients sparse.
+        relocate(parameters_[i].dw_rows(NULL, 0), gradients_memory, offsets_[i]);
+    }
+    weights   = storage_t(mshadow::Shape2(1, total), weights_memory, 0);
+    gradients = storage_t(mshadow::Shape2(1, total), gradients_memory, 0);
+}
+
+template<typename R>
+const vector<Mat<R>>& FlatParameters<R>::parameters() const {
+    return parameters_;
+}
+
+template<typename R>
+int FlatParameters<R>::size() const {
+    return weights.number_of_elements();
+}
+
+template<typename R>
+int FlatParameters<R>::offset(int i) const {
+    return offsets_[i];
+}
+
+template<typename R>
+R FlatParameters<R>::grad_norm() const {
+    return gradients.L2_norm();
+}
+
+template<typename R>
+R FlatParameters<R>::clip_grad_norm(R max_norm) {
+    R norm = grad_norm();
+    if (norm > max_norm) {
+        gradients *= max_norm / norm;
+    }
+    return norm;
+}
+
+template<typename R>
+bool FlatParameters<R>::is_grad_nan() const {
+    return gradients.is_nan();
+}
+
+template<typename R>
+void FlatParameters<R>::clear_grads() {
+    gradients.clear();
+    for (auto& param : parameters_) {
+        // forget the rows recorded so far.
+        if (param.sparse_grad_enabled()) param.clear_grad();
+    }
+}
+
+template<typename R>
+void FlatParameters<R>::check_layout(const FlatParameters<R>& other) const {
+    ASSERT2(offsets_.size() == other.offsets_.size() && size() == other.size(),
+            MS() << "Error: flat parameters have different layouts ("
+                 << offsets_.size() << " parameters in " << size() << " values vs. "
+                 << other.offsets_.size() << " parameters in " << other.size() << " values).");
+    for (int i = 0; i < parameters_.size(); i++) {
+        ASSERT2(offsets_[i] == other.offsets_[i] &&
+                parameters_[i].dims() == other.parameters_[i].dims(),
+                MS() << "Error: parameter " << i << " of the flat parameters has different dimensions.");
+    }
+}
+
+template<typename R>
+void FlatParameters<R>::copy_weights_from(const FlatParameters<R>& other) {
+    check_layout(other);
+    weights = other.weights.wrapper();
+}
+
+template<typename R>
+void FlatParameters<R>::copy_grads_from(const FlatParameters<R>& other) {
+    check_layout(other);
+    gradients = other.gradients.wrapper();
+}
+
+template<typename R>
+void FlatParameters<R>::average_weights(const vector<const FlatParameters<R>*>& replicas) {
+    ASSERT2(!replicas.empty(), "Error: no replicas to average.");
+    bool included = false;
+    for (auto replica : replicas) {
+        check_layout(*replica);
+        included = included || replica == this;
+    }
+    bool started = included;
+    for (auto replica : replicas) {
+        if (replica == this) continue;
+        if (started) {
+            weights += replica->weights.wrapper();
+        } else {
+            weights = replica->weights.wrapper();
+            started = true;
+        }
+    }
+    weights /= (R)replicas.size();
+}
+
+template class FlatParameters<float>;
+template class FlatParameters<double>;
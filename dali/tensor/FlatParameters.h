@@ -0,0 +1,77 @@
+#ifndef DALI_TENSOR_FLAT_PARAMETERS_H
+#define DALI_TENSOR_FLAT_PARAMETERS_H
+
+#include <memory>
+#include <vector>
+
+#include "dali/math/SynchronizedMemory.h"
+#include "dali/math/TensorInternal.h"
+#include "dali/tensor/Mat.h"
+
+/*
+Flat Parameters
+---------------
+
+Relocates the weights and gradients of a model into two contiguous
+buffers (one for each), with the existing `Mat` handles left pointing
+at their slice. Every parameter starts on a 64 byte boundary and the
+padding in between stays zero, so whole model operations (gradient
+norm, clipping, clearing, copying weights between replicas,
+averaging) become one pass over a single buffer:
+
+    auto params = model.parameters();
+    FlatParameters<R> flat(params);
+    ...
+    flat.clip_grad_norm(5.0);
+    solver.step(params);
+    ...
+    replica_flat.copy_weights_from(flat);
+
+Copies of the parameters share the relocated storage. Operations that
+reallocate a parameter (`resize`, `npy_load`, `forget_w`, ...) detach
+it from the buffer again.
+*/
+
+template<typename R>
+class FlatParameters {
+    public:
+        typedef TensorInternal<R,2> storage_t;
+
+        // the whole weight (resp. gradient) buffer as a 1 x size tensor.
+        storage_t weights;
+        storage_t gradients;
+
+        // Copies the current weights and gradients of `parameters`
+        // into the buffers (creating the gradients that do not exist
+        // yet). Parameters listed more than once are relocated only
+        // once.
+        FlatParameters(std::vector<Mat<R>> parameters);
+
+        const std::vector<Mat<R>>& parameters() const;
+        // values in each buffer, padding included.
+        int size() const;
+        // position of the first value of `parameters()[i]` in the buffers.
+        int offset(int i) const;
+
+        R grad_norm() const;
+        // rescale the gradients so that their global norm is at most
+        // `max_norm`, returns the norm before clipping.
+        R clip_grad_norm(R max_norm);
+        bool is_grad_nan() const;
+        void clear_grads();
+
+        // `other` must flatten parameters with the same shapes (e.g. a
+        // Hogwild replica), both copies are a single transfer.
+        void copy_weights_from(const FlatParameters<R>& other);
+        void copy_grads_from(const FlatParameters<R>& other);
+        // weights become the mean of the replicas' weights (this
+        // instance may be one of them).
+        void average_weights(const std::vector<const FlatParameters<R>*>& replicas);
+    private:
+        std::vector<Mat<R>> parameters_;
+        std::vector<int> offsets_;
+
+        void check_layout(const FlatParameters<R>& other) const;
+};
+
+#endif
@@ -1,5 +1,8 @@
 #include "dali/tensor/Mat.h"
 #include "dali/tensor/Index.h"
+#include "dali/tensor/op/fusion.h"
+
+#include <algorithm>
 
 using std::vector;
 using std::string;
@@ -17,32 +20,115 @@ Mat<R>::Mat() : Mat(0,0) {
 
 template<typename R>
 typename Mat<R>::storage_t& Mat<R>::w() {
+    if (pending != nullptr) {
+        matops::Fusion<R>::evaluate(*this);
+    }
     return *m;
 }
 
 template<typename R>
 const typename Mat<R>::storage_t& Mat<R>::w() const {
+    if (pending != nullptr) {
+        matops::Fusion<R>::evaluate(*this);
+    }
     return *m;
 }
 
 template<typename R>
 void Mat<R>::forget_w() {
     m = NULL;
+    pending = nullptr;
 }
 
 template<typename R>
 void Mat<R>::forget_dw() {
-    g = NULL;
+    // (copies made so far keep the old gradient)
+    g = make_shared<GradSlot<R>>();
+    if (g_rows != nullptr) {
+        g_rows = make_shared<SparseGradRows>();
+    }
 }
 
 template<typename R>
 typename Mat<R>::storage_t& Mat<R>::dw() {
-    return *g;
+    return static_cast<const Mat<R>*>(this)->dw();
 }
 
 template<typename R>
 typename Mat<R>::storage_t& Mat<R>::dw() const {
-    return *g;
+    // the gradient of a pending value only flows back once the
+    // backward closure of its expression is recorded.
+    if (pending != nullptr) {
+        matops::Fusion<R>::evaluate(*this);
+    }
+    if (g_rows != nullptr) {
+        g_rows->dense = true;
+    }
+    return grad_storage();
+}
+
+template<typename R>
+typename Mat<R>::storage_t& Mat<R>::grad_storage() const {
+    // gradient storage is created the first time it is needed
+    // (by a backward closure, a solver, etc.), and its memory
+    // is only zeroed once someone actually reads or writes it.
+    if (!g->created.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> guard(g->mutex);
+        if (!g->created.load(std::memory_order_relaxed) && m != nullptr) {
+            g->storage = make_shared<TensorInternal<R,2>>(m->shape);
+            // like the values: a parameter's gradient first used inside
+            // a graph::ArenaScope must outlive the pass.
+            g->storage->memory().use_arena = m->memory().use_arena;
+            g->storage->clear();
+            g->created.store(true, std::memory_order_release);
+        }
+    }
+    return *g->storage;
+}
+
+template<typename R>
+bool Mat<R>::has_grad() const {
+    return g->created.load(std::memory_order_acquire);
+}
+
+template<typename R>
+void Mat<R>::enable_sparse_grad() {
+    if (g_rows == nullptr) {
+        g_rows = make_shared<SparseGradRows>();
+        // whatever is already in the gradient is not accounted for.
+        g_rows->dense = has_grad();
+    }
+}
+
+template<typename R>
+bool Mat<R>::sparse_grad_enabled() const {
+    return g_rows != nullptr;
+}
+
+template<typename R>
+const vector<int>* Mat<R>::grad_rows() const {
+    if (g_rows == nullptr || g_rows->dense) {
+        return NULL;
+    }
+    auto& rows = g_rows->rows;
+    if (!g_rows->sorted) {
+        std::sort(rows.begin(), rows.end());
+        rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+        g_rows->sorted = true;
+    }
+    return &rows;
+}
+
+template<typename R>
+typename Mat<R>::storage_t& Mat<R>::dw_rows(const int* rows, int num_rows) const {
+    if (pending != nullptr) {
+        matops::Fusion<R>::evaluate(*this);
+    }
+    if (g_rows != nullptr && !g_rows->dense && num_rows > 0) {
+        g_rows->rows.insert(g_rows->rows.end(), rows, rows + num_rows);
+        g_rows->sorted = false;
+    }
+    return grad_storage();
 }
 
 template<typename R>
@@ -116,13 +202,12 @@ Mat<R>::Mat(dim_t n, dim_t d) : Mat(n,d, true) {
 
 template<typename R>
 void Mat<R>::resize(dim_t n, dim_t d) {
-    if (m == nullptr || g == nullptr) {
+    if (m == nullptr) {
         if (n * d > 0) {
             // Don't fill with zeros - it's initializer's job.
             m = make_shared<TensorInternal<R,2>>(mshadow::Shape2(n, d));
             // We always reset the grad calculation
-            g = make_shared<TensorInternal<R,2>>(mshadow::Shape2(n, d));
-            g->clear();
+            forget_dw();
         }
     } else if (n * d > 0) {
         MatOps<R>::resize(*this, n, d);
@@ -147,13 +232,11 @@ Note: the copy constructor below is only a sideshow,
 **/
 template<typename R>
 Mat<R>::Mat(dim_t n, dim_t d, typename weights<R>::initializer_t wi) :
-        name(nullptr), constant(false) {
+        g(make_shared<GradSlot<R>>()), name(nullptr), constant(false) {
     if (n * d > 0) {
         // Don't fill with zeros - it's initializer's job.
         m = make_shared<TensorInternal<R,2>>(mshadow::Shape2(n, d));
-        // We always reset the grad calculation
-        g = make_shared<TensorInternal<R,2>>(mshadow::Shape2(n, d));
-        g->clear();
+        // gradient is created by `dw` when needed.
         wi(w());
     }
 }
@@ -165,6 +248,7 @@ Mat<R>::Mat (dim_t n, dim_t d, bool fill_zeros) :
 
 template<typename R>
 Mat<R>::Mat(string fname) :
+        g(make_shared<GradSlot<R>>()),
         name(nullptr),
         constant(false) {
     npy_load(fname);
@@ -173,26 +257,49 @@ Mat<R>::Mat(string fname) :
 template<typename R>
 Mat<R>::Mat(const Mat<R>& other, bool copy_w, bool copy_dw) :
         name(other.name),
+        // (the int8 copy is of the other values)
+        quantized(copy_w ? nullptr : other.quantized),
         constant(other.constant) {
 
     if (copy_w && other.m != nullptr) {
         // This copies memory using copy constructor
         // The copy is only executed if matrix was actually initialized
         // hence the && other.m part.
-        m = make_shared<TensorInternal<R,2>>(*other.m, true);
+        m = make_shared<TensorInternal<R,2>>(other.w(), true);
     } else {
         // This does not. (only shared_ptr is copied).
         m = other.m;
+        pending = other.pending;
     }
 
-    if (copy_dw && other.g != nullptr) {
-        // see comment for copy_w.
-        g = make_shared<TensorInternal<R,2>>(*other.g, true);
+    if (copy_dw) {
+        // see comment for copy_w (a missing gradient stays
+        // missing, and will be created separately for the copy).
+        g = make_shared<GradSlot<R>>();
+        if (other.has_grad()) {
+            g->storage = make_shared<TensorInternal<R,2>>(*other.g->storage, true);
+            g->created = true;
+        }
+        if (other.g_rows != nullptr)
+            g_rows = make_shared<SparseGradRows>(*other.g_rows);
     } else {
         g = other.g;
+        g_rows = other.g_rows;
     }
 }
 
+template<typename R>
+Mat<R>& Mat<R>::operator=(const Mat<R>& other) {
+    name      = other.name;
+    quantized = other.quantized;
+    constant  = other.constant;
+    m         = other.m;
+    pending   = other.pending;
+    g         = other.g;
+    g_rows    = other.g_rows;
+    return *this;
+}
+
 template<typename R>
 Mat<R> Mat<R>::shallow_copy() {
     return Mat(*this, false, true);
@@ -243,13 +350,32 @@ void Mat<R>::grad() {
 
 template<typename R>
 void Mat<R>::clear_grad() {
-    dw().clear();
+    // nothing to clear until the gradient is created.
+    if (!has_grad()) {
+        return;
+    }
+    auto& grad = *g->storage;
+    auto rows = grad_rows();
+    if (rows != NULL && !grad.compute_me_on_gpu()) {
+        // only the rows that were written to
+        auto data = grad.mutable_cpu_data();
+        for (auto row : *rows) {
+            std::fill(data.dptr_ + row * data.stride_, data.dptr_ + row * data.stride_ + data.size(1), (R)0);
+        }
+    } else {
+        grad.clear();
+    }
+    if (g_rows != nullptr) {
+        g_rows->rows.clear();
+        g_rows->sorted = true;
+        g_rows->dense  = false;
+    }
 }
 
 template<typename R>
 void Mat<R>::clear() {
     w().clear();
-    dw().clear();
+    clear_grad();
 }
 
 template<typename R>
@@ -267,7 +393,7 @@ void Mat<R>::npy_save (string fname, string mode) {
 template<typename R>
 unsigned int Mat<R>::number_of_elements() const {
     if (m != nullptr) {
-        return w().number_of_elements();
+        return m->number_of_elements();
     }
     return 0;
 }
@@ -440,8 +566,9 @@ void Mat<R>::npy_load(cnpy::NpyArray& arr) {
     int n = arr.shape[0];
     int d = arr.shape.size() > 1 ? arr.shape[1] : 1;
 
-    g = make_shared<storage_t>(mshadow::Shape2(n,d));
-    g->clear();
+    forget_dw();
+    // new values: the int8 copy is stale.
+    quantized = nullptr;
 
     m = make_shared<storage_t>(mshadow::Shape2(n,d));
     auto mut_data = w().mutable_cpu_data();
@@ -534,6 +661,7 @@ template<typename R>
 Mat<R>& Mat<R>::operator+=(Mat<R> other) {
     auto sum = MatOps<R>::add(*this, other);
     this->m = sum.m;
+    this->pending = sum.pending;
     this->g = sum.g;
     return *this;
 }
@@ -542,6 +670,7 @@ template<typename R>
 Mat<R>& Mat<R>::operator+=(R other) {
     auto sum = MatOps<R>::add(*this, other);
     this->m = sum.m;
+    this->pending = sum.pending;
     this->g = sum.g;
     return *this;
 }
@@ -560,6 +689,7 @@ template<typename R>
 Mat<R>& Mat<R>::operator-=(Mat<R> other) {
     auto diff = MatOps<R>::sub(*this, other);
     this->m = diff.m;
+    this->pending = diff.pending;
     this->g = diff.g;
     return *this;
 }
@@ -568,6 +698,7 @@ template<typename R>
 Mat<R>& Mat<R>::operator-=(R other) {
     auto diff = MatOps<R>::add(*this, -other);
     this->m = diff.m;
+    this->pending = diff.pending;
     this->g = diff.g;
     return *this;
 }
@@ -586,6 +717,7 @@ template<typename R>
 Mat<R>& Mat<R>::operator*=(Mat<R> other) {
     auto prod = MatOps<R>::eltmul(*this, other);
     this->m = prod.m;
+    this->pending = prod.pending;
     this->g = prod.g;
     return *this;
 }
@@ -594,6 +726,7 @@ template<typename R>
 Mat<R>& Mat<R>::operator*=(R other) {
     auto prod = MatOps<R>::eltmul(*this, other);
     this->m = prod.m;
+    this->pending = prod.pending;
     this->g = prod.g;
     return *this;
 }
@@ -618,6 +751,7 @@ template<typename R>
 Mat<R>& Mat<R>::operator/=(Mat<R> other) {
     auto divided = MatOps<R>::eltdivide(*this, other);
     this->m = divided.m;
+    this->pending = divided.pending;
     this->g = divided.g;
     return *this;
 }
@@ -626,6 +760,7 @@ template<typename R>
 Mat<R>& Mat<R>::operator/=(R other) {
     auto divided = MatOps<R>::eltdivide(*this, other);
     this->m = divided.m;
+    this->pending = divided.pending;
     this->g = divided.g;
     return *this;
 }
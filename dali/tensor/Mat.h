@@ -6,6 +6,7 @@
 #include <initializer_list>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <ostream>
@@ -23,8 +24,39 @@ namespace Indexing {
     class Index;
 }
 
+namespace matops {
+    template<typename R> struct FusedExpression;
+    template<typename R> class Fusion;
+}
+
 template<typename R>
 struct weights;
+
+template<typename R>
+class QuantizedMat;
+
+// rows of a sparse gradient written since it was last cleared
+// (see `Mat::enable_sparse_grad`).
+struct SparseGradRows {
+    std::vector<int> rows;
+    bool sorted = true;
+    // the gradient was also written some other way.
+    bool dense  = false;
+};
+
+// Gradient shared by a Mat and its shallow copies. The slot exists
+// along with the values, so that every copy accumulates into the same
+// gradient, while the storage in it is only created the first time
+// the gradient is used (from any of the copies, on any thread).
+template<typename R>
+struct GradSlot {
+    std::shared_ptr<TensorInternal<R,2>> storage;
+    std::atomic<bool> created;
+    std::mutex mutex;
+
+    GradSlot() : created(false) {}
+};
+
 /**
 Mat
 ---
@@ -59,11 +91,23 @@ class Mat {
         typedef std::shared_ptr<storage_t> storage_ref_t;
     private:
         storage_ref_t m;
-        mutable storage_ref_t g;
+        mutable std::shared_ptr<GradSlot<R>> g;
+        mutable std::shared_ptr<SparseGradRows> g_rows;
+        // elementwise expression whose value `m` is waiting for (see
+        // dali/tensor/op/fusion.h), evaluated on first access.
+        mutable std::shared_ptr<matops::FusedExpression<R>> pending;
+        storage_t& grad_storage() const;
+
+        friend class matops::Fusion<R>;
     public:
 
         std::shared_ptr<std::string> name = nullptr;
 
+        // int8 copy of the values read by matrix products and
+        // `rows_pluck` while backprop is disabled (see
+        // dali/tensor/Quantization.h).
+        std::shared_ptr<QuantizedMat<R>> quantized = nullptr;
+
         bool constant;
 
         Mat();
@@ -87,6 +131,7 @@ class Mat {
         but `w` buffers are shared amongst threads.
         */
         Mat (const Mat<R>& m, bool copy_w=false, bool copy_d=false);
+        Mat& operator=(const Mat<R>& other);
 
         ~Mat();
 
@@ -123,8 +168,25 @@ class Mat {
         void forget_w();
         void forget_dw();
 
+        // the gradient is created on first access (and never by
+        // operations running under `graph::NoBackprop`), and shared
+        // with every shallow copy, whenever they were made.
         storage_t& dw() const;
         storage_t& dw();
+        bool has_grad() const;
+
+        // Sparse gradient: record which rows `rows_pluck` writes to, so
+        // that solvers and `clear_grad` only visit those (embeddings).
+        // Any other access through `dw()` makes the gradient dense
+        // again until it is cleared.
+        void enable_sparse_grad();
+        bool sparse_grad_enabled() const;
+        // sorted rows written since the gradient was cleared, or NULL
+        // when the gradient is dense.
+        const std::vector<int>* grad_rows() const;
+        // `dw()` that keeps the gradient sparse, recording `rows` as
+        // about to be written.
+        storage_t& dw_rows(const int* rows, int num_rows) const;
 
         std::vector<dim_t> dims() const;
         dim_t dims(int idx) const;
@@ -0,0 +1,388 @@
+#include "dali/tensor/ParameterServer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#include "dali/utils/assert2.h"
+#include "dali/utils/core_utils.h"
+
+using std::string;
+using std::vector;
+using utils::MS;
+
+namespace {
+    const char     SERVER_MAGIC[8]   = {'D', 'A', 'L', 'I', 'P', 'S', 'R', 'V'};
+    const uint32_t SERVER_VERSION    = 2;
+    const uint64_t SERVER_ALIGNMENT  = 64;
+
+    // slot states, any positive value is the pid of the process
+    // writing to the slot.
+    const int32_t SLOT_FREE  = 0;
+    const int32_t SLOT_READY = -1;
+
+    struct server_header {
+        char     magic[8];
+        uint32_t version;
+        uint32_t dtype_size;
+        uint32_t num_tensors;
+        uint32_t num_shards;
+        uint32_t queue_capacity;
+        // process applying the gradients (0 once it went away)
+        std::atomic<int32_t> server_pid;
+        uint64_t segment_size;
+        // page aligned range holding the weights
+        uint64_t weights_begin;
+        uint64_t weights_end;
+        std::atomic<uint64_t> updates;
+    };
+    static_assert(sizeof(server_header) == 64, "parameter server header must take 64 bytes.");
+
+    struct server_tensor {
+        uint32_t rows;
+        uint32_t cols;
+        uint32_t shard;
+        uint32_t reserved;
+        // byte offset of the weights in the segment
+        uint64_t offset;
+        // position of the gradient in the slots of its shard
+        uint64_t slot_offset;
+    };
+    static_assert(sizeof(server_tensor) == 32, "parameter server tensors must take 32 bytes.");
+
+    struct server_shard {
+        // values in one gradient of the shard
+        uint64_t size;
+        // byte offset of the first slot in the segment
+        uint64_t queue_offset;
+        uint64_t slot_bytes;
+        char     reserved[40];
+    };
+    static_assert(sizeof(server_shard) == 64, "parameter server shards must take 64 bytes.");
+
+    // followed by the gradient values
+    struct server_slot {
+        std::atomic<int32_t> state;
+        char reserved[60];
+    };
+    static_assert(sizeof(server_slot) == 64, "parameter server slots must take 64 bytes.");
+    static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+            "parameter server needs lock free atomics to share them between processes.");
+
+    uint64_t aligned(uint64_t offset, uint64_t alignment) {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+
+    bool process_died(int32_t pid) {
+        return kill(pid, 0) != 0 && errno == ESRCH;
+    }
+}
+
+template<typename R>
+struct ParameterServer<R>::Segment {
+    char* data;
+    size_t size;
+
+    Segment(char* data, size_t size) : data(data), size(size) {}
+    ~Segment() {
+        munmap(data, size);
+    }
+
+    server_header& header() const {
+        return *(server_header*)data;
+    }
+
+    server_tensor* tensors() const {
+        return (server_tensor*)(data + sizeof(server_header));
+    }
+
+    server_shard* shards() const {
+        return (server_shard*)(tensors() + header().num_tensors);
+    }
+
+    R* weights(int tensor) const {
+        return (R*)(data + tensors()[tensor].offset);
+    }
+
+    server_slot* slot(int shard, int i) const {
+        auto& description = shards()[shard];
+        return (server_slot*)(data + description.queue_offset + i * description.slot_bytes);
+    }
+
+    R* slot_values(server_slot* slot) const {
+        return (R*)(slot + 1);
+    }
+};
+
+template<typename R>
+ParameterServer<R>::ParameterServer(std::shared_ptr<Segment> _segment,
+                                    vector<Mat<R>> _parameters,
+                                    const string& _name,
+                                    bool _owner) :
+        segment(_segment),
+        parameters(_parameters),
+        shard_tensors(_segment->header().num_shards),
+        name(_name),
+        owner(_owner),
+        seen_updates(0) {
+    for (int i = 0; i < parameters.size(); i++) {
+        shard_tensors[segment->tensors()[i].shard].emplace_back(i);
+    }
+}
+
+template<typename R>
+std::shared_ptr<ParameterServer<R>> ParameterServer<R>::create(const string& name,
+                                                               vector<Mat<R>> parameters,
+                                                               int num_shards,
+                                                               int queue_capacity) {
+    ASSERT2(!parameters.empty(), "Error: no parameters to serve.");
+    ASSERT2(num_shards > 0 && queue_capacity > 0,
+            "Error: parameter server needs at least one shard and one slot per queue.");
+    num_shards = std::min(num_shards, (int)parameters.size());
+    const uint64_t page_size = sysconf(_SC_PAGESIZE);
+
+    // largest tensors first, each to the lightest shard.
+    vector<server_tensor> tensors(parameters.size());
+    vector<server_shard> shards(num_shards);
+    memset(tensors.data(), 0, tensors.size() * sizeof(server_tensor));
+    memset(shards.data(), 0, shards.size() * sizeof(server_shard));
+    vector<int> order(parameters.size());
+    for (int i = 0; i < order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&parameters](int a, int b) {
+        return parameters[a].number_of_elements() > parameters[b].number_of_elements();
+    });
+    for (auto i : order) {
+        auto& param = parameters[i];
+        ASSERT2(param.w().offset == 0 && param.w().memory().total_memory == param.number_of_elements(),
+                MS() << "Error: parameter " << i << " is a view and cannot be served.");
+        auto lightest = std::min_element(shards.begin(), shards.end(),
+                [](const server_shard& a, const server_shard& b) { return a.size < b.size; });
+        tensors[i].rows        = param.dims(0);
+        tensors[i].cols        = param.dims(1);
+        tensors[i].shard       = lightest - shards.begin();
+        tensors[i].slot_offset = lightest->size;
+        lightest->size += param.number_of_elements();
+    }
+
+    uint64_t offset = sizeof(server_header) + tensors.size() * sizeof(server_tensor)
+                    + shards.size() * sizeof(server_shard);
+    const uint64_t weights_begin = offset = aligned(offset, page_size);
+    for (auto& tensor : tensors) {
+        tensor.offset = aligned(offset, SERVER_ALIGNMENT);
+        offset = tensor.offset + (uint64_t)tensor.rows * tensor.cols * sizeof(R);
+    }
+    const uint64_t weights_end = offset = aligned(offset, page_size);
+    for (auto& shard : shards) {
+        shard.queue_offset = offset;
+        shard.slot_bytes   = sizeof(server_slot) + aligned(shard.size * sizeof(R), SERVER_ALIGNMENT);
+        offset += queue_capacity * shard.slot_bytes;
+    }
+    const uint64_t segment_size = offset;
+
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    ASSERT2(fd >= 0, MS() << "Error: could not create shared memory segment " << name
+                          << " (" << strerror(errno) << ").");
+    if (ftruncate(fd, segment_size) != 0) {
+        close(fd);
+        shm_unlink(name.c_str());
+        ASSERT2(false, MS() << "Error: could not allocate " << segment_size
+                            << " bytes of shared memory for " << name << ".");
+    }
+    void* data = mmap(NULL, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        ASSERT2(false, MS() << "Error: could not map shared memory segment " << name << ".");
+    }
+    // the pages of a new segment are zeros: no update yet, and every
+    // slot starts free.
+    auto segment = std::make_shared<Segment>((char*)data, segment_size);
+    auto& header = segment->header();
+    memcpy(header.magic, SERVER_MAGIC, sizeof(SERVER_MAGIC));
+    header.version        = SERVER_VERSION;
+    header.dtype_size     = sizeof(R);
+    header.num_tensors    = parameters.size();
+    header.num_shards     = num_shards;
+    header.queue_capacity = queue_capacity;
+    header.server_pid     = getpid();
+    header.segment_size   = segment_size;
+    header.weights_begin  = weights_begin;
+    header.weights_end    = weights_end;
+    memcpy(segment->tensors(), tensors.data(), tensors.size() * sizeof(server_tensor));
+    memcpy(segment->shards(), shards.data(), shards.size() * sizeof(server_shard));
+
+    for (int i = 0; i < parameters.size(); i++) {
+        auto values = segment->weights(i);
+        memcpy(values, parameters[i].w().cpu_data().dptr_, parameters[i].number_of_elements() * sizeof(R));
+        parameters[i].w().memory().adopt_cpu(values, segment);
+    }
+    return std::shared_ptr<ParameterServer<R>>(new ParameterServer<R>(segment, parameters, name, true));
+}
+
+template<typename R>
+std::shared_ptr<ParameterServer<R>> ParameterServer<R>::attach(const string& name,
+                                                               vector<Mat<R>> parameters) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    ASSERT2(fd >= 0, MS() << "Error: could not open shared memory segment " << name
+                          << " (" << strerror(errno) << ").");
+    struct stat segment_stat;
+    if (fstat(fd, &segment_stat) != 0 || (size_t)segment_stat.st_size < sizeof(server_header)) {
+        close(fd);
+        ASSERT2(false, MS() << "Error: " << name << " is not a parameter server segment.");
+    }
+    size_t size = segment_stat.st_size;
+    void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    ASSERT2(data != MAP_FAILED, MS() << "Error: could not map shared memory segment " << name << ".");
+    auto segment = std::make_shared<Segment>((char*)data, size);
+
+    auto& header = segment->header();
+    ASSERT2(memcmp(header.magic, SERVER_MAGIC, sizeof(SERVER_MAGIC)) == 0 &&
+            header.version == SERVER_VERSION && header.segment_size == size,
+            MS() << "Error: " << name << " is not a parameter server segment.");
+    ASSERT2(header.dtype_size == sizeof(R),
+            MS() << "Error: parameter server " << name << " holds another floating point type.");
+    ASSERT2(header.num_tensors == parameters.size(),
+            MS() << "Error: parameter server " << name << " holds " << header.num_tensors
+                 << " tensors, but " << parameters.size() << " parameters were given.");
+    for (int i = 0; i < parameters.size(); i++) {
+        auto& tensor = segment->tensors()[i];
+        ASSERT2(tensor.rows == parameters[i].dims(0) && tensor.cols == parameters[i].dims(1),
+                MS() << "Error: tensor " << i << " of parameter server " << name << " has dimensions ("
+                     << tensor.rows << ", " << tensor.cols << "), but parameter has dimensions ("
+                     << parameters[i].dims(0) << ", " << parameters[i].dims(1) << ").");
+        ASSERT2(parameters[i].w().offset == 0 &&
+                parameters[i].w().memory().total_memory == parameters[i].number_of_elements(),
+                MS() << "Error: parameter " << i << " is a view and cannot be attached.");
+    }
+    // only the server writes the weights.
+    ASSERT2(mprotect((char*)data + header.weights_begin, header.weights_end - header.weights_begin, PROT_READ) == 0,
+            MS() << "Error: could not protect the weights of " << name << ".");
+    for (int i = 0; i < parameters.size(); i++) {
+        parameters[i].w().memory().adopt_cpu(segment->weights(i), segment);
+    }
+    auto client = std::shared_ptr<ParameterServer<R>>(new ParameterServer<R>(segment, parameters, name, false));
+    client->seen_updates = header.updates.load(std::memory_order_acquire);
+    return client;
+}
+
+template<typename R>
+void ParameterServer<R>::push_gradients() {
+    const int32_t pid = getpid();
+    const int capacity = segment->header().queue_capacity;
+    for (int shard = 0; shard < shard_tensors.size(); shard++) {
+        server_slot* slot = NULL;
+        for (int i = 0; slot == NULL; i = (i + 1) % capacity) {
+            auto candidate = segment->slot(shard, i);
+            int32_t state = SLOT_FREE;
+            if (candidate->state.compare_exchange_strong(state, pid, std::memory_order_acquire)) {
+                slot = candidate;
+            } else if (i + 1 == capacity) {
+                // queue is full, wait for the server.
+                int32_t server_pid = segment->header().server_pid.load();
+                ASSERT2(server_pid != 0 && !process_died(server_pid),
+                        MS() << "Error: parameter server " << name << " went away.");
+                std::this_thread::yield();
+            }
+        }
+        R* values = segment->slot_values(slot);
+        for (auto t : shard_tensors[shard]) {
+            auto& param = parameters[t];
+            R* destination = values + segment->tensors()[t].slot_offset;
+            if (param.has_grad()) {
+                // (`dw_rows` does not make a sparse gradient dense)
+                memcpy(destination, param.dw_rows(NULL, 0).cpu_data().dptr_,
+                       param.number_of_elements() * sizeof(R));
+            } else {
+                memset(destination, 0, param.number_of_elements() * sizeof(R));
+            }
+        }
+        slot->state.store(SLOT_READY, std::memory_order_release);
+    }
+    for (auto& param : parameters) {
+        param.clear_grad();
+    }
+    refresh();
+}
+
+template<typename R>
+void ParameterServer<R>::refresh() {
+    if (owner) return;
+    uint64_t updates = segment->header().updates.load(std::memory_order_acquire);
+    if (updates == seen_updates) return;
+    seen_updates = updates;
+    for (auto& param : parameters) {
+        // the server wrote the shared pages: mark the values as changed,
+        // so that copies derived from them (packed LSTM gates, int8
+        // weights, pending fused expressions) are not reused.
+        param.w().memory().mutable_cpu_data();
+    }
+}
+
+template<typename R>
+int ParameterServer<R>::apply_gradients(Solver::AbstractSolver<R>& solver) {
+    int consumed = 0;
+    const int capacity = segment->header().queue_capacity;
+    for (int shard = 0; shard < shard_tensors.size(); shard++) {
+        int received = 0;
+        for (int i = 0; i < capacity; i++) {
+            auto slot = segment->slot(shard, i);
+            int32_t state = slot->state.load(std::memory_order_acquire);
+            if (state > 0 && process_died(state)) {
+                // the worker crashed halfway through its push.
+                slot->state.compare_exchange_strong(state, SLOT_FREE);
+                continue;
+            }
+            if (state != SLOT_READY) continue;
+            const R* values = segment->slot_values(slot);
+            for (auto t : shard_tensors[shard]) {
+                const R* gradient = values + segment->tensors()[t].slot_offset;
+                R* total = parameters[t].dw().mutable_cpu_data().dptr_;
+                for (int j = 0; j < parameters[t].number_of_elements(); j++) {
+                    total[j] += gradient[j];
+                }
+            }
+            slot->state.store(SLOT_FREE, std::memory_order_release);
+            received++;
+        }
+        if (received > 0) {
+            vector<Mat<R>> shard_parameters;
+            for (auto t : shard_tensors[shard]) {
+                shard_parameters.emplace_back(parameters[t]);
+            }
+            solver.step(shard_parameters);
+            segment->header().updates++;
+        }
+        consumed += received;
+    }
+    return consumed;
+}
+
+template<typename R>
+int ParameterServer<R>::num_shards() const {
+    return shard_tensors.size();
+}
+
+template<typename R>
+unsigned long ParameterServer<R>::updates() const {
+    return segment->header().updates.load();
+}
+
+template<typename R>
+ParameterServer<R>::~ParameterServer() {
+    if (owner) {
+        segment->header().server_pid = 0;
+        shm_unlink(name.c_str());
+    }
+}
+
+template class ParameterServer<float>;
+template class ParameterServer<double>;
@@ -0,0 +1,104 @@
+#ifndef DALI_TENSOR_PARAMETER_SERVER_H
+#define DALI_TENSOR_PARAMETER_SERVER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "dali/tensor/Mat.h"
+#include "dali/tensor/Solver.h"
+
+/*
+Parameter Server
+----------------
+
+Shares the weights of a model between the training processes of one
+machine through a POSIX shared memory segment:
+
+    header, tensor and shard descriptions
+    weights     each tensor on a 64 byte boundary (the weights of the
+                attached parameters point straight at these pages)
+    queues      per shard, a ring of gradient slots
+
+Parameters are split into shards of similar size. A worker pushes its
+gradients by claiming a free slot in each shard's queue with a
+compare and swap, copying the shard's gradients into it and marking
+it ready; the server sums the ready slots of a shard into its own
+gradients and takes one solver step for the shard. No locks are
+taken, and slots claimed by a process that died before finishing
+its push are taken back, so a crashing worker never blocks training.
+
+Server:
+
+    auto server = ParameterServer<R>::create("/my_model", model.parameters(), 4);
+    while (training) server->apply_gradients(solver);
+
+Workers (other processes, building the same model):
+
+    auto client = ParameterServer<R>::attach("/my_model", model.parameters());
+    client->refresh();
+    ... forward, backward ...
+    client->push_gradients();
+
+Workers map the weights read only (only the server writes them), and
+read them while the server updates them, Hogwild style.
+*/
+
+template<typename R>
+class ParameterServer {
+    public:
+        struct Segment;
+    private:
+        std::shared_ptr<Segment> segment;
+        std::vector<Mat<R>> parameters;
+        // parameters in each shard
+        std::vector<std::vector<int>> shard_tensors;
+        std::string name;
+        bool owner;
+        // worker: server updates when the weights were last refreshed
+        uint64_t seen_updates;
+
+        ParameterServer(std::shared_ptr<Segment> segment,
+                        std::vector<Mat<R>> parameters,
+                        const std::string& name,
+                        bool owner);
+    public:
+        // Creates the segment `name` (e.g. "/model", it must not
+        // exist) and moves the weights of the parameters into it.
+        // Each shard queue holds up to `queue_capacity` gradients.
+        static std::shared_ptr<ParameterServer<R>> create(const std::string& name,
+                                                          std::vector<Mat<R>> parameters,
+                                                          int num_shards=1,
+                                                          int queue_capacity=4);
+        // Attaches to an existing segment: the weights of the
+        // parameters (which must have the saved dimensions) become
+        // read only views of the shared weights.
+        static std::shared_ptr<ParameterServer<R>> attach(const std::string& name,
+                                                          std::vector<Mat<R>> parameters);
+
+        // worker: copies the gradients of the parameters into every
+        // shard queue (waiting while one is full, and throwing if the
+        // server went away), clears them and calls `refresh`.
+        void push_gradients();
+        // worker: if the server stepped since the last call, marks
+        // the weights as changed (see SynchronizedMemory::version):
+        // their values change under the worker without it writing
+        // them, so copies derived from them (packed LSTM gates, int8
+        // weights) need to be told. Call before each forward pass.
+        void refresh();
+        // server: sums the gradients waiting in each queue into the
+        // parameters and steps `solver` once for every shard that got
+        // some. Returns the number of gradients consumed.
+        int apply_gradients(Solver::AbstractSolver<R>& solver);
+
+        int num_shards() const;
+        // solver steps taken by the server so far.
+        unsigned long updates() const;
+
+        // the creator removes the segment's name when it goes away,
+        // processes attached to it keep their mapping.
+        ~ParameterServer();
+};
+
+#endif
@@ -0,0 +1,327 @@
+#include "dali/tensor/Quantization.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <unordered_set>
+
+#include "dali/math/simd/Int8Gemm.h"
+#include "dali/tensor/__MatMacros__.h"
+#include "dali/tensor/Tape.h"
+#include "dali/utils/assert2.h"
+#include "dali/utils/core_utils.h"
+
+using std::vector;
+using utils::MS;
+
+namespace {
+    thread_local bool _float_weights = false;
+
+    // Writes round(127 * in / max |in|) into `out` and returns the
+    // scale, max |in| / 127 (0 for a row of zeros).
+    template<typename R>
+    float quantize_row(const R* in, int size, int8_t* out) {
+        float max_abs = 0.0;
+        for (int k = 0; k < size; ++k) {
+            max_abs = std::max(max_abs, (float)std::abs(in[k]));
+        }
+        if (max_abs == 0.0) {
+            std::fill(out, out + size, 0);
+            return 0.0;
+        }
+        const float inverse = 127.0f / max_abs;
+        for (int k = 0; k < size; ++k) {
+            float value = (float)in[k] * inverse;
+            out[k] = (int8_t)(value >= 0.0f ? value + 0.5f : value - 0.5f);
+        }
+        return max_abs / 127.0f;
+    }
+
+    int padded_size(int size) {
+        return (size + simd::int8_row_alignment - 1) / simd::int8_row_alignment * simd::int8_row_alignment;
+    }
+
+    // out += activations . weight^T, through a float buffer unless R is float.
+    template<typename R>
+    void add_int8_product(const int8_t* activations, const float* scales, int rows,
+                          const QuantizedMat<R>& weight, R* out, int out_stride) {
+        vector<float> product(rows * weight.rows, 0.0);
+        simd::int8_gemm(activations, scales, rows,
+                        weight.values.data(), weight.scales.data(), weight.sums.data(), weight.rows,
+                        weight.stride, product.data(), weight.rows);
+        for (int i = 0; i < rows; ++i) {
+            for (int j = 0; j < weight.rows; ++j) {
+                out[i * out_stride + j] += product[i * weight.rows + j];
+            }
+        }
+    }
+
+    void add_int8_product(const int8_t* activations, const float* scales, int rows,
+                          const QuantizedMat<float>& weight, float* out, int out_stride) {
+        simd::int8_gemm(activations, scales, rows,
+                        weight.values.data(), weight.scales.data(), weight.sums.data(), weight.rows,
+                        weight.stride, out, out_stride);
+    }
+}
+
+namespace quantization {
+    bool enabled() {
+        return !_float_weights && !graph::backprop_enabled();
+    }
+
+    FloatScope::FloatScope() : old_value(_float_weights) {
+        _float_weights = true;
+    }
+
+    FloatScope::~FloatScope() {
+        _float_weights = old_value;
+    }
+}
+
+/* QuantizedMat */
+template<typename R>
+QuantizedMat<R>::QuantizedMat(const Mat<R>& matrix, quantization::QuantizedLayout _layout) :
+        layout(_layout) {
+    const bool transpose = layout == quantization::QUANTIZE_COLUMNS;
+    rows   = transpose ? matrix.dims(1) : matrix.dims(0);
+    cols   = transpose ? matrix.dims(0) : matrix.dims(1);
+    stride = padded_size(cols);
+    values.assign((size_t)rows * stride, 0);
+    scales.assign(rows, 0.0);
+    sums.assign(rows, 0);
+
+    auto& tensor = MAT(matrix);
+    // (read before the values: a write while quantizing makes it stale)
+    source         = tensor.memory_;
+    source_offset  = tensor.offset;
+    source_version = tensor.memory().version.load();
+
+    const R* data = tensor.cpu_data().dptr_;
+    vector<R> row(cols);
+    for (int r = 0; r < rows; ++r) {
+        for (int c = 0; c < cols; ++c) {
+            row[c] = transpose ? data[(size_t)c * rows + r] : data[(size_t)r * cols + c];
+        }
+        int8_t* quantized_row = values.data() + (size_t)r * stride;
+        scales[r] = quantize_row(row.data(), cols, quantized_row);
+        for (int c = 0; c < cols; ++c) {
+            sums[r] += quantized_row[c];
+        }
+    }
+}
+
+template<typename R>
+bool QuantizedMat<R>::matches(const Mat<R>& matrix, quantization::QuantizedLayout _layout) const {
+    if (layout != _layout) return false;
+    const bool transpose = layout == quantization::QUANTIZE_COLUMNS;
+    auto& tensor = MAT(matrix);
+    return rows == (transpose ? matrix.dims(1) : matrix.dims(0)) &&
+           cols == (transpose ? matrix.dims(0) : matrix.dims(1)) &&
+           source.lock() == tensor.memory_ &&
+           source_offset  == tensor.offset &&
+           source_version == tensor.memory().version.load();
+}
+
+template<typename R>
+void QuantizedMat<R>::dequantize_row(int row, R* out) const {
+    const int8_t* quantized_row = values.data() + (size_t)row * stride;
+    const float scale = scales[row];
+    for (int c = 0; c < cols; ++c) {
+        out[c] = (R)(scale * quantized_row[c]);
+    }
+}
+
+template<typename R>
+Mat<R> QuantizedMat<R>::dequantize() const {
+    const bool transpose = layout == quantization::QUANTIZE_COLUMNS;
+    Mat<R> out(transpose ? cols : rows, transpose ? rows : cols, weights<R>::empty());
+    R* data = MAT(out).overwrite_cpu_data().dptr_;
+    vector<R> row(cols);
+    for (int r = 0; r < rows; ++r) {
+        dequantize_row(r, row.data());
+        for (int c = 0; c < cols; ++c) {
+            if (transpose) {
+                data[(size_t)c * rows + r] = row[c];
+            } else {
+                data[(size_t)r * cols + c] = row[c];
+            }
+        }
+    }
+    return out;
+}
+
+template<typename R>
+size_t QuantizedMat<R>::memory_usage() const {
+    return values.size() * sizeof(int8_t) +
+           scales.size() * sizeof(float) +
+           sums.size() * sizeof(int32_t);
+}
+
+template class QuantizedMat<float>;
+template class QuantizedMat<double>;
+template class QuantizedMat<int>;
+
+namespace quantization {
+    template<typename R>
+    void quantize(Mat<R>& matrix, QuantizedLayout layout) {
+        matrix.quantized = std::make_shared<QuantizedMat<R>>(matrix, layout);
+    }
+
+    template<typename R>
+    void quantize(vector<Mat<R>>& matrices, QuantizedLayout layout) {
+        for (auto& matrix : matrices) {
+            quantize(matrix, layout);
+        }
+    }
+
+    template<typename R>
+    void forget_quantized(Mat<R>& matrix) {
+        matrix.quantized = nullptr;
+    }
+
+    template<typename R>
+    const QuantizedMat<R>* quantized(const Mat<R>& matrix, QuantizedLayout layout) {
+        if (!enabled() || matrix.quantized == nullptr || !matrix.quantized->matches(matrix, layout)) {
+            return NULL;
+        }
+        return matrix.quantized.get();
+    }
+
+    template<typename R>
+    bool quantized(const vector<Mat<R>>& matrices, QuantizedLayout layout) {
+        for (auto& matrix : matrices) {
+            if (quantized(matrix, layout) == NULL) return false;
+        }
+        return !matrices.empty();
+    }
+
+    template<typename R>
+    void dot_accumulate(const R* input, int rows, int input_stride,
+                        const QuantizedMat<R>& weight,
+                        R* out, int out_stride) {
+        // reused between calls.
+        thread_local QuantizedInput activations;
+        quantize_input(input, rows, weight.cols, input_stride, &activations);
+        dot_accumulate(activations, weight, out, out_stride);
+    }
+
+    template<typename R>
+    void quantize_input(const R* input, int rows, int cols, int input_stride, QuantizedInput* out) {
+        out->rows   = rows;
+        out->cols   = cols;
+        out->stride = padded_size(cols);
+        // (the padding must be zero)
+        out->values.assign((size_t)rows * out->stride, 0);
+        out->scales.resize(rows);
+        for (int i = 0; i < rows; ++i) {
+            out->scales[i] = quantize_row(input + (size_t)i * input_stride, cols,
+                                          out->values.data() + (size_t)i * out->stride);
+        }
+    }
+
+    template<typename R>
+    void dot_accumulate(const QuantizedInput& input,
+                        const QuantizedMat<R>& weight,
+                        R* out, int out_stride) {
+        ASSERT2(weight.layout == QUANTIZE_COLUMNS,
+                "dot_accumulate: expected weights quantized with QUANTIZE_COLUMNS.");
+        ASSERT2(input.cols == weight.cols,
+                MS() << "dot_accumulate: input has " << input.cols << " columns, but weight expects "
+                     << weight.cols << ".");
+        add_int8_product(input.values.data(), input.scales.data(), input.rows, weight, out, out_stride);
+    }
+
+    template<typename R>
+    Report<R> report(const vector<Mat<R>>& parameters,
+                     std::function<vector<Mat<R>>()> predict) {
+        graph::NoBackprop nb;
+        vector<Mat<R>> reference;
+        {
+            FloatScope float_weights;
+            reference = predict();
+        }
+        auto outputs = predict();
+        ASSERT2(outputs.size() == reference.size(),
+                MS() << "quantization::report: got " << outputs.size()
+                     << " outputs with int8 weights and " << reference.size() << " without.");
+
+        Report<R> result;
+        double max_error = 0.0, total_error = 0.0, squared_error = 0.0, squared_norm = 0.0;
+        int64_t num_values = 0, num_rows = 0, num_agreements = 0;
+        for (int o = 0; o < outputs.size(); ++o) {
+            ASSERT2(outputs[o].dims() == reference[o].dims(),
+                    MS() << "quantization::report: output " << o << " changed shape.");
+            const R* expected = MAT(reference[o]).cpu_data().dptr_;
+            const R* actual   = MAT(outputs[o]).cpu_data().dptr_;
+            const int rows = outputs[o].dims(0), cols = outputs[o].dims(1);
+            for (int i = 0; i < rows; ++i) {
+                const R* expected_row = expected + (size_t)i * cols;
+                const R* actual_row   = actual + (size_t)i * cols;
+                for (int j = 0; j < cols; ++j) {
+                    double error = std::abs((double)actual_row[j] - (double)expected_row[j]);
+                    max_error      = std::max(max_error, error);
+                    total_error   += error;
+                    squared_error += error * error;
+                    squared_norm  += (double)expected_row[j] * expected_row[j];
+                }
+                if (cols > 0) {
+                    num_agreements += (std::max_element(expected_row, expected_row + cols) - expected_row) ==
+                                      (std::max_element(actual_row, actual_row + cols) - actual_row);
+                    num_rows++;
+                }
+            }
+            num_values += outputs[o].number_of_elements();
+        }
+        result.max_absolute_error  = max_error;
+        result.mean_absolute_error = num_values > 0 ? total_error / num_values : 0.0;
+        result.relative_error      = squared_norm > 0 ? std::sqrt(squared_error / squared_norm) : 0.0;
+        result.argmax_agreement    = num_rows > 0 ? (double)num_agreements / num_rows : 1.0;
+
+        result.float_bytes = 0;
+        result.quantized_bytes = 0;
+        std::unordered_set<const QuantizedMat<R>*> seen;
+        for (auto& parameter : parameters) {
+            if (parameter.quantized != nullptr && seen.insert(parameter.quantized.get()).second) {
+                result.float_bytes     += parameter.number_of_elements() * sizeof(R);
+                result.quantized_bytes += parameter.quantized->memory_usage();
+            }
+        }
+        return result;
+    }
+
+    #define DALI_QUANTIZATION_INSTANTIATE(R) \
+        template void quantize<R>(Mat<R>&, QuantizedLayout); \
+        template void quantize<R>(vector<Mat<R>>&, QuantizedLayout); \
+        template void forget_quantized<R>(Mat<R>&); \
+        template const QuantizedMat<R>* quantized<R>(const Mat<R>&, QuantizedLayout); \
+        template bool quantized<R>(const vector<Mat<R>>&, QuantizedLayout); \
+        template void dot_accumulate<R>(const R*, int, int, const QuantizedMat<R>&, R*, int); \
+        template void quantize_input<R>(const R*, int, int, int, QuantizedInput*); \
+        template void dot_accumulate<R>(const QuantizedInput&, const QuantizedMat<R>&, R*, int); \
+        template Report<R> report<R>(const vector<Mat<R>>&, std::function<vector<Mat<R>>()>);
+
+    DALI_QUANTIZATION_INSTANTIATE(float)
+    DALI_QUANTIZATION_INSTANTIATE(double)
+    DALI_QUANTIZATION_INSTANTIATE(int)
+}
+
+template<typename R>
+std::ostream& operator<<(std::ostream& stream, const quantization::Report<R>& report) {
+    auto megabytes = [](size_t bytes) { return bytes / (1024.0 * 1024.0); };
+    stream << std::fixed << std::setprecision(3)
+           << "int8 weights: " << megabytes(report.float_bytes) << " MB -> "
+           << megabytes(report.quantized_bytes) << " MB";
+    if (report.quantized_bytes > 0) {
+        stream << " (" << std::setprecision(2)
+               << (double)report.float_bytes / report.quantized_bytes << "x smaller)";
+    }
+    stream << std::setprecision(6) << std::defaultfloat
+           << "\nmax |error| " << report.max_absolute_error
+           << ", mean |error| " << report.mean_absolute_error
+           << ", relative error " << 100.0 * report.relative_error << "%"
+           << ", argmax agreement " << 100.0 * report.argmax_agreement << "%";
+    return stream;
+}
+
+template std::ostream& operator<< <float>(std::ostream&, const quantization::Report<float>&);
+template std::ostream& operator<< <double>(std::ostream&, const quantization::Report<double>&);
@@ -0,0 +1,169 @@
+#ifndef DALI_TENSOR_QUANTIZATION_H
+#define DALI_TENSOR_QUANTIZATION_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "dali/tensor/Mat.h"
+
+/*
+Quantization
+------------
+
+Post-training int8 quantization of weights for inference. Quantizing
+a Mat attaches an int8 copy of its values, with one float scale per
+row: row r is stored as round(127 * x / max |row r|).
+
+    model.quantize();  // Layer, StackedInputLayer, LSTM, StackedLSTM
+    quantization::quantize(embedding, quantization::QUANTIZE_ROWS);
+    {
+        graph::NoBackprop nb;
+        auto scores = model.activate(...);
+    }
+
+While backprop is disabled, `mul_with_bias`, `mul_add_mul_with_bias`
+and `lstm_cell` (hence Layer, StackedInputLayer and LSTM) multiply by
+the int8 copy of their weights when every weight has one. Their
+inputs get quantized on the fly, one scale per row, and the int8
+products accumulate in int32 (see dali/math/simd/Int8Gemm.h): the
+product reads a quarter of the memory of the float one. `rows_pluck`
+dequantizes the rows it gathers.
+
+A weight multiplied as in `x.dot(W)` needs one scale per column (per
+output unit): QUANTIZE_COLUMNS stores its transpose. Embeddings read
+through `rows_pluck` use QUANTIZE_ROWS. Ops reading a Mat the other
+way use its float values, which stay in place (for training, the
+gradients and checkpoints). The int8 copy is shared by shallow copies
+of the Mat (deep copies get none). It is not updated when the values
+change: once they are written to (see SynchronizedMemory::version),
+e.g. by a solver step, ops read the float values again until the Mat
+is quantized again.
+
+`report` measures what quantization costs a model on a given input.
+*/
+
+namespace quantization {
+    enum QuantizedLayout {
+        QUANTIZE_ROWS,
+        QUANTIZE_COLUMNS,
+    };
+
+    // whether ops read int8 weights (backprop is disabled and no
+    // FloatScope is alive).
+    bool enabled();
+
+    // Ops read the float weights of quantized Mats while a FloatScope
+    // is alive (this thread only).
+    class FloatScope {
+        private:
+            const bool old_value;
+        public:
+            FloatScope();
+            ~FloatScope();
+    };
+
+    template<typename R>
+    struct Report {
+        // over every output value
+        R max_absolute_error;
+        R mean_absolute_error;
+        // |quantized - float| / |float| (Frobenius norms)
+        R relative_error;
+        // fraction of output rows whose argmax is unchanged
+        R argmax_agreement;
+        // weights of the quantized Mats, in float and in int8 (with
+        // their scales and padding).
+        size_t float_bytes;
+        size_t quantized_bytes;
+    };
+}
+
+template<typename R>
+class QuantizedMat {
+    public:
+        quantization::QuantizedLayout layout;
+        // of the quantized matrix (the transpose of the original
+        // one for QUANTIZE_COLUMNS).
+        int rows;
+        int cols;
+        // bytes between rows: cols rounded up to a multiple of
+        // simd::int8_row_alignment, padded with zeros.
+        int stride;
+        std::vector<int8_t> values;
+        std::vector<float> scales;
+        // sum of the values of each row (for simd::int8_gemm).
+        std::vector<int32_t> sums;
+        // the memory the values were read from, and its version then.
+        std::weak_ptr<SynchronizedMemory<R>> source;
+        int source_offset;
+        long long source_version;
+
+        QuantizedMat(const Mat<R>& matrix, quantization::QuantizedLayout layout);
+
+        // whether this is the int8 copy of the current values of
+        // `matrix` in `layout`.
+        bool matches(const Mat<R>& matrix, quantization::QuantizedLayout layout) const;
+        // writes the float values of (quantized) row `row`.
+        void dequantize_row(int row, R* out) const;
+        Mat<R> dequantize() const;
+        size_t memory_usage() const;
+};
+
+namespace quantization {
+    // Attaches an int8 copy of the current values of `matrix` (see above).
+    template<typename R>
+    void quantize(Mat<R>& matrix, QuantizedLayout layout);
+    template<typename R>
+    void quantize(std::vector<Mat<R>>& matrices, QuantizedLayout layout);
+    template<typename R>
+    void forget_quantized(Mat<R>& matrix);
+
+    // the int8 copy ops should read instead of `matrix`, or NULL.
+    template<typename R>
+    const QuantizedMat<R>* quantized(const Mat<R>& matrix, QuantizedLayout layout);
+    // whether each of these matrices has one (and `enabled()`).
+    template<typename R>
+    bool quantized(const std::vector<Mat<R>>& matrices, QuantizedLayout layout);
+
+    // out[i, :] += input[i, :] . W for the `rows` rows of `input` (of
+    // `weight.cols` values, `input_stride` apart), with `weight` the
+    // QUANTIZE_COLUMNS copy of W. Inputs are quantized one row at a
+    // time.
+    template<typename R>
+    void dot_accumulate(const R* input, int rows, int input_stride,
+                        const QuantizedMat<R>& weight,
+                        R* out, int out_stride);
+
+    // Input rows quantized once for several products (e.g. by the
+    // weights of every gate of an LSTM), one scale per row.
+    struct QuantizedInput {
+        int rows;
+        int cols;
+        // bytes between rows, as in QuantizedMat
+        int stride;
+        std::vector<int8_t> values;
+        std::vector<float> scales;
+    };
+    template<typename R>
+    void quantize_input(const R* input, int rows, int cols, int input_stride, QuantizedInput* out);
+    // same as above, with an input quantized by `quantize_input`.
+    template<typename R>
+    void dot_accumulate(const QuantizedInput& input,
+                        const QuantizedMat<R>& weight,
+                        R* out, int out_stride);
+
+    // Runs `predict` (under NoBackprop) with the float then the int8
+    // weights and compares the outputs. `parameters` are those of the
+    // model, some of them quantized.
+    template<typename R>
+    Report<R> report(const std::vector<Mat<R>>& parameters,
+                     std::function<std::vector<Mat<R>>()> predict);
+}
+
+template<typename R>
+std::ostream& operator<<(std::ostream&, const quantization::Report<R>&);
+
+#endif
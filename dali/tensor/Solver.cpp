@@ -1,6 +1,11 @@
 #include "dali/tensor/Solver.h"
-#include "dali/tensor/__MatMacros__.h"
 
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include "dali/tensor/__MatMacros__.h"
+#include "dali/utils/ThreadPool.h"
 
 using std::vector;
 #define PARAM_KEY_FOR_LOOKUP_TABLE &MAT(param)
@@ -9,43 +14,370 @@ using std::vector;
 
 namespace Solver {
     bool nan_protection = true;
+    int num_threads = 0;
 
+    /* ParameterCaches */
     template<typename R>
-    void create_cache(Mat<R>& param,
-            std::unordered_map<cache_key_t<R>, cache_t<R>>& caches) {
-        if (caches.count(PARAM_KEY_FOR_LOOKUP_TABLE) == 0) {
-            auto new_cache = caches.emplace(
-                std::piecewise_construct,
-            std::forward_as_tuple(PARAM_KEY_FOR_LOOKUP_TABLE),
-            std::forward_as_tuple(param.dims(0), param.dims(1)));
-            // initialize values for step cache to zero:
-            new_cache.first->second.clear();
-        }
+    ParameterCaches<R>::ParameterCaches(int caches_per_param) :
+            per_param(caches_per_param) {
     }
 
     template<typename R>
-    void create_cache(vector<Mat<R>>& params,
-            std::unordered_map<cache_key_t<R>, cache_t<R>>& caches) {
-        for (auto& param: params) {
-            create_cache(param, caches);
+    void ParameterCaches<R>::create(const vector<Mat<R>>& params) {
+        for (auto& param : params) {
+            cache_key_t<R> key = (cache_key_t<R>) PARAM_KEY_FOR_LOOKUP_TABLE;
+            if (slots.count(key) > 0) continue;
+            slots[key] = keys.size();
+            keys.emplace_back(key);
+            for (int i = 0; i < per_param; i++) {
+                caches.emplace_back(param.dims(0), param.dims(1));
+                // initialize values for step cache to zero:
+                caches.back().clear();
+            }
         }
     }
 
     template<typename R>
-    void reset_cache(Mat<R>& param,
-        std::unordered_map<cache_key_t<R>, cache_t<R>>& caches) {
-        auto& s = caches.at(PARAM_KEY_FOR_LOOKUP_TABLE);
-        s.clear();
+    void ParameterCaches<R>::reset(const vector<Mat<R>>& params) {
+        create(params);
+        for (int i = 0; i < params.size(); i++) {
+            auto cache = of(params, i);
+            for (int j = 0; j < per_param; j++) {
+                cache[j].clear();
+            }
+        }
     }
 
     template<typename R>
-    void reset_cache(vector<Mat<R>>& params,
-        std::unordered_map<cache_key_t<R>, cache_t<R>>& caches) {
-        for (auto& param: params) {
-            reset_cache(param, caches);
+    cache_t<R>* ParameterCaches<R>::of(const vector<Mat<R>>& params, int i) {
+        const auto& param = params[i];
+        cache_key_t<R> key = (cache_key_t<R>) PARAM_KEY_FOR_LOOKUP_TABLE;
+        int slot = i;
+        if (slot >= keys.size() || keys[slot] != key) {
+            auto found = slots.find(key);
+            ASSERT2(found != slots.end(),
+                "Solver has no caches for this parameter (see create_gradient_caches).");
+            slot = found->second;
         }
+        return &caches[slot * per_param];
     }
 
+    template<typename R>
+    int ParameterCaches<R>::caches_per_param() const {
+        return per_param;
+    }
+
+    template class ParameterCaches<float>;
+    template class ParameterCaches<double>;
+
+    /* Fused step */
+    namespace {
+        // elements of a parameter updated by one task.
+        const int FUSED_STEP_GRAIN = 1 << 15;
+
+        ThreadPool& step_pool() {
+            // the calling thread works too.
+            static ThreadPool pool(std::max(1, (num_threads > 0 ?
+                    num_threads : (int)std::thread::hardware_concurrency()) - 1));
+            return pool;
+        }
+
+        template<typename Function>
+        void parallel_chunks(int num_chunks, Function f) {
+            if (num_chunks == 1) {
+                f(0);
+            } else {
+                step_pool().parallel_for(0, num_chunks, f, 1);
+            }
+        }
+
+        template<typename R>
+        struct FusedTensor {
+            R* w;
+            R* dw;
+            R* cache[3];
+            int size;
+            // gradient has NaNs, only clear it.
+            bool skip;
+            // norm clipping
+            R scale;
+        };
+
+        struct FusedChunk {
+            int tensor;
+            int begin;
+            int end;
+        };
+
+        // the fused step works straight on the CPU arrays, GPU tensors
+        // and sparse gradients have their own paths.
+        template<typename R>
+        bool fusable(const Mat<R>& param) {
+            return !param.sparse_grad_enabled() && !MAT(param).compute_me_on_gpu();
+        }
+
+        template<typename R>
+        FusedTensor<R> fused_tensor(Mat<R>& param, Mat<R>* cache, int num_caches) {
+            FusedTensor<R> tensor;
+            tensor.w    = MAT(param).mutable_cpu_data().dptr_;
+            tensor.dw   = GRAD(param).mutable_cpu_data().dptr_;
+            tensor.size = param.number_of_elements();
+            for (int i = 0; i < 3; i++) {
+                tensor.cache[i] = i < num_caches ? MAT(cache[i]).mutable_cpu_data().dptr_ : NULL;
+            }
+            tensor.skip  = false;
+            tensor.scale = 1.0;
+            return tensor;
+        }
+
+        // Checks for NaNs, clips, regularizes, applies `rule` and clears
+        // the gradient of every tensor, in parallel chunks. The gradient
+        // is read once beforehand when its norm or NaNs are needed
+        // (same rules as SolverUpdates::clip_and_regularize).
+        template<typename R, typename Rule>
+        void fused_step(vector<FusedTensor<R>>& tensors, R clip_abs, R clip_norm, R regc, const Rule& rule) {
+            vector<FusedChunk> chunks;
+            for (int t = 0; t < tensors.size(); t++) {
+                for (int begin = 0; begin < tensors[t].size; begin += FUSED_STEP_GRAIN) {
+                    chunks.push_back({t, begin, std::min(tensors[t].size, begin + FUSED_STEP_GRAIN)});
+                }
+            }
+            if (chunks.empty()) return;
+
+            if (nan_protection || clip_norm > 0) {
+                vector<R> squared_norms(chunks.size());
+                parallel_chunks(chunks.size(), [&](int c) {
+                    const auto& chunk = chunks[c];
+                    const R* dw = tensors[chunk.tensor].dw;
+                    R squared_norm = 0.0;
+                    for (int i = chunk.begin; i < chunk.end; i++) {
+                        squared_norm += dw[i] * dw[i];
+                    }
+                    squared_norms[c] = squared_norm;
+                });
+                vector<R> tensor_norms(tensors.size(), 0.0);
+                for (int c = 0; c < chunks.size(); c++) {
+                    tensor_norms[chunks[c].tensor] += squared_norms[c];
+                }
+                for (int t = 0; t < tensors.size(); t++) {
+                    // NaN or infinite gradients show up in the norm.
+                    R norm = std::sqrt(tensor_norms[t]);
+                    if (nan_protection && !std::isfinite(norm) &&
+                            std::any_of(tensors[t].dw, tensors[t].dw + tensors[t].size,
+                                        [](R x) { return x != x; })) {
+                        std::cout << "WARNING: Ignoring gradient update because of NaNs." << std::endl;
+                        tensors[t].skip = true;
+                    } else if (clip_norm > 0 && norm > clip_norm && (regc > 0 || clip_abs <= 0)) {
+                        tensors[t].scale = clip_norm / norm;
+                    }
+                }
+            }
+
+            parallel_chunks(chunks.size(), [&](int c) {
+                const auto& chunk = chunks[c];
+                auto& tensor = tensors[chunk.tensor];
+                if (!tensor.skip) {
+                    for (int i = chunk.begin; i < chunk.end; i++) {
+                        R grad = tensor.scale * tensor.dw[i];
+                        if (clip_abs > 0) {
+                            grad = std::max(-clip_abs, std::min(clip_abs, grad));
+                        }
+                        if (regc > 0) {
+                            grad += regc * tensor.w[i];
+                        }
+                        rule(tensor.w[i], grad, tensor.cache, i);
+                    }
+                }
+                std::fill(tensor.dw + chunk.begin, tensor.dw + chunk.end, (R)0.0);
+            });
+        }
+
+        // rows to update when only some rows of the parameter received a
+        // gradient (see `Mat::enable_sparse_grad`), NULL for a dense update.
+        template<typename R>
+        const vector<int>* sparse_rows(const Mat<R>& param, R regc) {
+            // weight decay changes every row.
+            if (regc > 0 || MAT(param).compute_me_on_gpu()) {
+                return NULL;
+            }
+            return param.grad_rows();
+        }
+
+        // Update rules of the solvers. `operator()` updates a single
+        // element for the fused step, `sparse_update` and `dense_update`
+        // update a whole parameter with SolverUpdates.
+        template<typename R>
+        struct sgd_rule {
+            static const bool sparse = true;
+            R step_size;
+
+            void operator()(R& w, R grad, R* const* cache, int i) const {
+                w -= step_size * grad;
+            }
+            void sparse_update(Mat<R>& param, Mat<R>* cache, const vector<int>& rows) const {
+                MatOps<R>::sparse_sgd_update(param, rows, step_size);
+            }
+            void dense_update(Mat<R>& param, Mat<R>* cache) const {
+                MatOps<R>::sgd_update(param, step_size);
+            }
+        };
+
+        template<typename R>
+        struct adagrad_rule {
+            static const bool sparse = true;
+            R step_size;
+            R smooth_eps;
+
+            void operator()(R& w, R grad, R* const* cache, int i) const {
+                R& gsum = cache[0][i];
+                gsum += grad * grad;
+                w -= step_size * grad / (std::sqrt(gsum) + smooth_eps);
+            }
+            void sparse_update(Mat<R>& param, Mat<R>* cache, const vector<int>& rows) const {
+                MatOps<R>::sparse_adagrad_update(param, cache[0], rows, step_size, smooth_eps);
+            }
+            void dense_update(Mat<R>& param, Mat<R>* cache) const {
+                MatOps<R>::adagrad_update(param, cache[0], step_size, smooth_eps);
+            }
+        };
+
+        template<typename R>
+        struct rmsprop_rule {
+            static const bool sparse = true;
+            R decay_rate;
+            R step_size;
+            R smooth_eps;
+
+            void operator()(R& w, R grad, R* const* cache, int i) const {
+                R& gsum = cache[0][i];
+                gsum = decay_rate * gsum + ((R)1.0 - decay_rate) * grad * grad;
+                w -= step_size * grad / std::sqrt(gsum + smooth_eps);
+            }
+            void sparse_update(Mat<R>& param, Mat<R>* cache, const vector<int>& rows) const {
+                MatOps<R>::sparse_rmsprop_update(param, cache[0], rows, decay_rate, step_size, smooth_eps);
+            }
+            void dense_update(Mat<R>& param, Mat<R>* cache) const {
+                MatOps<R>::rmsprop_update(param, cache[0], decay_rate, step_size, smooth_eps);
+            }
+        };
+
+        template<typename R>
+        struct rmsprop_momentum_rule {
+            static const bool sparse = true;
+            R decay_rate;
+            R momentum;
+            R step_size;
+            R smooth_eps;
+
+            void operator()(R& w, R grad, R* const* cache, int i) const {
+                R& n = cache[0][i];
+                R& g = cache[1][i];
+                R& m = cache[2][i];
+                n = decay_rate * n + ((R)1.0 - decay_rate) * grad * grad;
+                g = decay_rate * g + ((R)1.0 - decay_rate) * grad;
+                m = momentum * m - step_size * grad / std::sqrt(n - g * g + smooth_eps);
+                w += m;
+            }
+            void sparse_update(Mat<R>& param, Mat<R>* cache, const vector<int>& rows) const {
+                // lazy: the momentum of the other rows is not applied.
+                MatOps<R>::sparse_rmsprop_momentum_update(param, cache[0], cache[1], cache[2], rows,
+                        decay_rate, momentum, step_size, smooth_eps);
+            }
+            void dense_update(Mat<R>& param, Mat<R>* cache) const {
+                MatOps<R>::rmsprop_momentum_update(param, cache[0], cache[1], cache[2],
+                        decay_rate, momentum, step_size, smooth_eps);
+            }
+        };
+
+        template<typename R>
+        struct adadelta_rule {
+            static const bool sparse = true;
+            R rho;
+            R smooth_eps;
+
+            void operator()(R& w, R grad, R* const* cache, int i) const {
+                R& gsum = cache[0][i];
+                R& xsum = cache[1][i];
+                gsum = rho * gsum + ((R)1.0 - rho) * grad * grad;
+                R dparam = std::sqrt(xsum + smooth_eps) / std::sqrt(gsum + smooth_eps) * grad;
+                xsum = rho * xsum + ((R)1.0 - rho) * dparam * dparam;
+                w -= dparam;
+            }
+            void sparse_update(Mat<R>& param, Mat<R>* cache, const vector<int>& rows) const {
+                MatOps<R>::sparse_adadelta_update(param, cache[0], cache[1], rows, rho, smooth_eps);
+            }
+            void dense_update(Mat<R>& param, Mat<R>* cache) const {
+                MatOps<R>::adadelta_update(param, cache[0], cache[1], rho, smooth_eps);
+            }
+        };
+
+        template<typename R>
+        struct adam_rule {
+            static const bool sparse = true;
+            R b1;
+            R b2;
+            R smooth_eps;
+            R step_size;
+            unsigned long long epoch;
+            // step size with the bias correction of this epoch
+            R lr_t;
+
+            void operator()(R& w, R grad, R* const* cache, int i) const {
+                R& m = cache[0][i];
+                R& v = cache[1][i];
+                m = m * ((R)1.0 - b1) + b1 * grad;
+                v = v * ((R)1.0 - b2) + b2 * grad * grad;
+                w -= lr_t * m / (std::sqrt(v) + smooth_eps);
+            }
+            void sparse_update(Mat<R>& param, Mat<R>* cache, const vector<int>& rows) const {
+                // lazy: moments of the other rows are left as they are.
+                MatOps<R>::sparse_adam_update(param, cache[0], cache[1], rows,
+                        b1, b2, smooth_eps, step_size, epoch);
+            }
+            void dense_update(Mat<R>& param, Mat<R>* cache) const {
+                MatOps<R>::adam_update(param, cache[0], cache[1],
+                        b1, b2, smooth_eps, step_size, epoch);
+            }
+        };
+
+        // One step of `rule` over all the parameters: sparse gradients
+        // only update their rows, parameters in CPU memory go through
+        // `fused_step` together, the others through SolverUpdates.
+        template<typename R, typename Rule>
+        void step_parameters(AbstractSolver<R>& solver,
+                             vector<Mat<R>>& parameters,
+                             ParameterCaches<R>* caches,
+                             const Rule& rule) {
+            vector<FusedTensor<R>> fused;
+            for (int i = 0; i < parameters.size(); i++) {
+                auto& param = parameters[i];
+                Mat<R>* cache = caches != NULL ? caches->of(parameters, i) : NULL;
+                const vector<int>* rows = Rule::sparse ? sparse_rows(param, solver.regc) : NULL;
+                if (rows != NULL) {
+                    if (nan_protection && MatOps<R>::sparse_is_grad_nan(param, *rows)) {
+                        std::cout << "WARNING: Ignoring gradient update because of NaNs." << std::endl;
+                    } else {
+                        MatOps<R>::sparse_clip(param, *rows, solver.clip_abs, solver.clip_norm);
+                        rule.sparse_update(param, cache, *rows);
+                    }
+                    // reset gradient
+                    param.clear_grad();
+                } else if (fusable(param)) {
+                    fused.emplace_back(fused_tensor(param, cache, caches != NULL ? caches->caches_per_param() : 0));
+                } else {
+                    if (nan_protection && param.is_grad_nan()) {
+                        std::cout << "WARNING: Ignoring gradient update because of NaNs." << std::endl;
+                    } else {
+                        MatOps<R>::clip_and_regularize(param, solver.clip_abs, solver.clip_norm, solver.regc);
+                        rule.dense_update(param, cache);
+                    }
+                    // reset gradient
+                    param.clear_grad();
+                }
+            }
+            fused_step(fused, solver.clip_abs, solver.clip_norm, solver.regc, rule);
+        }
+    }
 
     /* Abstract Solver */
     template<typename R>
@@ -88,16 +420,8 @@ namespace Solver {
 
     template<typename R>
     void SGD<R>::step (vector<Mat<R>>& parameters, R step_size) {
-        for (auto& param : parameters) {
-            if (nan_protection && param.is_grad_nan()) {
-                std::cout << "WARNING: Ignoring gradient update because of NaNs." << std::endl;
-            } else {
-                MatOps<R>::clip_and_regularize(param, this->clip_abs, this->clip_norm, this->regc);
-                MatOps<R>::sgd_update(param, step_size);
-            }
-            // reset gradient
-            GRAD(param).clear();
-        }
+        step_parameters(*this, parameters, (ParameterCaches<R>*) NULL,
+                        sgd_rule<R>{step_size});
     }
 
     template<typename R>
@@ -113,7 +437,8 @@ namespace Solver {
     AdaGrad<R>::AdaGrad (
             R smooth_eps,
             R clip_norm,
-            R regc) : AbstractSolver<R>(clip_norm, smooth_eps, regc, METHOD_ADAGRAD) {
+            R regc) : AbstractSolver<R>(clip_norm, smooth_eps, regc, METHOD_ADAGRAD),
+                      caches(1) {
     }
 
     template<typename R>
@@ -121,39 +446,28 @@ namespace Solver {
             vector<Mat<R>>& parameters,
             R smooth_eps,
             R clip_norm,
-            R regc) : AbstractSolver<R>(clip_norm, smooth_eps, regc, METHOD_ADAGRAD) {
+            R regc) : AbstractSolver<R>(clip_norm, smooth_eps, regc, METHOD_ADAGRAD),
+                      caches(1) {
         create_gradient_caches(parameters);
     }
 
     template<typename R>
     void AdaGrad<R>::create_gradient_caches(
             vector<Mat<R>>& parameters) {
-        create_cache(parameters, gsums);
+        caches.create(parameters);
     }
 
     template<typename R>
     void AdaGrad<R>::reset_caches(
             vector<Mat<R>>& parameters) {
-        reset_cache(parameters, gsums);
+        caches.reset(parameters);
     }
 
     template<typename R>
     void AdaGrad<R>::step(
             vector<Mat<R>>& parameters, R step_size) {
-        for (auto& param : parameters) {
-
-            if (nan_protection && param.is_grad_nan()) {
-                std::cout << "WARNING: Ignoring gradient update because of NaNs." << std::endl;
-            } else {
-                auto& s = gsums.at(PARAM_KEY_FOR_LOOKUP_TABLE);
-
-                MatOps<R>::clip_and_regularize(param, this->clip_abs, this->clip_norm, this->regc);
-                MatOps<R>::adagrad_update(param, s, step_size, this->smooth_eps);
-            }
-
-            // reset gradient
-            GRAD(param).clear();
-        }
+        step_parameters(*this, parameters, &caches,
+                        adagrad_rule<R>{step_size, this->smooth_eps});
     }
 
     template<typename R>
@@ -192,21 +506,11 @@ namespace Solver {
             vector<Mat<R>>& parameters,
             R step_size
             ) {
-        for (auto& param : parameters) {
-
-            if (nan_protection && param.is_grad_nan()) {
-                std::cout << "WARNING: Ignoring gradient update because of NaNs." << std::endl;
-            } else {
-                auto& s = this->gsums[PARAM_KEY_FOR_LOOKUP_TABLE];
-
-                MatOps<R>::clip_and_regularize(param, this->clip_abs, this->clip_norm, this->regc);
-                MatOps<R>::rmsprop_update(param, s, decay_rate, step_size, this->smooth_eps);
-            }
-
-            // reset gradient
-            GRAD(param).clear();
-            DEBUG_ASSERT_NOT_NAN(MAT(param));
-        }
+        rmsprop_rule<R> rule;
+        rule.decay_rate = decay_rate;
+        rule.step_size  = step_size;
+        rule.smooth_eps = this->smooth_eps;
+        step_parameters(*this, parameters, &this->caches, rule);
     }
 
     template<typename R>
@@ -229,7 +533,8 @@ namespace Solver {
             R regc) : AbstractSolver<R>(clip_norm, smooth_eps, regc, METHOD_RMSPROPMOMENTUM),
                       decay_rate(decay_rate),
                       momentum(momentum),
-                      step_size(step_size) {
+                      step_size(step_size),
+                      caches(3) {
     }
 
     template<typename R>
@@ -243,7 +548,8 @@ namespace Solver {
             R regc) : AbstractSolver<R>(clip_norm, smooth_eps, regc, METHOD_RMSPROPMOMENTUM),
                       decay_rate(decay_rate),
                       momentum(momentum),
-                      step_size(step_size) {
+                      step_size(step_size),
+                      caches(3) {
         create_gradient_caches(parameters);
     }
 
@@ -251,41 +557,24 @@ namespace Solver {
     template<typename R>
     void RMSPropMomentum<R>::create_gradient_caches(
             vector<Mat<R>>& parameters) {
-        create_cache(parameters, n_cache);
-        create_cache(parameters, g_cache);
-        create_cache(parameters, momentum_cache);
+        caches.create(parameters);
     }
 
     template<typename R>
     void RMSPropMomentum<R>::reset_caches(
             vector<Mat<R>>& parameters) {
-
-        reset_cache(parameters, n_cache);
-        reset_cache(parameters, g_cache);
-        reset_cache(parameters, momentum_cache);
+        caches.reset(parameters);
     }
 
     template<typename R>
     void RMSPropMomentum<R>::step(
             vector<Mat<R>>& parameters, R step_size_override) {
-        for (auto& param : parameters) {
-
-            if (nan_protection && param.is_grad_nan()) {
-                std::cout << "WARNING: Ignoring gradient update because of NaNs." << std::endl;
-            } else {
-                auto& n = n_cache.at(PARAM_KEY_FOR_LOOKUP_TABLE);
-                auto& g = g_cache.at(PARAM_KEY_FOR_LOOKUP_TABLE);
-                auto& m = momentum_cache.at(PARAM_KEY_FOR_LOOKUP_TABLE);
-
-                MatOps<R>::clip_and_regularize(param, this->clip_abs, this->clip_norm, this->regc);
-                MatOps<R>::rmsprop_momentum_update(
-                        param, n, g, m, decay_rate, momentum,
-                        step_size_override, this->smooth_eps);
-            }
-
-            // reset gradient
-            GRAD(param).clear();
-        }
+        rmsprop_momentum_rule<R> rule;
+        rule.decay_rate = decay_rate;
+        rule.momentum   = momentum;
+        rule.step_size  = step_size_override;
+        rule.smooth_eps = this->smooth_eps;
+        step_parameters(*this, parameters, &caches, rule);
     }
 
     template<typename R>
@@ -304,7 +593,8 @@ namespace Solver {
             R smooth_eps,
             R clip_norm,
             R regc) : AbstractSolver<R>(clip_norm, smooth_eps, regc, METHOD_ADADELTA),
-                      rho(_rho) {
+                      rho(_rho),
+                      caches(2) {
     }
 
     template<typename R>
@@ -314,43 +604,30 @@ namespace Solver {
             R smooth_eps,
             R clip_norm,
             R regc) : AbstractSolver<R>(clip_norm, smooth_eps, regc, METHOD_ADADELTA),
-                      rho(_rho) {
+                      rho(_rho),
+                      caches(2) {
         create_gradient_caches(parameters);
     }
 
     template<typename R>
     void AdaDelta<R>::create_gradient_caches(
             vector<Mat<R>>& parameters) {
-        create_cache(parameters, gsums);
-        create_cache(parameters, xsums);
+        caches.create(parameters);
     }
 
     template<typename R>
     void AdaDelta<R>::reset_caches(
             vector<Mat<R>>& parameters) {
-        reset_cache(parameters, gsums);
-        reset_cache(parameters, xsums);
+        caches.reset(parameters);
     }
 
 
     template<typename R>
     void AdaDelta<R>::step (vector<Mat<R>>& parameters) {
-        for (auto& param : parameters) {
-            if (nan_protection && param.is_grad_nan()) {
-                std::cout << "WARNING: Ignoring gradient update because of NaNs." << std::endl;
-            } else {
-                auto& gsum = gsums.at(PARAM_KEY_FOR_LOOKUP_TABLE);
-                auto& xsum = xsums.at(PARAM_KEY_FOR_LOOKUP_TABLE);
-
-                MatOps<R>::clip_and_regularize(param, this->clip_abs, this->clip_norm, this->regc);
-                MatOps<R>::adadelta_update(param, gsum, xsum, rho, this->smooth_eps);
-            }
-
-            // reset gradient
-            GRAD(param).clear();
-
-            DEBUG_ASSERT_NOT_NAN(GET_MAT(param));
-        }
+        adadelta_rule<R> rule;
+        rule.rho        = rho;
+        rule.smooth_eps = this->smooth_eps;
+        step_parameters(*this, parameters, &caches, rule);
     }
 
     template class AdaDelta<float>;
@@ -365,7 +642,7 @@ namespace Solver {
             R smooth_eps,
             R clip_norm,
             R regc) : AbstractSolver<R>(clip_norm, smooth_eps, regc, METHOD_ADAM),
-                      step_size(_step_size), b1(_b1), b2(_b2), epoch(0) {
+                      step_size(_step_size), b1(_b1), b2(_b2), epoch(0), caches(2) {
     }
 
     template<typename R>
@@ -377,22 +654,20 @@ namespace Solver {
             R smooth_eps,
             R clip_norm,
             R regc) : AbstractSolver<R>(clip_norm, smooth_eps, regc, METHOD_ADAM),
-                      step_size(_step_size), b1(_b1), b2(_b2), epoch(0) {
+                      step_size(_step_size), b1(_b1), b2(_b2), epoch(0), caches(2) {
         create_gradient_caches(parameters);
     }
 
     template<typename R>
     void Adam<R>::create_gradient_caches(
             vector<Mat<R>>& parameters) {
-        create_cache(parameters, gsums);
-        create_cache(parameters, xsums);
+        caches.create(parameters);
     }
 
     template<typename R>
     void Adam<R>::reset_caches(
             vector<Mat<R>>& parameters) {
-        reset_cache(parameters, gsums);
-        reset_cache(parameters, xsums);
+        caches.reset(parameters);
         epoch = 0;
     }
 
@@ -401,21 +676,19 @@ namespace Solver {
         // increase timesteps:
         epoch += 1;
 
-        for (auto& param : parameters) {
-            if (nan_protection && param.is_grad_nan()) {
-                std::cout << "WARNING: Ignoring gradient update because of NaNs." << std::endl;
-            } else {
-                auto& m = gsums.at(PARAM_KEY_FOR_LOOKUP_TABLE);
-                auto& v = xsums.at(PARAM_KEY_FOR_LOOKUP_TABLE);
-
-                MatOps<R>::clip_and_regularize(param, this->clip_abs, this->clip_norm, this->regc);
-
-                MatOps<R>::adam_update(param, m, v, b1, b2, this->smooth_eps, step_size, epoch);
-            }
-
-            // reset gradient
-            GRAD(param).clear();
-        }
+        adam_rule<R> rule;
+        rule.b1         = b1;
+        rule.b2         = b2;
+        rule.smooth_eps = this->smooth_eps;
+        rule.step_size  = step_size;
+        rule.epoch      = epoch;
+        // this affects the learning rate:
+        auto fix1 = 1.0 - std::pow(b1, epoch);
+        auto fix2 = 1.0 - std::pow(b2, epoch);
+        rule.lr_t = step_size * sqrt(fix2 / fix1);
+        ASSERT2(rule.lr_t == rule.lr_t, "Epoch learning rate is NaN. Try changing b1 or b2.");
+
+        step_parameters(*this, parameters, &caches, rule);
     }
 
 
@@ -12,6 +12,27 @@ namespace Solver {
     template<typename R>
     using cache_t = Mat<R>;
 
+    // Solver state of every parameter: `caches_per_param` matrices of
+    // zeros with the parameter's dimensions. The caches of params[i]
+    // are found by position (and by key only when the vector of
+    // parameters changed since the caches were created).
+    template<typename R>
+    class ParameterCaches {
+        public:
+            explicit ParameterCaches(int caches_per_param);
+            // create the caches of the parameters that have none yet.
+            void create(const std::vector<Mat<R>>& params);
+            void reset(const std::vector<Mat<R>>& params);
+            // first of the caches of params[i], which must exist.
+            cache_t<R>* of(const std::vector<Mat<R>>& params, int i);
+            int caches_per_param() const;
+        private:
+            int per_param;
+            std::vector<cache_key_t<R>> keys;
+            std::unordered_map<cache_key_t<R>, int> slots;
+            std::vector<cache_t<R>> caches;
+    };
+
     enum Method {
         METHOD_UNINITIALIZED,
         METHOD_ADAGRAD,
@@ -23,6 +44,9 @@ namespace Solver {
     };
 
     extern bool nan_protection;
+    // threads used to update parameters in CPU memory (0 means one
+    // per core). Read when the first step happens.
+    extern int num_threads;
 
     const double SMOOTH_DEFAULT = 1e-4;
 
@@ -58,7 +82,8 @@ namespace Solver {
             // This can be overriden by parameter passed to step function.
             R step_size = SOLVER_MAT_DEFAULT_STEP_SIZE_H;
 
-            std::unordered_map<cache_key_t<R>, cache_t<R>> gsums;
+            // sum of squared gradients
+            ParameterCaches<R> caches;
             AdaGrad (R smooth_eps = SMOOTH_DEFAULT, R clip_norm = 100.0, R regc = 0.0);
             AdaGrad (std::vector<Mat<R>>&, R smooth_eps = SMOOTH_DEFAULT, R clip_norm = 100.0, R regc = 0.0);
             virtual void step( std::vector<Mat<R>>&);
@@ -84,9 +109,8 @@ namespace Solver {
             R decay_rate;
             R momentum;
 
-            std::unordered_map<cache_key_t<R>, cache_t<R>> n_cache;
-            std::unordered_map<cache_key_t<R>, cache_t<R>> g_cache;
-            std::unordered_map<cache_key_t<R>, cache_t<R>> momentum_cache;
+            // n, g and momentum
+            ParameterCaches<R> caches;
 
             RMSPropMomentum (R decay_rate= 0.95, R momentum=0.9, R step_size=1e-4, R smooth_eps = 1e-4, R clip_norm = 100.0, R regc = 0.0);
             RMSPropMomentum (std::vector<Mat<R>>&, R decay_rate= 0.95, R momentum=0.9, R step_size=1e-4, R smooth_eps = 1e-4, R clip_norm = 100.0, R regc = 0.0);
@@ -99,8 +123,8 @@ namespace Solver {
     template<typename R> class AdaDelta : public AbstractSolver<R> {
         public:
             R rho;
-            std::unordered_map<cache_key_t<R>, cache_t<R>> xsums;
-            std::unordered_map<cache_key_t<R>, cache_t<R>> gsums;
+            // gsum and xsum
+            ParameterCaches<R> caches;
             AdaDelta (R rho= 0.95, R smooth_eps = 1e-4, R clip_norm = 100.0, R regc = 0.0);
             AdaDelta (std::vector<Mat<R>>&, R rho= 0.95, R smooth_eps = 1e-4, R clip_norm = 100.0, R regc = 0.0);
             virtual void step(std::vector<Mat<R>>&);
@@ -115,8 +139,8 @@ namespace Solver {
             R step_size;
             // This is a large integer:
             unsigned long long epoch;
-            std::unordered_map<cache_key_t<R>, cache_t<R>> xsums;
-            std::unordered_map<cache_key_t<R>, cache_t<R>> gsums;
+            // first and second moments
+            ParameterCaches<R> caches;
             Adam (R step_size = 0.0002, R b1 = 0.5, R b2 = 1e-6, R smooth_eps = SMOOTH_DEFAULT, R clip_norm = 100.0, R regc = 0.0);
             Adam (std::vector<Mat<R>>&, R step_size = 0.0002, R b1 = 0.5, R b2 = 1e-6, R smooth_eps = SMOOTH_DEFAULT, R clip_norm = 100.0, R regc = 0.0);
             virtual void step(std::vector<Mat<R>>&);
@@ -1,20 +1,29 @@
 #include "Tape.h"
+#include <algorithm>
 #include <iostream>
 
+#include "dali/math/memory_bank/MemoryArena.h"
+#include "dali/utils/assert2.h"
+#include "dali/utils/core_utils.h"
+
 namespace graph {
     thread_local bool _backprop_enabled = true;
+    thread_local bool _fusion_enabled = false;
     thread_local Tape tape;
-
-    void emplace_back(std::function<void()>&& f) {
-        tape.backprop.emplace_back(f);
-    }
+    thread_local Plan* capturing_plan = NULL;
 
     void backward() {
+        ASSERT2(capturing_plan == NULL,
+                "graph::backward cannot be called while capturing a graph::Plan.");
         tape.backward();
+        memory_arena::reset();
     }
 
     void clear() {
-        tape.backprop.clear();
+        ASSERT2(capturing_plan == NULL,
+                "graph::clear cannot be called while capturing a graph::Plan.");
+        tape.clear();
+        memory_arena::reset();
     }
 
     bool backprop_enabled() {
@@ -25,17 +34,88 @@ namespace graph {
         _backprop_enabled = value;
     }
 
+    bool fusion_enabled() {
+        // a plan needs every op to hand over its own kernel.
+        return _fusion_enabled && capturing_plan == NULL;
+    }
+
     size_t size() {
-        return tape.backprop.size();
+        return tape.size();
     }
 
 
     /* Tape */
 
+    const size_t Tape::block_size;
+
+    Tape::Tape() : current_block(0) {
+    }
+
+    Tape::~Tape() {
+        clear();
+        for (auto& block : blocks) {
+            delete[] block.data;
+        }
+    }
+
+    void* Tape::reserve(size_t bytes, size_t alignment) {
+        while (current_block < blocks.size()) {
+            auto& block = blocks[current_block];
+            size_t start = (block.used + alignment - 1) / alignment * alignment;
+            if (start + bytes <= block.size) {
+                block.used = start + bytes;
+                return block.data + start;
+            }
+            current_block++;
+        }
+        // operator new[] alignment suffices for closures of Mats and scalars.
+        Block block;
+        block.size = std::max(block_size, bytes);
+        block.data = new char[block.size];
+        block.used = bytes;
+        blocks.emplace_back(block);
+        current_block = blocks.size() - 1;
+        return block.data;
+    }
+
     void Tape::backward () {
-        for (auto it = backprop.rbegin(); it != backprop.rend(); ++it)
-            (*it)();
-        backprop.clear();
+        replay();
+        clear();
+    }
+
+    void Tape::replay() {
+        // index based: a node may record new nodes while running.
+        for (size_t i = nodes.size(); i > 0; i--) {
+            auto node = nodes[i - 1];
+            if (node->profile_tag != profiler::NOT_PROFILED && profiler::enabled()) {
+                long event = profiler::begin_backward(node->profile_tag);
+                node->invoke(node);
+                profiler::end(event);
+            } else {
+                node->invoke(node);
+            }
+        }
+    }
+
+    void Tape::clear() {
+        for (auto node : nodes) {
+            node->destroy(node);
+        }
+        nodes.clear();
+        for (auto& block : blocks) {
+            block.used = 0;
+        }
+        current_block = 0;
+    }
+
+    size_t Tape::size() const {
+        return nodes.size();
+    }
+
+    void Tape::swap(Tape& other) {
+        blocks.swap(other.blocks);
+        nodes.swap(other.nodes);
+        std::swap(current_block, other.current_block);
     }
 
     /* NoBackprop */
@@ -52,4 +132,172 @@ namespace graph {
             _backprop_enabled = old_value;
     }
 
+    /* ScopedTape */
+    ScopedTape::ScopedTape() {
+        tape.swap(saved);
+    }
+
+    ScopedTape::~ScopedTape() {
+        tape.clear();
+        tape.swap(saved);
+    }
+
+    /* ArenaScope */
+    ArenaScope::ArenaScope() : ArenaScope(true) {
+    }
+
+    ArenaScope::ArenaScope(bool condition) : old_value(memory_arena::enabled()), enabled(condition) {
+        if (enabled)
+            memory_arena::_set_enabled(true);
+    }
+
+    ArenaScope::~ArenaScope() {
+        if (enabled)
+            memory_arena::_set_enabled(old_value);
+    }
+
+    /* FusionScope */
+    FusionScope::FusionScope() : FusionScope(true) {
+    }
+
+    FusionScope::FusionScope(bool condition) : old_value(_fusion_enabled), enabled(condition) {
+        if (enabled)
+            _fusion_enabled = true;
+    }
+
+    FusionScope::~FusionScope() {
+        if (enabled)
+            _fusion_enabled = old_value;
+    }
+
+    /* Plan */
+    Plan::Plan() : captured_(false) {
+    }
+
+    void Plan::capture(std::function<void()> step) {
+        ASSERT2(capturing_plan == NULL, "graph::Plan: already capturing a plan.");
+        clear();
+        auto observer = profiler::op_observer;
+        // the step records onto this plan's tape.
+        tape.swap(nodes);
+        capturing_plan = this;
+        profiler::op_observer = this;
+        auto stop_capturing = [&]() {
+            profiler::op_observer = observer;
+            capturing_plan = NULL;
+            tape.swap(nodes);
+        };
+        try {
+            step();
+        } catch (...) {
+            stop_capturing();
+            clear();
+            throw;
+        }
+        stop_capturing();
+        if (!uncaptured.empty()) {
+            auto ops = utils::join(uncaptured, ", ");
+            clear();
+            utils::assert2(false, utils::MS() << "graph::Plan: cannot replay " << ops
+                                              << " (no forward kernel).");
+        }
+        captured_ = true;
+        nodes.replay();
+    }
+
+    void Plan::replay() {
+        forward();
+        // the forward kernels may have taken another path (e.g. int8
+        // weights), leaving the buffers of the closures unfilled.
+        if (backprop_enabled()) {
+            nodes.replay();
+        }
+    }
+
+    void Plan::forward() {
+        ASSERT2(captured_, "graph::Plan: nothing was captured.");
+        for (auto& kernel : kernels) {
+            kernel();
+        }
+    }
+
+    bool Plan::captured() const {
+        return captured_;
+    }
+
+    size_t Plan::size() const {
+        return kernels.size();
+    }
+
+    void Plan::clear() {
+        kernels.clear();
+        nodes.clear();
+        frames.clear();
+        uncaptured.clear();
+        captured_ = false;
+    }
+
+    void Plan::add_kernel(std::function<void()> kernel) {
+        if (frames.empty()) {
+            if (kernel) kernels.emplace_back(std::move(kernel));
+            return;
+        }
+        frames.back().has_kernel = true;
+        frames.back().kernel = std::move(kernel);
+    }
+
+    void Plan::add_prologue(std::function<void()> kernel) {
+        kernels.emplace_back(std::move(kernel));
+    }
+
+    void Plan::op_begin(const char* name) {
+        Frame frame;
+        frame.name              = name;
+        frame.first_kernel      = kernels.size();
+        frame.first_node        = tape.size();
+        frame.child_nodes       = 0;
+        frame.children          = 0;
+        frame.children_captured = 0;
+        frame.has_kernel        = false;
+        frame.culprit           = NULL;
+        frames.emplace_back(std::move(frame));
+    }
+
+    void Plan::op_end() {
+        Frame frame = std::move(frames.back());
+        frames.pop_back();
+        size_t recorded = tape.size() - frame.first_node;
+        bool captured;
+        if (frame.has_kernel) {
+            // the op's kernel redoes what the ops it called did.
+            kernels.erase(kernels.begin() + frame.first_kernel, kernels.end());
+            if (frame.kernel) kernels.emplace_back(std::move(frame.kernel));
+            captured = true;
+        } else {
+            // fine if the op only strings together ops that can be
+            // replayed (any backward closure of its own means it did
+            // some work of its own).
+            captured = frame.children > 0 &&
+                       frame.children_captured == frame.children &&
+                       recorded == frame.child_nodes;
+            if (!captured && frame.culprit == NULL) frame.culprit = frame.name;
+        }
+        if (!frames.empty()) {
+            auto& parent = frames.back();
+            parent.children++;
+            parent.child_nodes += recorded;
+            if (captured) {
+                parent.children_captured++;
+            } else if (parent.culprit == NULL) {
+                parent.culprit = frame.culprit;
+            }
+        } else if (!captured) {
+            std::string op = frame.culprit == frame.name ?
+                    std::string(frame.name) :
+                    std::string(frame.culprit) + " (called by " + frame.name + ")";
+            if (std::find(uncaptured.begin(), uncaptured.end(), op) == uncaptured.end()) {
+                uncaptured.emplace_back(op);
+            }
+        }
+    }
 }
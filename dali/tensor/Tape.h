@@ -1,11 +1,19 @@
 #ifndef CORE_NEW_GRAPH_H
 #define CORE_NEW_GRAPH_H
 
+#include <cstddef>
 #include <functional>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "dali/utils/Profiler.h"
+
 namespace graph {
-    void emplace_back(std::function<void()>&& f);
+    template<typename Function>
+    void emplace_back(Function&& f);
 
     void backward();
 
@@ -13,18 +21,106 @@ namespace graph {
 
     bool backprop_enabled();
 
+    // whether elementwise ops get deferred (see FusionScope).
+    bool fusion_enabled();
+
     // avoid using explicitly - use NoBackprop object instead
     void _set_backprop_enabled(bool value);
 
     size_t size();
 
+    /*
+    Backward Node
+    -------------
+
+    A recorded backward closure. The closure is stored inline right
+    after this header, and the two function pointers know its real
+    type, so the tape never needs a std::function (and its heap
+    allocation) per op.
+    */
+    struct BackwardNode {
+        void (*invoke)(BackwardNode*);
+        void (*destroy)(BackwardNode*);
+        // op that recorded the node (see dali/utils/Profiler.h)
+        long profile_tag;
+    };
+
+    template<typename Function>
+    struct TypedBackwardNode : public BackwardNode {
+        Function function;
+
+        template<typename F>
+        explicit TypedBackwardNode(F&& f) : function(std::forward<F>(f)) {
+            invoke  = &TypedBackwardNode::call;
+            destroy = &TypedBackwardNode::release;
+        }
+
+        static void call(BackwardNode* node) {
+            static_cast<TypedBackwardNode*>(node)->function();
+        }
+
+        static void release(BackwardNode* node) {
+            static_cast<TypedBackwardNode*>(node)->~TypedBackwardNode();
+        }
+    };
+
+    /*
+    Tape
+    ----
+
+    Backward nodes are placed one after the other into large blocks
+    of memory. Clearing the tape (or running backward) destroys the
+    nodes but keeps the blocks and the node index, so that once a
+    training loop has warmed up recording an op no longer touches
+    the heap.
+    */
     class Tape {
+        private:
+            struct Block {
+                char* data;
+                size_t size;
+                size_t used;
+            };
+            std::vector<Block> blocks;
+            // block currently being filled
+            size_t current_block;
+            std::vector<BackwardNode*> nodes;
+
+            void* reserve(size_t bytes, size_t alignment);
+
+            Tape(const Tape&) = delete;
+            Tape& operator =(Tape const &) = delete;
         public:
-            std::vector<std::function<void()>>  backprop;
+            static const size_t block_size = 1 << 16;
+
+            Tape();
+            ~Tape();
+
+            template<typename Function>
+            void emplace_back(Function&& f) {
+                typedef TypedBackwardNode<typename std::decay<Function>::type> node_t;
+                void* slot = reserve(sizeof(node_t), alignof(node_t));
+                auto node = new (slot) node_t(std::forward<Function>(f));
+                node->profile_tag = profiler::enabled() ? profiler::current_op() : profiler::NOT_PROFILED;
+                nodes.emplace_back(node);
+            }
 
-            void backward ();
+            void backward();
+            // runs the nodes like backward, but keeps them.
+            void replay();
+            void clear();
+            size_t size() const;
+            // exchange recorded nodes (and their memory) with another tape.
+            void swap(Tape& other);
     };
 
+    extern thread_local Tape tape;
+
+    template<typename Function>
+    void emplace_back(Function&& f) {
+        tape.emplace_back(std::forward<Function>(f));
+    }
+
     class NoBackprop {
         private:
             // value of backprop before object go activated.
@@ -40,6 +136,223 @@ namespace graph {
             explicit NoBackprop(bool condition);
             ~NoBackprop();
     };
+
+    /*
+    ScopedTape
+    ----------
+
+    While a ScopedTape is alive, ops are recorded onto a fresh tape
+    and `graph::backward` only replays what was recorded since. The
+    thread's previous tape is put back (untouched) on destruction,
+    which makes it possible to backpropagate through a piece of the
+    graph from inside a backward closure.
+    */
+    class ScopedTape {
+        private:
+            Tape saved;
+            ScopedTape(const ScopedTape&) = delete;
+            ScopedTape& operator =(ScopedTape const &) = delete;
+
+        public:
+            explicit ScopedTape();
+            ~ScopedTape();
+    };
+
+    /*
+    ArenaScope
+    ----------
+
+    Mats created while an ArenaScope is alive take their cpu memory
+    from a per-thread bump allocator that is rewound by
+    `graph::backward` and `graph::clear`, instead of going through the
+    memory bank one tensor at a time. Parameters should be created
+    outside of the scope so that they stay on the regular allocator.
+
+    Temporaries that outlive the pass remain valid: the arena only
+    reuses memory nobody points to anymore.
+    */
+    class ArenaScope {
+        private:
+            // value of arena flag before object got activated.
+            const bool old_value;
+            // whether the object actually does something (used for condition).
+            const bool enabled;
+            ArenaScope(const ArenaScope&) = delete;
+            ArenaScope& operator =(ArenaScope const &) = delete;
+
+        public:
+            explicit ArenaScope();
+            // Use the arena only if condition is true
+            explicit ArenaScope(bool condition);
+            ~ArenaScope();
+    };
+
+    /*
+    FusionScope
+    -----------
+
+    While a FusionScope is alive, chains of elementwise ops are not
+    computed one op at a time: each op returns a Mat whose value is
+    pending, and the whole chain is evaluated in one pass (with one
+    backward closure) when something reads that value. The inputs of a
+    pending chain must not be written to before it is evaluated. See
+    dali/tensor/op/fusion.h.
+    */
+    class FusionScope {
+        private:
+            // value of fusion flag before object got activated.
+            const bool old_value;
+            // whether the object actually does something (used for condition).
+            const bool enabled;
+            FusionScope(const FusionScope&) = delete;
+            FusionScope& operator =(FusionScope const &) = delete;
+
+        public:
+            explicit FusionScope();
+            // Fuse only if condition is true
+            explicit FusionScope(bool condition);
+            ~FusionScope();
+    };
+
+    class Plan;
+
+    // plan capturing the ops run by this thread (or NULL).
+    extern thread_local Plan* capturing_plan;
+
+    inline bool capturing() {
+        return capturing_plan != NULL;
+    }
+
+    /*
+    Plan
+    ----
+
+    A training step captured once and replayed many times. While
+    `capture` runs the step, every op hands over a forward kernel
+    along with its backward closures. The plan keeps both, with the
+    Mats they read and write, so a replay redoes the same arithmetic
+    into the same buffers: no Mat gets allocated and no closure gets
+    recorded anymore.
+
+        Mat<R> input(batch_size, input_size);
+        Mat<int> targets(batch_size, 1);
+        graph::Plan step;
+        step.capture([&]() {
+            auto error = MatOps<R>::softmax_cross_entropy_rowwise(model.activate(input), targets);
+            error.grad();
+        });
+        solver.step(params);
+        for (...) {
+            ... copy the next minibatch into input.w() and targets.w() ...
+            step.replay();
+            solver.step(params);
+        }
+
+    Shapes are those of the capture, and new data can only come in
+    through the Mats (or Indexes) the step read: work done between
+    ops is not replayed. Capturing a step that uses an op without a
+    forward kernel fails and names the op. Capturing runs the
+    forward and backward pass once; the step itself must not call
+    graph::backward.
+    */
+    class Plan : private profiler::OpObserver {
+        private:
+            // op running while capturing
+            struct Frame {
+                const char* name;
+                // kernels and nodes recorded before the op started
+                size_t first_kernel;
+                size_t first_node;
+                // nodes recorded by the ops it called
+                size_t child_nodes;
+                int children;
+                int children_captured;
+                bool has_kernel;
+                std::function<void()> kernel;
+                // innermost op that could not be captured
+                const char* culprit;
+            };
+            std::vector<std::function<void()>> kernels;
+            Tape nodes;
+            std::vector<Frame> frames;
+            std::vector<std::string> uncaptured;
+            bool captured_;
+
+            void op_begin(const char* name) override;
+            void op_end() override;
+
+            Plan(const Plan&) = delete;
+            Plan& operator =(Plan const &) = delete;
+        public:
+            Plan();
+
+            // runs `step` once, recording it.
+            void capture(std::function<void()> step);
+            // forward then backward pass of the captured step (forward
+            // pass only while backprop is disabled).
+            void replay();
+            // forward pass only (e.g. for a step captured under NoBackprop).
+            void forward();
+            bool captured() const;
+            // number of forward kernels.
+            size_t size() const;
+            void clear();
+
+            // used by ops (see capture_forward and capture_prologue).
+            void add_kernel(std::function<void()> kernel);
+            void add_prologue(std::function<void()> kernel);
+    };
+
+    /*
+    An op supports capture by writing its forward computation as a
+    kernel taking its output first, and running it through:
+
+        auto forward = [](Mat<R>& out, Mat<R>& matrix) { MAT(out) = ...; };
+        forward(out, matrix);
+        graph::capture_forward(forward, out, matrix);
+
+    The kernel replaces those of the ops it called. The plan keeps
+    copies of the arguments (which share their memory) and resets
+    the gradient of the output before every replay.
+    */
+    template<typename Kernel, typename Output, typename... Inputs>
+    std::function<void()> bind_forward(Kernel kernel, Output output, Inputs... inputs) {
+        return [kernel, output, inputs...]() mutable {
+            kernel(output, inputs...);
+            output.clear_grad();
+        };
+    }
+
+    template<typename Kernel, typename Output, typename... Inputs>
+    void capture_forward(Kernel kernel, const Output& output, const Inputs&... inputs) {
+        if (capturing_plan != NULL) {
+            capturing_plan->add_kernel(bind_forward(kernel, output, inputs...));
+        }
+    }
+
+    // for ops whose output is a view of their input: nothing to redo.
+    inline void capture_view() {
+        if (capturing_plan != NULL) {
+            capturing_plan->add_kernel(std::function<void()>());
+        }
+    }
+
+    // Work replayed where it was captured, ahead of the kernels of the
+    // ops that follow it (e.g. an op copying indices into a Mat<int>
+    // before calling other ops).
+    template<typename Kernel, typename... Args>
+    std::function<void()> bind_prologue(Kernel kernel, Args... args) {
+        return [kernel, args...]() mutable {
+            kernel(args...);
+        };
+    }
+
+    template<typename Kernel, typename... Args>
+    void capture_prologue(Kernel kernel, const Args&... args) {
+        if (capturing_plan != NULL) {
+            capturing_plan->add_prologue(bind_prologue(kernel, args...));
+        }
+    }
 }
 
 #endif
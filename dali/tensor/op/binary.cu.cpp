@@ -2,9 +2,11 @@
 
 #include "dali/tensor/Mat.h"
 #include "dali/tensor/__MatMacros__.h"
+#include "dali/tensor/op/fusion.h"
 #include "dali/math/TensorOps.h"
 #include "dali/math/LazyTensor.h"
 #include "dali/utils/core_utils.h"
+#include "dali/utils/Profiler.h"
 
 using utils::MS;
 using std::vector;
@@ -15,12 +17,17 @@ namespace matops {
     Mat<R> Binary<R>::eltmul_broadcast_colwise(
             Mat<R> matrix1,
             Mat<R> matrix2) {
+        profiler::OpScope profile("Binary::eltmul_broadcast_colwise", matrix1, matrix2);
         ASSERT2(matrix1.dims(0) == matrix2.dims(0) && matrix2.dims(1) == 1,
                 MS() << "Matrices " << matrix1 << " and " << matrix2
                      << " cannot be element multiplied with broadcast,"
                      << " they do not have the same dimensions.");
         auto out = Mat<R>::empty_like(matrix1);
-        MAT(out) = MAT(matrix1).wrapper() * MAT(matrix2).ravel().wrapper().template broadcast<0>(MAT(matrix1).shape);
+        auto forward = [](Mat<R>& out, Mat<R>& matrix1, Mat<R>& matrix2) {
+            MAT(out) = MAT(matrix1).wrapper() * MAT(matrix2).ravel().wrapper().template broadcast<0>(MAT(matrix1).shape);
+        };
+        forward(out, matrix1, matrix2);
+        graph::capture_forward(forward, out, matrix1, matrix2);
         if (graph::backprop_enabled())
             graph::emplace_back([matrix1, matrix2, out]() mutable {
                 SAFE_GRAD(matrix1) += GRAD(out).wrapper() * (MAT(matrix2).ravel().wrapper().template broadcast<0>(GRAD(out).shape));
@@ -33,16 +40,21 @@ namespace matops {
     Mat<R> Binary<R>::eltdivide_broadcast(
             Mat<R> matrix1,
             Mat<R> matrix2) {
+        profiler::OpScope profile("Binary::eltdivide_broadcast", matrix1, matrix2);
         ASSERT2(matrix1.dims(0) == matrix2.dims(0) && matrix2.dims(1) == 1,
                 MS() << "Matrices " << matrix1 << " and " << matrix2
                      << " cannot be element divided with broadcast,"
                      << " they do not have the same dimensions.");
         auto out = Mat<R>::empty_like(matrix1);
-        MAT(out) = (
-            MAT(matrix1).wrapper()
-            /
-            MAT(matrix2).ravel().wrapper().template broadcast<0>(MAT(matrix1).shape)
-        );
+        auto forward = [](Mat<R>& out, Mat<R>& matrix1, Mat<R>& matrix2) {
+            MAT(out) = (
+                MAT(matrix1).wrapper()
+                /
+                MAT(matrix2).ravel().wrapper().template broadcast<0>(MAT(matrix1).shape)
+            );
+        };
+        forward(out, matrix1, matrix2);
+        graph::capture_forward(forward, out, matrix1, matrix2);
         if (graph::backprop_enabled())
             graph::emplace_back([matrix1, matrix2, out]() mutable {
                 SAFE_GRAD(matrix1) += (
@@ -63,6 +75,7 @@ namespace matops {
     Mat<R> Binary<R>::eltmul(
             Mat<R> matrix1,
             Mat<R> matrix2) {
+        profiler::OpScope profile("Binary::eltmul", matrix1, matrix2);
 
         if (matrix1.dims(0) != matrix2.dims(0) && (matrix1.dims(0) == 1 || matrix2.dims(0) == 1)) {
             if (matrix1.dims(0) == 1) {
@@ -73,8 +86,16 @@ namespace matops {
 
         ASSERT2(matrix1.dims(0) == matrix2.dims(0) && matrix1.dims(1) == matrix2.dims(1),
                 "Matrices cannot be element-wise multiplied, they do not have the same dimensions.");
+        if (Fusion<R>::defer(matrix1, matrix2)) {
+            return Fusion<R>::binary(FUSED_ELTMUL, matrix1, matrix2);
+        }
+
         auto out = Mat<R>::empty_like(matrix1);
-        MAT(out) = MAT(matrix1).wrapper() * MAT(matrix2).wrapper();
+        auto forward = [](Mat<R>& out, Mat<R>& matrix1, Mat<R>& matrix2) {
+            MAT(out) = MAT(matrix1).wrapper() * MAT(matrix2).wrapper();
+        };
+        forward(out, matrix1, matrix2);
+        graph::capture_forward(forward, out, matrix1, matrix2);
         if (graph::backprop_enabled())
             graph::emplace_back([matrix1, matrix2, out]() mutable {
                 SAFE_GRAD(matrix1) += MAT(matrix2).wrapper() * GRAD(out).wrapper();
@@ -99,6 +120,7 @@ namespace matops {
     Mat<R> Binary<R>::eltdivide(
             Mat<R> matrix1,
             Mat<R> matrix2) {
+        profiler::OpScope profile("Binary::eltdivide", matrix1, matrix2);
         if (matrix1.dims(1) != matrix2.dims(1) && (matrix1.dims(1) == 1 || matrix2.dims(1) == 1)) {
             if (matrix1.dims(1) == 1) {
                 return eltdivide_broadcast_reversed(matrix2, matrix1);
@@ -107,8 +129,16 @@ namespace matops {
         }
         ASSERT2(matrix1.dims(0) == matrix2.dims(0) && matrix1.dims(1) == matrix2.dims(1),
                 "Matrices cannot be element-wise divided, they do not have the same dimensions.");
+        if (Fusion<R>::defer(matrix1, matrix2)) {
+            return Fusion<R>::binary(FUSED_ELTDIVIDE, matrix1, matrix2);
+        }
+
         auto out = Mat<R>::empty_like(matrix1);
-        MAT(out) = MAT(matrix1).wrapper() / MAT(matrix2).wrapper();
+        auto forward = [](Mat<R>& out, Mat<R>& matrix1, Mat<R>& matrix2) {
+            MAT(out) = MAT(matrix1).wrapper() / MAT(matrix2).wrapper();
+        };
+        forward(out, matrix1, matrix2);
+        graph::capture_forward(forward, out, matrix1, matrix2);
         if (graph::backprop_enabled())
             graph::emplace_back([matrix1, matrix2, out]() mutable {
                 SAFE_GRAD(matrix1) += (
@@ -127,6 +157,7 @@ namespace matops {
     Mat<R> Binary<R>::add(
             Mat<R> matrix1,
             Mat<R> matrix2) {
+        profiler::OpScope profile("Binary::add", matrix1, matrix2);
         if (matrix1.dims(0) != matrix2.dims(0) && (matrix1.dims(0) == 1 || matrix2.dims(0) == 1)) {
             if (matrix1.dims(0) == 1) {
                 // consider matrix1 to be a vector
@@ -136,9 +167,16 @@ namespace matops {
             return add_broadcast_rowwise(matrix1, matrix2);
         }
         ASSERT2(matrix1.dims() == matrix2.dims(), "Matrices cannot be added, they do not have the same dimensions.");
+        if (Fusion<R>::defer(matrix1, matrix2)) {
+            return Fusion<R>::binary(FUSED_ADD, matrix1, matrix2);
+        }
 
         auto out = Mat<R>::empty_like(matrix1);
-        MAT(out) = MAT(matrix1).wrapper() + MAT(matrix2).wrapper();
+        auto forward = [](Mat<R>& out, Mat<R>& matrix1, Mat<R>& matrix2) {
+            MAT(out) = MAT(matrix1).wrapper() + MAT(matrix2).wrapper();
+        };
+        forward(out, matrix1, matrix2);
+        graph::capture_forward(forward, out, matrix1, matrix2);
 
         if (graph::backprop_enabled())
             graph::emplace_back([matrix1, matrix2, out]() mutable {
@@ -153,6 +191,7 @@ namespace matops {
     Mat<R> Binary<R>::sub(
             Mat<R> matrix1,
             Mat<R> matrix2) {
+        profiler::OpScope profile("Binary::sub", matrix1, matrix2);
         if (matrix1.dims(1) != matrix2.dims(1) && (matrix1.dims(1) == 1 || matrix2.dims(1) == 1)) {
             if (matrix1.dims(1) == 1) {
                 // consider matrix1 to be a vector
@@ -163,9 +202,16 @@ namespace matops {
         }
 
         ASSERT2(matrix1.dims() == matrix2.dims(), "Matrices cannot be subtracted, they do not have the same dimensions.");
+        if (Fusion<R>::defer(matrix1, matrix2)) {
+            return Fusion<R>::binary(FUSED_SUB, matrix1, matrix2);
+        }
 
         auto out = Mat<R>::empty_like(matrix1);
-        MAT(out) = MAT(matrix1).wrapper() - MAT(matrix2).wrapper();
+        auto forward = [](Mat<R>& out, Mat<R>& matrix1, Mat<R>& matrix2) {
+            MAT(out) = MAT(matrix1).wrapper() - MAT(matrix2).wrapper();
+        };
+        forward(out, matrix1, matrix2);
+        graph::capture_forward(forward, out, matrix1, matrix2);
 
         if (graph::backprop_enabled())
             graph::emplace_back([matrix1, matrix2, out]() mutable {
@@ -178,18 +224,23 @@ namespace matops {
 
     template<typename R>
     Mat<R> Binary<R>::add_broadcast_rowwise(Mat<R> matrix1, Mat<R> matrix2) {
+        profiler::OpScope profile("Binary::add_broadcast_rowwise", matrix1, matrix2);
         // broadcast matrix 2:
         ASSERT2(matrix2.dims(0) == 1, "Second argument to add_broadcast must be a row vector (first dimension=1)");
         ASSERT2(matrix1.dims(1) == matrix2.dims(1),
                 MS() << "vector-like argument to add_broadcast_rowwise must have length (" << matrix2.dims(1)
                      << ") equal to outer dimension of first argument (" << matrix1.dims(1) << ").");
         auto out = Mat<R>::empty_like(matrix1);
-        MAT(out) = (
-            MAT(matrix1).wrapper() +
-            MAT(matrix2).ravel().wrapper().template broadcast<1>(
-                MAT(matrix1).shape
-            )
-        );
+        auto forward = [](Mat<R>& out, Mat<R>& matrix1, Mat<R>& matrix2) {
+            MAT(out) = (
+                MAT(matrix1).wrapper() +
+                MAT(matrix2).ravel().wrapper().template broadcast<1>(
+                    MAT(matrix1).shape
+                )
+            );
+        };
+        forward(out, matrix1, matrix2);
+        graph::capture_forward(forward, out, matrix1, matrix2);
         if (graph::backprop_enabled())
             graph::emplace_back([matrix1, matrix2, out]() mutable {
                 SAFE_GRAD(matrix1) += GRAD(out).wrapper();
@@ -200,18 +251,23 @@ namespace matops {
 
     template<typename R>
     Mat<R> Binary<R>::add_broadcast_colwise(Mat<R> matrix1, Mat<R> matrix2) {
+        profiler::OpScope profile("Binary::add_broadcast_colwise", matrix1, matrix2);
         // broadcast matrix 2:
         ASSERT2(matrix2.dims(1) == 1, "Second argument to add_broadcast must be a col vector (second dimension=1)");
         ASSERT2(matrix1.dims(0) == matrix2.dims(0),
                 MS() << "vector-like argument to add_broadcast_colwise must have outer dimension (" << matrix2.dims(0)
                      << ") equal to inner dimension of first argument (" << matrix1.dims(0) << ").");
         auto out = Mat<R>::empty_like(matrix1);
-        MAT(out) = (
-            MAT(matrix1).wrapper() +
-            MAT(matrix2).ravel().wrapper().template broadcast<0>(
-                MAT(matrix1).shape
-            )
-        );
+        auto forward = [](Mat<R>& out, Mat<R>& matrix1, Mat<R>& matrix2) {
+            MAT(out) = (
+                MAT(matrix1).wrapper() +
+                MAT(matrix2).ravel().wrapper().template broadcast<0>(
+                    MAT(matrix1).shape
+                )
+            );
+        };
+        forward(out, matrix1, matrix2);
+        graph::capture_forward(forward, out, matrix1, matrix2);
         if (graph::backprop_enabled())
             graph::emplace_back([matrix1, matrix2, out]() mutable {
                 SAFE_GRAD(matrix1) += GRAD(out).wrapper();
@@ -222,6 +278,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Binary<R>::sub_broadcast(Mat<R> matrix1, Mat<R> matrix2) {
+        profiler::OpScope profile("Binary::sub_broadcast", matrix1, matrix2);
         // broadcast matrix 2:
         ASSERT2(matrix2.dims(1) == 1, "Second argument to sub_broadcast must be a vector (second dimension=1)");
         if (matrix1.dims(0) != matrix2.dims(0)) {
@@ -230,12 +287,16 @@ namespace matops {
                      << ") equal to inner dimension of first argument (" << matrix1.dims(0) << ").");
         }
         auto out = Mat<R>::empty_like(matrix1);
-        MAT(out) = (
-            MAT(matrix1).wrapper() -
-            MAT(matrix2).ravel().wrapper().template broadcast<0>(
-                MAT(matrix1).shape
-            )
-        );
+        auto forward = [](Mat<R>& out, Mat<R>& matrix1, Mat<R>& matrix2) {
+            MAT(out) = (
+                MAT(matrix1).wrapper() -
+                MAT(matrix2).ravel().wrapper().template broadcast<0>(
+                    MAT(matrix1).shape
+                )
+            );
+        };
+        forward(out, matrix1, matrix2);
+        graph::capture_forward(forward, out, matrix1, matrix2);
         if (graph::backprop_enabled())
             graph::emplace_back([matrix1, matrix2, out]() mutable {
                 SAFE_GRAD(matrix1) += GRAD(out).wrapper();
@@ -246,6 +307,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Binary<R>::sub_broadcast_reversed(Mat<R> matrix1, Mat<R> matrix2) {
+        profiler::OpScope profile("Binary::sub_broadcast_reversed", matrix1, matrix2);
         // broadcast matrix 2:
         ASSERT2(matrix2.dims(1) == 1, "Second argument to sub_broadcast_reversed must be a vector (first dimension=1)");
         if (matrix1.dims(0) != matrix2.dims(0)) {
@@ -254,11 +316,15 @@ namespace matops {
                      << ") equal to inner dimension of first argument (" << matrix1.dims(0) << ").");
         }
         auto out = Mat<R>::empty_like(matrix1);
-        MAT(out) = (
-            MAT(matrix2).ravel().wrapper().template broadcast<0>(
-                MAT(matrix1).shape
-            ) - MAT(matrix1).wrapper()
-        );
+        auto forward = [](Mat<R>& out, Mat<R>& matrix1, Mat<R>& matrix2) {
+            MAT(out) = (
+                MAT(matrix2).ravel().wrapper().template broadcast<0>(
+                    MAT(matrix1).shape
+                ) - MAT(matrix1).wrapper()
+            );
+        };
+        forward(out, matrix1, matrix2);
+        graph::capture_forward(forward, out, matrix1, matrix2);
         if (graph::backprop_enabled())
             graph::emplace_back([matrix1, matrix2, out]() mutable {
                 SAFE_GRAD(matrix1) -= GRAD(out).wrapper();
@@ -270,6 +336,7 @@ namespace matops {
     // not GPU friendly.
     template<typename R>
     Mat<R> Binary<R>::pow(Mat<R> matrix, Mat<R> other) {
+        profiler::OpScope profile("Binary::pow", matrix, other);
         ASSERT2(other.dims(0) == 1 && other.dims(1) == 1, "exponent must be a 1x1 matrix.");
         auto out = Mat<R>::empty_like(matrix);
         // TODO (szymon): it would be better it was done completely on GPU.
@@ -330,11 +397,17 @@ namespace matops {
 
     template<typename R>
     Mat<R> Binary<R>::add(std::vector<Mat<R>>& matrices) {
+        profiler::OpScope profile("Binary::add");
         ASSERT2(matrices.size() > 0, "Got 0 matrices to add.");
 
-        auto out = Mat<R>::zeros_like(matrices.front());
-        for (auto& matrix : matrices)
-            MAT(out) += MAT(matrix).wrapper();
+        auto out = Mat<R>::empty_like(matrices.front());
+        auto forward = [](Mat<R>& out, vector<Mat<R>>& matrices) {
+            MAT(out) = (R)0.0;
+            for (auto& matrix : matrices)
+                MAT(out) += MAT(matrix).wrapper();
+        };
+        forward(out, matrices);
+        graph::capture_forward(forward, out, matrices);
         if (graph::backprop_enabled())
             graph::emplace_back([matrices, out]() mutable {
                 for (auto& matrix : matrices) {
@@ -349,10 +422,16 @@ namespace matops {
     Mat<R> Binary<R>::mul(
             Mat<R> matrix1,
             Mat<R> matrix2) {
+        profiler::OpScope profile("Binary::mul", matrix1, matrix2);
         ASSERT2(matrix1.dims(1) == matrix2.dims(0), "matrix product dimensions misaligned.");
+        profiler::set_flops(2 * (int64_t)matrix1.dims(0) * matrix1.dims(1) * matrix2.dims(1));
         Mat<R> out (matrix1.dims(0), matrix2.dims(1), weights<R>::empty());
 
-        MAT(out) = dot( MAT(matrix1).wrapper(), MAT(matrix2).wrapper() );
+        auto forward = [](Mat<R>& out, Mat<R>& matrix1, Mat<R>& matrix2) {
+            MAT(out) = dot( MAT(matrix1).wrapper(), MAT(matrix2).wrapper() );
+        };
+        forward(out, matrix1, matrix2);
+        graph::capture_forward(forward, out, matrix1, matrix2);
 
         if (graph::backprop_enabled())
             graph::emplace_back([matrix1, matrix2, out]() mutable {
@@ -367,16 +446,21 @@ namespace matops {
     Mat<R> Binary<R>::eltdivide_broadcast_reversed(
             Mat<R> matrix1,
             Mat<R> matrix2) {
+        profiler::OpScope profile("Binary::eltdivide_broadcast_reversed", matrix1, matrix2);
         ASSERT2(matrix1.dims(0) == matrix2.dims(0) && matrix2.dims(1) == 1,
                 MS() << "Matrices " << matrix1 << " and " << matrix2
                      << " cannot be element divided with broadcast,"
                      << " they do not have the same dimensions.");
         auto out = Mat<R>::empty_like(matrix1);
-        MAT(out) = (
-            MAT(matrix2).ravel().wrapper().template broadcast<0>(MAT(matrix1).shape)
-            /
-            MAT(matrix1).wrapper()
-        );
+        auto forward = [](Mat<R>& out, Mat<R>& matrix1, Mat<R>& matrix2) {
+            MAT(out) = (
+                MAT(matrix2).ravel().wrapper().template broadcast<0>(MAT(matrix1).shape)
+                /
+                MAT(matrix1).wrapper()
+            );
+        };
+        forward(out, matrix1, matrix2);
+        graph::capture_forward(forward, out, matrix1, matrix2);
         if (graph::backprop_enabled())
             graph::emplace_back([matrix1, matrix2, out]() mutable {
                 SAFE_GRAD(matrix1) -= F<op::div_grad<R>>(
@@ -394,10 +478,15 @@ namespace matops {
     Mat<R> Binary<R>::eltmul_broadcast_rowwise(
             Mat<R> matrix1,
             Mat<R> row_vector) {
+        profiler::OpScope profile("Binary::eltmul_broadcast_rowwise", matrix1, row_vector);
         ASSERT2(matrix1.dims(1) == row_vector.dims(1) && row_vector.dims(0) == 1,
             "Matrices A and B^T cannot be element multiplied with broadcast, they do not have the same dimensions.");
         auto out = Mat<R>::empty_like(matrix1);
-        MAT(out) = MAT(matrix1).wrapper() * MAT(row_vector).ravel().wrapper().template broadcast<1>(MAT(matrix1).shape);
+        auto forward = [](Mat<R>& out, Mat<R>& matrix1, Mat<R>& row_vector) {
+            MAT(out) = MAT(matrix1).wrapper() * MAT(row_vector).ravel().wrapper().template broadcast<1>(MAT(matrix1).shape);
+        };
+        forward(out, matrix1, row_vector);
+        graph::capture_forward(forward, out, matrix1, row_vector);
         if (graph::backprop_enabled())
             graph::emplace_back([matrix1, row_vector, out]() mutable {
                 SAFE_GRAD(matrix1) += GRAD(out).wrapper() * MAT(row_vector).ravel().wrapper().template broadcast<1>(GRAD(out).shape);
@@ -410,11 +499,16 @@ namespace matops {
     Mat<R> Binary<R>::eltmul_rowwise(
         Mat<R> matrix1,
         Mat<R> matrix2) {
+        profiler::OpScope profile("Binary::eltmul_rowwise", matrix1, matrix2);
 
         ASSERT2(matrix1.dims(0) == matrix2.dims(1) && matrix1.dims(1) == matrix2.dims(0),
             "Matrices A and B^T cannot be element-wise multiplied, they do not have the same dimensions.");
         auto out = Mat<R>::empty_like(matrix1);
-        MAT(out) = MAT(matrix1).wrapper() * MAT(matrix2).wrapper().T();
+        auto forward = [](Mat<R>& out, Mat<R>& matrix1, Mat<R>& matrix2) {
+            MAT(out) = MAT(matrix1).wrapper() * MAT(matrix2).wrapper().T();
+        };
+        forward(out, matrix1, matrix2);
+        graph::capture_forward(forward, out, matrix1, matrix2);
         if (graph::backprop_enabled())
             graph::emplace_back([matrix1, matrix2, out]() mutable {
                 SAFE_GRAD(matrix1) += (
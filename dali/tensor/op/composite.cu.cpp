@@ -1,21 +1,367 @@
 #include "dali/tensor/op/composite.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include "dali/tensor/__MatMacros__.h"
 #include "dali/math/TensorOps.h"
 #include "dali/math/LazyTensor.h"
+#include "dali/tensor/Quantization.h"
 #include "dali/tensor/Weights.h"
+#include "dali/utils/Profiler.h"
 
 using std::vector;
 using utils::MS;
 
+namespace {
+    template<typename R>
+    inline R sigmoid_value(R x) {
+        return 1.0 / (1.0 + std::exp(-x));
+    }
+
+    // Lays the inputs out side by side in `packed`, repeating the
+    // single row of broadcast inputs.
+    template<typename R>
+    void pack_lstm_inputs(const vector<Mat<R>>& inputs, TensorInternal<R,2>& packed) {
+        auto out = packed.overwrite_cpu_data();
+        int offset = 0;
+        for (auto& input : inputs) {
+            auto in = MAT(input).cpu_data();
+            const int cols = input.dims(1);
+            for (int row = 0; row < out.size(0); ++row) {
+                const R* src = in.dptr_ + in.stride_ * (input.dims(0) == 1 ? 0 : row);
+                std::copy(src, src + cols, out.dptr_ + out.stride_ * row + offset);
+            }
+            offset += cols;
+        }
+    }
+
+    // Packs gate_weights[g][i] into the block of rows of input i and
+    // the block of columns of gate g.
+    template<typename R>
+    void pack_lstm_weights(const vector<vector<Mat<R>>>& gate_weights, TensorInternal<R,2>& packed) {
+        auto out = packed.overwrite_cpu_data();
+        for (int g = 0; g < gate_weights.size(); ++g) {
+            int row_offset = 0;
+            for (auto& weight : gate_weights[g]) {
+                auto w = MAT(weight).cpu_data();
+                const int cols = weight.dims(1);
+                for (int row = 0; row < weight.dims(0); ++row) {
+                    const R* src = w.dptr_ + w.stride_ * row;
+                    std::copy(src, src + cols, out.dptr_ + out.stride_ * (row_offset + row) + g * cols);
+                }
+                row_offset += weight.dims(0);
+            }
+        }
+    }
+
+    // Shared by both versions of Composite::lstm_cell: the gates are
+    // offset either by `gate_biases` or, when there are none, by the
+    // precomputed `gate_inputs`.
+    template<typename R>
+    std::tuple<Mat<R>, Mat<R>> lstm_cell_step(
+            const vector<Mat<R>>& inputs,
+            const vector<Mat<R>>& memories,
+            const vector<vector<Mat<R>>>& gate_weights,
+            const vector<Mat<R>>& gate_biases,
+            Mat<R> gate_inputs,
+            std::shared_ptr<matops::PackedGateWeights<R>> weights_cache) {
+        const int num_children = memories.size();
+        const int num_gates    = num_children + 3;
+        const bool has_gate_inputs = gate_biases.empty();
+        ASSERT2(num_children > 0, "lstm_cell: expected at least one memory.");
+        ASSERT2(inputs.size() > 0, "lstm_cell: expected at least one input.");
+        ASSERT2(gate_weights.size() == num_gates,
+                MS() << "lstm_cell: expected weights for " << num_gates << " gates.");
+        ASSERT2(has_gate_inputs || gate_biases.size() == num_gates,
+                MS() << "lstm_cell: expected bias for " << num_gates << " gates.");
+        const int hidden_size = memories[0].dims(1);
+
+        int num_examples = 1;
+        int total_input_size = 0;
+        for (auto& input : inputs) {
+            num_examples = std::max(num_examples, (int)input.dims(0));
+            total_input_size += input.dims(1);
+        }
+        for (auto& memory : memories) {
+            ASSERT2(memory.dims(1) == hidden_size,
+                    MS() << "lstm_cell: memories should have size " << hidden_size
+                         << " not " << memory.dims(1));
+            num_examples = std::max(num_examples, (int)memory.dims(0));
+        }
+        if (has_gate_inputs) {
+            num_examples = std::max(num_examples, (int)gate_inputs.dims(0));
+        }
+        for (auto& input : inputs) {
+            ASSERT2(input.dims(0) == num_examples || input.dims(0) == 1,
+                    MS() << "lstm_cell: incorrect number of rows for input " << input);
+        }
+        for (auto& memory : memories) {
+            ASSERT2(memory.dims(0) == num_examples || memory.dims(0) == 1,
+                    MS() << "lstm_cell: incorrect number of rows for memory " << memory);
+        }
+        for (int g = 0; g < num_gates; ++g) {
+            ASSERT2(gate_weights[g].size() == inputs.size(),
+                    MS() << "lstm_cell: gate " << g << " has " << gate_weights[g].size()
+                         << " weights for " << inputs.size() << " inputs.");
+            for (int i = 0; i < inputs.size(); ++i) {
+                ASSERT2(gate_weights[g][i].dims(0) == inputs[i].dims(1) &&
+                        gate_weights[g][i].dims(1) == hidden_size,
+                        MS() << "lstm_cell: weight " << i << " of gate " << g << " has wrong dimensions.");
+            }
+            ASSERT2(has_gate_inputs || gate_biases[g].number_of_elements() == hidden_size,
+                    MS() << "lstm_cell: bias of gate " << g << " has wrong dimensions.");
+        }
+        const int gates_size = num_gates * hidden_size;
+        if (has_gate_inputs) {
+            ASSERT2(gate_inputs.dims(1) == gates_size &&
+                    (gate_inputs.dims(0) == num_examples || gate_inputs.dims(0) == 1),
+                    MS() << "lstm_cell: gate inputs should have " << gates_size
+                         << " columns and " << num_examples << " or 1 rows (got " << gate_inputs << ").");
+        }
+
+        TensorInternal<R,2> packed_inputs(mshadow::Shape2(num_examples, total_input_size));
+        // pre-activations, then activations of all the gates
+        TensorInternal<R,2> gates(mshadow::Shape2(num_examples, gates_size));
+        Mat<R> memory(num_examples, hidden_size, weights<R>::empty());
+        Mat<R> hidden(num_examples, hidden_size, weights<R>::empty());
+        // set by the forward pass, read by the backward one.
+        auto packed_weights = std::make_shared<TensorInternal<R,2>>();
+
+        auto forward = [](Mat<R>& memory, Mat<R>& hidden,
+                          TensorInternal<R,2>& packed_inputs, TensorInternal<R,2>& gates,
+                          std::shared_ptr<TensorInternal<R,2>>& packed_weights,
+                          std::shared_ptr<matops::PackedGateWeights<R>>& weights_cache,
+                          const vector<Mat<R>>& inputs,
+                          const vector<Mat<R>>& memories,
+                          const vector<vector<Mat<R>>>& gate_weights,
+                          const vector<Mat<R>>& gate_biases,
+                          Mat<R>& gate_inputs) {
+            const int num_children = memories.size();
+            const bool has_gate_inputs = gate_biases.empty();
+            const int num_examples = memory.dims(0);
+            const int hidden_size  = memory.dims(1);
+            // (capture_forward resets the gradient of memory only)
+            hidden.clear_grad();
+
+            pack_lstm_inputs(inputs, packed_inputs);
+            bool quantized = true;
+            for (auto& gate : gate_weights) {
+                quantized = quantized && quantization::quantized(gate, quantization::QUANTIZE_COLUMNS);
+            }
+            if (quantized) {
+                // each input is quantized once, then one int8 product
+                // per gate goes straight into the gates.
+                gates.clear();
+                auto packed = packed_inputs.cpu_data();
+                auto out = gates.mutable_cpu_data();
+                thread_local quantization::QuantizedInput quantized_input;
+                int offset = 0;
+                for (int i = 0; i < gate_weights[0].size(); ++i) {
+                    const int input_size = gate_weights[0][i].dims(0);
+                    quantization::quantize_input(packed.dptr_ + offset, num_examples, input_size,
+                                                 packed.stride_, &quantized_input);
+                    for (int g = 0; g < gate_weights.size(); ++g) {
+                        quantization::dot_accumulate(quantized_input, *gate_weights[g][i].quantized,
+                                                     out.dptr_ + g * hidden_size, out.stride_);
+                    }
+                    offset += input_size;
+                }
+            } else {
+                if (weights_cache != nullptr) {
+                    *packed_weights = weights_cache->get(gate_weights);
+                } else {
+                    *packed_weights = TensorInternal<R,2>(mshadow::Shape2(packed_inputs.shape[1], gates.shape[1]));
+                    pack_lstm_weights(gate_weights, *packed_weights);
+                }
+                gates = dot(packed_inputs.wrapper(), packed_weights->wrapper());
+            }
+
+            auto gates_data  = gates.mutable_cpu_data();
+            auto memory_data = MAT(memory).overwrite_cpu_data();
+            auto hidden_data = MAT(hidden).overwrite_cpu_data();
+            // all the biases side by side, like the gates.
+            vector<R> biases;
+            for (auto& bias : gate_biases) {
+                const R* bias_data = MAT(bias).cpu_data().dptr_;
+                biases.insert(biases.end(), bias_data, bias_data + hidden_size);
+            }
+            const R* gate_inputs_data = NULL;
+            int gate_inputs_stride = 0;
+            if (has_gate_inputs) {
+                auto data = MAT(gate_inputs).cpu_data();
+                gate_inputs_data   = data.dptr_;
+                gate_inputs_stride = gate_inputs.dims(0) == 1 ? 0 : data.stride_;
+            }
+            vector<decltype(memory_data)> prev_memories;
+            for (auto& prev : memories) prev_memories.emplace_back(MAT(prev).cpu_data());
+
+            for (int row = 0; row < num_examples; ++row) {
+                R* gate = gates_data.dptr_ + gates_data.stride_ * row;
+                const R* offset = has_gate_inputs ?
+                    gate_inputs_data + gate_inputs_stride * row :
+                    biases.data();
+                for (int col = 0; col < hidden_size; ++col) {
+                    R* input_gate = gate + col;
+                    *input_gate = sigmoid_value<R>(*input_gate + offset[col]);
+                    R cell = 0.0;
+                    for (int k = 0; k < num_children; ++k) {
+                        R* forget_gate = gate + (1 + k) * hidden_size + col;
+                        *forget_gate = sigmoid_value<R>(*forget_gate + offset[(1 + k) * hidden_size + col]);
+                        auto& prev = prev_memories[k];
+                        cell += *forget_gate * prev.dptr_[prev.stride_ * (memories[k].dims(0) == 1 ? 0 : row) + col];
+                    }
+                    R* output_gate = gate + (1 + num_children) * hidden_size + col;
+                    *output_gate = sigmoid_value<R>(*output_gate + offset[(1 + num_children) * hidden_size + col]);
+                    R* cell_write = gate + (2 + num_children) * hidden_size + col;
+                    *cell_write = std::tanh(*cell_write + offset[(2 + num_children) * hidden_size + col]);
+
+                    cell += *input_gate * *cell_write;
+                    memory_data.dptr_[memory_data.stride_ * row + col] = cell;
+                    hidden_data.dptr_[hidden_data.stride_ * row + col] = *output_gate * std::tanh(cell);
+                }
+            }
+        };
+        forward(memory, hidden, packed_inputs, gates, packed_weights, weights_cache,
+                inputs, memories, gate_weights, gate_biases, gate_inputs);
+        graph::capture_forward(forward, memory, hidden, packed_inputs, gates, packed_weights, weights_cache,
+                               inputs, memories, gate_weights, gate_biases, gate_inputs);
+
+        if (graph::backprop_enabled())
+            graph::emplace_back([inputs, memories, gate_weights, gate_biases, gate_inputs, packed_inputs, packed_weights, gates, memory, hidden]() mutable {
+                const int num_children = memories.size();
+                const int num_gates    = num_children + 3;
+                const int hidden_size  = memory.dims(1);
+                const int num_examples = memory.dims(0);
+                const int gates_size   = num_gates * hidden_size;
+                const int total_input_size = packed_inputs.shape[1];
+
+                // gradient with respect to the gates' pre-activations
+                TensorInternal<R,2> gate_grads(mshadow::Shape2(num_examples, gates_size));
+                {
+                    auto gates_data  = gates.cpu_data();
+                    auto grads_data  = gate_grads.overwrite_cpu_data();
+                    auto memory_data = MAT(memory).cpu_data();
+                    auto dmemory     = GRAD(memory).cpu_data();
+                    auto dhidden     = GRAD(hidden).cpu_data();
+                    vector<decltype(memory_data)> prev_memories;
+                    for (auto& prev : memories) prev_memories.emplace_back(MAT(prev).cpu_data());
+                    vector<R*> prev_dmemories;
+                    for (auto& prev : memories) {
+                        prev_dmemories.emplace_back(prev.constant ? NULL : GRAD(prev).mutable_cpu_data().dptr_);
+                    }
+
+                    for (int row = 0; row < num_examples; ++row) {
+                        const R* gate = gates_data.dptr_ + gates_data.stride_ * row;
+                        R* grad = grads_data.dptr_ + grads_data.stride_ * row;
+                        for (int col = 0; col < hidden_size; ++col) {
+                            const R input_gate  = gate[col];
+                            const R output_gate = gate[(1 + num_children) * hidden_size + col];
+                            const R cell_write  = gate[(2 + num_children) * hidden_size + col];
+                            const R cell_tanh   = std::tanh(memory_data.dptr_[memory_data.stride_ * row + col]);
+                            const R dh          = dhidden.dptr_[dhidden.stride_ * row + col];
+                            const R dcell       = dmemory.dptr_[dmemory.stride_ * row + col] +
+                                                  dh * output_gate * (1.0 - cell_tanh * cell_tanh);
+
+                            grad[col] = dcell * cell_write * input_gate * (1.0 - input_gate);
+                            for (int k = 0; k < num_children; ++k) {
+                                const R forget_gate = gate[(1 + k) * hidden_size + col];
+                                const int prev_idx  = prev_memories[k].stride_ * (memories[k].dims(0) == 1 ? 0 : row) + col;
+                                grad[(1 + k) * hidden_size + col] =
+                                        dcell * prev_memories[k].dptr_[prev_idx] * forget_gate * (1.0 - forget_gate);
+                                if (prev_dmemories[k] != NULL) {
+                                    prev_dmemories[k][prev_idx] += dcell * forget_gate;
+                                }
+                            }
+                            grad[(1 + num_children) * hidden_size + col] =
+                                    dh * cell_tanh * output_gate * (1.0 - output_gate);
+                            grad[(2 + num_children) * hidden_size + col] =
+                                    dcell * input_gate * (1.0 - cell_write * cell_write);
+                        }
+                    }
+                }
+
+                if (gate_biases.empty() && !gate_inputs.constant) {
+                    auto grads_data   = gate_grads.cpu_data();
+                    auto dgate_inputs = GRAD(gate_inputs).mutable_cpu_data();
+                    for (int row = 0; row < num_examples; ++row) {
+                        const R* grad = grads_data.dptr_ + grads_data.stride_ * row;
+                        R* dst = dgate_inputs.dptr_ + dgate_inputs.stride_ * (gate_inputs.dims(0) == 1 ? 0 : row);
+                        for (int col = 0; col < gates_size; ++col) {
+                            dst[col] += grad[col];
+                        }
+                    }
+                }
+                for (int g = 0; g < gate_biases.size(); ++g) {
+                    if (gate_biases[g].constant) continue;
+                    auto grads_data = gate_grads.cpu_data();
+                    R* dbias = GRAD(gate_biases[g]).mutable_cpu_data().dptr_;
+                    for (int row = 0; row < num_examples; ++row) {
+                        const R* grad = grads_data.dptr_ + grads_data.stride_ * row + g * hidden_size;
+                        for (int col = 0; col < hidden_size; ++col) {
+                            dbias[col] += grad[col];
+                        }
+                    }
+                }
+
+                {
+                    // (the weights the forward pass ran with)
+                    TensorInternal<R,2> input_grads(mshadow::Shape2(num_examples, total_input_size));
+                    input_grads = dot(gate_grads.wrapper(), packed_weights->wrapper().T());
+                    auto grads_data = input_grads.cpu_data();
+                    int offset = 0;
+                    for (auto& input : inputs) {
+                        const int cols = input.dims(1);
+                        if (!input.constant) {
+                            auto dinput = GRAD(input).mutable_cpu_data();
+                            for (int row = 0; row < num_examples; ++row) {
+                                R* dst = dinput.dptr_ + dinput.stride_ * (input.dims(0) == 1 ? 0 : row);
+                                const R* src = grads_data.dptr_ + grads_data.stride_ * row + offset;
+                                for (int col = 0; col < cols; ++col) {
+                                    dst[col] += src[col];
+                                }
+                            }
+                        }
+                        offset += cols;
+                    }
+                }
+
+                {
+                    TensorInternal<R,2> weight_grads(mshadow::Shape2(total_input_size, gates_size));
+                    weight_grads = dot(packed_inputs.wrapper().T(), gate_grads.wrapper());
+                    auto grads_data = weight_grads.cpu_data();
+                    for (int g = 0; g < num_gates; ++g) {
+                        int row_offset = 0;
+                        for (auto& weight : gate_weights[g]) {
+                            if (!weight.constant) {
+                                auto dweight = GRAD(weight).mutable_cpu_data();
+                                for (int row = 0; row < weight.dims(0); ++row) {
+                                    R* dst = dweight.dptr_ + dweight.stride_ * row;
+                                    const R* src = grads_data.dptr_ + grads_data.stride_ * (row_offset + row) + g * hidden_size;
+                                    for (int col = 0; col < hidden_size; ++col) {
+                                        dst[col] += src[col];
+                                    }
+                                }
+                            }
+                            row_offset += weight.dims(0);
+                        }
+                    }
+                }
+            });
+        return std::make_tuple(memory, hidden);
+    }
+}
+
 namespace matops {
     template<typename R>
     Mat<R> Composite<R>::quadratic_form(
             Mat<R> left,
             Mat<R> middle,
             Mat<R> right) {
+        profiler::OpScope profile("Composite::quadratic_form", left, middle, right);
         ASSERT2(middle.dims(1) == right.dims(0), "Quadratic form right matrix has wrong dimensions.");
         ASSERT2(left.dims(0) == middle.dims(0) , "Quadratic form left matrix has wrong dimensions.");
+        profiler::set_flops(2 * (int64_t)left.dims(1) * middle.dims(1) * (left.dims(0) + right.dims(1)));
         Mat<R> out (left.dims(1), right.dims(1), weights<R>::empty());
         if (graph::backprop_enabled()) {
             TensorInternal<R,2> left_side_mul(mshadow::Shape2(left.dims(1), middle.dims(1)));
@@ -66,6 +412,7 @@ namespace matops {
     Mat<R> Composite<R>::mul_add_mul_with_bias_colwise(const vector<Mat<R>>& weight_mats,
                                                const vector<Mat<R>>& inputs,
                                                Mat<R> bias) {
+        profiler::OpScope profile("Composite::mul_add_mul_with_bias_colwise", bias);
 
         ASSERT2(weight_mats.size() == inputs.size(),
                 "Different number of weights and inputs passed to mul_add_mul_with_bias");
@@ -76,8 +423,13 @@ namespace matops {
         }
 
         Mat<R> out(weight_mats[0].dims(0), max_num_examples, weights<R>::empty());
-        MAT(out) = MAT(bias).ravel().wrapper().template broadcast<0>(MAT(out).shape);
-
+        if (profiler::enabled()) {
+            int64_t flops = 0;
+            for (int i = 0; i < weight_mats.size(); ++i) {
+                flops += 2 * (int64_t)weight_mats[i].dims(0) * weight_mats[i].dims(1) * inputs[i].dims(1);
+            }
+            profiler::set_flops(flops);
+        }
         for (int i = 0; i < weight_mats.size(); ++i) {
             // inputs must either match the broadcasted size, or be broadcastable by having their
             // outer dimension be 1 (a column vector essentially)
@@ -85,17 +437,26 @@ namespace matops {
                     MS() << "incorrect outer dimension for input " << i);
             ASSERT2(inputs[i].dims(0) == weight_mats[i].dims(1),
                     MS() << "Disagreement on inner dimension on input pair " << i);
+        }
 
-            if (inputs[i].dims(1) == max_num_examples) {
-                MAT(out) += dot(MAT(weight_mats[i]).wrapper(), MAT(inputs[i]).wrapper());
-            } else {
-                TensorInternal<R, 2> temp(mshadow::Shape2(weight_mats[i].dims(0), 1));
-                temp = dot(MAT(weight_mats[i]).wrapper(), MAT(inputs[i]).wrapper());
-                MAT(out) += temp.ravel().wrapper().template broadcast<0>(MAT(out).shape);
-            }
+        auto forward = [](Mat<R>& out, const vector<Mat<R>>& weight_mats,
+                          const vector<Mat<R>>& inputs, Mat<R>& bias) {
+            MAT(out) = MAT(bias).ravel().wrapper().template broadcast<0>(MAT(out).shape);
+
+            for (int i = 0; i < weight_mats.size(); ++i) {
+                if (inputs[i].dims(1) == out.dims(1)) {
+                    MAT(out) += dot(MAT(weight_mats[i]).wrapper(), MAT(inputs[i]).wrapper());
+                } else {
+                    TensorInternal<R, 2> temp(mshadow::Shape2(weight_mats[i].dims(0), 1));
+                    temp = dot(MAT(weight_mats[i]).wrapper(), MAT(inputs[i]).wrapper());
+                    MAT(out) += temp.ravel().wrapper().template broadcast<0>(MAT(out).shape);
+                }
 
-            DEBUG_ASSERT_MAT_NOT_NAN(out)
-        }
+                DEBUG_ASSERT_MAT_NOT_NAN(out)
+            }
+        };
+        forward(out, weight_mats, inputs, bias);
+        graph::capture_forward(forward, out, weight_mats, inputs, bias);
 
         if (graph::backprop_enabled())
             graph::emplace_back([weight_mats, inputs, bias, out, max_num_examples]() mutable {
@@ -134,6 +495,7 @@ namespace matops {
     Mat<R> Composite<R>::mul_add_mul_with_bias(const vector<Mat<R>>& weight_mats,
                                                const vector<Mat<R>>& inputs,
                                                Mat<R> bias) {
+        profiler::OpScope profile("Composite::mul_add_mul_with_bias", bias);
         ASSERT2(weight_mats.size() == inputs.size(),
                 "Different number of weights and inputs passed to mul_add_mul_with_bias");
         // broacast to largest number of examples
@@ -143,8 +505,13 @@ namespace matops {
         }
 
         Mat<R> out(max_num_examples, weight_mats[0].dims(1), weights<R>::empty());
-        MAT(out) = MAT(bias).ravel().wrapper().template broadcast<1>(MAT(out).shape);
-
+        if (profiler::enabled()) {
+            int64_t flops = 0;
+            for (int i = 0; i < weight_mats.size(); ++i) {
+                flops += 2 * (int64_t)inputs[i].dims(0) * weight_mats[i].dims(0) * weight_mats[i].dims(1);
+            }
+            profiler::set_flops(flops);
+        }
         for (int i = 0; i < weight_mats.size(); ++i) {
             // inputs must either match the broadcasted size, or be broadcastable by having their
             // outer dimension be 1 (a column vector essentially)
@@ -152,20 +519,50 @@ namespace matops {
                     MS() << "incorrect outer dimension for input " << i);
             ASSERT2(inputs[i].dims(1) == weight_mats[i].dims(0),
                     MS() << "Disagreement on inner dimension on input pair " << i);
+        }
 
+        auto forward = [](Mat<R>& out, const vector<Mat<R>>& weight_mats,
+                          const vector<Mat<R>>& inputs, Mat<R>& bias) {
+            MAT(out) = MAT(bias).ravel().wrapper().template broadcast<1>(MAT(out).shape);
 
-            if (inputs[i].dims(0) == max_num_examples) {
-                MAT(out) += dot(MAT(inputs[i]).wrapper(), MAT(weight_mats[i]).wrapper());
-            } else {
-                TensorInternal<R, 2> temp(mshadow::Shape2(1, weight_mats[i].dims(1)));
+            if (quantization::quantized(weight_mats, quantization::QUANTIZE_COLUMNS)) {
+                auto out_data = MAT(out).mutable_cpu_data();
+                for (int i = 0; i < weight_mats.size(); ++i) {
+                    auto input = MAT(inputs[i]).cpu_data();
+                    if (inputs[i].dims(0) == out.dims(0)) {
+                        quantization::dot_accumulate(input.dptr_, inputs[i].dims(0), input.stride_,
+                                                     *weight_mats[i].quantized,
+                                                     out_data.dptr_, out_data.stride_);
+                    } else {
+                        vector<R> temp(out.dims(1), 0.0);
+                        quantization::dot_accumulate(input.dptr_, 1, input.stride_,
+                                                     *weight_mats[i].quantized,
+                                                     temp.data(), out.dims(1));
+                        for (int row = 0; row < out.dims(0); ++row) {
+                            R* out_row = out_data.dptr_ + out_data.stride_ * row;
+                            for (int col = 0; col < out.dims(1); ++col) out_row[col] += temp[col];
+                        }
+                    }
+                }
+                return;
+            }
 
-                temp = dot(MAT(inputs[i]).wrapper(), MAT(weight_mats[i]).wrapper());
+            for (int i = 0; i < weight_mats.size(); ++i) {
+                if (inputs[i].dims(0) == out.dims(0)) {
+                    MAT(out) += dot(MAT(inputs[i]).wrapper(), MAT(weight_mats[i]).wrapper());
+                } else {
+                    TensorInternal<R, 2> temp(mshadow::Shape2(1, weight_mats[i].dims(1)));
 
-                MAT(out) += temp.ravel().wrapper().template broadcast<1>(MAT(out).shape);
-            }
+                    temp = dot(MAT(inputs[i]).wrapper(), MAT(weight_mats[i]).wrapper());
 
-            DEBUG_ASSERT_MAT_NOT_NAN(out)
-        }
+                    MAT(out) += temp.ravel().wrapper().template broadcast<1>(MAT(out).shape);
+                }
+
+                DEBUG_ASSERT_MAT_NOT_NAN(out)
+            }
+        };
+        forward(out, weight_mats, inputs, bias);
+        graph::capture_forward(forward, out, weight_mats, inputs, bias);
 
         if (graph::backprop_enabled())
             graph::emplace_back([weight_mats, inputs, bias, out, max_num_examples]() mutable {
@@ -197,6 +594,69 @@ namespace matops {
     }
 
 
+    template<typename R>
+    std::tuple<Mat<R>, Mat<R>> Composite<R>::lstm_cell(
+            const vector<Mat<R>>& inputs,
+            const vector<Mat<R>>& memories,
+            const vector<vector<Mat<R>>>& gate_weights,
+            const vector<Mat<R>>& gate_biases,
+            std::shared_ptr<PackedGateWeights<R>> packed_weights) {
+        profiler::OpScope profile("Composite::lstm_cell");
+        ASSERT2(!gate_biases.empty(), "lstm_cell: expected a bias for every gate.");
+        return lstm_cell_step(inputs, memories, gate_weights, gate_biases, Mat<R>(), packed_weights);
+    }
+
+    template<typename R>
+    std::tuple<Mat<R>, Mat<R>> Composite<R>::lstm_cell(
+            const vector<Mat<R>>& inputs,
+            const vector<Mat<R>>& memories,
+            const vector<vector<Mat<R>>>& gate_weights,
+            Mat<R> gate_inputs,
+            std::shared_ptr<PackedGateWeights<R>> packed_weights) {
+        profiler::OpScope profile("Composite::lstm_cell", gate_inputs);
+        return lstm_cell_step(inputs, memories, gate_weights, vector<Mat<R>>(), gate_inputs, packed_weights);
+    }
+
+    template<typename R>
+    TensorInternal<R,2> PackedGateWeights<R>::get(const vector<vector<Mat<R>>>& gate_weights) {
+        std::lock_guard<std::mutex> guard(mutex);
+        int num_weights = 0;
+        bool fresh = true;
+        for (auto& gate : gate_weights) {
+            for (auto& weight : gate) {
+                auto& tensor = MAT(weight);
+                fresh = fresh && num_weights < (int)sources.size() &&
+                        sources[num_weights].memory.lock() == tensor.memory_ &&
+                        sources[num_weights].offset  == tensor.offset &&
+                        sources[num_weights].version == tensor.memory().version.load();
+                num_weights++;
+            }
+        }
+        if (fresh && num_weights == (int)sources.size()) {
+            return packed;
+        }
+        sources.clear();
+        int total_input_size = 0;
+        for (auto& gate : gate_weights) {
+            for (auto& weight : gate) {
+                auto& tensor = MAT(weight);
+                // (read before packing: a write while packing makes it stale)
+                sources.push_back({tensor.memory_, tensor.offset, tensor.memory().version.load()});
+            }
+        }
+        for (auto& weight : gate_weights[0]) {
+            total_input_size += weight.dims(0);
+        }
+        // a new buffer: steps recorded so far keep the weights they ran with.
+        packed = TensorInternal<R,2>(mshadow::Shape2(total_input_size, gate_weights.size() * gate_weights[0][0].dims(1)));
+        pack_lstm_weights(gate_weights, packed);
+        return packed;
+    }
+
+    template class PackedGateWeights<float>;
+    template class PackedGateWeights<double>;
+    template class PackedGateWeights<int>;
+
     template class Composite<float>;
     template class Composite<double>;
     template class Composite<int>;
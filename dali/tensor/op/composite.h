@@ -1,6 +1,9 @@
 #ifndef DALI_TENSOR_OP_COMPOSITE_H
 #define DALI_TENSOR_OP_COMPOSITE_H
 
+#include <memory>
+#include <mutex>
+#include <tuple>
 #include <vector>
 
 #include "dali/tensor/Mat.h"
@@ -10,6 +13,27 @@
 template<typename R> class Mat;
 
 namespace matops {
+    // The gate weights of `lstm_cell` packed into one matrix, kept by
+    // their owner (e.g. LSTM) across steps and calls. They are packed
+    // again only once one of the weights is replaced or written to
+    // (see SynchronizedMemory::version), e.g. by a solver step.
+    template<typename R>
+    class PackedGateWeights {
+        public:
+            // `gate_weights` packed as in `lstm_cell`, shared with the
+            // previous calls while the weights stay the same.
+            TensorInternal<R,2> get(const std::vector<std::vector<Mat<R>>>& gate_weights);
+        private:
+            struct source_t {
+                std::weak_ptr<SynchronizedMemory<R>> memory;
+                int offset;
+                long long version;
+            };
+            std::mutex mutex;
+            std::vector<source_t> sources;
+            TensorInternal<R,2> packed;
+    };
+
     template<typename R>
     struct Composite {
         static Mat<R> mul_with_bias(Mat<R>, Mat<R>, Mat<R>);
@@ -27,6 +51,32 @@ namespace matops {
                                             Mat<R> bias);
 
         static Mat<R> quadratic_form(Mat<R> left, Mat<R> weigths, Mat<R> right);
+
+        // One LSTM step (see `LSTM::activate`), returns the new memory
+        // and hidden state. `gate_weights[g][i]` maps the i-th input to
+        // gate g, with gates ordered as: input gate, one forget gate per
+        // memory, output gate, cell write. The weights of every gate are
+        // packed side by side so that all the gate activations come out
+        // of a single matrix product, and nonlinearities and cell update
+        // happen in one pass (both forward and backward). The packed
+        // weights come from `packed_weights` when given, otherwise they
+        // are packed on every call. Works on CPU memory.
+        static std::tuple<Mat<R>, Mat<R>> lstm_cell(
+                const std::vector<Mat<R>>& inputs,
+                const std::vector<Mat<R>>& memories,
+                const std::vector<std::vector<Mat<R>>>& gate_weights,
+                const std::vector<Mat<R>>& gate_biases,
+                std::shared_ptr<PackedGateWeights<R>> packed_weights = nullptr);
+        // Same, but the gates are offset by `gate_inputs` (one or
+        // num_examples rows, one block of columns per gate) instead of
+        // biases, for instance the input projections of a whole
+        // sequence computed ahead of time (see `LSTM::activate_sequence`).
+        static std::tuple<Mat<R>, Mat<R>> lstm_cell(
+                const std::vector<Mat<R>>& inputs,
+                const std::vector<Mat<R>>& memories,
+                const std::vector<std::vector<Mat<R>>>& gate_weights,
+                Mat<R> gate_inputs,
+                std::shared_ptr<PackedGateWeights<R>> packed_weights = nullptr);
     };
 }
 
@@ -7,6 +7,7 @@
 #include "dali/math/lazy_patch2col.h"
 #include "dali/math/TensorConvolution.h"
 #include "dali/tensor/op/reshaping.h"
+#include "dali/utils/Profiler.h"
 
 using utils::assert2;
 using utils::MS;
@@ -25,6 +26,7 @@ namespace matops {
             const int& kernel_height,
             const int& kernel_width,
             const int& kernel_stride) {
+        profiler::OpScope profile("Convolution::conv2d", image, kernels);
         ASSERT2(image_shape.size() == 4,
             utils::MS() << "image_shape argument to patch2col must be a size "
                         << "4 vector (got " << image_shape.size() << ")"
@@ -153,6 +155,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Convolution<R>::circular_convolution(Mat<R> matrix, Mat<R> shift) {
+        profiler::OpScope profile("Convolution::circular_convolution", matrix, shift);
         assert2(matrix.dims(0) == shift.dims(0) && matrix.dims(1) == shift.dims(1),
                 "Cannot perform circular convolution: matrix and shift must be of the same size.");
         auto out = Mat<R>::zeros_like(matrix);
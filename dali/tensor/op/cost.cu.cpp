@@ -3,6 +3,7 @@
 #include "dali/tensor/__MatMacros__.h"
 #include "dali/math/TensorOps.h"
 #include "dali/math/LazyTensor.h"
+#include "dali/utils/Profiler.h"
 
 using std::vector;
 using namespace TensorOps;
@@ -13,14 +14,23 @@ namespace matops {
     // performs row wise normalization
     template<typename R>
     Mat<R> Cost<R>::softmax_no_grad_rowwise(Mat<R> matrix, R temperature) {
+        profiler::OpScope profile("Cost::softmax_no_grad_rowwise", matrix);
         auto out = Mat<R>::empty_like(matrix);
-        MAT(out) = MAT(matrix).wrapper().softmax_rowwise(temperature);
+        auto forward = [](Mat<R>& out, Mat<R>& matrix, R temperature) {
+            MAT(out) = MAT(matrix).wrapper().softmax_rowwise(temperature);
+        };
+        forward(out, matrix, temperature);
+        graph::capture_forward(forward, out, matrix, temperature);
         return out;
     }
 
     template<typename R>
     Mat<R> Cost<R>::softmax_rowwise(Mat<R> matrix, R temperature) {
+        profiler::OpScope profile("Cost::softmax_rowwise", matrix);
         Mat<R> out = Cost<R>::softmax_no_grad_rowwise(matrix, temperature);
+        graph::capture_forward([](Mat<R>& out, Mat<R>& matrix, R temperature) {
+            MAT(out) = MAT(matrix).wrapper().softmax_rowwise(temperature);
+        }, out, matrix, temperature);
         if (graph::backprop_enabled() && !matrix.constant)
             graph::emplace_back([matrix, temperature, out]() mutable {
                 TensorInternal<R, 1> sm_times_dy_colsum( mshadow::Shape1(matrix.dims(0)));
@@ -36,6 +46,7 @@ namespace matops {
 
     template<typename R>
     vector<Mat<R>> Cost<R>::softmax_no_grad_colwise(const vector<Mat<R>>& matrices, R temperature) {
+        profiler::OpScope profile("Cost::softmax_no_grad_colwise");
         vector<Mat<R>> out;
         out.reserve(matrices.size());
         ASSERT2(matrices.size() > 0, "Must be a non empty list of vectors to softmax.");
@@ -59,6 +70,7 @@ namespace matops {
     // performs column wise normalization
     template<typename R>
     vector<Mat<R>> Cost<R>::softmax(vector<Mat<R>>& matrices, R temperature) {
+        profiler::OpScope profile("Cost::softmax");
         vector<Mat<R>> out = Cost<R>::softmax_no_grad_colwise(matrices, temperature);
         if (graph::backprop_enabled())
             graph::emplace_back([temperature, out, matrices]() mutable {
@@ -81,6 +93,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Cost<R>::softmax_colwise(Mat<R> matrix, R temperature) {
+        profiler::OpScope profile("Cost::softmax_colwise", matrix);
         Mat<R> out     = Cost<R>::softmax_no_grad_colwise(matrix, temperature);
 
         if (graph::backprop_enabled() && !matrix.constant)
@@ -99,6 +112,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Cost<R>::softmax_no_grad_colwise(Mat<R> matrix, R temperature) {
+        profiler::OpScope profile("Cost::softmax_no_grad_colwise", matrix);
         auto out = Mat<R>::empty_like(matrix);
         MAT(out) = MAT(matrix).wrapper().softmax_colwise(temperature);
         return out;
@@ -106,6 +120,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Cost<R>::sigmoid_binary_cross_entropy(Mat<R> matrix, R t) {
+        profiler::OpScope profile("Cost::sigmoid_binary_cross_entropy", matrix);
         ASSERT2(0 <= t && t <= 1,
             "Target value for sigmoid_binary_cross_entropy must be a probability between 0 and 1.");
         auto out = Mat<R>::empty_like(matrix);
@@ -127,6 +142,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Cost<R>::sigmoid_binary_cross_entropy(Mat<R> matrix, Mat<R> target) {
+        profiler::OpScope profile("Cost::sigmoid_binary_cross_entropy", matrix, target);
         ASSERT2(matrix.dims(0) == target.dims(0) && matrix.dims(1) == target.dims(1),
             "Matrix and target must have same dimension");
 
@@ -150,6 +166,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Cost<R>::binary_cross_entropy(Mat<R> matrix, R t) {
+        profiler::OpScope profile("Cost::binary_cross_entropy", matrix);
         assert(0 <= t && t <= 1);
         assert(matrix.dims().size() > 1);
         Mat<R> out =  Mat<R>(
@@ -175,6 +192,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Cost<R>::binary_cross_entropy(Mat<R> matrix, Mat<R> target) {
+        profiler::OpScope profile("Cost::binary_cross_entropy", matrix, target);
         ASSERT2(matrix.dims(0) == target.dims(0) && matrix.dims(1) == target.dims(1),
             "Matrix and target must have same dimension");
 
@@ -199,6 +217,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Cost<R>::cross_entropy_colwise(Mat<R> matrix, uint answer_idx) {
+        profiler::OpScope profile("Cost::cross_entropy_colwise", matrix);
         DEBUG_ASSERT_BOUNDS(MAT(matrix),0.0,1.0 + EPS);
         ASSERT2(answer_idx < matrix.dims(0),
             utils::MS() << "Cross entropy target (" << answer_idx << ") must be less than"
@@ -219,6 +238,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Cost<R>::cross_entropy_rowwise(Mat<R> matrix, uint answer_idx) {
+        profiler::OpScope profile("Cost::cross_entropy_rowwise", matrix);
         DEBUG_ASSERT_BOUNDS(MAT(matrix),0.0,1.0 + EPS);
         ASSERT2(answer_idx < matrix.dims(1),
             utils::MS() << "Cross entropy target (" << answer_idx << ") must be less than"
@@ -244,6 +264,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Cost<R>::cross_entropy_colwise(Mat<R> matrix, Mat<int> targets) {
+        profiler::OpScope profile("Cost::cross_entropy_colwise", matrix);
         ASSERT2(targets.number_of_elements() == matrix.dims(1), "Number of cols must be equal to the number of target in Cross Entropy colwise");
         Mat<R> out =  Mat<R>(1, targets.number_of_elements(), weights<R>::empty());
 
@@ -261,6 +282,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Cost<R>::cross_entropy_rowwise(Mat<R> matrix, Mat<int> targets) {
+        profiler::OpScope profile("Cost::cross_entropy_rowwise", matrix);
         ASSERT2(targets.number_of_elements() == matrix.dims(0), "Number of rows must be equal to the number of target in Cross Entropy rowwise");
         Mat<R> out =  Mat<R>(targets.number_of_elements(), 1, weights<R>::empty());
 
@@ -278,6 +300,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Cost<R>::cross_entropy(Mat<R> matrix, Mat<R> target) {
+        profiler::OpScope profile("Cost::cross_entropy", matrix, target);
         ASSERT2(matrix.dims(0) == target.dims(0) && matrix.dims(1) == target.dims(1),
             "Matrix and target must have same dimension");
 
@@ -298,6 +321,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Cost<R>::softmax_cross_entropy_colwise(Mat<R> matrix, uint answer_idx) {
+        profiler::OpScope profile("Cost::softmax_cross_entropy_colwise", matrix);
         Mat<int> target(1,1);
         MAT(target) = answer_idx;
         return softmax_cross_entropy_colwise(matrix, target);
@@ -305,6 +329,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Cost<R>::softmax_cross_entropy_colwise(Mat<R> matrix, Mat<int> targets) {
+        profiler::OpScope profile("Cost::softmax_cross_entropy_colwise", matrix);
         ASSERT2(targets.number_of_elements() == matrix.dims(1),
                 utils::MS() << "Softmax cross entropy: Number of targets ("
                             << targets.number_of_elements() << ") should equal number of input columns ("
@@ -331,6 +356,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Cost<R>::softmax_cross_entropy_colwise(Mat<R> matrix, Indexing::Index targets) {
+        profiler::OpScope profile("Cost::softmax_cross_entropy_colwise", matrix);
         Mat<int> targets_mat(1, targets.size());
         for (int i = 0; i < targets.size(); ++i) {
             targets_mat.w(i) = targets[i];
@@ -344,6 +370,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Cost<R>::softmax_cross_entropy_rowwise(Mat<R> matrix, uint answer_idx) {
+        profiler::OpScope profile("Cost::softmax_cross_entropy_rowwise", matrix);
         Mat<int> target(1,1);
         MAT(target) = answer_idx;
         return softmax_cross_entropy_rowwise(matrix, target);
@@ -351,6 +378,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Cost<R>::softmax_cross_entropy_rowwise(Mat<R> matrix, Mat<int> targets) {
+        profiler::OpScope profile("Cost::softmax_cross_entropy_rowwise", matrix);
         ASSERT2(targets.number_of_elements() == matrix.dims(0),
                 utils::MS() << "Softmax cross entropy: Number of targets ("
                             << targets.number_of_elements() << ") should equal number of input rows ("
@@ -360,10 +388,16 @@ namespace matops {
 
         Mat<R> probs = softmax_no_grad_rowwise(matrix);
 
-        select_from_rows(MAT(out), MAT(probs), targets.w().ravel());
-
-
-        MAT(out) = (R)-1.0 * F<op::log<R>>(MAT(out).wrapper());
+        auto forward = [](Mat<R>& out, Mat<R>& probs, Mat<R>& matrix, Mat<int>& targets) {
+            select_from_rows(MAT(out), MAT(probs), targets.w().ravel());
+            MAT(out) = (R)-1.0 * F<op::log<R>>(MAT(out).wrapper());
+        };
+        forward(out, probs, matrix, targets);
+        // probs are recomputed into the same buffer by the replay.
+        graph::capture_forward([forward](Mat<R>& out, Mat<R>& probs, Mat<R>& matrix, Mat<int>& targets) {
+            MAT(probs) = MAT(matrix).wrapper().softmax_rowwise(1.0);
+            forward(out, probs, matrix, targets);
+        }, out, probs, matrix, targets);
 
         if (graph::backprop_enabled()) {
             graph::emplace_back([matrix, probs, out, targets]() mutable {
@@ -383,10 +417,15 @@ namespace matops {
 
     template<typename R>
     Mat<R> Cost<R>::softmax_cross_entropy_rowwise(Mat<R> matrix, Indexing::Index targets) {
+        profiler::OpScope profile("Cost::softmax_cross_entropy_rowwise", matrix);
         Mat<int> targets_mat(targets.size(), 1);
-        for (int i = 0; i < targets.size(); ++i) {
-            targets_mat.w(i) = targets[i];
-        }
+        auto copy_targets = [](Mat<int>& targets_mat, Indexing::Index& targets) {
+            for (int i = 0; i < targets.size(); ++i) {
+                targets_mat.w(i) = targets[i];
+            }
+        };
+        copy_targets(targets_mat, targets);
+        graph::capture_prologue(copy_targets, targets_mat, targets);
         return softmax_cross_entropy_rowwise(matrix, targets_mat);
     }
 
@@ -394,6 +433,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Cost<R>::margin_loss_rowwise(Mat<R> matrix, uint answer_idx, R margin) {
+        profiler::OpScope profile("Cost::margin_loss_rowwise", matrix);
         // Exprected input is a column vector
         ASSERT2(answer_idx < matrix.dims(1),
             utils::MS() << "Target answer ("
@@ -414,6 +454,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Cost<R>::margin_loss_colwise(Mat<R> matrix, uint answer_idx, R margin) {
+        profiler::OpScope profile("Cost::margin_loss_colwise", matrix);
         // Exprected input is a column vector
         ASSERT2(answer_idx < matrix.dims(0),
             utils::MS() << "Target answer ("
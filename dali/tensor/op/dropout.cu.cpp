@@ -5,6 +5,7 @@
 #include "dali/math/LazyTensor.h"
 
 #include "dali/utils/core_utils.h"
+#include "dali/utils/Profiler.h"
 
 using std::vector;
 using std::make_shared;
@@ -16,23 +17,27 @@ namespace matops {
     Mat<R> Dropout<R>::dropout(
             Mat<R> matrix,
             R drop_prob) {
+        profiler::OpScope profile("Dropout::dropout", matrix);
 
         assert(0.0 <= drop_prob && drop_prob <= 1.0);
 
         // no dropout happens.
-        if (drop_prob < 1e-6)
+        if (drop_prob < 1e-6) {
+            graph::capture_view();
             return matrix;
+        }
 
         auto out = Mat<R>::empty_like(matrix);
 
         auto mask = make_shared<TensorInternal<R, 2>>(MAT(matrix).shape);
-        {
-            utils::Timer tbernoulli("tbernoulli");
+        // (a replay draws a new mask)
+        auto forward = [](Mat<R>& out, Mat<R>& matrix,
+                          std::shared_ptr<TensorInternal<R, 2>>& mask, R drop_prob) {
             weights<R>::bernoulli(1.0 - drop_prob)(*mask);
-        }
-
-
-        MAT(out) = MAT(matrix).wrapper() * (*mask).wrapper();
+            MAT(out) = MAT(matrix).wrapper() * (*mask).wrapper();
+        };
+        forward(out, matrix, mask, drop_prob);
+        graph::capture_forward(forward, out, matrix, mask, drop_prob);
 
         if (graph::backprop_enabled()) {
             graph::emplace_back([matrix, out, mask]() mutable {
@@ -46,19 +51,27 @@ namespace matops {
     Mat<R> Dropout<R>::dropout_normalized(
             Mat<R> matrix,
             R drop_prob) {
+        profiler::OpScope profile("Dropout::dropout_normalized", matrix);
 
         assert(0.0 <= drop_prob && drop_prob <= 1.0);
 
         // no dropout happens.
-        if (drop_prob < 1e-6)
+        if (drop_prob < 1e-6) {
+            graph::capture_view();
             return matrix;
+        }
 
         auto out = Mat<R>::empty_like(matrix);
 
         auto mask = make_shared<TensorInternal<R, 2>>(MAT(matrix).shape);
-        weights<R>::bernoulli_normalized(1.0 - drop_prob)(*mask);
-
-        MAT(out) = MAT(matrix).wrapper() * (*mask).wrapper();
+        // (a replay draws a new mask)
+        auto forward = [](Mat<R>& out, Mat<R>& matrix,
+                          std::shared_ptr<TensorInternal<R, 2>>& mask, R drop_prob) {
+            weights<R>::bernoulli_normalized(1.0 - drop_prob)(*mask);
+            MAT(out) = MAT(matrix).wrapper() * (*mask).wrapper();
+        };
+        forward(out, matrix, mask, drop_prob);
+        graph::capture_forward(forward, out, matrix, mask, drop_prob);
 
         if (graph::backprop_enabled()) {
             graph::emplace_back([matrix, out, mask]() mutable {
@@ -95,13 +108,19 @@ namespace matops {
     template<typename R>
     Mat<R> Dropout<R>::fast_dropout(
             Mat<R> matrix) {
+        profiler::OpScope profile("Dropout::fast_dropout", matrix);
 
         auto out = Mat<R>::empty_like(matrix);
 
         auto mask = make_shared<TensorInternal<R, 2>>(MAT(matrix).shape);
-        weights<R>::gaussian(1.0, 1.0)(*mask);
-
-        MAT(out) = MAT(matrix).wrapper() * (*mask).wrapper();
+        // (a replay draws a new mask)
+        auto forward = [](Mat<R>& out, Mat<R>& matrix,
+                          std::shared_ptr<TensorInternal<R, 2>>& mask) {
+            weights<R>::gaussian(1.0, 1.0)(*mask);
+            MAT(out) = MAT(matrix).wrapper() * (*mask).wrapper();
+        };
+        forward(out, matrix, mask);
+        graph::capture_forward(forward, out, matrix, mask);
 
         if (graph::backprop_enabled()) {
             graph::emplace_back([matrix, out, mask]() mutable {
@@ -1,19 +1,69 @@
 #include "dali/tensor/op/elementwise.h"
 
+#include <type_traits>
+#include <utility>
+
 #include "dali/tensor/__MatMacros__.h"
+#include "dali/tensor/op/fusion.h"
 #include "dali/math/TensorOps.h"
 #include "dali/math/LazyTensor.h"
+#include "dali/utils/Profiler.h"
 
 using namespace TensorOps;
 using std::vector;
 
+namespace {
+    // whether `op_t` has an array overload of Map (see dali/math/simd).
+    template<typename op_t, typename R, typename... Args>
+    struct has_array_map {
+        template<typename T>
+        static char test(decltype(T::Map((const R*)NULL, (R*)NULL, 0, std::declval<Args>()...))*);
+        template<typename T>
+        static long test(...);
+        static const bool value = sizeof(test<op_t>(NULL)) == 1;
+    };
+
+    template<typename op_t, typename R, typename... Args>
+    void map_elementwise(std::false_type, TensorInternal<R,2>& out, const TensorInternal<R,2>& in, Args... args) {
+        out = F<op_t>(in.wrapper(), args...);
+    }
+
+    template<typename op_t, typename R, typename... Args>
+    void map_elementwise(std::true_type, TensorInternal<R,2>& out, const TensorInternal<R,2>& in, Args... args) {
+        #ifdef DALI_USE_CUDA
+            if (in.compute_me_on_gpu()) {
+                out = F<op_t>(in.wrapper(), args...);
+                return;
+            }
+        #endif
+        auto in_data = in.cpu_data();
+        auto out_data = out.overwrite_cpu_data();
+        op_t::Map(in_data.dptr_, out_data.dptr_, in.shape.Size(), args...);
+    }
+
+    // out = F<op_t>(in, args...), going through the vectorized array
+    // version of the op for CPU data whenever the op provides one.
+    template<typename op_t, typename R, typename... Args>
+    void map_elementwise(TensorInternal<R,2>& out, const TensorInternal<R,2>& in, Args... args) {
+        map_elementwise<op_t>(
+            std::integral_constant<bool, has_array_map<op_t, R, Args...>::value>(),
+            out, in, args...);
+    }
+}
+
 namespace matops {
-    #define DALI_UNARY_OP0(name, forward_op, backward) \
+    #define DALI_UNARY_OP0(name, forward_op, fused_op, backward) \
         template<typename R>                                                                                  \
         Mat<R> Elementwise<R>::name(Mat<R> matrix) {                                                          \
+            profiler::OpScope profile("Elementwise::" #name, matrix);                                         \
+            if (Fusion<R>::defer(matrix))                                                                     \
+                return Fusion<R>::unary(fused_op, matrix);                                                    \
             auto out = Mat<R>::empty_like(matrix);                                                            \
-                                                                                                              \
-            MAT(out) = F<forward_op<R>>(MAT(matrix).wrapper());                                               \
+            auto forward = [](Mat<R>& out, Mat<R>& matrix) {                                                  \
+                map_elementwise<forward_op<R>>(MAT(out), MAT(matrix));                                        \
+            };                                                                                                \
+            forward(out, matrix);                                                                             \
+            graph::capture_forward(forward, out, matrix);                                                     \
                                                                                                               \
             if (graph::backprop_enabled() && !matrix.constant)                                                  \
                 graph::emplace_back([matrix, out]() mutable {                                                 \
@@ -22,12 +72,18 @@ namespace matops {
             return out;                                                                                       \
         }
 
-    #define DALI_UNARY_OP1(name, arg1, forward_op, backward) \
+    #define DALI_UNARY_OP1(name, arg1, forward_op, fused_op, backward) \
         template<typename R>                                                                                  \
         Mat<R> Elementwise<R>::name(Mat<R> matrix, R arg1) {                                                  \
+            profiler::OpScope profile("Elementwise::" #name, matrix);                                         \
+            if (Fusion<R>::defer(matrix))                                                                     \
+                return Fusion<R>::unary(fused_op, matrix, arg1);                                              \
             auto out = Mat<R>::empty_like(matrix);                                                            \
-                                                                                                              \
-            MAT(out) = F<forward_op<R>>(MAT(matrix).wrapper(), arg1);                                         \
+            auto forward = [](Mat<R>& out, Mat<R>& matrix, R arg1) {                                          \
+                map_elementwise<forward_op<R>>(MAT(out), MAT(matrix), arg1);                                  \
+            };                                                                                                \
+            forward(out, matrix, arg1);                                                                       \
+            graph::capture_forward(forward, out, matrix, arg1);                                               \
                                                                                                               \
             if (graph::backprop_enabled() && !matrix.constant)                                                  \
                 graph::emplace_back([matrix, out, arg1]() mutable {                                           \
@@ -36,27 +92,35 @@ namespace matops {
             return out;                                                                                       \
         }
 
-    DALI_UNARY_OP0(tanh, op::tanh,
+    DALI_UNARY_OP0(tanh, op::tanh, FUSED_TANH,
             F<op::dtanh<R>>(MAT(out).wrapper()));
-    DALI_UNARY_OP0(softplus, op::softplus,
+    DALI_UNARY_OP0(softplus, op::softplus, FUSED_SOFTPLUS,
             F<op::softplus_backward<R>>(MAT(matrix).wrapper()));
-    DALI_UNARY_OP0(abs, op::abs,
+    DALI_UNARY_OP0(abs, op::abs, FUSED_ABS,
             F<op::sign<R>>(MAT(matrix).wrapper()));
-    DALI_UNARY_OP0(log, op::log,
+    DALI_UNARY_OP0(log, op::log, FUSED_LOG,
             F<op::inv<R>>(MAT(matrix).wrapper()));
-    DALI_UNARY_OP0(relu, op::relu,
+    DALI_UNARY_OP0(relu, op::relu, FUSED_RELU,
             F<op::relu_backward<R>>(MAT(out).wrapper()));
 
-    DALI_UNARY_OP1(eltmax, lower_bound, op::max_scalar,
+    DALI_UNARY_OP1(eltmax, lower_bound, op::max_scalar, FUSED_MAX_SCALAR,
             F<op::max_scalar_mask<R>>(MAT(matrix).wrapper(), lower_bound));
-    DALI_UNARY_OP1(steep_sigmoid, aggressiveness, op::steep_sigmoid,
+    DALI_UNARY_OP1(steep_sigmoid, aggressiveness, op::steep_sigmoid, FUSED_STEEP_SIGMOID,
             F<op::steep_sigmoid_backward<R>>(MAT(out).wrapper(), aggressiveness));
 
 
     template<typename R>
     Mat<R> Elementwise<R>::exp(Mat<R> matrix) {
+        profiler::OpScope profile("Elementwise::exp", matrix);
+        if (Fusion<R>::defer(matrix)) {
+            return Fusion<R>::unary(FUSED_EXP, matrix);
+        }
         auto out = Mat<R>::empty_like(matrix);
-        MAT(out) = F<op::exp<R>>(MAT(matrix).wrapper());
+        auto forward = [](Mat<R>& out, Mat<R>& matrix) {
+            map_elementwise<op::exp<R>>(MAT(out), MAT(matrix));
+        };
+        forward(out, matrix);
+        graph::capture_forward(forward, out, matrix);
 
         if (graph::backprop_enabled() && !matrix.constant)
             graph::emplace_back([matrix, out]() mutable {
@@ -67,8 +131,16 @@ namespace matops {
 
     template<typename R>
     Mat<R> Elementwise<R>::sigmoid(Mat<R> matrix) {
+        profiler::OpScope profile("Elementwise::sigmoid", matrix);
+        if (Fusion<R>::defer(matrix)) {
+            return Fusion<R>::unary(FUSED_SIGMOID, matrix);
+        }
         auto out = Mat<R>::empty_like(matrix);
-        MAT(out) = F<op::sigmoid<R>>(MAT(matrix).wrapper());
+        auto forward = [](Mat<R>& out, Mat<R>& matrix) {
+            map_elementwise<op::sigmoid<R>>(MAT(out), MAT(matrix));
+        };
+        forward(out, matrix);
+        graph::capture_forward(forward, out, matrix);
         if (graph::backprop_enabled() && !matrix.constant)
             graph::emplace_back([matrix, out]() mutable {
                 GRAD(matrix) += (
@@ -80,8 +152,16 @@ namespace matops {
 
     template<typename R>
     Mat<R> Elementwise<R>::sqrt(Mat<R> matrix) {
+        profiler::OpScope profile("Elementwise::sqrt", matrix);
+        if (Fusion<R>::defer(matrix)) {
+            return Fusion<R>::unary(FUSED_SQRT, matrix);
+        }
         auto out = Mat<R>::empty_like(matrix);
-        MAT(out) = F<op::sqrt_f<R>>(MAT(matrix).wrapper());
+        auto forward = [](Mat<R>& out, Mat<R>& matrix) {
+            MAT(out) = F<op::sqrt_f<R>>(MAT(matrix).wrapper());
+        };
+        forward(out, matrix);
+        graph::capture_forward(forward, out, matrix);
         if (graph::backprop_enabled())
             graph::emplace_back([matrix, out]() mutable {
                 SAFE_GRAD(matrix) += ((R)0.5 / MAT(out).wrapper()) * GRAD(out).wrapper();
@@ -91,8 +171,16 @@ namespace matops {
 
     template<typename R>
     Mat<R> Elementwise<R>::elt_inv(Mat<R> matrix) {
+        profiler::OpScope profile("Elementwise::elt_inv", matrix);
+        if (Fusion<R>::defer(matrix)) {
+            return Fusion<R>::unary(FUSED_ELT_INV, matrix);
+        }
         auto out = Mat<R>::empty_like(matrix);
-        MAT(out) = F<op::inv<R>>(MAT(matrix).wrapper());
+        auto forward = [](Mat<R>& out, Mat<R>& matrix) {
+            MAT(out) = F<op::inv<R>>(MAT(matrix).wrapper());
+        };
+        forward(out, matrix);
+        graph::capture_forward(forward, out, matrix);
         if (graph::backprop_enabled())
             graph::emplace_back([matrix, out]() mutable {
                 SAFE_GRAD(matrix) -= F<op::square<R>>(MAT(out).wrapper()) * GRAD(out).wrapper();
@@ -103,8 +191,16 @@ namespace matops {
 
     template<typename R>
     Mat<R> Elementwise<R>::square(Mat<R> matrix) {
+        profiler::OpScope profile("Elementwise::square", matrix);
+        if (Fusion<R>::defer(matrix)) {
+            return Fusion<R>::unary(FUSED_SQUARE, matrix);
+        }
         auto out = Mat<R>::empty_like(matrix);
-        MAT(out) = F<op::square<R>>(MAT(matrix).wrapper());
+        auto forward = [](Mat<R>& out, Mat<R>& matrix) {
+            MAT(out) = F<op::square<R>>(MAT(matrix).wrapper());
+        };
+        forward(out, matrix);
+        graph::capture_forward(forward, out, matrix);
 
         if (graph::backprop_enabled() && !matrix.constant)
             graph::emplace_back([matrix, out]() mutable {
@@ -115,6 +211,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Elementwise<R>::pow(Mat<R> matrix, R other) {
+        profiler::OpScope profile("Elementwise::pow", matrix);
         if (std::abs(other - (R)-1.0) < 1e-9) {
             return Elementwise<R>::elt_inv(matrix);
         } else if (std::abs(other - (R)0.0) < 1e-9) {
@@ -122,6 +219,7 @@ namespace matops {
         } else if (std::abs(other - (R)0.5) < 1e-9) {
             return Elementwise<R>::sqrt(matrix);
         } else if (std::abs(other - (R)1.0) < 1e-9) {
+            graph::capture_view();
             return matrix;
         } else if (std::abs(other - (R)2.0) < 1e-9) {
             return Elementwise<R>::square(matrix);
@@ -129,7 +227,11 @@ namespace matops {
 
         auto out = Mat<R>::empty_like(matrix);
 
-        MAT(out) = F<op::power<R>>(MAT(matrix).wrapper(), other);
+        auto forward = [](Mat<R>& out, Mat<R>& matrix, R other) {
+            MAT(out) = F<op::power<R>>(MAT(matrix).wrapper(), other);
+        };
+        forward(out, matrix, other);
+        graph::capture_forward(forward, out, matrix, other);
 
         if (graph::backprop_enabled())
             graph::emplace_back([matrix, out, other]() mutable {
@@ -147,8 +249,16 @@ namespace matops {
     Mat<R> Elementwise<R>::add(
             Mat<R> matrix1,
             R alpha) {
+        profiler::OpScope profile("Elementwise::add", matrix1);
+        if (Fusion<R>::defer(matrix1)) {
+            return Fusion<R>::unary(FUSED_ADD_SCALAR, matrix1, alpha);
+        }
         auto out = Mat<R>::empty_like(matrix1);
-        MAT(out) = MAT(matrix1).wrapper() + alpha;
+        auto forward = [](Mat<R>& out, Mat<R>& matrix1, R alpha) {
+            MAT(out) = MAT(matrix1).wrapper() + alpha;
+        };
+        forward(out, matrix1, alpha);
+        graph::capture_forward(forward, out, matrix1, alpha);
         if (graph::backprop_enabled() && !matrix1.constant)
             graph::emplace_back([matrix1, out]() mutable {
                 GRAD(matrix1) += GRAD(out).wrapper();
@@ -158,8 +268,16 @@ namespace matops {
 
     template<typename R>
     Mat<R> Elementwise<R>::sub_broadcast_reversed(Mat<R> matrix, R other) {
+        profiler::OpScope profile("Elementwise::sub_broadcast_reversed", matrix);
+        if (Fusion<R>::defer(matrix)) {
+            return Fusion<R>::unary(FUSED_SUB_FROM_SCALAR, matrix, other);
+        }
         auto out = Mat<R>::empty_like(matrix);
-        MAT(out) = (other - MAT(matrix).wrapper());
+        auto forward = [](Mat<R>& out, Mat<R>& matrix, R other) {
+            MAT(out) = (other - MAT(matrix).wrapper());
+        };
+        forward(out, matrix, other);
+        graph::capture_forward(forward, out, matrix, other);
         if (graph::backprop_enabled())
             graph::emplace_back([matrix, out] () mutable {
                 SAFE_GRAD(matrix) -= GRAD(out).wrapper();
@@ -171,8 +289,16 @@ namespace matops {
     Mat<R> Elementwise<R>::eltdivide(
             Mat<R> matrix,
             R alpha) {
+        profiler::OpScope profile("Elementwise::eltdivide", matrix);
+        if (Fusion<R>::defer(matrix)) {
+            return Fusion<R>::unary(FUSED_ELTDIVIDE_SCALAR, matrix, alpha);
+        }
         auto out = Mat<R>::empty_like(matrix);
-        MAT(out) = MAT(matrix).wrapper() / alpha;
+        auto forward = [](Mat<R>& out, Mat<R>& matrix, R alpha) {
+            MAT(out) = MAT(matrix).wrapper() / alpha;
+        };
+        forward(out, matrix, alpha);
+        graph::capture_forward(forward, out, matrix, alpha);
         if (graph::backprop_enabled())
             graph::emplace_back([matrix, alpha, out]() mutable {
                 SAFE_GRAD(matrix) += ((R)1.0 / alpha) * GRAD(out).wrapper();
@@ -184,8 +310,16 @@ namespace matops {
     Mat<R> Elementwise<R>::eltmul(
             Mat<R> matrix,
             R alpha) {
+        profiler::OpScope profile("Elementwise::eltmul", matrix);
+        if (Fusion<R>::defer(matrix)) {
+            return Fusion<R>::unary(FUSED_ELTMUL_SCALAR, matrix, alpha);
+        }
         auto out = Mat<R>::empty_like(matrix);
-        MAT(out) = MAT(matrix).wrapper() * alpha;
+        auto forward = [](Mat<R>& out, Mat<R>& matrix, R alpha) {
+            MAT(out) = MAT(matrix).wrapper() * alpha;
+        };
+        forward(out, matrix, alpha);
+        graph::capture_forward(forward, out, matrix, alpha);
         if (graph::backprop_enabled())
             graph::emplace_back([matrix, alpha, out]() mutable {
                 SAFE_GRAD(matrix) += alpha * GRAD(out).wrapper();
@@ -0,0 +1,435 @@
+#include "dali/tensor/op/fusion.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "dali/tensor/__MatMacros__.h"
+#include "dali/math/TensorOps.h"
+#include "dali/utils/Profiler.h"
+
+using namespace TensorOps;
+using std::vector;
+
+namespace {
+    // elements going through the chain at once.
+    const int block_size = 256;
+
+    template<typename R>
+    struct Instruction {
+        matops::FusedOp op;
+        // operand instructions (-1 when unused)
+        int a;
+        int b;
+        R scalar;
+        // index in Program::inputs of FUSED_INPUT instructions
+        int input;
+    };
+
+    // an expression flattened in evaluation order (the value is that
+    // of the last instruction).
+    template<typename R>
+    struct Program {
+        vector<Instruction<R>> instructions;
+        vector<Mat<R>> inputs;
+        // versions of the inputs when the ops read them (or -1)
+        vector<long long> versions;
+        Mat<R> out;
+    };
+
+    template<typename R>
+    int compile(Program<R>& program,
+                const typename matops::Fusion<R>::expression_t& expression,
+                std::unordered_map<const matops::FusedExpression<R>*, int>& compiled) {
+        auto found = compiled.find(expression.get());
+        if (found != compiled.end()) {
+            return found->second;
+        }
+        Instruction<R> instruction;
+        instruction.op     = expression->op;
+        instruction.scalar = expression->scalar;
+        instruction.a      = -1;
+        instruction.b      = -1;
+        instruction.input  = -1;
+        if (expression->evaluated) {
+            instruction.op    = matops::FUSED_INPUT;
+            instruction.input = program.inputs.size();
+            program.inputs.emplace_back(expression->value);
+            program.versions.emplace_back(expression->version);
+        } else {
+            instruction.a = compile(program, expression->a, compiled);
+            if (expression->b != nullptr) {
+                instruction.b = compile(program, expression->b, compiled);
+            }
+        }
+        program.instructions.emplace_back(instruction);
+        int index = program.instructions.size() - 1;
+        compiled[expression.get()] = index;
+        return index;
+    }
+
+    template<typename R>
+    void forward_op(const Instruction<R>& instruction, const R* x, const R* y, R* out, int size) {
+        const R s = instruction.scalar;
+        switch (instruction.op) {
+            case matops::FUSED_ADD:
+                for (int i = 0; i < size; i++) out[i] = x[i] + y[i];
+                break;
+            case matops::FUSED_SUB:
+                for (int i = 0; i < size; i++) out[i] = x[i] - y[i];
+                break;
+            case matops::FUSED_ELTMUL:
+                for (int i = 0; i < size; i++) out[i] = x[i] * y[i];
+                break;
+            case matops::FUSED_ELTDIVIDE:
+                for (int i = 0; i < size; i++) out[i] = x[i] / y[i];
+                break;
+            case matops::FUSED_ADD_SCALAR:
+                for (int i = 0; i < size; i++) out[i] = x[i] + s;
+                break;
+            case matops::FUSED_SUB_FROM_SCALAR:
+                for (int i = 0; i < size; i++) out[i] = s - x[i];
+                break;
+            case matops::FUSED_ELTMUL_SCALAR:
+                for (int i = 0; i < size; i++) out[i] = x[i] * s;
+                break;
+            case matops::FUSED_ELTDIVIDE_SCALAR:
+                for (int i = 0; i < size; i++) out[i] = x[i] / s;
+                break;
+            case matops::FUSED_MAX_SCALAR:
+                for (int i = 0; i < size; i++) out[i] = op::max_scalar<R>::Map(x[i], s);
+                break;
+            case matops::FUSED_SQUARE:
+                for (int i = 0; i < size; i++) out[i] = op::square<R>::Map(x[i]);
+                break;
+            case matops::FUSED_SQRT:
+                for (int i = 0; i < size; i++) out[i] = op::sqrt_f<R>::Map(x[i]);
+                break;
+            case matops::FUSED_ELT_INV:
+                for (int i = 0; i < size; i++) out[i] = op::inv<R>::Map(x[i]);
+                break;
+            // same vectorized kernels as Elementwise (see dali/math/simd)
+            case matops::FUSED_TANH:
+                op::tanh<R>::Map(x, out, size);
+                break;
+            case matops::FUSED_SIGMOID:
+                op::sigmoid<R>::Map(x, out, size);
+                break;
+            case matops::FUSED_STEEP_SIGMOID:
+                op::steep_sigmoid<R>::Map(x, out, size, s);
+                break;
+            case matops::FUSED_EXP:
+                op::exp<R>::Map(x, out, size);
+                break;
+            case matops::FUSED_LOG:
+                op::log<R>::Map(x, out, size);
+                break;
+            case matops::FUSED_SOFTPLUS:
+                op::softplus<R>::Map(x, out, size);
+                break;
+            case matops::FUSED_RELU:
+                for (int i = 0; i < size; i++) out[i] = op::relu<R>::Map(x[i]);
+                break;
+            case matops::FUSED_ABS:
+                for (int i = 0; i < size; i++) out[i] = op::abs<R>::Map(x[i]);
+                break;
+            case matops::FUSED_INPUT:
+                break;
+        }
+    }
+
+    // adds the gradient of the operands of an instruction given that of
+    // its value (`dx` and `dy` are NULL for constant inputs).
+    template<typename R>
+    void backward_op(const Instruction<R>& instruction,
+                     const R* x, const R* y, const R* out, const R* dout,
+                     R* dx, R* dy, int size) {
+        const R s = instruction.scalar;
+        switch (instruction.op) {
+            case matops::FUSED_ADD:
+                if (dx) for (int i = 0; i < size; i++) dx[i] += dout[i];
+                if (dy) for (int i = 0; i < size; i++) dy[i] += dout[i];
+                break;
+            case matops::FUSED_SUB:
+                if (dx) for (int i = 0; i < size; i++) dx[i] += dout[i];
+                if (dy) for (int i = 0; i < size; i++) dy[i] -= dout[i];
+                break;
+            case matops::FUSED_ELTMUL:
+                if (dx) for (int i = 0; i < size; i++) dx[i] += y[i] * dout[i];
+                if (dy) for (int i = 0; i < size; i++) dy[i] += x[i] * dout[i];
+                break;
+            case matops::FUSED_ELTDIVIDE:
+                if (dx) for (int i = 0; i < size; i++) dx[i] += op::inv<R>::Map(y[i]) * dout[i];
+                if (dy) for (int i = 0; i < size; i++) dy[i] -= (x[i] / op::square<R>::Map(y[i])) * dout[i];
+                break;
+            case matops::FUSED_ADD_SCALAR:
+                if (dx) for (int i = 0; i < size; i++) dx[i] += dout[i];
+                break;
+            case matops::FUSED_SUB_FROM_SCALAR:
+                if (dx) for (int i = 0; i < size; i++) dx[i] -= dout[i];
+                break;
+            case matops::FUSED_ELTMUL_SCALAR:
+                if (dx) for (int i = 0; i < size; i++) dx[i] += s * dout[i];
+                break;
+            case matops::FUSED_ELTDIVIDE_SCALAR:
+                if (dx) for (int i = 0; i < size; i++) dx[i] += ((R)1.0 / s) * dout[i];
+                break;
+            case matops::FUSED_MAX_SCALAR:
+                if (dx) for (int i = 0; i < size; i++) dx[i] += op::max_scalar_mask<R>::Map(x[i], s) * dout[i];
+                break;
+            case matops::FUSED_SQUARE:
+                if (dx) for (int i = 0; i < size; i++) dx[i] += dout[i] * x[i] * (R) 2.0;
+                break;
+            case matops::FUSED_SQRT:
+                if (dx) for (int i = 0; i < size; i++) dx[i] += ((R)0.5 / out[i]) * dout[i];
+                break;
+            case matops::FUSED_ELT_INV:
+                if (dx) for (int i = 0; i < size; i++) dx[i] -= op::square<R>::Map(out[i]) * dout[i];
+                break;
+            case matops::FUSED_TANH:
+                if (dx) for (int i = 0; i < size; i++) dx[i] += op::dtanh<R>::Map(out[i]) * dout[i];
+                break;
+            case matops::FUSED_SIGMOID:
+                if (dx) for (int i = 0; i < size; i++) dx[i] += op::dsigmoid<R>::Map(out[i]) * dout[i];
+                break;
+            case matops::FUSED_STEEP_SIGMOID:
+                if (dx) for (int i = 0; i < size; i++) dx[i] += op::steep_sigmoid_backward<R>::Map(out[i], s) * dout[i];
+                break;
+            case matops::FUSED_RELU:
+                if (dx) for (int i = 0; i < size; i++) dx[i] += op::relu_backward<R>::Map(out[i]) * dout[i];
+                break;
+            case matops::FUSED_EXP:
+                if (dx) for (int i = 0; i < size; i++) dx[i] += out[i] * dout[i];
+                break;
+            case matops::FUSED_LOG:
+                if (dx) for (int i = 0; i < size; i++) dx[i] += op::inv<R>::Map(x[i]) * dout[i];
+                break;
+            case matops::FUSED_SOFTPLUS:
+                if (dx) for (int i = 0; i < size; i++) dx[i] += op::softplus_backward<R>::Map(x[i]) * dout[i];
+                break;
+            case matops::FUSED_ABS:
+                if (dx) for (int i = 0; i < size; i++) dx[i] += op::sign<R>::Map(x[i]) * dout[i];
+                break;
+            case matops::FUSED_INPUT:
+                break;
+        }
+    }
+
+    // computes the values of the instructions for the elements
+    // [start, start + size) into `values` (one block per instruction),
+    // pointing `slots` at them. Inputs are read in place, and the last
+    // instruction goes to `out` (or is already there when `out_ready`).
+    template<typename R>
+    void run_forward(const Program<R>& program,
+                     const vector<const R*>& inputs,
+                     R* out,
+                     bool out_ready,
+                     R* values,
+                     vector<const R*>& slots,
+                     int start,
+                     int size) {
+        const int last = program.instructions.size() - 1;
+        for (int i = 0; i <= last; i++) {
+            auto& instruction = program.instructions[i];
+            if (instruction.op == matops::FUSED_INPUT) {
+                slots[i] = inputs[instruction.input] + start;
+                continue;
+            }
+            R* destination = i == last ? out + start : values + i * block_size;
+            if (i != last || !out_ready) {
+                forward_op(instruction,
+                           slots[instruction.a],
+                           instruction.b == -1 ? (const R*)NULL : slots[instruction.b],
+                           destination,
+                           size);
+            }
+            slots[i] = destination;
+        }
+    }
+
+    template<typename R>
+    void run_backward(const Program<R>& program) {
+        const int num_instructions = program.instructions.size();
+        const int last = num_instructions - 1;
+        const int total = program.out.number_of_elements();
+
+        vector<const R*> inputs(program.inputs.size());
+        vector<R*> input_grads(program.inputs.size(), (R*)NULL);
+        for (int i = 0; i < (int)program.inputs.size(); i++) {
+            auto& input = program.inputs[i];
+            inputs[i] = MAT(input).cpu_data().dptr_;
+            if (!input.constant) {
+                input_grads[i] = GRAD(input).mutable_cpu_data().dptr_;
+            }
+        }
+        R* out = MAT(program.out).mutable_cpu_data().dptr_;
+        const R* dout = GRAD(program.out).cpu_data().dptr_;
+
+        vector<R> values(num_instructions * block_size);
+        vector<R> grads(num_instructions * block_size);
+        vector<const R*> slots(num_instructions);
+        vector<R*> grad_slots(num_instructions);
+
+        for (int start = 0; start < total; start += block_size) {
+            const int size = std::min(block_size, total - start);
+            run_forward(program, inputs, out, true, values.data(), slots, start, size);
+            for (int i = 0; i < num_instructions; i++) {
+                auto& instruction = program.instructions[i];
+                if (instruction.op == matops::FUSED_INPUT) {
+                    grad_slots[i] = input_grads[instruction.input] == NULL ?
+                        (R*)NULL : input_grads[instruction.input] + start;
+                } else if (i != last) {
+                    grad_slots[i] = grads.data() + i * block_size;
+                    std::fill(grad_slots[i], grad_slots[i] + size, (R)0.0);
+                }
+            }
+            for (int i = last; i >= 0; i--) {
+                auto& instruction = program.instructions[i];
+                if (instruction.op == matops::FUSED_INPUT) continue;
+                backward_op(instruction,
+                            slots[instruction.a],
+                            instruction.b == -1 ? (const R*)NULL : slots[instruction.b],
+                            slots[i],
+                            i == last ? dout + start : grad_slots[i],
+                            grad_slots[instruction.a],
+                            instruction.b == -1 ? (R*)NULL : grad_slots[instruction.b],
+                            size);
+            }
+        }
+    }
+}
+
+namespace matops {
+    template<typename R>
+    const int Fusion<R>::max_ops;
+
+    template<typename R>
+    bool Fusion<R>::defer(const Mat<R>& matrix) {
+        if (!graph::fusion_enabled() || matrix.empty()) {
+            return false;
+        }
+        #ifdef DALI_USE_CUDA
+            if (matrix.pending == nullptr && matrix.w().compute_me_on_gpu()) {
+                return false;
+            }
+        #endif
+        return true;
+    }
+
+    template<typename R>
+    bool Fusion<R>::defer(const Mat<R>& matrix1, const Mat<R>& matrix2) {
+        return defer(matrix1) && defer(matrix2);
+    }
+
+    template<typename R>
+    typename Fusion<R>::expression_t Fusion<R>::operand(const Mat<R>& matrix) {
+        auto pending = matrix.pending;
+        if (pending != nullptr &&
+                !pending->evaluated &&
+                !matrix.constant &&
+                pending->backprop == graph::backprop_enabled() &&
+                pending->size < max_ops) {
+            // continue the chain
+            return pending;
+        }
+        auto input = std::make_shared<FusedExpression<R>>();
+        input->op        = FUSED_INPUT;
+        input->scalar    = 0;
+        input->value     = matrix;
+        input->evaluated = true;
+        input->backprop  = graph::backprop_enabled();
+        input->size      = 0;
+        // (does not evaluate a pending matrix)
+        input->version   = pending == nullptr || pending->evaluated ?
+                (long long)matrix.m->memory().version : -1;
+        return input;
+    }
+
+    template<typename R>
+    Mat<R> Fusion<R>::unary(FusedOp op, Mat<R> matrix, R scalar) {
+        auto out = Mat<R>::empty_like(matrix);
+        auto expression = std::make_shared<FusedExpression<R>>();
+        expression->op        = op;
+        expression->scalar    = scalar;
+        expression->a         = operand(matrix);
+        expression->value     = out;
+        expression->evaluated = false;
+        expression->backprop  = graph::backprop_enabled();
+        expression->size      = 1 + expression->a->size;
+        expression->version   = -1;
+        out.pending = expression;
+        return out;
+    }
+
+    template<typename R>
+    Mat<R> Fusion<R>::binary(FusedOp op, Mat<R> matrix1, Mat<R> matrix2) {
+        auto out = Mat<R>::empty_like(matrix1);
+        auto expression = std::make_shared<FusedExpression<R>>();
+        expression->op        = op;
+        expression->scalar    = 0;
+        expression->a         = operand(matrix1);
+        expression->b         = operand(matrix2);
+        expression->value     = out;
+        expression->evaluated = false;
+        expression->backprop  = graph::backprop_enabled();
+        expression->size      = 1 + expression->a->size + expression->b->size;
+        expression->version   = -1;
+        out.pending = expression;
+        return out;
+    }
+
+    template<typename R>
+    void Fusion<R>::evaluate(const Mat<R>& matrix) {
+        auto expression = matrix.pending;
+        matrix.pending = nullptr;
+        if (expression->evaluated) {
+            // through another copy of the Mat
+            return;
+        }
+        profiler::OpScope profile("Fusion::evaluate", expression->value);
+
+        auto program = std::make_shared<Program<R>>();
+        std::unordered_map<const FusedExpression<R>*, int> compiled;
+        compile(*program, expression, compiled);
+        program->out = expression->value;
+
+        const int num_instructions = program->instructions.size();
+        const int total = program->out.number_of_elements();
+        profiler::set_flops((int64_t)(num_instructions - (int)program->inputs.size()) * total);
+
+        // (evaluates the inputs that are pending themselves)
+        vector<const R*> inputs(program->inputs.size());
+        for (int i = 0; i < (int)program->inputs.size(); i++) {
+            inputs[i] = MAT(program->inputs[i]).cpu_data().dptr_;
+            ASSERT2(program->versions[i] == -1 ||
+                    program->versions[i] == MAT(program->inputs[i]).memory().version,
+                "Input of a pending expression (see graph::FusionScope) was "
+                "written to before the expression was evaluated.");
+        }
+        R* out = MAT(program->out).overwrite_cpu_data().dptr_;
+
+        vector<R> values(num_instructions * block_size);
+        vector<const R*> slots(num_instructions);
+        for (int start = 0; start < total; start += block_size) {
+            run_forward(*program, inputs, out, false, values.data(), slots, start, std::min(block_size, total - start));
+        }
+
+        expression->evaluated = true;
+        // the expression now only stands for its value.
+        expression->a = nullptr;
+        expression->b = nullptr;
+
+        // recorded even if the value is first read under NoBackprop,
+        // as the ops would have been.
+        if (expression->backprop) {
+            graph::emplace_back([program]() {
+                run_backward(*program);
+            });
+        }
+    }
+
+    template class Fusion<float>;
+    template class Fusion<double>;
+    // (Mat<int>, Binary<int> and Elementwise<int> call into it)
+    template class Fusion<int>;
+}
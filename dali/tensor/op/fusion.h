@@ -0,0 +1,115 @@
+#ifndef DALI_TENSOR_OP_FUSION_H
+#define DALI_TENSOR_OP_FUSION_H
+
+#include <memory>
+
+#include "dali/tensor/Mat.h"
+#include "dali/tensor/Tape.h"
+#include "dali/utils.h"
+
+/*
+Fusion
+------
+
+Inside a `graph::FusionScope`, elementwise ops (`+`, `-`, `*` and `/`
+between Mats of the same shape or with a scalar, and every op of
+`Elementwise` but a generic `pow`) do not compute anything. They
+return a Mat whose value is pending: an expression of the Mats they
+read. Ops on pending Mats extend the expression, so that in
+
+    graph::FusionScope fusion;
+    auto cell   = forget_gate * prev_cell + input_gate * cell_input;
+    auto hidden = output_gate * cell.tanh();
+
+`hidden` is a single expression of 5 Mats. It is evaluated the first
+time its value or gradient is accessed (by a reduction, a matrix
+product, `w()`, `grad()`, ...) in one pass: blocks of elements small
+enough to stay in L1 go through every op of the chain before the next
+block is read, and the intermediate Mats are never allocated. One
+backward closure is recorded for the whole chain. It recomputes the
+forward pass one block at a time and runs the chain backwards into
+the gradients of the Mats the expression read.
+
+An intermediate Mat (`cell` above) that also gets read is evaluated on
+its own: chains recompute their intermediate values instead of sharing
+them. Constant Mats, Mats on the gpu and chains longer than
+`max_ops` are read as inputs. Nothing is deferred while a graph::Plan
+is capturing.
+
+Inputs are read when the expression is evaluated, not when the op
+runs, so they must not be written to in between (e.g. by a solver
+step, `clear()` or `w(i) = ...`): read the pending value first.
+Evaluation checks the version of each input's memory (see
+SynchronizedMemory::version) and throws if one was written to.
+*/
+
+namespace matops {
+    enum FusedOp {
+        // a Mat read by the expression (or an evaluated expression)
+        FUSED_INPUT,
+        FUSED_ADD,
+        FUSED_SUB,
+        FUSED_ELTMUL,
+        FUSED_ELTDIVIDE,
+        FUSED_ADD_SCALAR,
+        // scalar - matrix
+        FUSED_SUB_FROM_SCALAR,
+        FUSED_ELTMUL_SCALAR,
+        FUSED_ELTDIVIDE_SCALAR,
+        FUSED_MAX_SCALAR,
+        FUSED_SQUARE,
+        FUSED_SQRT,
+        FUSED_ELT_INV,
+        FUSED_TANH,
+        FUSED_SIGMOID,
+        FUSED_STEEP_SIGMOID,
+        FUSED_RELU,
+        FUSED_EXP,
+        FUSED_LOG,
+        FUSED_SOFTPLUS,
+        FUSED_ABS,
+    };
+
+    template<typename R>
+    struct FusedExpression {
+        FusedOp op;
+        // argument of the scalar ops
+        R scalar;
+        std::shared_ptr<FusedExpression<R>> a;
+        std::shared_ptr<FusedExpression<R>> b;
+        // the input, or the Mat receiving the value of the expression
+        Mat<R> value;
+        bool evaluated;
+        // whether backprop was enabled when the op ran
+        bool backprop;
+        // ops in the expression (shared ones counted every time)
+        int size;
+        // for inputs: version of their memory when the op read them
+        // (-1 for a pending input, whose value is computed later)
+        long long version;
+    };
+
+    template<typename R>
+    class Fusion {
+        public:
+            typedef std::shared_ptr<FusedExpression<R>> expression_t;
+            // longer chains get split.
+            static const int max_ops = 16;
+
+            // whether an op reading these Mats should be deferred.
+            static bool defer(const Mat<R>& matrix);
+            static bool defer(const Mat<R>& matrix1, const Mat<R>& matrix2);
+
+            // pending op(matrix) (or op(matrix, scalar) for scalar ops).
+            static Mat<R> unary(FusedOp op, Mat<R> matrix, R scalar = 0);
+            // pending op(matrix1, matrix2), of Mats of the same shape.
+            static Mat<R> binary(FusedOp op, Mat<R> matrix1, Mat<R> matrix2);
+
+            // computes the pending value of `matrix` (from Mat::w and Mat::dw).
+            static void evaluate(const Mat<R>& matrix);
+        private:
+            static expression_t operand(const Mat<R>& matrix);
+    };
+}
+
+#endif
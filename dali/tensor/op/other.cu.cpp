@@ -3,12 +3,14 @@
 #include "dali/tensor/__MatMacros__.h"
 #include "dali/math/TensorOps.h"
 #include "dali/math/LazyTensor.h"
+#include "dali/utils/Profiler.h"
 
 using std::vector;
 
 namespace matops {
     template<typename R>
     Mat<R> Other<R>::fill(Mat<R> matrix, R filler) {
+        profiler::OpScope profile("Other::fill", matrix);
         auto out = Mat<R>::empty_like(matrix);
         MAT(out) = filler;
         return out;
@@ -18,6 +20,10 @@ namespace matops {
     void Other<R>::grad(Mat<R>* mat) {
         if (graph::backprop_enabled()) {
             mat->dw() += 1;
+            // (after the kernel that resets the gradient of mat)
+            graph::capture_prologue([](Mat<R>& mat) {
+                mat.dw() += 1;
+            }, *mat);
         }
     }
 
@@ -25,17 +31,21 @@ namespace matops {
     Mat<R> Other<R>::consider_constant_if(
             Mat<R> matrix,
             bool should_consider_constant) {
+        profiler::OpScope profile("Other::consider_constant_if", matrix);
         if (should_consider_constant)
             return consider_constant(matrix);
+        graph::capture_view();
         return matrix;
     }
 
     template<typename R>
     Mat<R> Other<R>::consider_constant(Mat<R> matrix) {
+        profiler::OpScope profile("Other::consider_constant", matrix);
         // perform a copy of the matrix that references
         // everything and owns nothing. A true nomad.
         Mat<R> out(matrix, false, false);
         out.constant = true;
+        graph::capture_view();
         return out;
     }
 
@@ -133,6 +143,11 @@ namespace matops {
         GRAD(*dest) = GRAD(source).wrapper();
     }
 
+    template<typename R>
+    void Other<R>::add_grad(Mat<R>* dest, const Mat<R>& source) {
+        GRAD(*dest) += GRAD(source).wrapper();
+    }
+
     template class Other<float>;
     template class Other<double>;
     template class Other<int>;
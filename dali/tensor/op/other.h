@@ -35,6 +35,8 @@ namespace matops {
 
         static void copy(Mat<R>* dest, const Mat<R>& source);
         static void copy_grad(Mat<R>* dest, const Mat<R>& source);
+        // dest's gradient += source's gradient
+        static void add_grad(Mat<R>* dest, const Mat<R>& source);
     };
 }
 
@@ -3,11 +3,13 @@
 #include "dali/tensor/__MatMacros__.h"
 #include "dali/math/TensorOps.h"
 #include "dali/math/LazyTensor.h"
+#include "dali/utils/Profiler.h"
 
 namespace matops {
 
     template<typename R>
     Mat<R> Reducers<R>::grad_norm(Mat<R> matrix) {
+        profiler::OpScope profile("Reducers::grad_norm", matrix);
         auto out = Mat<R>(1, 1, weights<R>::empty());
         auto norm = GRAD(matrix).L2_norm();
         out.w(0) = norm;
@@ -16,6 +18,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Reducers<R>::grad_norm_rowwise(Mat<R> matrix) {
+        profiler::OpScope profile("Reducers::grad_norm_rowwise", matrix);
         if (matrix.dims(1) == 1)
             return matrix;
         Mat<R> out(matrix.dims(0), 1);
@@ -28,6 +31,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Reducers<R>::grad_norm_colwise(Mat<R> matrix) {
+        profiler::OpScope profile("Reducers::grad_norm_colwise", matrix);
         if (matrix.dims(0) == 1)
             return matrix;
         Mat<R> out(1, matrix.dims(1), weights<R>::empty());
@@ -39,6 +43,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Reducers<R>::L2_norm(Mat<R> matrix) {
+        profiler::OpScope profile("Reducers::L2_norm", matrix);
         auto out = Mat<R>(1, 1, weights<R>::empty());
         auto norm = MAT(matrix).L2_norm();
         out.w(0) = norm;
@@ -52,6 +57,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Reducers<R>::L2_norm_rowwise(Mat<R> matrix) {
+        profiler::OpScope profile("Reducers::L2_norm_rowwise", matrix);
         if (matrix.dims(1) == 1)
             return matrix;
         Mat<R> out(matrix.dims(0), 1);
@@ -70,6 +76,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Reducers<R>::L2_norm_colwise(Mat<R> matrix) {
+        profiler::OpScope profile("Reducers::L2_norm_colwise", matrix);
         if (matrix.dims(0) == 1)
             return matrix;
         Mat<R> out(1, matrix.dims(1), weights<R>::empty());
@@ -89,10 +96,17 @@ namespace matops {
 
     template<typename R>
     Mat<R> Reducers<R>::sum(Mat<R> matrix) {
-        if (matrix.dims(0) == 1 && matrix.dims(1) == 1)
+        profiler::OpScope profile("Reducers::sum", matrix);
+        if (matrix.dims(0) == 1 && matrix.dims(1) == 1) {
+            graph::capture_view();
             return matrix;
+        }
         Mat<R> out(1,1, weights<R>::empty());
-        out.w(0) = MAT(matrix).sum();
+        auto forward = [](Mat<R>& out, Mat<R>& matrix) {
+            out.w(0) = MAT(matrix).sum();
+        };
+        forward(out, matrix);
+        graph::capture_forward(forward, out, matrix);
 
         if (graph::backprop_enabled() && !matrix.constant)
             graph::emplace_back([matrix, out]() mutable {
@@ -103,10 +117,17 @@ namespace matops {
 
     template<typename R>
     Mat<R> Reducers<R>::sum_rowwise(Mat<R> matrix) {
-        if (matrix.dims(1) == 1)
+        profiler::OpScope profile("Reducers::sum_rowwise", matrix);
+        if (matrix.dims(1) == 1) {
+            graph::capture_view();
             return matrix;
+        }
         Mat<R> out(matrix.dims(0), 1, weights<R>::empty());
-        MAT(out).ravel() = reduce_to_1d<0, mshadow::red::sum>(MAT(matrix).wrapper());
+        auto forward = [](Mat<R>& out, Mat<R>& matrix) {
+            MAT(out).ravel() = reduce_to_1d<0, mshadow::red::sum>(MAT(matrix).wrapper());
+        };
+        forward(out, matrix);
+        graph::capture_forward(forward, out, matrix);
 
         if (graph::backprop_enabled() && !matrix.constant)
             graph::emplace_back([matrix, out]() mutable {
@@ -117,10 +138,17 @@ namespace matops {
 
     template<typename R>
     Mat<R> Reducers<R>::sum_colwise(Mat<R> matrix) {
-        if (matrix.dims(0) == 1)
+        profiler::OpScope profile("Reducers::sum_colwise", matrix);
+        if (matrix.dims(0) == 1) {
+            graph::capture_view();
             return matrix;
+        }
         Mat<R> out(1, matrix.dims(1), weights<R>::empty());
-        MAT(out).ravel() = reduce_to_1d<1, mshadow::red::sum>(MAT(matrix).wrapper());
+        auto forward = [](Mat<R>& out, Mat<R>& matrix) {
+            MAT(out).ravel() = reduce_to_1d<1, mshadow::red::sum>(MAT(matrix).wrapper());
+        };
+        forward(out, matrix);
+        graph::capture_forward(forward, out, matrix);
 
         if (graph::backprop_enabled() && !matrix.constant)
             graph::emplace_back([matrix, out]() mutable {
@@ -131,9 +159,14 @@ namespace matops {
 
     template<typename R>
     Mat<R> Reducers<R>::mean(Mat<R> matrix) {
+        profiler::OpScope profile("Reducers::mean", matrix);
         Mat<R> out (1,1, weights<R>::empty());
         auto ne = matrix.number_of_elements();
-        out.w(0) = MAT(matrix).sum() / ne;
+        auto forward = [](Mat<R>& out, Mat<R>& matrix) {
+            out.w(0) = MAT(matrix).sum() / matrix.number_of_elements();
+        };
+        forward(out, matrix);
+        graph::capture_forward(forward, out, matrix);
         if (graph::backprop_enabled() && !matrix.constant)
             graph::emplace_back([matrix, out, ne]() mutable {
                 GRAD(matrix) += out.dw(0) / ne;
@@ -145,6 +178,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Reducers<R>::mean_rowwise(Mat<R> matrix) {
+        profiler::OpScope profile("Reducers::mean_rowwise", matrix);
         if (matrix.dims(1) == 1)
             return matrix;
         Mat<R> out(matrix.dims(0), 1, weights<R>::empty());
@@ -162,6 +196,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Reducers<R>::mean_colwise(Mat<R> matrix) {
+        profiler::OpScope profile("Reducers::mean_colwise", matrix);
         if (matrix.dims(0) == 1)
             return matrix;
         Mat<R> out(1, matrix.dims(1), weights<R>::empty());
@@ -178,12 +213,14 @@ namespace matops {
 
     template<typename R>
     Mat<R> Reducers<R>::max(Mat<R> matrix) {
+        profiler::OpScope profile("Reducers::max", matrix);
         auto mat_idx = MAT(matrix).argmax();
         return matrix.ravel()[mat_idx];
     }
 
     template<typename R>
     Mat<R> Reducers<R>::max_rowwise(Mat<R> matrix) {
+        profiler::OpScope profile("Reducers::max_rowwise", matrix);
         if (matrix.dims(1) == 1)
             return matrix;
         Mat<R> out(matrix.dims(0), 1, weights<R>::empty());
@@ -204,6 +241,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Reducers<R>::max_colwise(Mat<R> matrix) {
+        profiler::OpScope profile("Reducers::max_colwise", matrix);
         if (matrix.dims(0) == 1)
             return matrix;
         Mat<R> out(1, matrix.dims(1), weights<R>::empty());
@@ -224,12 +262,14 @@ namespace matops {
 
     template<typename R>
     Mat<R> Reducers<R>::min(Mat<R> matrix) {
+        profiler::OpScope profile("Reducers::min", matrix);
         auto mat_idx = MAT(matrix).argmin();
         return matrix.ravel()[mat_idx];
     }
 
     template<typename R>
     Mat<R> Reducers<R>::min_rowwise(Mat<R> matrix) {
+        profiler::OpScope profile("Reducers::min_rowwise", matrix);
         if (matrix.dims(1) == 1)
             return matrix;
         Mat<R> out(matrix.dims(0), 1, weights<R>::empty());
@@ -250,6 +290,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Reducers<R>::min_colwise(Mat<R> matrix) {
+        profiler::OpScope profile("Reducers::min_colwise", matrix);
         if (matrix.dims(0) == 1)
             return matrix;
         Mat<R> out(1, matrix.dims(1), weights<R>::empty());
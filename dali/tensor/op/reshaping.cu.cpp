@@ -5,7 +5,9 @@
 #include "dali/math/LazyTensor.h"
 #include "dali/math/lazy_patch2col.h"
 #include "dali/math/lazy_swapaxis.h"
+#include "dali/tensor/Quantization.h"
 #include "dali/utils/assert2.h"
+#include "dali/utils/Profiler.h"
 
 #define DONT_COMPILE
 
@@ -18,10 +20,15 @@ namespace matops {
     Mat<R> Reshaping<R>::rows_pluck(
             Mat<R> matrix,
             Indexing::Index indices) {
+        profiler::OpScope profile("Reshaping::rows_pluck", matrix);
         Mat<int> indices_mat(1, indices.size());
-        for (int i = 0; i < indices.size(); ++i) {
-            indices_mat.w(i) = indices[i];
-        }
+        auto copy_indices = [](Mat<int>& indices_mat, Indexing::Index& indices) {
+            for (int i = 0; i < indices.size(); ++i) {
+                indices_mat.w(i) = indices[i];
+            }
+        };
+        copy_indices(indices_mat, indices);
+        graph::capture_prologue(copy_indices, indices_mat, indices);
         return Reshaping<R>::rows_pluck(matrix, indices_mat);
     }
 
@@ -29,16 +36,36 @@ namespace matops {
     Mat<R> Reshaping<R>::rows_pluck(
             Mat<R> matrix,
             Mat<int> indices) {
+        profiler::OpScope profile("Reshaping::rows_pluck", matrix);
         Mat<R> out (
             indices.number_of_elements(),
             matrix.dims(1),
             weights<R>::empty());
 
-        TensorOps::rows_pluck(MAT(out), MAT(matrix), indices.w().ravel());
+        auto forward = [](Mat<R>& out, Mat<R>& matrix, Mat<int>& indices) {
+            auto quantized = quantization::quantized(matrix, quantization::QUANTIZE_ROWS);
+            if (quantized != NULL) {
+                auto out_data = MAT(out).overwrite_cpu_data();
+                const int* rows = indices.w().ravel().cpu_data().dptr_;
+                for (int i = 0; i < out.dims(0); ++i) {
+                    assert2(0 <= rows[i] && rows[i] < (int)matrix.dims(0),
+                            utils::MS() << "rows_pluck: index " << rows[i] << " out of range.");
+                    quantized->dequantize_row(rows[i], out_data.dptr_ + out_data.stride_ * i);
+                }
+            } else {
+                TensorOps::rows_pluck(MAT(out), MAT(matrix), indices.w().ravel());
+            }
+        };
+        forward(out, matrix, indices);
+        graph::capture_forward(forward, out, matrix, indices);
 
         if (graph::backprop_enabled() && !matrix.constant) {
             graph::emplace_back([matrix, out, indices]() mutable {
-                TensorOps::rows_pluck_backprop(GRAD(matrix), GRAD(out), indices.w().ravel());
+                auto rows = indices.w().ravel();
+                // only these rows are written (see Mat::enable_sparse_grad)
+                auto& matrix_grad = matrix.dw_rows(
+                        rows.cpu_data().dptr_, rows.number_of_elements());
+                TensorOps::rows_pluck_backprop(matrix_grad, GRAD(out), rows);
             });
         }
         return out;
@@ -46,6 +73,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Reshaping<R>::broadcast_row_vector(Mat<R> matrix, int num_rows) {
+        profiler::OpScope profile("Reshaping::broadcast_row_vector", matrix);
         assert2(matrix.dims(0) == 1, "broadcast: expected a row vector");
         Mat<R> out(num_rows, matrix.dims(1), weights<R>::empty());
         MAT(out) = MAT(matrix).ravel().wrapper().template broadcast<1>(MAT(out).shape);
@@ -59,6 +87,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Reshaping<R>::broadcast_col_vector(Mat<R> matrix, int num_cols) {
+        profiler::OpScope profile("Reshaping::broadcast_col_vector", matrix);
         assert2(matrix.dims(1) == 1, "broadcast: expected a column vector.");
         Mat<R> out(matrix.dims(0), num_cols, weights<R>::empty());
         MAT(out) = MAT(matrix).ravel().wrapper().template broadcast<0>(MAT(out).shape);
@@ -84,6 +113,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Reshaping<R>::hstack(const std::vector<Mat<R>>& matrices) {
+        profiler::OpScope profile("Reshaping::hstack");
         int n = -1;
         int d_total = 0;
         for (auto& mat : matrices) {
@@ -97,21 +127,25 @@ namespace matops {
         Mat<R> out (
             n, d_total, weights<R>::empty()
         );
-        int offset = 0;
-        int col, row;
-        auto out_data = out.w().mutable_cpu_data();
-
-        for (row = 0; row < n; row++) {
-            offset = 0;
-            for (auto& mat : matrices) {
-                const int col_size = mat.dims(1);
-                const auto mat_data = mat.w().cpu_data();
-                for (col = 0; col < col_size; col++) {
-                    *(out_data.dptr_ + (out_data.stride_ * row) + (col + offset)) = *(mat_data.dptr_ + (mat_data.stride_ * row) + col);
+        auto forward = [](Mat<R>& out, const vector<Mat<R>>& matrices) {
+            int offset = 0;
+            int col, row;
+            auto out_data = out.w().mutable_cpu_data();
+
+            for (row = 0; row < out.dims(0); row++) {
+                offset = 0;
+                for (auto& mat : matrices) {
+                    const int col_size = mat.dims(1);
+                    const auto mat_data = mat.w().cpu_data();
+                    for (col = 0; col < col_size; col++) {
+                        *(out_data.dptr_ + (out_data.stride_ * row) + (col + offset)) = *(mat_data.dptr_ + (mat_data.stride_ * row) + col);
+                    }
+                    offset += col_size;
                 }
-                offset += col_size;
             }
-        }
+        };
+        forward(out, matrices);
+        graph::capture_forward(forward, out, matrices);
 
         if (graph::backprop_enabled())
             graph::emplace_back([matrices, out, n]() mutable {
@@ -142,7 +176,8 @@ namespace matops {
     template<typename R>
     void Reshaping<R>::resize(Mat<R>& matrix, dim_t n, dim_t d) {
         MAT(matrix).resize(mshadow::Shape2(n, d));
-        GRAD(matrix).resize(mshadow::Shape2(n, d));
+        if (matrix.has_grad())
+            GRAD(matrix).resize(mshadow::Shape2(n, d));
     }
 
     template<typename R>
@@ -153,6 +188,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Reshaping<R>::vstack(const std::vector<Mat<R>>& matrices) {
+        profiler::OpScope profile("Reshaping::vstack");
         assert(matrices.size() > 0);
         int d = matrices[0].dims(1);
         int n_total = 0;
@@ -167,12 +203,16 @@ namespace matops {
             d,
             weights<R>::empty()
         );
-        int offset = 0;
-        for (auto& mat : matrices) {
-            MAT(out).Slice(offset, offset + mat.dims(0)) = MAT(mat).wrapper() + (R)0.0;
-            // MAT(out).mutable_cpu_data().Slice(offset, offset + mat.dims(0)) += MAT(mat).cpu_data();
-            offset += mat.dims(0);
-        }
+        auto forward = [](Mat<R>& out, const vector<Mat<R>>& matrices) {
+            int offset = 0;
+            for (auto& mat : matrices) {
+                MAT(out).Slice(offset, offset + mat.dims(0)) = MAT(mat).wrapper() + (R)0.0;
+                // MAT(out).mutable_cpu_data().Slice(offset, offset + mat.dims(0)) += MAT(mat).cpu_data();
+                offset += mat.dims(0);
+            }
+        };
+        forward(out, matrices);
+        graph::capture_forward(forward, out, matrices);
         if (graph::backprop_enabled())
             graph::emplace_back([matrices, out]() mutable {
                 int offset = 0;
@@ -192,6 +232,7 @@ namespace matops {
             Mat<R> matrix,
             Indexing::Index row_indices,
             Indexing::Index col_indices) {
+        profiler::OpScope profile("Reshaping::rows_cols_pluck", matrix);
         #ifndef DONT_COMPILE
         ASSERT2(row_indices.size() != col_indices.size(),"Cannot pluck column row pairs, not the "
                 "same amount of row and column indices.");
@@ -223,6 +264,7 @@ namespace matops {
     Mat<R> Reshaping<R>::row_pluck(
             Mat<R> matrix,
             int row) {
+        profiler::OpScope profile("Reshaping::row_pluck", matrix);
         ASSERT2(
             0 <= row && row < matrix.dims(0),
             utils::MS() << "Row (" << row
@@ -231,7 +273,10 @@ namespace matops {
         );
         Mat<R> out(1, matrix.dims(1), weights<R>::empty());
         MAT(out)  = MAT(matrix)[row].reshape(MAT(out).shape);
-        GRAD(out) = GRAD(matrix)[row].reshape(MAT(out).shape);
+        if (graph::backprop_enabled())
+            GRAD(out) = GRAD(matrix)[row].reshape(MAT(out).shape);
+        // (the output is a view of the row)
+        graph::capture_view();
 
         return out;
     }
@@ -240,6 +285,7 @@ namespace matops {
     Mat<R> Reshaping<R>::reshape(
             Mat<R> matrix,
             int rows, int cols) {
+        profiler::OpScope profile("Reshaping::reshape", matrix);
         ASSERT2(
             ((rows * cols) == (matrix.dims(0) * matrix.dims(1))) && rows > 0 && cols > 0 ,
             utils::MS() << "Not the same number of elements in original matrix (" << matrix.dims(0) * matrix.dims(1)
@@ -247,7 +293,8 @@ namespace matops {
         );
         Mat<R> out(rows, cols, weights<R>::empty());
         MAT(out)  = MAT(matrix).reshape(mshadow::Shape2(rows, cols));
-        GRAD(out) = GRAD(matrix).reshape(mshadow::Shape2(rows, cols));
+        if (graph::backprop_enabled())
+            GRAD(out) = GRAD(matrix).reshape(mshadow::Shape2(rows, cols));
 
         return out;
     }
@@ -256,6 +303,7 @@ namespace matops {
     Mat<R> Reshaping<R>::col_pluck(
             Mat<R> matrix,
             int col) {
+        profiler::OpScope profile("Reshaping::col_pluck", matrix);
         ASSERT2 (0 <= col && col <= matrix.dims(1), "Wrong col index used in col_pluck");
         Mat<R> out (matrix.dims(0), 1, weights<R>::empty());
 
@@ -273,6 +321,9 @@ namespace matops {
             Mat<R> matrix,
             int rowstart, int rowwend
             ) {
+        profiler::OpScope profile("Reshaping::slice", matrix);
+        // (the output is a view of the matrix)
+        graph::capture_view();
         if (rowstart == rowwend) {
             return Mat<R>(0, matrix.dims(1));
         }
@@ -285,19 +336,22 @@ namespace matops {
             matrix.dims(1),
             weights<R>::empty());
         MAT(out) = MAT(matrix).Slice(rowstart, rowwend);
-        GRAD(out) = GRAD(matrix).Slice(rowstart, rowwend);
+        if (graph::backprop_enabled())
+            GRAD(out) = GRAD(matrix).Slice(rowstart, rowwend);
         return out;
     }
 
     template<typename R>
     Mat<R> Reshaping<R>::transpose(Mat<R> matrix) {
+        profiler::OpScope profile("Reshaping::transpose", matrix);
         Mat<R> out (
             matrix.dims(1),
             matrix.dims(0),
             weights<R>::empty());
         if (matrix.dims(0) == 1 || matrix.dims(1) == 1) {
             MAT(out) = MAT(matrix).reshape(MAT(out).shape);
-            GRAD(out) = GRAD(matrix).reshape(GRAD(out).shape);
+            if (graph::backprop_enabled())
+                GRAD(out) = GRAD(matrix).reshape(MAT(out).shape);
         } else {
             MAT(out) = MAT(matrix).wrapper().T();
             if (graph::backprop_enabled() && !matrix.constant)
@@ -329,6 +383,7 @@ namespace matops {
             const int& kernel_height,
             const int& kernel_width,
             const int& kernel_stride) {
+        profiler::OpScope profile("Reshaping::patch2col_no_grad", matrix);
         ASSERT2(four_d_shape.size() == 4,
             utils::MS() << "four_d_shape argument to patch2col must be a size "
                         << "4 vector (got " << four_d_shape.size() << ")"
@@ -390,6 +445,7 @@ namespace matops {
             const int& kernel_height,
             const int& kernel_width,
             const int& kernel_stride) {
+        profiler::OpScope profile("Reshaping::patch2col", matrix);
 
         auto out = patch2col_no_grad(
             matrix,
@@ -480,6 +536,7 @@ namespace matops {
 
     template<typename R>
     Mat<R> Reshaping<R>::swapaxes(Mat<R> mat, const std::vector<int>& reshape, const int& axis1, const int& axis2) {
+        profiler::OpScope profile("Reshaping::swapaxes", mat);
         if (axis2 > axis1) {
             return swapaxes(mat, reshape, axis2, axis1);
         }
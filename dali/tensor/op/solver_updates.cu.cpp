@@ -234,6 +234,238 @@ namespace matops {
         MAT(param) -= lr_t * GRAD(param).wrapper();
     }
 
+    template<typename R>
+    bool SolverUpdates<R>::sparse_is_grad_nan(Mat<R> param, const vector<int>& rows) {
+        const auto grad = param.dw_rows(NULL, 0).cpu_data();
+        const int cols = param.dims(1);
+        for (auto row : rows) {
+            const R* grad_row = grad.dptr_ + row * grad.stride_;
+            for (int j = 0; j < cols; ++j) {
+                if (grad_row[j] != grad_row[j]) return true;
+            }
+        }
+        return false;
+    }
+
+    template<typename R>
+    void SolverUpdates<R>::sparse_clip(Mat<R> param, const vector<int>& rows, R clip_abs, R clip_norm) {
+        auto grad = param.dw_rows(NULL, 0).mutable_cpu_data();
+        const int cols = param.dims(1);
+        // same rules as clip_and_regularize without regularization.
+        if (clip_abs > 0) {
+            for (auto row : rows) {
+                R* grad_row = grad.dptr_ + row * grad.stride_;
+                for (int j = 0; j < cols; ++j) {
+                    grad_row[j] = op::clip<R>::Map(grad_row[j], clip_abs);
+                }
+            }
+        } else if (clip_norm > 0) {
+            // the other rows are zero, so this is the norm of the whole gradient.
+            R squared_norm = 0.0;
+            for (auto row : rows) {
+                const R* grad_row = grad.dptr_ + row * grad.stride_;
+                for (int j = 0; j < cols; ++j) {
+                    squared_norm += grad_row[j] * grad_row[j];
+                }
+            }
+            R norm = std::sqrt(squared_norm);
+            if (norm > clip_norm) {
+                for (auto row : rows) {
+                    R* grad_row = grad.dptr_ + row * grad.stride_;
+                    for (int j = 0; j < cols; ++j) {
+                        grad_row[j] *= clip_norm / norm;
+                    }
+                }
+            }
+        }
+    }
+
+    template<typename R>
+    void SolverUpdates<R>::sparse_sgd_update(Mat<R> param, const vector<int>& rows, R step_size) {
+        auto weights = MAT(param).mutable_cpu_data();
+        const auto grad = param.dw_rows(NULL, 0).cpu_data();
+        const int cols = param.dims(1);
+        for (auto row : rows) {
+            R* weights_row    = weights.dptr_ + row * weights.stride_;
+            const R* grad_row = grad.dptr_    + row * grad.stride_;
+            for (int j = 0; j < cols; ++j) {
+                weights_row[j] -= step_size * grad_row[j];
+            }
+        }
+        DEBUG_ASSERT_NOT_NAN(MAT(param));
+    }
+
+    template<typename R>
+    void SolverUpdates<R>::sparse_adagrad_update(Mat<R> param,
+                                                 Mat<R>& cache,
+                                                 const vector<int>& rows,
+                                                 R step_size,
+                                                 R smooth_eps) {
+        ASSERT2(cache.number_of_elements() == param.number_of_elements(),
+            utils::MS() << "cache parameter in sparse_adagrad_update has different "
+                        << "size than parameter (got " << cache.number_of_elements()
+                        << " and expected " << param.number_of_elements() << ")."
+        );
+        auto weights = MAT(param).mutable_cpu_data();
+        auto gsum    = MAT(cache).mutable_cpu_data();
+        const auto grad = param.dw_rows(NULL, 0).cpu_data();
+        const int cols = param.dims(1);
+        for (auto row : rows) {
+            R* weights_row    = weights.dptr_ + row * weights.stride_;
+            R* gsum_row       = gsum.dptr_    + row * gsum.stride_;
+            const R* grad_row = grad.dptr_    + row * grad.stride_;
+            for (int j = 0; j < cols; ++j) {
+                gsum_row[j]    += grad_row[j] * grad_row[j];
+                weights_row[j] -= step_size * grad_row[j] / (std::sqrt(gsum_row[j]) + smooth_eps);
+            }
+        }
+        DEBUG_ASSERT_NOT_NAN(MAT(param));
+    }
+
+    template<typename R>
+    void SolverUpdates<R>::sparse_rmsprop_update(Mat<R> param,
+                                                 Mat<R>& cache,
+                                                 const vector<int>& rows,
+                                                 R decay_rate,
+                                                 R step_size,
+                                                 R smooth_eps) {
+        ASSERT2(cache.number_of_elements() == param.number_of_elements(),
+            utils::MS() << "cache parameter in sparse_rmsprop_update has different "
+                        << "size than parameter (got " << cache.number_of_elements()
+                        << " and expected " << param.number_of_elements() << ")."
+        );
+        auto weights = MAT(param).mutable_cpu_data();
+        auto gsum    = MAT(cache).mutable_cpu_data();
+        const auto grad = param.dw_rows(NULL, 0).cpu_data();
+        const int cols = param.dims(1);
+        for (auto row : rows) {
+            R* weights_row    = weights.dptr_ + row * weights.stride_;
+            R* gsum_row       = gsum.dptr_    + row * gsum.stride_;
+            const R* grad_row = grad.dptr_    + row * grad.stride_;
+            for (int j = 0; j < cols; ++j) {
+                gsum_row[j] = decay_rate * gsum_row[j] + ((R)1.0 - decay_rate) * grad_row[j] * grad_row[j];
+                weights_row[j] -= step_size * grad_row[j] / std::sqrt(gsum_row[j] + smooth_eps);
+            }
+        }
+        DEBUG_ASSERT_NOT_NAN(MAT(param));
+    }
+
+    template<typename R>
+    void SolverUpdates<R>::sparse_rmsprop_momentum_update(Mat<R> param,
+                                                          Mat<R>& n_cache,
+                                                          Mat<R>& g_cache,
+                                                          Mat<R>& momentum_cache,
+                                                          const vector<int>& rows,
+                                                          R decay_rate,
+                                                          R momentum,
+                                                          R step_size,
+                                                          R smooth_eps) {
+        ASSERT2(n_cache.number_of_elements() == param.number_of_elements() &&
+                g_cache.number_of_elements() == param.number_of_elements() &&
+                momentum_cache.number_of_elements() == param.number_of_elements(),
+            utils::MS() << "caches in sparse_rmsprop_momentum_update must have the same "
+                        << "size as the parameter (got " << n_cache.number_of_elements()
+                        << ", " << g_cache.number_of_elements()
+                        << " and " << momentum_cache.number_of_elements() << ", expected "
+                        << param.number_of_elements() << ")."
+        );
+        auto weights = MAT(param).mutable_cpu_data();
+        auto n_data  = MAT(n_cache).mutable_cpu_data();
+        auto g_data  = MAT(g_cache).mutable_cpu_data();
+        auto m_data  = MAT(momentum_cache).mutable_cpu_data();
+        const auto grad = param.dw_rows(NULL, 0).cpu_data();
+        const int cols = param.dims(1);
+        for (auto row : rows) {
+            R* weights_row    = weights.dptr_ + row * weights.stride_;
+            R* n_row          = n_data.dptr_  + row * n_data.stride_;
+            R* g_row          = g_data.dptr_  + row * g_data.stride_;
+            R* m_row          = m_data.dptr_  + row * m_data.stride_;
+            const R* grad_row = grad.dptr_    + row * grad.stride_;
+            for (int j = 0; j < cols; ++j) {
+                n_row[j] = decay_rate * n_row[j] + ((R)1.0 - decay_rate) * grad_row[j] * grad_row[j];
+                g_row[j] = decay_rate * g_row[j] + ((R)1.0 - decay_rate) * grad_row[j];
+                m_row[j] = momentum * m_row[j] - step_size * grad_row[j] / std::sqrt(n_row[j] - g_row[j] * g_row[j] + smooth_eps);
+                weights_row[j] += m_row[j];
+            }
+        }
+        DEBUG_ASSERT_NOT_NAN(MAT(param));
+    }
+
+    template<typename R>
+    void SolverUpdates<R>::sparse_adadelta_update(Mat<R> param,
+                                                  Mat<R>& gsum,
+                                                  Mat<R>& xsum,
+                                                  const vector<int>& rows,
+                                                  R rho,
+                                                  R smooth_eps) {
+        ASSERT2(gsum.number_of_elements() == param.number_of_elements() &&
+                xsum.number_of_elements() == param.number_of_elements(),
+            utils::MS() << "gsum and xsum parameters in sparse_adadelta_update must have the same "
+                        << "size as the parameter (got " << gsum.number_of_elements()
+                        << " and " << xsum.number_of_elements() << ", expected "
+                        << param.number_of_elements() << ")."
+        );
+        auto weights   = MAT(param).mutable_cpu_data();
+        auto gsum_data = MAT(gsum).mutable_cpu_data();
+        auto xsum_data = MAT(xsum).mutable_cpu_data();
+        const auto grad = param.dw_rows(NULL, 0).cpu_data();
+        const int cols = param.dims(1);
+        for (auto row : rows) {
+            R* weights_row    = weights.dptr_   + row * weights.stride_;
+            R* gsum_row       = gsum_data.dptr_ + row * gsum_data.stride_;
+            R* xsum_row       = xsum_data.dptr_ + row * xsum_data.stride_;
+            const R* grad_row = grad.dptr_      + row * grad.stride_;
+            for (int j = 0; j < cols; ++j) {
+                gsum_row[j] = rho * gsum_row[j] + ((R)1.0 - rho) * grad_row[j] * grad_row[j];
+                R dparam = std::sqrt(xsum_row[j] + smooth_eps) / std::sqrt(gsum_row[j] + smooth_eps) * grad_row[j];
+                xsum_row[j] = rho * xsum_row[j] + ((R)1.0 - rho) * dparam * dparam;
+                weights_row[j] -= dparam;
+            }
+        }
+        DEBUG_ASSERT_NOT_NAN(MAT(param));
+    }
+
+    template<typename R>
+    void SolverUpdates<R>::sparse_adam_update(Mat<R> param,
+                                              Mat<R>& m,
+                                              Mat<R>& v,
+                                              const vector<int>& rows,
+                                              R b1,
+                                              R b2,
+                                              R smooth_eps,
+                                              R step_size,
+                                              unsigned long long epoch) {
+        ASSERT2(m.number_of_elements() == param.number_of_elements() &&
+                v.number_of_elements() == param.number_of_elements(),
+            utils::MS() << "m and v parameters in sparse_adam_update must have the same "
+                        << "size as the parameter (got " << m.number_of_elements()
+                        << " and " << v.number_of_elements() << ", expected "
+                        << param.number_of_elements() << ")."
+        );
+        auto fix1 = 1.0 - std::pow(b1, epoch);
+        auto fix2 = 1.0 - std::pow(b2, epoch);
+        R lr_t = step_size * sqrt(fix2 / fix1);
+
+        ASSERT2(lr_t == lr_t, "Epoch learning rate is NaN. Try changing b1 or b2.");
+
+        auto weights = MAT(param).mutable_cpu_data();
+        auto m_data  = MAT(m).mutable_cpu_data();
+        auto v_data  = MAT(v).mutable_cpu_data();
+        const auto grad = param.dw_rows(NULL, 0).cpu_data();
+        const int cols = param.dims(1);
+        for (auto row : rows) {
+            R* weights_row    = weights.dptr_ + row * weights.stride_;
+            R* m_row          = m_data.dptr_  + row * m_data.stride_;
+            R* v_row          = v_data.dptr_  + row * v_data.stride_;
+            const R* grad_row = grad.dptr_    + row * grad.stride_;
+            for (int j = 0; j < cols; ++j) {
+                m_row[j] = m_row[j] * (R)(1.0 - b1) + b1 * grad_row[j];
+                v_row[j] = v_row[j] * (R)(1.0 - b2) + b2 * grad_row[j] * grad_row[j];
+                weights_row[j] -= lr_t * m_row[j] / (std::sqrt(v_row[j]) + smooth_eps);
+            }
+        }
+    }
+
     template class SolverUpdates<float>;
     template class SolverUpdates<double>;
     template class SolverUpdates<int>;
@@ -51,6 +51,56 @@ namespace matops {
                                 R smooth_eps,
                                 R step_size,
                                 unsigned long long epoch);
+
+        // Sparse versions of the above: only `rows` of the parameter
+        // received a gradient (see `Mat::enable_sparse_grad`), so only
+        // those rows are visited, as are the rows of the caches (the
+        // caches of the other rows are not decayed). CPU only.
+        static bool sparse_is_grad_nan(Mat<R> param, const std::vector<int>& rows);
+
+        static void sparse_clip(Mat<R> param, const std::vector<int>& rows, R clip_abs, R clip_norm);
+
+        static void sparse_sgd_update(Mat<R> param, const std::vector<int>& rows, R step_size);
+
+        static void sparse_adagrad_update(Mat<R> param,
+                                          Mat<R>& cache,
+                                          const std::vector<int>& rows,
+                                          R step_size,
+                                          R smooth_eps);
+
+        static void sparse_rmsprop_update(Mat<R> param,
+                                          Mat<R>& cache,
+                                          const std::vector<int>& rows,
+                                          R decay_rate,
+                                          R step_size,
+                                          R smooth_eps);
+
+        static void sparse_rmsprop_momentum_update(Mat<R> param,
+                                                   Mat<R>& n_cache,
+                                                   Mat<R>& g_cache,
+                                                   Mat<R>& momentum_cache,
+                                                   const std::vector<int>& rows,
+                                                   R decay_rate,
+                                                   R momentum,
+                                                   R step_size,
+                                                   R smooth_eps);
+
+        static void sparse_adadelta_update(Mat<R> param,
+                                           Mat<R>& gsum,
+                                           Mat<R>& xsum,
+                                           const std::vector<int>& rows,
+                                           R rho,
+                                           R smooth_eps);
+
+        static void sparse_adam_update(Mat<R> param,
+                                       Mat<R>& m,
+                                       Mat<R>& v,
+                                       const std::vector<int>& rows,
+                                       R b1,
+                                       R b2,
+                                       R smooth_eps,
+                                       R step_size,
+                                       unsigned long long epoch);
     };
 }
 
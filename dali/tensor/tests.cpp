@@ -1,15 +1,32 @@
 #include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
 #include <vector>
 #include <iomanip>
+#include <sstream>
+#include <thread>
 #include <gtest/gtest.h>
+#include <unistd.h>
 
 #include "dali/test_utils.h"
 #include "dali/tensor/Index.h"
 #include "dali/layers/Layers.h"
+#include "dali/layers/LSTM.h"
 #include "dali/tensor/Mat.h"
 #include "dali/tensor/MatOps.h"
 #include "dali/tensor/Tape.h"
 #include "dali/tensor/Solver.h"
+#include "dali/tensor/Checkpoint.h"
+#include "dali/tensor/FlatParameters.h"
+#include "dali/tensor/ParameterServer.h"
+#include "dali/tensor/Quantization.h"
+#include "dali/math/memory_bank/MemoryArena.h"
+#include "dali/math/memory_bank/MemoryBank.h"
+#include "dali/math/simd/Int8Gemm.h"
+#include "dali/math/simd/SimdFunctions.h"
+#include "dali/utils/Profiler.h"
 
 using std::vector;
 using std::chrono::milliseconds;
@@ -375,6 +392,102 @@ TEST(MatrixIOTests, save_load_test) {
     }
 }
 
+TEST(MatrixIOTests, checkpoint_test) {
+    auto fname = utils::dir_join({STR(DALI_DATA_DIR), "tests", "checkpoint.temp.dali"});
+    vector<Mat<R>> params = {
+        Mat<R>(3, 5, weights<R>::uniform(2.0)),
+        Mat<R>(7, 2, weights<R>::uniform(2.0))
+    };
+    utils::save_checkpoint(params, fname);
+
+    vector<Mat<R>> loaded = {Mat<R>(3, 5), Mat<R>(7, 2)};
+    utils::load_checkpoint(loaded, fname);
+    for (int i = 0; i < params.size(); i++) {
+        ASSERT_TRUE(MatOps<R>::equals(params[i], loaded[i]));
+    }
+
+    // mapped parameters point at the file, writes stay private
+    vector<Mat<R>> mapped = {Mat<R>(3, 5), Mat<R>(7, 2)};
+    utils::map_checkpoint(mapped, fname, true);
+    for (int i = 0; i < params.size(); i++) {
+        ASSERT_TRUE(MatOps<R>::equals(params[i], mapped[i]));
+    }
+    mapped[0].w(0) += 1.0;
+    utils::load_checkpoint(loaded, fname);
+    ASSERT_TRUE(MatOps<R>::equals(params[0], loaded[0]));
+    ASSERT_FALSE(MatOps<R>::equals(params[0], mapped[0]));
+
+    vector<Mat<R>> wrong_shape = {Mat<R>(5, 3), Mat<R>(7, 2)};
+    EXPECT_THROW(utils::load_checkpoint(wrong_shape, fname), std::runtime_error);
+
+    // corrupt a value of the first tensor
+    {
+        std::fstream file(fname, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekg(128 + 3);
+        char byte = file.get();
+        file.seekp(128 + 3);
+        file.put(~byte);
+    }
+    EXPECT_THROW(utils::load_checkpoint(loaded, fname), std::runtime_error);
+    EXPECT_NO_THROW(utils::map_checkpoint(mapped, fname));
+    EXPECT_THROW(utils::map_checkpoint(mapped, fname, true), std::runtime_error);
+    mapped.clear();
+    std::remove(fname.c_str());
+}
+
+TEST_F(MatrixTests, flat_parameters) {
+    Mat<R> A(3, 5, weights<R>::uniform(2.0));
+    Mat<R> B(7, 2, weights<R>::uniform(2.0));
+    Mat<R> A_before(A, true, true);
+    Mat<R> B_before(B, true, true);
+    (A.sum() + B.sum()).grad();
+    graph::backward();
+
+    // A is listed twice (tied weights) but only placed once.
+    FlatParameters<R> flat({A, B, A});
+    ASSERT_TRUE(MatOps<R>::equals(A, A_before));
+    ASSERT_TRUE(MatOps<R>::equals(B, B_before));
+    ASSERT_EQ(flat.offset(0), 0);
+    ASSERT_EQ(flat.offset(2), 0);
+    ASSERT_EQ((flat.offset(1) * sizeof(R)) % 64, 0);
+    ASSERT_EQ(flat.weights.memory_, A.w().memory_);
+    ASSERT_EQ(flat.gradients.memory_, B.dw().memory_);
+
+    // the handles are views into the buffers
+    A.w(1, 2) = 42.0;
+    ASSERT_EQ(flat.weights(0, 1 * 5 + 2), 42.0);
+    B.dw(3) = 5.0;
+    ASSERT_EQ(flat.gradients(0, flat.offset(1) + 3), 5.0);
+    // padding does not count towards the norm
+    R norm = std::sqrt(A.dw().L2_norm() * A.dw().L2_norm() + B.dw().L2_norm() * B.dw().L2_norm());
+    ASSERT_NEAR(flat.grad_norm(), norm, 1e-6);
+
+    flat.clip_grad_norm(1.0);
+    ASSERT_NEAR(flat.grad_norm(), 1.0, 1e-6);
+    ASSERT_NEAR(B.dw(3), 5.0 / norm, 1e-6);
+
+    // replicas of the same model copy and average in one pass
+    Mat<R> A2(3, 5, weights<R>::uniform(2.0));
+    Mat<R> B2(7, 2, weights<R>::uniform(2.0));
+    FlatParameters<R> replica({A2, B2, A2});
+    replica.copy_weights_from(flat);
+    ASSERT_TRUE(MatOps<R>::equals(A, A2));
+    ASSERT_TRUE(MatOps<R>::equals(B, B2));
+    B2.w(4) += 2.0;
+    R expected = B.w(4) + 1.0;
+    flat.average_weights({&flat, &replica});
+    ASSERT_NEAR(B.w(4), expected, 1e-6);
+
+    flat.clear_grads();
+    ASSERT_EQ(flat.grad_norm(), 0.0);
+    ASSERT_EQ(A.dw().sum(), 0.0);
+
+    FlatParameters<R> other_model({Mat<R>(5, 3), Mat<R>(7, 2)});
+    EXPECT_THROW(flat.copy_weights_from(other_model), std::runtime_error);
+    // already flattened
+    EXPECT_THROW(FlatParameters<R>({A}), std::runtime_error);
+}
+
 TEST_F(MatrixTests, lazy_allocation) {
     // if memory must be filled with zeros,
     // then allocation is lazy
@@ -406,6 +519,279 @@ TEST_F(MatrixTests, lazy_allocation) {
     #endif
 }
 
+TEST_F(MatrixTests, lazy_gradient) {
+    Mat<R> A(3, 4, weights<R>::uniform(2.0));
+    ASSERT_FALSE(A.has_grad());
+    {
+        graph::NoBackprop nb;
+        auto out = A.tanh().sum();
+        ASSERT_FALSE(out.has_grad());
+        ASSERT_FALSE(A.has_grad());
+    }
+    auto out = A.tanh().sum();
+    // only created once backward writes to it
+    ASSERT_FALSE(A.has_grad());
+    out.grad();
+    graph::backward();
+    ASSERT_TRUE(A.has_grad());
+    for (int i = 0; i < A.number_of_elements(); i++) {
+        ASSERT_NEAR(A.dw(i), 1.0 - std::pow(std::tanh(A.w(i)), 2), 1e-9);
+    }
+
+    // parameters created under NoBackprop still share their gradient
+    // with the copies used for training.
+    Mat<R> B;
+    {
+        graph::NoBackprop nb;
+        B = Mat<R>(3, 4, weights<R>::uniform(2.0));
+    }
+    vector<Mat<R>> params({B});
+    B.eltmul(2.0).sum().grad();
+    graph::backward();
+    for (int i = 0; i < B.number_of_elements(); i++) {
+        ASSERT_NEAR(params[0].dw(i), 2.0, 1e-9);
+    }
+
+    // and so do copies made under NoBackprop, before any backward.
+    Mat<R> C(3, 4, weights<R>::uniform(2.0));
+    vector<Mat<R>> copies;
+    {
+        graph::NoBackprop nb;
+        copies.emplace_back(C);
+    }
+    ASSERT_FALSE(copies[0].has_grad());
+    C.eltmul(3.0).sum().grad();
+    graph::backward();
+    for (int i = 0; i < C.number_of_elements(); i++) {
+        ASSERT_NEAR(copies[0].dw(i), 3.0, 1e-9);
+    }
+
+    // the first use from concurrent threads creates a single gradient.
+    Mat<R> D(3, 4, weights<R>::uniform(2.0));
+    vector<Mat<R>> thread_copies(8, D);
+    vector<std::thread> threads;
+    vector<const void*> seen(thread_copies.size());
+    for (int t = 0; t < thread_copies.size(); t++) {
+        threads.emplace_back([&thread_copies, &seen, t]() {
+            seen[t] = &thread_copies[t].dw();
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    for (auto grad : seen) {
+        ASSERT_EQ(&D.dw(), grad);
+    }
+}
+
+TEST_F(MatrixTests, memory_bank_recycling) {
+    // warm up the cache with one temporary of each shape
+    {
+        Mat<R> A(13, 17, weights<R>::uniform(2.0));
+        auto B = A * 2.0;
+    }
+    auto system_allocations = memory_bank<R>::num_cpu_allocations.load();
+    auto recycled = memory_bank<R>::num_cpu_recycled.load();
+    for (int i = 0; i < 10; i++) {
+        Mat<R> A(13, 17, weights<R>::uniform(2.0));
+        auto B = A * 2.0;
+    }
+    #ifndef DALI_USE_CUDA
+    // steady state should be served entirely from the cache
+    ASSERT_EQ(system_allocations, memory_bank<R>::num_cpu_allocations.load());
+    ASSERT_LT(recycled, memory_bank<R>::num_cpu_recycled.load());
+    #endif
+
+    // size classes leave at most 25% slack
+    for (int amount = 1; amount < 100000; amount += 7) {
+        int size_class = memory_bank<R>::cpu_size_class(amount);
+        ASSERT_GE(memory_bank<R>::cpu_size_class_capacity(size_class), amount);
+        ASSERT_LE(memory_bank<R>::cpu_size_class_capacity(size_class), std::max(16, amount + amount / 4 + 1));
+    }
+
+    #ifndef DALI_USE_CUDA
+    ASSERT_LT(0, memory_bank<R>::thread_cached_cpu_memory());
+    #endif
+    memory_bank<R>::clear_cpu();
+    // other threads (e.g. ThreadPool workers) keep their magazines,
+    // so only this thread's share of the cache is known to be gone.
+    ASSERT_EQ(0, memory_bank<R>::thread_cached_cpu_memory());
+}
+
+TEST_F(MatrixTests, arena_scope) {
+    Mat<R> param(5, 5, weights<R>::uniform(2.0));
+    Mat<R> kept;
+    graph::clear();
+    {
+        graph::ArenaScope arena;
+        auto hidden = param.tanh();
+        kept = (hidden * param).sum();
+        #ifndef DALI_USE_CUDA
+        ASSERT_TRUE(hidden.w().memory().cpu_from_arena);
+        ASSERT_FALSE(param.w().memory().cpu_from_arena);
+        #endif
+        kept.grad();
+        graph::backward();
+    }
+    // values held past the pass are not recycled from under us
+    auto expected = (param.tanh() * param).sum();
+    ASSERT_NEAR(expected.w(0), kept.w(0), 1e-6);
+    ASSERT_FALSE(param.dw().memory().cpu_from_arena);
+    graph::clear();
+}
+
+TEST_F(MatrixTests, arena_scope_steady_state) {
+    // the loss and the recurrent state are held across backward:
+    // their chunks are not replaced, so only the first step gets
+    // chunks from the system.
+    Mat<R> param(5, 5, weights<R>::uniform(2.0));
+    Mat<R> state(1, 5, weights<R>::uniform(2.0));
+    Mat<R> error;
+    graph::clear();
+    long long chunk_allocations = 0;
+    for (int step = 0; step < 10; step++) {
+        {
+            graph::ArenaScope arena;
+            state = (state.dot(param) + 1.0).tanh();
+            error = state.sum();
+            error.grad();
+            graph::backward();
+        }
+        if (step == 0) {
+            chunk_allocations = memory_arena::num_chunk_allocations.load();
+        } else {
+            ASSERT_EQ(chunk_allocations, memory_arena::num_chunk_allocations.load());
+        }
+    }
+    graph::clear();
+}
+
+TEST_F(MatrixTests, arena_scope_parameter_gradient) {
+    Mat<R> param(5, 5, weights<R>::uniform(2.0));
+    graph::clear();
+    ASSERT_FALSE(param.has_grad());
+    {
+        graph::ArenaScope arena;
+        // the gradient is first touched by backward, inside the scope.
+        auto loss = (param.tanh() * param).sum();
+        loss.grad();
+        graph::backward();
+        #ifndef DALI_USE_CUDA
+        ASSERT_FALSE(param.dw().memory().cpu_from_arena);
+        #endif
+        // reuse the rewound arena
+        auto other = (Mat<R>(5, 5, weights<R>::uniform(2.0)) * 3.0).sum();
+    }
+    for (int i = 0; i < param.number_of_elements(); i++) {
+        R t = std::tanh(param.w(i));
+        ASSERT_NEAR(param.dw(i), t + param.w(i) * (1.0 - t * t), 1e-5);
+    }
+    graph::clear();
+}
+
+TEST_F(MatrixTests, fusion_scope) {
+    auto chain = [](vector<Mat<R>>& Xs)-> Mat<R> {
+        auto gate = (Xs[0] + Xs[1]).sigmoid();
+        auto cell = gate * Xs[2] + (1.0 - gate) * Xs[2].tanh();
+        return (cell * 2.0).relu() * (Xs[1].square() + 1.0).log() / (cell.square() + 0.5);
+    };
+    auto fused = [&chain](vector<Mat<R>>& Xs)-> Mat<R> {
+        graph::FusionScope fusion;
+        return chain(Xs);
+    };
+    EXPERIMENT_REPEAT {
+        vector<Mat<R>> Xs = {
+            Mat<R>(10, 20, weights<R>::uniform(2.0)),
+            Mat<R>(10, 20, weights<R>::uniform(2.0)),
+            Mat<R>(10, 20, weights<R>::uniform(2.0)),
+        };
+        ASSERT_TRUE(gradient_same(fused, Xs, 1e-3, 1e-3));
+
+        graph::NoBackprop nb;
+        auto expected = chain(Xs);
+        auto result = fused(Xs);
+        ASSERT_MATRIX_CLOSE(expected, result, 1e-5);
+    }
+    // intermediate values read on their own are evaluated separately,
+    // and the gradient reaches the inputs through both paths.
+    Mat<R> A(4, 5, weights<R>::uniform(2.0));
+    Mat<R> B(4, 5, weights<R>::uniform(2.0));
+    graph::clear();
+    auto eager_hidden = A.tanh() * B;
+    ((eager_hidden + A).sigmoid().sum() + eager_hidden.sum()).grad();
+    graph::backward();
+    auto dA = Mat<R>(A, true, true), dB = Mat<R>(B, true, true);
+    A.clear_grad();
+    B.clear_grad();
+    {
+        graph::FusionScope fusion;
+        auto hidden = A.tanh() * B;
+        auto error = (hidden + A).sigmoid().sum() + hidden.sum();
+        error.grad();
+    }
+    graph::backward();
+    ASSERT_TRUE(MatOps<R>::grad_allclose(dA, A, 1e-5));
+    ASSERT_TRUE(MatOps<R>::grad_allclose(dB, B, 1e-5));
+    graph::clear();
+
+    // inputs are read on evaluation: writing to them first is an error.
+    {
+        graph::NoBackprop nb;
+        graph::FusionScope fusion;
+        auto read_first = A.tanh() * B;
+        auto written_first = A.tanh() * B;
+        ASSERT_MATRIX_CLOSE(read_first, eager_hidden, 1e-5);
+        B.w(0) += 1.0;
+        EXPECT_THROW(written_first.w(), std::runtime_error);
+    }
+}
+
+TEST_F(MatrixTests, profiler) {
+    Mat<R> a(4, 3, weights<R>::uniform(2.0));
+    Mat<R> b(3, 5, weights<R>::uniform(2.0));
+    graph::clear();
+    profiler::reset();
+    profiler::enable();
+    auto error = a.dot(b).tanh().sum();
+    error.grad();
+    graph::backward();
+    profiler::disable();
+
+    int forward_mul = 0, backward_mul = 0, backward_tanh = 0;
+    for (auto& event : profiler::events()) {
+        ASSERT_GE(event.duration_ns, 0);
+        ASSERT_LE(event.self_ns, event.duration_ns);
+        if (std::string(event.name) == "Binary::mul") {
+            ASSERT_EQ(2, event.num_shapes);
+            ASSERT_EQ(4, event.shapes[0][0]);
+            ASSERT_EQ(5, event.shapes[1][1]);
+            if (event.backward) {
+                ASSERT_EQ(2 * 2 * 4 * 3 * 5, event.flops);
+                backward_mul++;
+            } else {
+                ASSERT_EQ(2 * 4 * 3 * 5, event.flops);
+                // the output of the product
+                ASSERT_GE(event.bytes, (int64_t)(4 * 5 * sizeof(R)));
+                forward_mul++;
+            }
+        }
+        if (std::string(event.name) == "Elementwise::tanh" && event.backward) {
+            backward_tanh++;
+        }
+    }
+    ASSERT_EQ(1, forward_mul);
+    ASSERT_EQ(1, backward_mul);
+    ASSERT_EQ(1, backward_tanh);
+
+    std::stringstream report;
+    profiler::report(report);
+    ASSERT_NE(std::string::npos, report.str().find("Binary::mul"));
+
+    // nothing is recorded while disabled
+    profiler::reset();
+    a.dot(b);
+    ASSERT_TRUE(profiler::events().empty());
+    graph::clear();
+}
+
 TEST_F(MatrixTests, view_transpose) {
     // For 1xN or Nx1 matrices, a transpose is simply a
     // different view onto the memory
@@ -941,6 +1327,96 @@ TEST_F(MatrixTests, log) {
     }
 }
 
+TEST_F(MatrixTests, simd_elementwise) {
+    // float ops go through dali/math/simd on the CPU: compare every
+    // instruction set this cpu supports with the C library (17 x 13
+    // elements also exercises the partial last register).
+    auto original = simd::instruction_set();
+    auto A = Mat<float>(17, 13, weights<float>::uniform(-10.0, 10.0));
+    auto B = Mat<float>(17, 13, weights<float>::uniform(1e-3, 100.0));
+
+    auto expect_close = [](Mat<float> input, Mat<float> output, std::function<double(double)> f) {
+        for (int i = 0; i < input.dims(0); i++) {
+            for (int j = 0; j < input.dims(1); j++) {
+                double expected = f(input.w()(i, j));
+                ASSERT_NEAR(output.w()(i, j), expected, 1e-6 * std::max(1.0, std::abs(expected)));
+            }
+        }
+    };
+    for (auto instruction_set : {"scalar", "sse2", "avx2", "avx512"}) {
+        if (!simd::set_instruction_set(instruction_set)) continue;
+        expect_close(A, MatOps<float>::exp(A), [](double x) { return std::exp(x); });
+        expect_close(B, MatOps<float>::log(B), [](double x) { return std::log(x); });
+        expect_close(A, MatOps<float>::tanh(A), [](double x) { return std::tanh(x); });
+        expect_close(A, MatOps<float>::sigmoid(A), [](double x) { return 1.0 / (1.0 + std::exp(-x)); });
+        expect_close(A, MatOps<float>::softplus(A), [](double x) { return std::log1p(std::exp(x)); });
+        expect_close(A, MatOps<float>::steep_sigmoid(A, 1.5), [](double x) { return 1.0 / (1.0 + std::exp(-1.5 * x)); });
+    }
+    ASSERT_TRUE(simd::set_instruction_set(original));
+}
+
+TEST_F(MatrixTests, quantized_products) {
+    // int8 copies are read only while backprop is disabled, and every
+    // int8 kernel this cpu supports agrees (130 inputs exercise the
+    // padding of the rows, `row` the broadcasting of an input).
+    auto original = simd::int8_instruction_set();
+    auto W    = Mat<float>(130, 9, weights<float>::uniform(-1.0, 1.0));
+    auto V    = Mat<float>(130, 9, weights<float>::uniform(-1.0, 1.0));
+    auto bias = Mat<float>(1, 9, weights<float>::uniform(-1.0, 1.0));
+    auto X    = Mat<float>(5, 130, weights<float>::uniform(-2.0, 2.0));
+    auto row  = Mat<float>(1, 130, weights<float>::uniform(-2.0, 2.0));
+    auto expected = MatOps<float>::mul_add_mul_with_bias({W, V}, {X, row}, bias);
+
+    quantization::quantize(W, quantization::QUANTIZE_COLUMNS);
+    quantization::quantize(V, quantization::QUANTIZE_COLUMNS);
+    ASSERT_TRUE(MatOps<float>::equals(MatOps<float>::mul_add_mul_with_bias({W, V}, {X, row}, bias), expected));
+    graph::clear();
+
+    graph::NoBackprop nb;
+    {
+        quantization::FloatScope float_weights;
+        ASSERT_TRUE(MatOps<float>::equals(MatOps<float>::mul_add_mul_with_bias({W, V}, {X, row}, bias), expected));
+    }
+    Mat<float> reference;
+    for (auto instruction_set : {"scalar", "avx2", "vnni"}) {
+        if (!simd::set_int8_instruction_set(instruction_set)) continue;
+        auto out = MatOps<float>::mul_add_mul_with_bias({W, V}, {X, row}, bias);
+        EXPECT_FALSE(MatOps<float>::equals(out, expected));
+        EXPECT_TRUE(MatOps<float>::allclose(out, expected, 0.25));
+        if (reference.empty()) {
+            reference = out;
+        } else {
+            EXPECT_TRUE(MatOps<float>::allclose(out, reference, 1e-4));
+        }
+    }
+    ASSERT_TRUE(simd::set_int8_instruction_set(original));
+
+    // embeddings: rows are dequantized, within half a step of the original
+    auto E = Mat<float>(20, 7, weights<float>::uniform(-1.0, 1.0));
+    quantization::quantize(E, quantization::QUANTIZE_ROWS);
+    auto plucked = MatOps<float>::rows_pluck(E, Indexing::Index({3, 0, 19}));
+    int rows[] = {3, 0, 19};
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 7; j++) {
+            EXPECT_NEAR(plucked.w(i, j), E.w(rows[i], j), 0.5 / 127.0 + 1e-6);
+        }
+    }
+    // products read the float values of embeddings.
+    EXPECT_TRUE(quantization::quantized(E, quantization::QUANTIZE_COLUMNS) == NULL);
+
+    // deep copies and writes to the values leave the int8 copy behind.
+    ASSERT_TRUE(quantization::quantized(W, quantization::QUANTIZE_COLUMNS) != NULL);
+    auto W_shallow = Mat<float>(W, false, false);
+    auto W_deep    = Mat<float>(W, true, false);
+    EXPECT_TRUE(quantization::quantized(W_shallow, quantization::QUANTIZE_COLUMNS) != NULL);
+    EXPECT_TRUE(quantization::quantized(W_deep, quantization::QUANTIZE_COLUMNS) == NULL);
+    W.w(0) += 1.0;
+    EXPECT_TRUE(quantization::quantized(W, quantization::QUANTIZE_COLUMNS) == NULL);
+    auto updated = MatOps<float>::mul_add_mul_with_bias({W, V}, {X, row}, bias);
+    quantization::FloatScope float_weights;
+    EXPECT_TRUE(MatOps<float>::equals(updated, MatOps<float>::mul_add_mul_with_bias({W, V}, {X, row}, bias)));
+}
+
 TEST_F(MatrixTests, dot) {
     auto functor = [](vector<Mat<R>> Xs)-> Mat<R> {
         return Xs[1].dot(Xs[0]);
@@ -1175,6 +1651,70 @@ TEST_F(MatOpsTests, matrix_mul_add_mul_with_bias_colwise) {
     }
 }
 
+TEST_F(MatOpsTests, lstm_cell) {
+    int num_examples = 2;
+    int hidden_size = 3;
+    int input_size = 4;
+    int num_children = 2;
+    int num_gates = num_children + 3;
+    // Xs = [input, hidden, memory 0, memory 1, then weights and bias of each gate]
+    auto make_functor = [num_gates](std::shared_ptr<matops::PackedGateWeights<R>> packed_weights) {
+        return [num_gates, packed_weights](vector<Mat<R>> Xs)-> Mat<R> {
+            vector<vector<Mat<R>>> gate_weights;
+            vector<Mat<R>> gate_biases;
+            for (int g = 0; g < num_gates; ++g) {
+                gate_weights.push_back({Xs[4 + 3 * g], Xs[5 + 3 * g]});
+                gate_biases.push_back(Xs[6 + 3 * g]);
+            }
+            auto cell = MatOps<R>::lstm_cell({Xs[0], Xs[1]}, {Xs[2], Xs[3]}, gate_weights, gate_biases, packed_weights);
+            return std::get<0>(cell) * std::get<1>(cell);
+        };
+    };
+    auto functor = make_functor(nullptr);
+    // weights packed once and reused until they change (gradient_same
+    // writes to them between calls).
+    auto cached_functor = make_functor(std::make_shared<matops::PackedGateWeights<R>>());
+    EXPERIMENT_REPEAT {
+        vector<Mat<R>> params = {
+            Mat<R>(num_examples, input_size,  weights<R>::uniform(2.0)),
+            // broadcast hidden state and memory
+            Mat<R>(1,            hidden_size, weights<R>::uniform(2.0)),
+            Mat<R>(num_examples, hidden_size, weights<R>::uniform(2.0)),
+            Mat<R>(1,            hidden_size, weights<R>::uniform(2.0))
+        };
+        for (int g = 0; g < num_gates; ++g) {
+            params.emplace_back(input_size,  hidden_size, weights<R>::uniform(2.0));
+            params.emplace_back(hidden_size, hidden_size, weights<R>::uniform(2.0));
+            params.emplace_back(1,           hidden_size, weights<R>::uniform(2.0));
+        }
+        ASSERT_TRUE(gradient_same(functor, params, 0.0003));
+        ASSERT_TRUE(gradient_same(cached_functor, params, 0.0003));
+    }
+}
+
+TEST_F(MatOpsTests, lstm_cell_packed_weights) {
+    int input_size = 5, hidden_size = 3;
+    vector<vector<Mat<R>>> gate_weights;
+    for (int g = 0; g < 4; ++g) {
+        gate_weights.push_back({Mat<R>(input_size,  hidden_size, weights<R>::uniform(2.0)),
+                                Mat<R>(hidden_size, hidden_size, weights<R>::uniform(2.0))});
+    }
+    matops::PackedGateWeights<R> packed_weights;
+    auto first = packed_weights.get(gate_weights);
+    ASSERT_EQ(first.memory_, packed_weights.get(gate_weights).memory_);
+    // a write to one of the weights packs them again
+    gate_weights[2][1].w(0, 1) += 1.0;
+    auto second = packed_weights.get(gate_weights);
+    ASSERT_NE(first.memory_, second.memory_);
+    ASSERT_EQ(second.shape[0], input_size + hidden_size);
+    ASSERT_EQ(second.shape[1], 4 * hidden_size);
+    ASSERT_NEAR(second(input_size + 0, 2 * hidden_size + 1), gate_weights[2][1].w(0, 1), 1e-9);
+    // so does another set of weights
+    auto other = gate_weights;
+    other[0][0] = Mat<R>(input_size, hidden_size, weights<R>::uniform(2.0));
+    ASSERT_NE(second.memory_, packed_weights.get(other).memory_);
+}
+
 
 TEST_F(MatrixTests, log_exp) {
     EXPERIMENT_REPEAT {
@@ -2058,6 +2598,144 @@ TEST(Solver, adam) {
     });
 }
 
+TEST(Solver, fused_step) {
+    // the fused step (NaN check, clipping, regularization, update and
+    // clearing, in parallel chunks) against the separate operations.
+    Mat<R> fused(300, 200, weights<R>::uniform(2.0));
+    Mat<R> reference(fused, true, true);
+    Mat<R> cache(300, 200);
+    vector<Mat<R>> params({fused});
+    Solver::AdaGrad<R> solver(params, 1e-6, 5.0, 1e-3);
+    solver.step_size = 0.1;
+
+    for (int iter = 0; iter < 3; ++iter) {
+        fused.tanh().sum().grad();
+        reference.tanh().sum().grad();
+        graph::backward();
+        solver.step(params);
+        MatOps<R>::clip_and_regularize(reference, 0.0, 5.0, 1e-3);
+        MatOps<R>::adagrad_update(reference, cache, 0.1, 1e-6);
+        reference.clear_grad();
+        ASSERT_TRUE(MatOps<R>::allclose(fused, reference, 1e-9));
+        ASSERT_EQ(fused.dw().sum(), 0.0);
+    }
+
+    // NaNs leave the parameter alone, but still clear the gradient.
+    Mat<R> before(fused, true, true);
+    fused.dw(0) = std::nan("");
+    fused.dw(7) = 1.0;
+    solver.step(params);
+    ASSERT_TRUE(MatOps<R>::equals(before, fused));
+    ASSERT_EQ(fused.dw(7), 0.0);
+}
+
+TEST(Solver, parameter_server) {
+    // the worker attaches from the same process here, through its own
+    // mapping of the segment.
+    auto name = "/dali_parameter_server_test_" + std::to_string(getpid());
+    Mat<R> A(3, 5, weights<R>::uniform(2.0));
+    Mat<R> B(7, 2, weights<R>::uniform(2.0));
+    Mat<R> A_before(A, true, true);
+    vector<Mat<R>> params({A, B});
+    auto server = ParameterServer<R>::create(name, params, 2);
+    ASSERT_EQ(server->num_shards(), 2);
+    ASSERT_TRUE(MatOps<R>::equals(A, A_before));
+    EXPECT_THROW(ParameterServer<R>::create(name, params), std::runtime_error);
+
+    Mat<R> A_worker(3, 5);
+    Mat<R> B_worker(7, 2);
+    vector<Mat<R>> worker_params({A_worker, B_worker});
+    auto client = ParameterServer<R>::attach(name, worker_params);
+    ASSERT_TRUE(MatOps<R>::equals(A, A_worker));
+    ASSERT_TRUE(MatOps<R>::equals(B, B_worker));
+    vector<Mat<R>> wrong_shape({Mat<R>(5, 3), Mat<R>(7, 2)});
+    EXPECT_THROW(ParameterServer<R>::attach(name, wrong_shape), std::runtime_error);
+
+    (A_worker.sum() + B_worker.sum()).grad();
+    graph::backward();
+    client->push_gradients();
+    ASSERT_EQ(A_worker.dw().sum(), 0.0);
+
+    Solver::SGD<R> solver(params, 0.0);
+    solver.step_size = 0.1;
+    ASSERT_EQ(server->apply_gradients(solver), 2);
+    ASSERT_EQ(server->updates(), 2);
+    ASSERT_EQ(server->apply_gradients(solver), 0);
+    // the worker reads the updated weights without copying them
+    ASSERT_NEAR(A.w(4), A_before.w(4) - 0.1, 1e-6);
+    ASSERT_TRUE(MatOps<R>::equals(A, A_worker));
+    ASSERT_TRUE(MatOps<R>::equals(B, B_worker));
+
+    // once the server is gone, a worker waiting on a full queue gives up.
+    auto small_name = name + "_small";
+    auto small_server = ParameterServer<R>::create(small_name, params, 1, 1);
+    auto small_client = ParameterServer<R>::attach(small_name, worker_params);
+    small_client->push_gradients();
+    small_server.reset();
+    EXPECT_THROW(small_client->push_gradients(), std::runtime_error);
+}
+
+TEST(Solver, parameter_server_lstm) {
+    // the worker's LSTM packs its gate weights on its first step, and
+    // must pack them again once the server updated them.
+    auto name = "/dali_parameter_server_lstm_test_" + std::to_string(getpid());
+    LSTM<R> lstm(3, 4);
+    auto params = lstm.parameters();
+    auto server = ParameterServer<R>::create(name, params);
+    LSTM<R> worker_lstm(3, 4);
+    auto worker_params = worker_lstm.parameters();
+    auto client = ParameterServer<R>::attach(name, worker_params);
+    Solver::SGD<R> solver(params, 0.0);
+    solver.step_size = 0.1;
+    Mat<R> input(1, 3, weights<R>::uniform(2.0));
+
+    for (int iter = 0; iter < 3; ++iter) {
+        client->refresh();
+        worker_lstm.activate(input, worker_lstm.initial_states()).hidden.sum().grad();
+        graph::backward();
+        client->push_gradients();
+        ASSERT_EQ(server->apply_gradients(solver), 1);
+
+        graph::NoBackprop nb;
+        client->refresh();
+        auto expected = lstm.activate(input, lstm.initial_states()).hidden;
+        auto result   = worker_lstm.activate(input, worker_lstm.initial_states()).hidden;
+        ASSERT_MATRIX_CLOSE(expected, result, 1e-9);
+    }
+}
+
+TEST(Solver, sparse_embedding) {
+    // an embedding with a sparse gradient must follow the same
+    // updates as a dense one, while only visiting the rows used.
+    for (std::string solvername : {"sgd", "adagrad", "rmsprop", "rmspropmomentum", "adadelta", "adam"}) {
+        Mat<R> dense(50, 4, weights<R>::uniform(2.0));
+        Mat<R> sparse(dense, true, true);
+        sparse.enable_sparse_grad();
+        vector<Mat<R>> dense_params({dense});
+        vector<Mat<R>> sparse_params({sparse});
+        auto dense_solver  = Solver::construct(solvername, dense_params, 0.1);
+        auto sparse_solver = Solver::construct(solvername, sparse_params, 0.1);
+
+        for (int iter = 0; iter < 5; ++iter) {
+            MatOps<R>::rows_pluck(dense, Indexing::Index({7, 3, 7})).tanh().sum().grad();
+            MatOps<R>::rows_pluck(sparse, Indexing::Index({7, 3, 7})).tanh().sum().grad();
+            graph::backward();
+            ASSERT_NE(sparse.grad_rows(), nullptr);
+            ASSERT_EQ(*sparse.grad_rows(), vector<int>({3, 7}));
+            dense_solver->step(dense_params);
+            sparse_solver->step(sparse_params);
+            ASSERT_TRUE(MatOps<R>::allclose(dense, sparse, 1e-9));
+        }
+        // any other use of the gradient makes it dense again.
+        sparse.sum().grad();
+        MatOps<R>::rows_pluck(sparse, Indexing::Index({1})).sum().grad();
+        graph::backward();
+        ASSERT_EQ(sparse.grad_rows(), nullptr);
+        sparse_solver->step(sparse_params);
+        ASSERT_EQ(*sparse.grad_rows(), vector<int>());
+    }
+}
+
 Mat<R> create_dataset() {
     int num_points     = 20;
     int num_dimensions = 5;
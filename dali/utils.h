@@ -7,6 +7,7 @@
 #include "dali/utils/Reporting.h"
 #include "dali/utils/SaneCrashes.h"
 #include "dali/utils/ThreadPool.h"
+#include "dali/utils/Profiler.h"
 #include "dali/utils/generator.h"
 #include "dali/utils/Training.h"
 #include "dali/utils/xml_cleaner.h"
@@ -0,0 +1,278 @@
+#include "dali/utils/Profiler.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <tuple>
+
+#include "dali/utils/assert2.h"
+#include "dali/utils/core_utils.h"
+
+using std::string;
+using std::vector;
+
+namespace profiler {
+    std::atomic<bool> enabled_(false);
+    thread_local OpObserver* op_observer = NULL;
+
+    namespace {
+        struct ThreadEvents {
+            int thread;
+            // id of events[0] (ids keep growing across resets)
+            long base;
+            vector<Event> events;
+            // ids of the events still open, innermost last
+            vector<long> open;
+        };
+
+        // thread buffers stay registered after their thread exits,
+        // so that its events can still be reported.
+        std::mutex registry_mutex;
+        vector<std::shared_ptr<ThreadEvents>> registry;
+        thread_local std::shared_ptr<ThreadEvents> local_events;
+
+        ThreadEvents& thread_events() {
+            if (local_events == nullptr) {
+                local_events = std::make_shared<ThreadEvents>();
+                local_events->base = 0;
+                std::lock_guard<std::mutex> lock(registry_mutex);
+                local_events->thread = registry.size();
+                registry.emplace_back(local_events);
+            }
+            return *local_events;
+        }
+
+        Event* find(ThreadEvents& thread, long id) {
+            if (id < thread.base || id >= thread.base + (long)thread.events.size()) {
+                return NULL;
+            }
+            return &thread.events[id - thread.base];
+        }
+
+        int64_t now_ns() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        long open_event(ThreadEvents& thread, const Event& event) {
+            long id = thread.base + thread.events.size();
+            thread.events.emplace_back(event);
+            thread.open.emplace_back(id);
+            // (last, to leave the bookkeeping out)
+            thread.events.back().start_ns = now_ns();
+            return id;
+        }
+
+        Event new_event(const ThreadEvents& thread, const char* name, bool backward) {
+            Event event;
+            event.name        = name;
+            event.backward    = backward;
+            event.thread      = thread.thread;
+            event.depth       = thread.open.size();
+            event.start_ns    = 0;
+            event.duration_ns = 0;
+            event.self_ns     = 0;
+            event.bytes       = 0;
+            event.flops       = 0;
+            event.num_shapes  = 0;
+            return event;
+        }
+
+        string shapes_to_str(const Event& event) {
+            std::stringstream ss;
+            ss << "[";
+            for (int i = 0; i < event.num_shapes; i++) {
+                if (i > 0) ss << ", ";
+                ss << event.shapes[i][0] << "x" << event.shapes[i][1];
+            }
+            ss << "]";
+            return ss.str();
+        }
+
+        string json_escape(const string& text) {
+            string escaped;
+            for (char c : text) {
+                if (c == '"' || c == '\\') escaped += '\\';
+                escaped += c;
+            }
+            return escaped;
+        }
+    }
+
+    void enable() {
+        enabled_.store(true);
+    }
+
+    void disable() {
+        enabled_.store(false);
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (auto& thread : registry) {
+            thread->base += thread->events.size();
+            thread->events.clear();
+            thread->open.clear();
+        }
+    }
+
+    long begin(const char* name, const int (*shapes)[2], int num_shapes, int64_t flops) {
+        auto& thread = thread_events();
+        auto event = new_event(thread, name, false);
+        event.num_shapes = std::min(num_shapes, (int)Event::max_shapes);
+        for (int i = 0; i < event.num_shapes; i++) {
+            event.shapes[i][0] = shapes[i][0];
+            event.shapes[i][1] = shapes[i][1];
+        }
+        event.flops = flops;
+        return open_event(thread, event);
+    }
+
+    long begin_backward(long forward) {
+        auto& thread = thread_events();
+        auto event = new_event(thread, "graph::emplace_back", true);
+        Event* op = forward == NO_OP ? NULL : find(thread, forward);
+        if (op != NULL) {
+            event.name       = op->name;
+            event.num_shapes = op->num_shapes;
+            std::copy(&op->shapes[0][0], &op->shapes[0][0] + 2 * Event::max_shapes, &event.shapes[0][0]);
+            event.flops      = 2 * op->flops;
+        }
+        return open_event(thread, event);
+    }
+
+    void end(long id) {
+        int64_t stop = now_ns();
+        auto& thread = thread_events();
+        if (!thread.open.empty() && thread.open.back() == id) {
+            thread.open.pop_back();
+        }
+        Event* event = find(thread, id);
+        if (event == NULL) return;
+        event->duration_ns = stop - event->start_ns;
+        event->self_ns    += event->duration_ns;
+        if (!thread.open.empty()) {
+            Event* parent = find(thread, thread.open.back());
+            if (parent != NULL) parent->self_ns -= event->duration_ns;
+        }
+    }
+
+    long current_op() {
+        auto& thread = thread_events();
+        return thread.open.empty() ? NO_OP : thread.open.back();
+    }
+
+    void set_flops(int64_t flops) {
+        if (!enabled()) return;
+        auto& thread = thread_events();
+        if (thread.open.empty()) return;
+        Event* event = find(thread, thread.open.back());
+        if (event != NULL) event->flops = flops;
+    }
+
+    void count_allocation(int64_t bytes) {
+        auto& thread = thread_events();
+        if (thread.open.empty()) return;
+        Event* event = find(thread, thread.open.back());
+        if (event != NULL) event->bytes += bytes;
+    }
+
+    vector<Event> events() {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        vector<Event> all;
+        for (auto& thread : registry) {
+            all.insert(all.end(), thread->events.begin(), thread->events.end());
+        }
+        return all;
+    }
+
+    void report(std::ostream& stream, bool per_thread) {
+        struct op_stats_t {
+            long calls = 0;
+            int64_t forward_ns = 0;
+            int64_t backward_ns = 0;
+            int64_t bytes = 0;
+            int64_t flops = 0;
+        };
+        // (thread or -1, name)
+        std::map<std::tuple<int, string>, op_stats_t> stats;
+        int64_t total_ns = 0;
+        for (auto& event : events()) {
+            auto& op = stats[std::make_tuple(per_thread ? event.thread : -1, string(event.name))];
+            if (event.backward) {
+                op.backward_ns += event.self_ns;
+            } else {
+                op.calls++;
+                op.forward_ns += event.self_ns;
+            }
+            op.bytes += event.bytes;
+            op.flops += event.flops;
+            total_ns += event.self_ns;
+        }
+        vector<std::pair<std::tuple<int, string>, op_stats_t>> rows(stats.begin(), stats.end());
+        std::sort(rows.begin(), rows.end(), [](const std::pair<std::tuple<int, string>, op_stats_t>& a,
+                                               const std::pair<std::tuple<int, string>, op_stats_t>& b) {
+            return a.second.forward_ns + a.second.backward_ns > b.second.forward_ns + b.second.backward_ns;
+        });
+
+        stream << std::left << std::setw(40) << "op";
+        if (per_thread) stream << std::right << std::setw(7) << "thread";
+        stream << std::right
+               << std::setw(9)  << "calls"
+               << std::setw(13) << "forward ms"
+               << std::setw(13) << "backward ms"
+               << std::setw(12) << "total ms"
+               << std::setw(8)  << "%"
+               << std::setw(12) << "MB alloc"
+               << std::setw(10) << "GFLOP/s" << std::endl;
+        stream << std::fixed;
+        for (auto& row : rows) {
+            auto& op = row.second;
+            int64_t op_ns = op.forward_ns + op.backward_ns;
+            stream << std::left << std::setw(40) << std::get<1>(row.first);
+            if (per_thread) stream << std::right << std::setw(7) << std::get<0>(row.first);
+            stream << std::right
+                   << std::setw(9)  << op.calls
+                   << std::setw(13) << std::setprecision(3) << op.forward_ns / 1e6
+                   << std::setw(13) << std::setprecision(3) << op.backward_ns / 1e6
+                   << std::setw(12) << std::setprecision(3) << op_ns / 1e6
+                   << std::setw(8)  << std::setprecision(1) << (total_ns > 0 ? 100.0 * op_ns / total_ns : 0.0)
+                   << std::setw(12) << std::setprecision(2) << op.bytes / (1024.0 * 1024.0)
+                   << std::setw(10) << std::setprecision(2) << (op_ns > 0 ? (double)op.flops / op_ns : 0.0)
+                   << std::endl;
+        }
+        stream << std::left << std::setw(40) << "total" << std::right
+               << std::setw(per_thread ? 16 : 9) << ""
+               << std::setw(38) << std::setprecision(3) << total_ns / 1e6 << std::endl;
+    }
+
+    void save_chrome_trace(const string& fname) {
+        std::ofstream out(fname);
+        ASSERT2(out.good(), utils::MS() << "Cannot write profiler trace to " << fname << ".");
+        auto all = events();
+        int64_t origin = 0;
+        for (auto& event : all) {
+            if (origin == 0 || event.start_ns < origin) origin = event.start_ns;
+        }
+        out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+        out << std::fixed << std::setprecision(3);
+        for (size_t i = 0; i < all.size(); i++) {
+            auto& event = all[i];
+            out << (i > 0 ? ",\n" : "\n")
+                << "{\"name\": \"" << json_escape(event.name) << "\""
+                << ", \"cat\": \"" << (event.backward ? "backward" : "forward") << "\""
+                << ", \"ph\": \"X\""
+                << ", \"ts\": " << (event.start_ns - origin) / 1e3
+                << ", \"dur\": " << event.duration_ns / 1e3
+                << ", \"pid\": 0, \"tid\": " << event.thread
+                << ", \"args\": {\"shapes\": \"" << shapes_to_str(event) << "\""
+                << ", \"bytes\": " << event.bytes
+                << ", \"flops\": " << event.flops << "}}";
+        }
+        out << "\n]}\n";
+    }
+}
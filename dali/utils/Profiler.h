@@ -0,0 +1,147 @@
+#ifndef DALI_UTILS_PROFILER_H
+#define DALI_UTILS_PROFILER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+Profiler
+--------
+
+Opt-in per op profiling. Every `matops` op opens an `OpScope` which,
+while the profiler is enabled, records the op's name, the shapes of
+its inputs, its forward time, the bytes of tensor memory it allocates
+and an estimate of its floating point operations. Backward closures
+recorded on the tape during an op are tagged with it, and running
+them records the op's backward time (closures recorded outside of an
+op show up as "graph::emplace_back").
+
+    profiler::enable();
+    ... a few training steps ...
+    profiler::disable();
+    profiler::report(std::cout);
+    profiler::save_chrome_trace("lstm_step.json");
+
+Events go into a buffer owned by the thread that runs the op, so
+recording takes no lock. Times are "self" times: time spent in ops
+called by an op (e.g. the ops of `Composite`) counts for those, so
+the table adds up to the time spent in ops. When disabled, an op pays
+for one relaxed atomic load (and one thread local load for the
+`OpObserver` hook).
+
+FLOPs are estimates: one per element of the largest input unless the
+op reports better (matrix products do), and twice the forward count
+for backward.
+
+Reports and traces must be made while no op is running.
+*/
+
+namespace profiler {
+    extern std::atomic<bool> enabled_;
+
+    inline bool enabled() {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    void enable();
+    void disable();
+    // forget every event recorded so far.
+    void reset();
+
+    // tag of backward closures recorded outside of any op.
+    const long NO_OP = -2;
+    // tag of backward closures recorded while profiling was disabled.
+    const long NOT_PROFILED = -1;
+
+    struct Event {
+        static const int max_shapes = 4;
+
+        const char* name;
+        bool backward;
+        int thread;
+        // nesting depth in the thread (0 for outermost ops)
+        int depth;
+        int64_t start_ns;
+        int64_t duration_ns;
+        // duration minus that of the ops run inside it
+        int64_t self_ns;
+        int64_t bytes;
+        int64_t flops;
+        int num_shapes;
+        int shapes[max_shapes][2];
+    };
+
+    // Opens an event in the calling thread and returns its id.
+    long begin(const char* name, const int (*shapes)[2], int num_shapes, int64_t flops);
+    // Opens the backward event of the op with id `forward` (or of a
+    // closure recorded outside of any op when NO_OP).
+    long begin_backward(long forward);
+    void end(long event);
+
+    // innermost op running in this thread, or NO_OP.
+    long current_op();
+    // replaces the FLOPs estimate of the innermost op of this thread.
+    void set_flops(int64_t flops);
+    // counts tensor memory allocated by the innermost op of this thread.
+    void count_allocation(int64_t bytes);
+
+    // every event recorded, ordered by thread then start time.
+    std::vector<Event> events();
+
+    // Table of the ops sorted by total (forward + backward) time:
+    // calls, forward and backward times, share of the total, bytes
+    // allocated and GFLOP/s. With `per_thread` every thread gets its
+    // own rows.
+    void report(std::ostream& stream, bool per_thread = false);
+    // Chrome trace (chrome://tracing, or https://ui.perfetto.dev) with
+    // one complete event per op, with its shapes, bytes and FLOPs.
+    void save_chrome_trace(const std::string& fname);
+
+    // Told about every op the thread starts and ends (nesting
+    // included), e.g. by graph::Plan to check that a captured step
+    // can be replayed.
+    class OpObserver {
+        public:
+            virtual void op_begin(const char* name) = 0;
+            virtual void op_end() = 0;
+    };
+
+    // observer of the ops run by this thread (or NULL).
+    extern thread_local OpObserver* op_observer;
+
+    // Records an op while alive (if profiling is enabled when it starts).
+    class OpScope {
+        private:
+            long event;
+            OpObserver* observer;
+        public:
+            template<typename... Mats>
+            OpScope(const char* name, const Mats&... inputs) : event(NOT_PROFILED), observer(op_observer) {
+                if (observer != NULL) observer->op_begin(name);
+                if (enabled()) {
+                    const int shapes[sizeof...(inputs) + 1][2] = {
+                        {(int)inputs.dims(0), (int)inputs.dims(1)}..., {0, 0}
+                    };
+                    int64_t largest = 0;
+                    for (int i = 0; i < (int)sizeof...(inputs); i++) {
+                        largest = std::max(largest, (int64_t)shapes[i][0] * shapes[i][1]);
+                    }
+                    event = begin(name, shapes, sizeof...(inputs), largest);
+                }
+            }
+
+            OpScope(const OpScope&) = delete;
+            OpScope& operator=(const OpScope&) = delete;
+
+            ~OpScope() {
+                if (event != NOT_PROFILED) end(event);
+                if (observer != NULL) observer->op_end();
+            }
+    };
+}
+
+#endif
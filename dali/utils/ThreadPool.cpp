@@ -12,111 +12,132 @@ __thread bool ThreadPool::in_thread_pool = false;
 __thread int ThreadPool::thread_number = -1;
 std::mutex ThreadPool::printing_lock;
 
+namespace {
+    // pool the current thread works for (tasks it submits stay local).
+    __thread ThreadPool* owning_pool = NULL;
+}
 
-ThreadPool::ThreadPool(int num_threads, Duration between_queue_checks) :
-        between_queue_checks(between_queue_checks),
+ThreadPool::ThreadPool(int num_threads) :
         should_terminate(false),
+        pending(0),
+        next_queue(0),
+        outstanding(0),
         active_count(0) {
     // Thread pool inception is not supported at this time.
     assert(!in_thread_pool);
 
-    ThreadPool::between_queue_checks = between_queue_checks;
+    for (int thread_number = 0; thread_number < num_threads; ++thread_number) {
+        queues.emplace_back(new WorkerQueue());
+    }
     for (int thread_number = 0; thread_number < num_threads; ++thread_number) {
         pool.emplace_back(&ThreadPool::thread_body, this, thread_number);
     }
 }
 
+bool ThreadPool::pop_task(int worker, Task& task) {
+    int num_threads = queues.size();
+    for (int i = 0; i < num_threads; ++i) {
+        auto& queue = *queues[(worker + i) % num_threads];
+        std::lock_guard<decltype(queue.mutex)> lock(queue.mutex);
+        if (queue.tasks.empty())
+            continue;
+        if (i == 0) {
+            // own deque: most recently pushed work is the hottest.
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            // steal the oldest work from someone else.
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        pending--;
+        return true;
+    }
+    return false;
+}
+
 void ThreadPool::thread_body(int _thread_id) {
     in_thread_pool = true;
     thread_number = _thread_id;
-    bool am_i_active = false;
+    owning_pool = this;
 
     while (true) {
-        function<void()> f;
-        {
-            std::lock_guard<decltype(queue_mutex)> lock(queue_mutex);
-            bool was_i_active = am_i_active;
-            if (should_terminate && work.empty())
-                break;
-            if (!work.empty()) {
-                am_i_active = true;
-                f = work.front();
-                work.pop_front();
-            } else {
-                am_i_active = false;
-            }
-
-            if (am_i_active != was_i_active) {
-                active_count += am_i_active ? 1 : -1;
-                if (active_count == 0) {
-                    // number of workers decrease so maybe all are idle
-                    is_idle.notify_all();
-                }
-            }
-        }
-        // Function defines implicit conversion to bool
-        // which is true only if call target was set.
-        if (static_cast<bool>(f)) {
+        Task f;
+        if (pop_task(_thread_id, f)) {
+            active_count++;
             f();
-        } else {
-            std::this_thread::sleep_for(between_queue_checks);
+            active_count--;
+            if (--outstanding == 0) {
+                // last task finished, waiters may be released.
+                std::lock_guard<decltype(idle_mutex)> lock(idle_mutex);
+                is_idle.notify_all();
+            }
+            continue;
         }
-        std::this_thread::yield();
+        std::unique_lock<decltype(sleep_mutex)> lock(sleep_mutex);
+        work_available.wait(lock, [this]{
+            return pending > 0 || should_terminate;
+        });
+        if (should_terminate && pending == 0)
+            break;
     }
 }
 
 int ThreadPool::active_workers() {
-    std::lock_guard<decltype(queue_mutex)> lock(queue_mutex);
     return active_count;
 }
 
+int ThreadPool::size() const {
+    return pool.size();
+}
+
 bool ThreadPool::wait_until_idle(Duration timeout) {
-    std::unique_lock<decltype(queue_mutex)> lock(queue_mutex);
+    std::unique_lock<decltype(idle_mutex)> lock(idle_mutex);
     is_idle.wait_for(lock, timeout, [this]{
-        return active_count == 0 && work.empty();
+        return outstanding == 0;
     });
     return idle();
 }
 
 bool ThreadPool::wait_until_idle() {
-    int retries = 3;
-    while (retries--) {
-        try {
-            std::unique_lock<decltype(queue_mutex)> lock(queue_mutex);
-            is_idle.wait(lock, [this]{
-                return active_count == 0 && work.empty();
-            });
-            return idle();
-        } catch (...) {}
-    }
-    throw std::runtime_error(
-        "exceeded retries when waiting until idle."
-    );
-    return false;
+    std::unique_lock<decltype(idle_mutex)> lock(idle_mutex);
+    is_idle.wait(lock, [this]{
+        return outstanding == 0;
+    });
+    return idle();
 }
 
 bool ThreadPool::idle() const {
-    return active_count == 0 && work.empty();
+    return outstanding == 0;
 }
 
-void ThreadPool::run(function<void()> f) {
-    int retries = 3;
-    while (retries--) {
-        try {
-            std::unique_lock<decltype(queue_mutex)> lock(queue_mutex);
-            work.push_back(f);
-            return;
-        } catch (...) {}
+void ThreadPool::run(Task f) {
+    assert(static_cast<bool>(f));
+    int num_threads = queues.size();
+    int target = owning_pool == this ?
+        thread_number :
+        (int)(next_queue++ % num_threads);
+    outstanding++;
+    {
+        std::lock_guard<decltype(sleep_mutex)> lock(sleep_mutex);
+        pending++;
     }
-    throw std::runtime_error(
-        "exceeded retries when trying to run operation on thread pool."
-    );
+    {
+        auto& queue = *queues[target];
+        std::lock_guard<decltype(queue.mutex)> lock(queue.mutex);
+        queue.tasks.push_back(std::move(f));
+    }
+    work_available.notify_one();
 }
 
 ThreadPool::~ThreadPool() {
     // Terminates thread pool making sure that all the work
     // is completed.
-    should_terminate = true;
+    {
+        std::lock_guard<decltype(sleep_mutex)> lock(sleep_mutex);
+        should_terminate = true;
+    }
+    work_available.notify_all();
     for (auto& t : pool)
         t.join();
 }
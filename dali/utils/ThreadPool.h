@@ -1,17 +1,67 @@
 #ifndef THREAD_POOL_H
 #define THREAD_POOL_H
 
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <condition_variable>
 #include <deque>
+#include <exception>
 #include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+/*
+Thread Pool
+-----------
+
+Work-stealing pool of threads. Each worker owns a deque of tasks:
+it pushes and pops work at the back of its own deque, and when
+the deque runs dry it steals from the front of the other workers'
+deques. Tasks submitted from outside the pool are spread round-robin
+across the workers. Idle workers block on a condition variable and
+are woken up as soon as work arrives.
+*/
+
 class ThreadPool {
+    public:
+        // Move-only, type-erased `void()` callable (unlike std::function
+        // it can hold a std::packaged_task or a lambda owning a
+        // unique_ptr, and moving it around never copies the capture).
+        class Task {
+            private:
+                struct Concept {
+                    virtual ~Concept() {}
+                    virtual void call() = 0;
+                };
+                template<typename Function>
+                struct Model : Concept {
+                    Function f;
+                    Model(Function&& f) : f(std::move(f)) {}
+                    void call() override { f(); }
+                };
+                std::unique_ptr<Concept> impl;
+            public:
+                Task() = default;
+                Task(Task&&) = default;
+                Task& operator=(Task&&) = default;
+
+                template<typename Function, typename = typename std::enable_if<
+                    !std::is_same<typename std::decay<Function>::type, Task>::value>::type>
+                Task(Function&& f) :
+                    impl(new Model<typename std::decay<Function>::type>(
+                        typename std::decay<Function>::type(std::forward<Function>(f)))) {}
+
+                void operator()() { impl->call(); }
+                explicit operator bool() const { return static_cast<bool>(impl); }
+        };
+
     private:
         typedef std::chrono::duration<double> Duration;
         static __thread bool in_thread_pool;
@@ -21,26 +71,123 @@ class ThreadPool {
 
         static std::mutex printing_lock;
 
+        struct WorkerQueue {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+        std::vector<std::unique_ptr<WorkerQueue>> queues;
+        std::vector<std::thread> pool;
+
+        // guards sleeping: `pending` only goes up while it is held,
+        // so a worker cannot miss the wakeup for work it did not see.
+        std::mutex sleep_mutex;
+        std::condition_variable work_available;
         bool should_terminate;
-        std::mutex queue_mutex;
-        std::condition_variable is_idle;
-        int active_count;
+        // tasks sitting in the deques (never less than their count).
+        std::atomic<int> pending;
+        // next deque for tasks submitted from outside the pool.
+        std::atomic<unsigned int> next_queue;
 
-        std::deque<std::function<void()> > work;
-        std::vector<std::thread> pool;
-        Duration between_queue_checks;
+        std::mutex idle_mutex;
+        std::condition_variable is_idle;
+        // tasks submitted and not finished yet.
+        std::atomic<int> outstanding;
+        std::atomic<int> active_count;
 
+        bool pop_task(int worker, Task& task);
         void thread_body(int _thread_id);
+
+        template<typename Function>
+        struct ParallelFor {
+            Function f;
+            int begin;
+            int end;
+            int grain_size;
+            int num_chunks;
+            std::atomic<int> next_chunk;
+            std::atomic<int> finished_chunks;
+            std::mutex mutex;
+            std::condition_variable done;
+            std::exception_ptr error;
+
+            ParallelFor(Function f, int begin, int end, int grain_size) :
+                    f(std::move(f)),
+                    begin(begin),
+                    end(end),
+                    grain_size(grain_size),
+                    num_chunks((end - begin + grain_size - 1) / grain_size),
+                    next_chunk(0),
+                    finished_chunks(0) {}
+
+            // Claims chunks until none are left. Returns once the
+            // last chunk claimed by this thread is done.
+            void work() {
+                int chunk;
+                while ((chunk = next_chunk++) < num_chunks) {
+                    int chunk_end = std::min(end, begin + (chunk + 1) * grain_size);
+                    try {
+                        for (int i = begin + chunk * grain_size; i < chunk_end; ++i) {
+                            f(i);
+                        }
+                    } catch (...) {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        if (!error) error = std::current_exception();
+                    }
+                    if (++finished_chunks == num_chunks) {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        done.notify_all();
+                    }
+                }
+            }
+        };
     public:
         // Creates a thread pool composed of num_threads threads.
         // threads are started immediately and exit only once ThreadPool
-        // goes out of scope. Threads periodically check for new work
-        // and the frequency of those checks is at minimum between_queue_checks
-        // (it can be higher due to thread scheduling).
-        ThreadPool(int num_threads, Duration between_queue_checks=std::chrono::milliseconds(1));
+        // goes out of scope, after all the submitted work is done.
+        ThreadPool(int num_threads);
+
+        // Run a function on a thread in pool. When called from one of
+        // the pool's threads the task goes to that thread's own deque.
+        void run(Task f);
+
+        // Run a function on a thread in pool, and obtain its result
+        // (or the exception it threw) through a future.
+        template<typename Function>
+        std::future<typename std::result_of<Function()>::type> submit(Function&& f) {
+            typedef typename std::result_of<Function()>::type result_t;
+            std::packaged_task<result_t()> task(std::forward<Function>(f));
+            auto result = task.get_future();
+            run(Task(std::move(task)));
+            return result;
+        }
 
-        // Run a function on a thread in pool.
-        void run(std::function<void()> f);
+        // Calls f(i) for every i in [begin, end), splitting the range
+        // into chunks of grain_size indices (by default about four
+        // chunks per thread). The calling thread processes chunks too,
+        // so calling parallel_for from inside a task cannot deadlock.
+        // The first exception thrown by f is rethrown once all
+        // chunks are done.
+        template<typename Function>
+        void parallel_for(int begin, int end, Function f, int grain_size = 0) {
+            if (end <= begin) return;
+            if (grain_size <= 0) {
+                int num_chunks = 4 * size();
+                grain_size = std::max(1, (end - begin + num_chunks - 1) / num_chunks);
+            }
+            auto job = std::make_shared<ParallelFor<Function>>(std::move(f), begin, end, grain_size);
+            int helpers = std::min(size(), job->num_chunks - 1);
+            for (int i = 0; i < helpers; ++i) {
+                run([job]() { job->work(); });
+            }
+            job->work();
+            {
+                std::unique_lock<std::mutex> lock(job->mutex);
+                job->done.wait(lock, [&job]() {
+                    return job->finished_chunks == job->num_chunks;
+                });
+            }
+            if (job->error) std::rethrow_exception(job->error);
+        }
 
         // Wait until queue is empty and all the threads have finished working.
         // If timeout is specified function waits at most timeout until the
@@ -52,6 +199,8 @@ class ThreadPool {
         bool idle() const;
         // Return number of active busy workers.
         int active_workers();
+        // Number of threads in the pool.
+        int size() const;
 
         // Can be called from within a thread to get a thread number.
         // the number is unique for each thread in the thread pool and
@@ -4,19 +4,154 @@ Python style generators for C++ 11
 @source https://github.com/dspeyer/generators
 
 An oasis of Python in lava sea of C++
+
+The producer runs on its own thread and streams its elements to the
+consumer through a bounded queue, a chunk of elements at a time:
+
+    producer thread                           consumer (range for)
+    yield(v) -> pending chunk --push--> [ring of chunks] --pop--> current chunk
+
+Chunks are handed over when full, or as soon as the consumer is
+waiting for one, so a slow producer adds no latency. The ring holds at
+most `capacity` chunks: a producer that gets ahead of its consumer
+sleeps until a chunk is taken (and a consumer with nothing to read
+sleeps until one is pushed), instead of spinning.
 */
 
 #ifndef DALI_UTILS_GENERATOR_H
 #define DALI_UTILS_GENERATOR_H
 
+#include <atomic>
+#include <condition_variable>
 #include <initializer_list>
 #include <exception>
 #include <functional>
+#include <memory>
 #include <thread>
 #include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include "dali/utils/ThreadPool.h"
 
 namespace utils {
 
+    struct GeneratorOptions {
+        // elements handed over at once (fewer if the consumer waits).
+        int chunk_size;
+        // chunks the producer may get ahead of the consumer.
+        int capacity;
+
+        explicit GeneratorOptions(int chunk_size = 64, int capacity = 2) :
+                chunk_size(chunk_size), capacity(capacity) {}
+    };
+
+    // Ring of chunks between one producer and one consumer. Positions
+    // are atomics, so a push or pop only takes the mutex to wake the
+    // other side when it went to sleep.
+    template<typename T>
+    class ChunkQueue {
+        private:
+            std::vector<std::vector<T>> ring;
+            // chunks pushed and popped so far (chunk i is in slot i % size)
+            std::atomic<size_t> pushed;
+            std::atomic<size_t> popped;
+            std::atomic<bool> closed;
+            std::atomic<bool> cancelled_;
+            std::atomic<bool> producer_sleeping;
+            std::atomic<bool> consumer_sleeping;
+            std::mutex mutex;
+            std::condition_variable wakeup;
+            static const int SPIN_ITERATIONS = 64;
+
+            // `sleeping` is set before `ready` is checked a last time,
+            // and the other side checks it after changing a position, so
+            // a wake up cannot be missed.
+            template<typename Condition>
+            void wait_until(std::atomic<bool>& sleeping, Condition ready) {
+                // a short wait usually suffices (the other side is
+                // busy filling or emptying a chunk).
+                for (int spin = 0; spin < SPIN_ITERATIONS; spin++) {
+                    if (ready()) return;
+                    std::this_thread::yield();
+                }
+                std::unique_lock<std::mutex> lock(mutex);
+                sleeping.store(true);
+                wakeup.wait(lock, ready);
+                sleeping.store(false);
+            }
+
+            void wake(std::atomic<bool>& sleeping) {
+                if (sleeping.load()) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    wakeup.notify_all();
+                }
+            }
+        public:
+            ChunkQueue(int capacity) :
+                    ring(std::max(capacity, 1)),
+                    pushed(0),
+                    popped(0),
+                    closed(false),
+                    cancelled_(false),
+                    producer_sleeping(false),
+                    consumer_sleeping(false) {
+            }
+
+            // producer: swaps `chunk` into the queue (waiting while it is
+            // full), leaving an empty chunk to fill next. Returns false
+            // when the consumer gave up.
+            bool push(std::vector<T>& chunk) {
+                size_t count = pushed.load(std::memory_order_relaxed);
+                wait_until(producer_sleeping, [&]() {
+                    return count - popped.load() < ring.size() || cancelled_.load();
+                });
+                if (cancelled_.load()) return false;
+                std::swap(ring[count % ring.size()], chunk);
+                pushed.store(count + 1);
+                wake(consumer_sleeping);
+                chunk.clear();
+                return true;
+            }
+
+            // producer: no more chunks will come.
+            void close() {
+                closed.store(true);
+                wake(consumer_sleeping);
+            }
+
+            // consumer: swaps the next chunk into `chunk` (waiting until
+            // there is one). Returns false once the queue is closed and
+            // empty.
+            bool pop(std::vector<T>& chunk) {
+                size_t count = popped.load(std::memory_order_relaxed);
+                wait_until(consumer_sleeping, [&]() {
+                    return pushed.load() > count || closed.load();
+                });
+                if (pushed.load() == count) return false;
+                chunk.clear();
+                std::swap(ring[count % ring.size()], chunk);
+                popped.store(count + 1);
+                wake(producer_sleeping);
+                return true;
+            }
+
+            // consumer: stops the producer at its next push or yield.
+            void cancel() {
+                cancelled_.store(true);
+                std::lock_guard<std::mutex> lock(mutex);
+                wakeup.notify_all();
+            }
+
+            bool cancelled() const {
+                return cancelled_.load(std::memory_order_relaxed);
+            }
+
+            bool consumer_waiting() const {
+                return consumer_sleeping.load(std::memory_order_relaxed);
+            }
+    };
+
     // subclass for handling forloop state internally.
     template<typename T>
     class ForLooping {
@@ -48,90 +183,123 @@ namespace utils {
     template<typename OutputT>
     class GeneratorHeart {
         private:
-            OutputT value;
-            bool hasOutputted;
-            std::shared_ptr<std::mutex> mutex;
-            bool abort;
+            ChunkQueue<OutputT>* queue;
+            std::vector<OutputT> pending;
+            int chunk_size;
             class AbortException : public std::exception {};
+
+            void flush() {
+                if (!pending.empty() && !queue->push(pending)) {
+                    throw AbortException();
+                }
+            }
         public:
             typedef OutputT Output;
 
             template<typename T>
             friend class Gen;
 
-            GeneratorHeart() : hasOutputted(false), abort(false) {}
+            GeneratorHeart() : queue(NULL), chunk_size(1) {}
 
             void yield(OutputT v) {
-                assert2((bool)mutex, "Mutex was not present during yield.");
-                value = v;
-                hasOutputted = true;
-                while (hasOutputted) {
-                    mutex->unlock();
-                    std::this_thread::yield();
-                    mutex->lock();
-                }
-                if (abort) {
+                assert2(queue != NULL, "Queue was not present during yield.");
+                if (queue->cancelled()) {
                     throw AbortException();
                 }
+                pending.emplace_back(std::move(v));
+                if (pending.size() >= chunk_size || queue->consumer_waiting()) {
+                    flush();
+                }
             }
     };
 
     template<typename Heart>
     class Gen {
+        public:
+            typedef typename Heart::Output Output;
         private:
-            std::function<void()> callback;
             Heart heart;
-            std::shared_ptr<std::mutex> mutex;
-            std::shared_ptr<std::thread> thread_ptr;
+            std::shared_ptr<ChunkQueue<Output>> queue;
+            // elements being read, and the position of the current one
+            std::vector<Output> chunk;
+            size_t position;
+            // exception that stopped the producer, rethrown to the
+            // consumer after the elements produced before it.
+            std::exception_ptr error;
+            std::thread thread;
             bool done;
+
+            // moves to the next chunk if the current one is exhausted.
+            void fetch() {
+                while (position >= chunk.size()) {
+                    position = 0;
+                    if (!queue->pop(chunk)) {
+                        done = true;
+                        if (error) {
+                            auto producer_error = error;
+                            error = nullptr;
+                            std::rethrow_exception(producer_error);
+                        }
+                        return;
+                    }
+                }
+            }
         public:
-            typedef typename Heart::Output Output;
             template<typename... ARGS>
-            Gen(ARGS... args) :
-                    done(false),
-                    mutex(std::make_shared<std::mutex>()) {
-                // Use bind instead of capture because capture does not get along with parameter packs
-                // callback=std::bind([&](Gen<Heart>* gen, ARGS... args){ gen->threadmain(args...); }, this, args...);
-                mutex->lock();
-                heart.mutex = mutex;
-                // pthread_create (&this->thread, NULL, generator_utils::invoke_callback, static_cast<void*>(&callback));
-                thread_ptr = std::make_shared<std::thread>(
-                    [this, args...]() {
-                        threadmain(args...);
-                    }
-                );
-                ++(*this);
+            Gen(const GeneratorOptions& options, ARGS... args) :
+                    queue(std::make_shared<ChunkQueue<Output>>(options.capacity)),
+                    position(0),
+                    done(false) {
+                heart.queue = queue.get();
+                heart.chunk_size = std::max(options.chunk_size, 1);
+                thread = std::thread([this, args...]() {
+                    threadmain(args...);
+                });
+                try {
+                    fetch();
+                } catch (...) {
+                    thread.join();
+                    throw;
+                }
             }
+            template<typename... ARGS>
+            Gen(ARGS... args) : Gen(GeneratorOptions(), args...) {}
+
+            Gen(const Gen&) = delete;
+            Gen& operator=(const Gen&) = delete;
+
             ~Gen() {
                 if (!done) {
-                    heart.abort = true;
-                    ++(*this);
+                    queue->cancel();
                 }
-                thread_ptr->join();
+                thread.join();
             }
             template<typename... ARGS>
             void threadmain(ARGS... args) {
-                mutex->lock();
                 try {
                     heart.run(args...);
-                } catch (typename Heart::AbortException ex) {}
-                done = true;
-                mutex->unlock();
+                } catch (typename Heart::AbortException& ex) {
+                    queue->close();
+                    return;
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                // elements yielded before the end (or the exception)
+                try {
+                    heart.flush();
+                } catch (typename Heart::AbortException& ex) {}
+                queue->close();
             }
             operator bool() {
                 return !done;
             }
             Gen<Heart>& operator++() {
-                heart.hasOutputted = false;
-                while (!heart.hasOutputted && !done) {
-                    mutex->unlock();
-                    std::this_thread::yield();
-                    mutex->lock();
-                }
+                position++;
+                fetch();
                 return *this;
             }
             Output operator*() {
-                return heart.value;
+                return chunk[position];
             }
             typedef utils::ForLooping<Gen<Heart>> ForLooping;
             ForLooping begin() { return ForLooping(this); }
@@ -160,6 +328,9 @@ namespace utils {
     a lambda. This wrapper allows easy copying, moving, and resetting
     of a generator.
 
+    Generators of large elements (e.g. minibatches) can lower
+    `options.chunk_size` to bound the memory used by elements
+    produced ahead of the consumer.
     */
     template<typename T>
     class Generator {
@@ -169,21 +340,24 @@ namespace utils {
             typedef typename heart_t::ForLooping ForLooping;
             std::shared_ptr< heart_t > genheart;
             generator_t gen;
+            GeneratorOptions options;
 
-            Generator(generator_t _gen) : gen(_gen), genheart(NULL) {};
-            Generator(const Generator<Gen<LambdaGeneratorHeart<T>>>& other) : gen(other.gen), genheart(NULL) {}
+            Generator(generator_t _gen, GeneratorOptions _options = GeneratorOptions()) :
+                    gen(_gen), genheart(NULL), options(_options) {};
+            Generator(const Generator<Gen<LambdaGeneratorHeart<T>>>& other) :
+                    gen(other.gen), genheart(NULL), options(other.options) {}
 
             void reset() {genheart = NULL;}
 
             ForLooping begin() {
                 if (!genheart)
-                    genheart = std::make_shared<heart_t>(gen);
+                    genheart = std::make_shared<heart_t>(options, gen);
                 return genheart->begin();
             };
 
             ForLooping end() {
                 if (!genheart)
-                    genheart = std::make_shared<Gen<LambdaGeneratorHeart<T>>>(gen);
+                    genheart = std::make_shared<heart_t>(options, gen);
                 return genheart->end();
             }
 
@@ -201,7 +375,42 @@ namespace utils {
                     for (auto el : other) {
                         yield(el);
                     }
-                });
+                }, options);
+            }
+
+            // Generator of f(element) for every element, in order. With
+            // more than one thread, blocks of elements are mapped in
+            // parallel (f must then be safe to call concurrently), while
+            // this generator keeps producing the next ones.
+            template<typename Function>
+            Generator<typename std::result_of<Function(T)>::type> map(Function f, int num_threads = 1) const {
+                typedef typename std::result_of<Function(T)>::type mapped_t;
+                auto source_gen = gen;
+                auto source_options = options;
+                return Generator<mapped_t>([source_gen, source_options, f, num_threads](yield_t<mapped_t> yield) {
+                    Generator<T> source(source_gen, source_options);
+                    if (num_threads <= 1) {
+                        for (auto el : source) yield(f(el));
+                        return;
+                    }
+                    ThreadPool pool(num_threads - 1);
+                    const int block_size = source_options.chunk_size * num_threads;
+                    std::vector<T> inputs;
+                    std::vector<mapped_t> outputs;
+                    auto map_block = [&]() {
+                        outputs.resize(inputs.size());
+                        pool.parallel_for(0, inputs.size(), [&](int i) {
+                            outputs[i] = f(inputs[i]);
+                        });
+                        for (auto& output : outputs) yield(std::move(output));
+                        inputs.clear();
+                    };
+                    for (auto el : source) {
+                        inputs.emplace_back(std::move(el));
+                        if (inputs.size() >= block_size) map_block();
+                    }
+                    map_block();
+                }, options);
             }
     };
 
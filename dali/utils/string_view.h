@@ -0,0 +1,45 @@
+#ifndef DALI_UTILS_STRING_VIEW_H
+#define DALI_UTILS_STRING_VIEW_H
+
+#include <cstring>
+#include <ostream>
+#include <string>
+
+namespace utils {
+    // Non owning reference to a sequence of characters (a subset of
+    // C++17's std::string_view), used to look up words without copying
+    // them out of the text they come from. The characters must outlive
+    // the view.
+    class string_view {
+        private:
+            const char* data_;
+            size_t size_;
+        public:
+            string_view() : data_(""), size_(0) {}
+            string_view(const char* data, size_t size) : data_(data), size_(size) {}
+            string_view(const char* str) : data_(str), size_(strlen(str)) {}
+            string_view(const std::string& str) : data_(str.data()), size_(str.size()) {}
+
+            const char* data() const { return data_; }
+            size_t size() const { return size_; }
+            bool empty() const { return size_ == 0; }
+            const char* begin() const { return data_; }
+            const char* end() const { return data_ + size_; }
+            char operator[](size_t i) const { return data_[i]; }
+
+            std::string str() const { return std::string(data_, size_); }
+
+            bool operator==(const string_view& other) const {
+                return size_ == other.size_ && memcmp(data_, other.data_, size_) == 0;
+            }
+            bool operator!=(const string_view& other) const {
+                return !(*this == other);
+            }
+    };
+
+    inline std::ostream& operator<<(std::ostream& stream, const string_view& view) {
+        return stream.write(view.data(), view.size());
+    }
+}
+
+#endif
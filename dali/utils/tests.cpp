@@ -70,6 +70,41 @@ TEST(ThreadPool, thread_number) {
     }
 }
 
+TEST(ThreadPool, submit) {
+    ThreadPool pool(4);
+    std::unique_ptr<int> value(new int(21));
+    // move-only captures are fine.
+    auto doubled = pool.submit(std::bind([](std::unique_ptr<int>& v) {
+        return 2 * (*v);
+    }, std::move(value)));
+    auto failed = pool.submit([]() -> int {
+        throw std::runtime_error("task failed");
+    });
+    ASSERT_EQ(doubled.get(), 42);
+    ASSERT_THROW(failed.get(), std::runtime_error);
+}
+
+TEST(ThreadPool, parallel_for) {
+    const int NUM_THREADS = 4;
+    ThreadPool pool(NUM_THREADS);
+    vector<int> seen(1000, 0);
+    pool.parallel_for(0, seen.size(), [&seen](int i) {
+        seen[i] += 1;
+    });
+    for (auto& count : seen) {
+        ASSERT_EQ(count, 1);
+    }
+    // nested loops run on the pool's own deques without deadlocking.
+    std::atomic<int> total(0);
+    pool.parallel_for(0, 2 * NUM_THREADS, [&pool, &total](int i) {
+        pool.parallel_for(0, 100, [&total](int j) {
+            total += 1;
+        });
+    });
+    ASSERT_EQ(total, 200 * NUM_THREADS);
+    ASSERT_TRUE(pool.wait_until_idle());
+}
+
 TEST(utils, stream_to_redirection_list) {
     stringstream ss(
         "hello->world\n"
@@ -292,6 +327,26 @@ TEST(utils, CharacterVocab) {
     ASSERT_EQ(special_seq, utils::join(spaceless_vocab.decode(&spaceless_chars)));
 }
 
+TEST(utils, frozen_vocab) {
+    auto vocab = utils::Vocab(vector<string>{"bob", "ate", "an", "apple", utils::end_symbol});
+    string text = "bob ate\tan  orange\r\nbob";
+    auto words = utils::tokenize(text);
+    auto expected = vocab.encode(words, true);
+    ASSERT_EQ(expected, vocab.encode(utils::string_view(text), true));
+    ASSERT_EQ(vocab.unknown_word, expected[3]);
+    ASSERT_EQ(3, vocab[string("apple")]);
+    ASSERT_EQ(2, vocab[utils::string_view(text.data() + 8, 2)]);
+
+    vocab.freeze();
+    ASSERT_TRUE(vocab.frozen());
+    ASSERT_EQ(expected, vocab.encode(utils::string_view(text), true));
+    ASSERT_EQ(expected, vocab.encode(words, true));
+    ASSERT_EQ(3, vocab["apple"]);
+    ASSERT_EQ(vocab.unknown_word, vocab[utils::string_view(text.data(), 2)]);
+    ASSERT_EQ(vocab.unknown_word, vocab[utils::unknown_word_symbol]);
+    ASSERT_THROW(vocab.add("orange"), std::runtime_error);
+}
+
 TEST(utils, prefix_match) {
     using utils::prefix_match;
     vector<string> candidates = {
@@ -405,6 +460,50 @@ TEST(utils, recursive_generator_test) {
     ASSERT_EQ(vector<int>({1,2,3,4,5, 1,2,3,4,5, 1,2,3,4,5, 1,2,3,4,5, 1,2,3,4,5}), vals);
 }
 
+TEST(utils, generator_streaming) {
+    // the producer stays a bounded number of elements ahead,
+    // and stops when the consumer does.
+    int produced = 0;
+    auto naturals = utils::Generator<int>([&produced](utils::yield_t<int> yield) {
+        for (int i = 0;; i++) {
+            produced++;
+            yield(i);
+        }
+    }, utils::GeneratorOptions(16, 2));
+    int consumed = 0;
+    for (int i : naturals) {
+        ASSERT_EQ(i, consumed);
+        if (++consumed == 100) break;
+    }
+    naturals.reset();
+    ASSERT_LE(produced, 100 + 16 * 4);
+
+    // exceptions reach the consumer after the elements yielded before them.
+    auto failing = utils::Generator<int>([](utils::yield_t<int> yield) {
+        for (int i = 0; i < 10; i++) yield(i);
+        throw std::runtime_error("failed");
+    });
+    consumed = 0;
+    EXPECT_THROW({
+        for (int i : failing) consumed++;
+    }, std::runtime_error);
+    ASSERT_EQ(consumed, 10);
+
+    // mapping in parallel keeps the order.
+    auto numbers = utils::Generator<int>([](utils::yield_t<int> yield) {
+        for (int i = 0; i < 1000; i++) yield(i);
+    });
+    for (int num_threads : {1, 4}) {
+        auto squares = numbers.map([](int x) { return x * x; }, num_threads);
+        int idx = 0;
+        for (int square : squares) {
+            ASSERT_EQ(square, idx * idx);
+            idx++;
+        }
+        ASSERT_EQ(idx, 1000);
+    }
+}
+
 TEST(utils, combine_generators) {
     // here we take two short generators and
     // create a longer one out of the pair:
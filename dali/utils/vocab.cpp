@@ -1,5 +1,7 @@
 #include "vocab.h"
 #include "dali/utils/core_utils.h"
+#include <algorithm>
+#include <cstdint>
 #include <sstream>
 
 using std::string;
@@ -10,7 +12,83 @@ const char* utils::end_symbol          = "**END**";
 const char* utils::unknown_word_symbol = "███████";
 
 namespace utils {
-	typename Vocab::ind_t Vocab::operator[](const string& word) const {
+    namespace {
+        // FNV-1a
+        uint64_t hash_word(string_view word) {
+            uint64_t hash = 14695981039346656037ULL;
+            for (char c : word) {
+                hash = (hash ^ (unsigned char)c) * 1099511628211ULL;
+            }
+            return hash;
+        }
+
+        bool is_whitespace(char c) {
+            return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+        }
+    }
+
+    struct Vocab::FrozenTable {
+        static const ind_t EMPTY = (ind_t)-1;
+        // a probe reads one slot: hash, index and where the word is.
+        struct slot_t {
+            uint32_t hash;
+            ind_t index;
+            uint32_t offset;
+            uint32_t length;
+        };
+        // every word, in index order.
+        std::string words;
+        // power of two size, at most half full (linear probing).
+        vector<slot_t> slots;
+        uint64_t mask;
+
+        FrozenTable(const std::unordered_map<string, ind_t>& word2index) {
+            vector<std::pair<ind_t, const string*>> entries;
+            entries.reserve(word2index.size());
+            size_t total_length = 0;
+            for (auto& kv : word2index) {
+                entries.emplace_back(kv.second, &kv.first);
+                total_length += kv.first.size();
+            }
+            std::sort(entries.begin(), entries.end());
+            words.reserve(total_length);
+
+            size_t capacity = 16;
+            while (capacity < 2 * entries.size()) capacity *= 2;
+            slots.assign(capacity, slot_t{0, EMPTY, 0, 0});
+            mask = capacity - 1;
+            for (auto& entry : entries) {
+                const string& word = *entry.second;
+                uint64_t hash = hash_word(word);
+                uint64_t position = hash & mask;
+                while (slots[position].index != EMPTY) position = (position + 1) & mask;
+                slots[position] = slot_t{(uint32_t)(hash >> 32), entry.first,
+                                         (uint32_t)words.size(), (uint32_t)word.size()};
+                words.append(word);
+            }
+        }
+
+        ind_t find(string_view word) const {
+            uint64_t hash = hash_word(word);
+            uint32_t tag = hash >> 32;
+            for (uint64_t position = hash & mask;; position = (position + 1) & mask) {
+                const slot_t& slot = slots[position];
+                if (slot.index == EMPTY) return EMPTY;
+                if (slot.hash == tag && slot.length == word.size() &&
+                        memcmp(words.data() + slot.offset, word.data(), word.size()) == 0) {
+                    return slot.index;
+                }
+            }
+        }
+    };
+
+    const typename Vocab::ind_t Vocab::FrozenTable::EMPTY;
+
+    typename Vocab::ind_t Vocab::operator[](const string& word) const {
+        if (frozen_table != nullptr) {
+            auto index = frozen_table->find(word);
+            return index == FrozenTable::EMPTY ? unknown_word : index;
+        }
         auto found = word2index.find(word);
         if (found != word2index.end()) {
             return found->second;
@@ -18,12 +96,38 @@ namespace utils {
         return unknown_word;
     }
 
+    typename Vocab::ind_t Vocab::operator[](const char* word) const {
+        return (*this)[string_view(word)];
+    }
+
+    typename Vocab::ind_t Vocab::operator[](string_view word) const {
+        if (frozen_table != nullptr) {
+            auto index = frozen_table->find(word);
+            return index == FrozenTable::EMPTY ? unknown_word : index;
+        }
+        auto found = word2index.find(word.str());
+        if (found != word2index.end()) {
+            return found->second;
+        }
+        return unknown_word;
+    }
+
+    void Vocab::freeze() {
+        assert2(word2index.size() < FrozenTable::EMPTY, "Too many words to freeze vocabulary.");
+        frozen_table = std::make_shared<const FrozenTable>(word2index);
+    }
+
+    bool Vocab::frozen() const {
+        return frozen_table != nullptr;
+    }
+
     void Vocab::construct_word2index() {
         uint i = 0;
         for (auto& s : index2word)
             word2index[s] = i++;
     }
     void Vocab::add_unknown_word() {
+        assert2(!frozen(), "Cannot add words to a frozen vocabulary.");
         if (word2index.find(unknown_word_symbol) == word2index.end()) {
             index2word.emplace_back(unknown_word_symbol);
             word2index[unknown_word_symbol] = index2word.size() - 1;
@@ -40,14 +144,26 @@ namespace utils {
     vector<typename Vocab::ind_t> Vocab::encode(const vector<string>& words, bool with_end_symbol) const {
         vector<ind_t> result;
         result.reserve(words.size() + (with_end_symbol ? 1 : 0));
-        std::transform(words.begin(), words.end(),
-                       std::back_inserter(result), [this](const string& word) {
-            if (word2index.find(word) == word2index.end()) {
-                return unknown_word;
-            } else {
-                return word2index.at(word);
-            }
-        });
+        for (auto& word : words) {
+            result.emplace_back((*this)[word]);
+        }
+        if (with_end_symbol) {
+            result.emplace_back( word2index.at(utils::end_symbol) );
+        }
+        return result;
+    }
+
+    vector<typename Vocab::ind_t> Vocab::encode(string_view text, bool with_end_symbol) const {
+        vector<ind_t> result;
+        const char* p   = text.begin();
+        const char* end = text.end();
+        while (true) {
+            while (p < end && is_whitespace(*p)) p++;
+            if (p == end) break;
+            const char* word_begin = p;
+            while (p < end && !is_whitespace(*p)) p++;
+            result.emplace_back((*this)[string_view(word_begin, p - word_begin)]);
+        }
         if (with_end_symbol) {
             result.emplace_back( word2index.at(utils::end_symbol) );
         }
@@ -61,6 +177,7 @@ namespace utils {
     }
 
     void Vocab::add(const string& word) {
+        assert2(!frozen(), "Cannot add words to a frozen vocabulary.");
         auto found = word2index.find(word) != word2index.end();
         if (!found) {
             uint next_index = word2index.size();
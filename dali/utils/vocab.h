@@ -1,10 +1,12 @@
 #ifndef DALI_UTILS_VOCAB_H
 #define DALI_UTILS_VOCAB_H
 
+#include <memory>
 #include <string>
 #include <vector>
 #include <unordered_map>
 #include "dali/tensor/Index.h"
+#include "dali/utils/string_view.h"
 
 namespace utils {
     extern const char* end_symbol;
@@ -12,6 +14,8 @@ namespace utils {
 
     class Vocab {
         private:
+            struct FrozenTable;
+            std::shared_ptr<const FrozenTable> frozen_table;
             void construct_word2index();
         public:
 
@@ -25,6 +29,10 @@ namespace utils {
             std::vector<std::string> index2word;
 
             std::vector<ind_t> encode(const std::vector<std::string>& words, bool with_end_symbol = false) const;
+            // Splits `text` on whitespace (like `tokenize`) and encodes
+            // every word. Only a frozen vocabulary looks the words up
+            // without copying them out of the text.
+            std::vector<ind_t> encode(string_view text, bool with_end_symbol = false) const;
             std::vector<std::string> decode(Indexing::Index, bool remove_end_symbol = false) const;
 
             Vocab();
@@ -33,7 +41,18 @@ namespace utils {
             Vocab(std::vector<std::string>&&, bool);
             Vocab(std::vector<std::string>&&);
             ind_t operator[](const std::string&) const;
+            ind_t operator[](const char*) const;
+            // copies the word into a string unless the vocabulary is frozen.
+            ind_t operator[](string_view) const;
             size_t size() const;
+
+            // Packs the words into a single buffer indexed by an open
+            // addressing hash table (with the hash of each word stored
+            // next to it), which lookups and `encode` use from then on.
+            // No words can be added to a frozen vocabulary, and
+            // `word2index` must not be modified anymore.
+            void freeze();
+            bool frozen() const;
     };
 
     class CharacterVocab {